@@ -0,0 +1,978 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+/*!
+ * \file
+ * CPU benchmark for #dcpspi_process().
+ *
+ * The production code is linked against fakes of all the system interfaces
+ * it uses, just like the unit tests do. In contrast to the mocks used by the
+ * unit tests, the fakes do not expect anything, but simulate a well-behaved
+ * DCPD and SPI slave as cheaply as possible. Time is virtual, so that the
+ * sequence of events is the same in each run; only the wall clock time
+ * measured around the main loop varies.
+ *
+ * Reported per packet are the wall clock time, the number of system calls
+ * (\c poll(2), \c read(2), \c writev(2), SPI \c ioctl(2), GPIO reads, and
+ * sleeps), and the number of bytes which crossed the system call boundary.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <linux/spi/spidev.h>
+
+#include "dcpspi_process.h"
+#include "dcpdefs.h"
+#include "spi.h"
+#include "spi_hw.h"
+#include "gpio.h"
+#include "trace.h"
+#include "hexdump.h"
+#include "messages.h"
+#include "os.h"
+#include "os_writev.h"
+
+#include "fake_dcp_peers.hh"
+
+/*!
+ * \addtogroup dcpspi_bench CPU benchmark
+ *
+ * Deterministic workloads for #dcpspi_process().
+ */
+/*!@{*/
+
+namespace
+{
+
+constexpr int fifo_in_fd = 10;
+constexpr int fifo_out_fd = 11;
+constexpr int spi_fd = 12;
+constexpr int gpio_fd = 13;
+
+/* slave read probes are this large, see #spi_send_buffer() */
+constexpr size_t slave_ready_probe_size = 2;
+
+/* maximum number of master packets DCPD has sent, but not seen answered */
+constexpr size_t master_window_size = 16;
+
+/* DCPD gives master packets this many retries */
+constexpr uint8_t master_packet_ttl = 10;
+
+/* give up if there is no progress for this many iterations */
+constexpr unsigned int max_idle_iterations = 1000;
+
+struct Counters
+{
+    unsigned long poll;
+    unsigned long read;
+    unsigned long writev;
+    unsigned long write;
+    unsigned long spi_transfers;
+    unsigned long gpio_reads;
+    unsigned long nanosleep;
+    unsigned long clock_reads;
+    unsigned long stalls;
+
+    unsigned long bytes_read;
+    unsigned long bytes_written;
+    unsigned long bytes_spi;
+
+    unsigned long collisions;
+    unsigned long acks;
+    unsigned long nacks;
+    unsigned long drops;
+    unsigned long errors;
+    unsigned long notices;
+    unsigned long mismatches;
+
+    unsigned long syscalls() const
+    {
+        return poll + read + writev + write + spi_transfers + gpio_reads +
+               nanosleep;
+    }
+
+    unsigned long bytes() const
+    {
+        return bytes_read + bytes_written + bytes_spi;
+    }
+};
+
+static Counters counters;
+static uint64_t virtual_time_ns;
+static bool show_messages;
+
+/*!
+ * Deterministic pseudo-random numbers (xorshift32).
+ */
+class Random
+{
+  private:
+    uint32_t state_;
+
+  public:
+    explicit Random(uint32_t seed): state_(seed) {}
+
+    uint32_t next()
+    {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 17;
+        state_ ^= state_ << 5;
+        return state_;
+    }
+
+    size_t size_between(size_t min, size_t max)
+    {
+        return min + next() % (max - min + 1);
+    }
+};
+
+static void make_dcp_packet(std::vector<uint8_t> &packet, uint8_t reg,
+                            size_t payload_size, Random &random)
+{
+    fake_dcp_peers::make_dcp_packet(packet, reg, payload_size,
+        [&random] (size_t) { return random.next() & UINT8_MAX; });
+}
+
+/*!
+ * What is going to happen in a benchmark run.
+ */
+struct Scenario
+{
+    const char *name;
+    const char *description;
+
+    /* share of slave packets in percent */
+    unsigned int slave_percentage;
+
+    size_t min_payload_size;
+    size_t max_payload_size;
+
+    /* slave starts talking on one in n master probes, 0 for never */
+    unsigned int collision_interval;
+
+    /* number of slave packets sent in a row, toggling the request line */
+    size_t slave_burst_length;
+};
+
+static const Scenario scenarios[] =
+{
+    {
+        "master-burst", "Master writes, DCPD keeps the pipe filled",
+        0, 1, 64, 0, 1,
+    },
+    {
+        "slave-flood", "Slave writes, back to back",
+        100, 1, 64, 0, 1,
+    },
+    {
+        "slave-burst", "Short slave writes requested during transactions",
+        100, 1, 8, 0, 8,
+    },
+    {
+        "mixed", "Master and slave writes, with collisions",
+        50, 1, 64, 4, 1,
+    },
+    {
+        "max-size", "Master and slave writes with maximum payload size",
+        50, DCP_PAYLOAD_MAXSIZE, DCP_PAYLOAD_MAXSIZE, 0, 1,
+    },
+};
+
+/*!
+ * Simulated DCPD on the other end of the pipes.
+ *
+ * Master packets are written in bursts of up to #master_window_size packets.
+ * Rejected packets are sent again with the TTL taken from the NACK.
+ * Packets forwarded from the slave are compared to what the slave has sent.
+ */
+class FakeDCPD
+{
+  private:
+    std::vector<std::vector<uint8_t>> master_packets_;
+    std::unordered_map<uint16_t, size_t> in_flight_;
+    size_t next_master_packet_;
+    uint16_t next_serial_;
+
+    fake_dcp_peers::DCPDPipe pipe_;
+
+    const std::vector<std::vector<uint8_t>> *expected_slave_packets_;
+    size_t slave_packets_received_;
+
+  public:
+    size_t master_packets_answered_;
+
+    FakeDCPD(const FakeDCPD &) = delete;
+    FakeDCPD &operator=(const FakeDCPD &) = delete;
+
+    explicit FakeDCPD():
+        next_master_packet_(0),
+        next_serial_(DCPSYNC_MASTER_SERIAL_MIN),
+        expected_slave_packets_(nullptr),
+        slave_packets_received_(0),
+        master_packets_answered_(0)
+    {}
+
+    void setup(std::vector<std::vector<uint8_t>> &&master_packets,
+               const std::vector<std::vector<uint8_t>> &slave_packets)
+    {
+        master_packets_ = std::move(master_packets);
+        expected_slave_packets_ = &slave_packets;
+        fill_window();
+    }
+
+    bool has_input() const { return pipe_.has_input(); }
+
+    bool has_master_packets_in_flight() const { return !in_flight_.empty(); }
+
+    bool is_done() const
+    {
+        return master_packets_answered_ == master_packets_.size() &&
+               slave_packets_received_ == expected_slave_packets_->size();
+    }
+
+    ssize_t read(void *dest, size_t count) { return pipe_.read(dest, count); }
+
+    void write(const void *src, size_t count) { pipe_.write(src, count); }
+
+    void process_output()
+    {
+        pipe_.process_output(
+            [this] (uint8_t command, uint8_t ttl, uint16_t serial,
+                    const uint8_t *data, size_t size)
+            {
+                process_packet(command, ttl, serial, data, size);
+            });
+
+        fill_window();
+    }
+
+  private:
+    void send(size_t idx, uint16_t serial, uint8_t ttl)
+    {
+        pipe_.send('c', ttl, serial, master_packets_[idx]);
+    }
+
+    void fill_window()
+    {
+        while(in_flight_.size() < master_window_size &&
+              next_master_packet_ < master_packets_.size())
+        {
+            const uint16_t serial = next_serial_;
+
+            next_serial_ = (next_serial_ == DCPSYNC_MASTER_SERIAL_MAX)
+                ? DCPSYNC_MASTER_SERIAL_MIN
+                : next_serial_ + 1;
+
+            in_flight_[serial] = next_master_packet_;
+            send(next_master_packet_++, serial, master_packet_ttl);
+        }
+    }
+
+    void process_packet(uint8_t command, uint8_t ttl, uint16_t serial,
+                        const uint8_t *data, size_t size)
+    {
+        switch(command)
+        {
+          case 'c':
+            if(slave_packets_received_ >= expected_slave_packets_->size() ||
+               (*expected_slave_packets_)[slave_packets_received_].size() != size ||
+               memcmp((*expected_slave_packets_)[slave_packets_received_].data(),
+                      data, size) != 0)
+                ++counters.mismatches;
+
+            ++slave_packets_received_;
+            return;
+
+          case 'a':
+          case 'n':
+            break;
+
+          default:
+            ++counters.mismatches;
+            return;
+        }
+
+        const auto it = in_flight_.find(serial);
+
+        if(it == in_flight_.end())
+        {
+            ++counters.mismatches;
+            return;
+        }
+
+        if(command == 'a')
+            ++counters.acks;
+        else if(ttl > 0)
+        {
+            ++counters.nacks;
+            send(it->second, serial, ttl);
+            return;
+        }
+        else
+            ++counters.drops;
+
+        in_flight_.erase(it);
+        ++master_packets_answered_;
+    }
+};
+
+/*!
+ * Simulated SPI slave and its request line.
+ *
+ * The slave asserts the request line when it has something to send, streams
+ * the escaped packet (preceded by a NOP) to the master, and deasserts the
+ * request line as soon as the packet has been read completely. In bursts,
+ * the request line is deasserted and asserted again right away as long as
+ * there are more packets in the burst, such as a slave would do for a
+ * volume knob being turned. Collisions
+ * happen when the slave starts sending while the master is probing, either
+ * because the request has not been seen yet, or at random if configured.
+ */
+class FakeSlave
+{
+  private:
+    const std::vector<std::vector<uint8_t>> *packets_;
+    size_t next_packet_;
+
+    fake_dcp_peers::SlaveStream stream_;
+
+    unsigned int collision_interval_;
+    Random random_;
+
+    size_t burst_length_;
+    size_t packets_left_in_burst_;
+
+    /* number of replies to master packets before the next slave packet */
+    size_t master_packets_per_slave_packet_;
+    size_t master_packets_answered_at_last_start_;
+
+  public:
+    bool is_request_active_;
+    bool is_request_reported_;
+
+    /* request line deasserted and asserted again since last report */
+    bool is_request_toggled_;
+
+    FakeSlave(const FakeSlave &) = delete;
+    FakeSlave &operator=(const FakeSlave &) = delete;
+
+    explicit FakeSlave():
+        packets_(nullptr),
+        next_packet_(0),
+        collision_interval_(0),
+        random_(0xc0111de),
+        burst_length_(1),
+        packets_left_in_burst_(0),
+        master_packets_per_slave_packet_(0),
+        master_packets_answered_at_last_start_(0),
+        is_request_active_(false),
+        is_request_reported_(false),
+        is_request_toggled_(false)
+    {}
+
+    void setup(const std::vector<std::vector<uint8_t>> &packets,
+               unsigned int collision_interval,
+               size_t master_packets_per_slave_packet,
+               size_t burst_length)
+    {
+        packets_ = &packets;
+        collision_interval_ = collision_interval;
+        burst_length_ = burst_length;
+        master_packets_per_slave_packet_ = master_packets_per_slave_packet;
+    }
+
+    bool is_idle() const
+    {
+        return !is_request_active_ && !is_request_reported_ &&
+               !stream_.is_sending();
+    }
+
+    bool is_done() const
+    {
+        return is_idle() && next_packet_ >= packets_->size();
+    }
+
+    void maybe_request(const FakeDCPD &dcpd, bool master_is_idle)
+    {
+        if(!is_idle() || next_packet_ >= packets_->size())
+            return;
+
+        if(!master_is_idle &&
+           dcpd.master_packets_answered_ <
+           master_packets_answered_at_last_start_ + master_packets_per_slave_packet_)
+            return;
+
+        master_packets_answered_at_last_start_ = dcpd.master_packets_answered_;
+        packets_left_in_burst_ = burst_length_ - 1;
+        start();
+    }
+
+    int transfer(const struct spi_ioc_transfer &xfer)
+    {
+        auto *const rx = reinterpret_cast<uint8_t *>(xfer.rx_buf);
+
+        if(rx == nullptr)
+            return 0;
+
+        if(xfer.len == slave_ready_probe_size && stream_.is_sending())
+            ++counters.collisions;
+        else if(xfer.len == slave_ready_probe_size)
+        {
+            if(collision_interval_ > 0 && next_packet_ < packets_->size() &&
+               !is_request_active_ && random_.next() % collision_interval_ == 0)
+            {
+                ++counters.collisions;
+                start();
+            }
+            else
+            {
+                memset(rx, 0, xfer.len);
+                return 0;
+            }
+        }
+
+        stream_.transfer(rx, xfer.len);
+
+        if(is_request_active_ && !stream_.is_sending())
+        {
+            if(packets_left_in_burst_ > 0 && next_packet_ < packets_->size())
+            {
+                --packets_left_in_burst_;
+                is_request_toggled_ = true;
+                start();
+            }
+            else
+                is_request_active_ = false;
+        }
+
+        return 0;
+    }
+
+  private:
+    void start()
+    {
+        stream_.start((*packets_)[next_packet_++]);
+        is_request_active_ = true;
+    }
+};
+
+static FakeDCPD *dcpd;
+static FakeSlave *slave;
+static struct dcp_transaction *transaction;
+
+static ssize_t fake_read(int, void *dest, size_t count)
+{
+    ++counters.read;
+
+    const ssize_t ret = dcpd->read(dest, count);
+
+    if(ret > 0)
+        counters.bytes_read += ret;
+
+    return ret;
+}
+
+static ssize_t fake_write(int, const void *buf, size_t count)
+{
+    ++counters.write;
+    counters.bytes_written += count;
+    dcpd->write(buf, count);
+    return count;
+}
+
+static ssize_t fake_writev(int, const struct iovec *iov, int iovcnt)
+{
+    ++counters.writev;
+
+    size_t count = 0;
+
+    for(int i = 0; i < iovcnt; ++i)
+    {
+        dcpd->write(iov[i].iov_base, iov[i].iov_len);
+        count += iov[i].iov_len;
+    }
+
+    counters.bytes_written += count;
+
+    return count;
+}
+
+static int fake_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    ++counters.poll;
+
+    /* DCPD answers whatever it has got so far before sending more */
+    dcpd->process_output();
+    slave->maybe_request(*dcpd, !dcpd->has_master_packets_in_flight());
+
+    int ready = 0;
+
+    for(nfds_t i = 0; i < nfds; ++i)
+    {
+        fds[i].revents = 0;
+
+        if(fds[i].fd < 0)
+            continue;
+
+        if(fds[i].fd == gpio_fd)
+        {
+            if(slave->is_request_active_ != slave->is_request_reported_ ||
+               slave->is_request_toggled_)
+            {
+                fds[i].revents = POLLPRI;
+                slave->is_request_reported_ = slave->is_request_active_;
+                slave->is_request_toggled_ = false;
+            }
+        }
+        else if(fds[i].fd == fifo_in_fd)
+        {
+            if(dcpd->has_input())
+                fds[i].revents = POLLIN;
+        }
+        else if(fds[i].fd == fifo_out_fd)
+            fds[i].revents = fds[i].events & POLLOUT;
+
+        if(fds[i].revents != 0)
+            ++ready;
+    }
+
+    if(ready == 0 && timeout > 0)
+        virtual_time_ns += timeout * 1000UL * 1000UL;
+
+    if(ready > 0 || timeout >= 0)
+        return ready;
+
+    /* nothing will ever happen, pretend we have got a signal */
+    ++counters.stalls;
+    errno = EINTR;
+    return -1;
+}
+
+static void print_message(const char *what, const char *format, va_list va)
+{
+    fprintf(stderr, "%s: ", what);
+    vfprintf(stderr, format, va);
+    fputc('\n', stderr);
+}
+
+}
+
+ssize_t (*os_read)(int fd, void *dest, size_t count) = fake_read;
+ssize_t (*os_write)(int fd, const void *buf, size_t count) = fake_write;
+ssize_t (*os_writev)(int fd, const struct iovec *iov, int iovcnt) = fake_writev;
+int (*os_poll)(struct pollfd *fds, nfds_t nfds, int timeout) = fake_poll;
+
+int os_clock_gettime(clockid_t, struct timespec *tp)
+{
+    ++counters.clock_reads;
+
+    /* time passes a little while we are busy */
+    virtual_time_ns += 1000;
+
+    tp->tv_sec = virtual_time_ns / (1000UL * 1000UL * 1000UL);
+    tp->tv_nsec = virtual_time_ns % (1000UL * 1000UL * 1000UL);
+
+    return 0;
+}
+
+void os_nanosleep(const struct timespec *tp)
+{
+    ++counters.nanosleep;
+    virtual_time_ns += tp->tv_sec * 1000UL * 1000UL * 1000UL + tp->tv_nsec;
+}
+
+void msg_error(int, int priority, const char *format, ...)
+{
+    if(priority > LOG_WARNING)
+    {
+        ++counters.notices;
+        return;
+    }
+
+    ++counters.errors;
+
+    if(show_messages)
+    {
+        va_list va;
+        va_start(va, format);
+        print_message("Error", format, va);
+        va_end(va);
+    }
+}
+
+void msg_info(const char *format, ...)
+{
+    if(show_messages)
+    {
+        va_list va;
+        va_start(va, format);
+        print_message("Info", format, va);
+        va_end(va);
+    }
+}
+
+void msg_vinfo(enum MessageVerboseLevel, const char *, ...) {}
+
+bool msg_is_verbose(enum MessageVerboseLevel)
+{
+    return false;
+}
+
+void hexdump_to_log(enum MessageVerboseLevel, const uint8_t *const, size_t,
+                    const char *)
+{}
+
+struct gpio_handle
+{
+    int fd;
+};
+
+short gpio_get_poll_events(const struct gpio_handle *)
+{
+    return POLLPRI | POLLERR;
+}
+
+bool gpio_has_edge_events(const struct gpio_handle *)
+{
+    return false;
+}
+
+ssize_t gpio_read_edge_events(struct gpio_handle *, struct gpio_edge_event *,
+                              size_t)
+{
+    return -1;
+}
+
+bool gpio_is_active(const struct gpio_handle *)
+{
+    ++counters.gpio_reads;
+    return slave->is_request_active_;
+}
+
+int gpio_get_debounce_fd(const struct gpio_handle *)
+{
+    return -1;
+}
+
+enum GpioDebounceResult gpio_debounce(struct gpio_handle *, bool,
+                                      struct stats_wait *)
+{
+    return GPIO_DEBOUNCE_SETTLED;
+}
+
+int spi_hw_open_device(const char *)
+{
+    return spi_fd;
+}
+
+void spi_hw_close_device(int) {}
+
+int spi_hw_do_transfer(int, const struct spi_ioc_transfer spi_transfer[],
+                       size_t number_of_fragments)
+{
+    ++counters.spi_transfers;
+
+    for(size_t i = 0; i < number_of_fragments; ++i)
+    {
+        counters.bytes_spi += spi_transfer[i].len;
+        slave->transfer(spi_transfer[i]);
+    }
+
+    return 0;
+}
+
+namespace
+{
+
+struct Options
+{
+    size_t packets;
+    const char *scenario;
+    bool gather_statistics;
+    bool record_trace;
+    bool read_ahead;
+    bool nonblocking_spi;
+    bool slave_fast_path;
+    bool show_breakdown;
+};
+
+static bool run_scenario(const Scenario &scenario, const Options &options)
+{
+    Random random(0x5eed1234);
+    std::vector<std::vector<uint8_t>> master_packets;
+    std::vector<std::vector<uint8_t>> slave_packets;
+
+    const size_t slave_count = options.packets * scenario.slave_percentage / 100;
+    const size_t master_count = options.packets - slave_count;
+
+    master_packets.resize(master_count);
+    slave_packets.resize(slave_count);
+
+    for(auto &p : master_packets)
+        make_dcp_packet(p, 0x47, random.size_between(scenario.min_payload_size,
+                                                     scenario.max_payload_size),
+                        random);
+
+    for(auto &p : slave_packets)
+        make_dcp_packet(p, 0x58, random.size_between(scenario.min_payload_size,
+                                                     scenario.max_payload_size),
+                        random);
+
+    FakeDCPD fake_dcpd;
+    FakeSlave fake_slave;
+
+    memset(&counters, 0, sizeof(counters));
+    virtual_time_ns = 0;
+    dcpd = &fake_dcpd;
+    slave = &fake_slave;
+
+    fake_slave.setup(slave_packets, scenario.collision_interval,
+                     slave_count > 0 ? master_count / slave_count : 0,
+                     scenario.slave_burst_length);
+    fake_dcpd.setup(std::move(master_packets), slave_packets);
+
+    static uint8_t dcp_buffer[DCPSYNC_HEADER_SIZE + DCP_HEADER_SIZE + DCP_PAYLOAD_MAXSIZE];
+    static uint8_t spi_buffer[(DCP_HEADER_SIZE + DCP_PAYLOAD_MAXSIZE) * 2];
+    struct dcp_transaction t {};
+    struct gpio_handle gpio { gpio_fd };
+    struct slave_request_and_lock_data rldata { true, &gpio, gpio_fd, false };
+
+    t.dcp_buffer.buffer = dcp_buffer;
+    t.dcp_buffer.size = sizeof(dcp_buffer);
+    t.spi_buffer.buffer = spi_buffer;
+    t.spi_buffer.size = sizeof(spi_buffer);
+    reset_transaction_struct(&t, true);
+    transaction = &t;
+
+    dcpspi_init();
+    dcpspi_read_ahead_enable(options.read_ahead);
+    dcpspi_nonblocking_spi_enable(options.nonblocking_spi);
+    dcpspi_slave_fast_path_enable(options.slave_fast_path);
+    dcpspi_statistics_enable(options.gather_statistics);
+    trace_init();
+    trace_enable(options.record_trace);
+    spi_reset();
+
+    unsigned long iterations = 0;
+    unsigned int idle_iterations = 0;
+    unsigned long last_activity = 0;
+    bool ok = true;
+
+    const auto started = std::chrono::steady_clock::now();
+
+    while(!(fake_dcpd.is_done() && fake_slave.is_done() && t.state == TR_IDLE))
+    {
+        if(!dcpspi_process(fifo_in_fd, fifo_out_fd, spi_fd, &t, &rldata))
+        {
+            fprintf(stderr, "%s: dcpspi_process() requested termination\n",
+                    scenario.name);
+            ok = false;
+            break;
+        }
+
+        fake_dcpd.process_output();
+        ++iterations;
+
+        const unsigned long activity = counters.bytes() + counters.gpio_reads;
+
+        if(activity != last_activity)
+        {
+            last_activity = activity;
+            idle_iterations = 0;
+        }
+        else if(++idle_iterations >= max_idle_iterations)
+        {
+            fprintf(stderr, "%s: no progress, stuck in state %d\n",
+                    scenario.name, t.state);
+            ok = false;
+            break;
+        }
+    }
+
+    const auto elapsed = std::chrono::steady_clock::now() - started;
+    const double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+    const double n = options.packets > 0 ? options.packets : 1;
+
+    printf("%-14s %8zu %10.1f %12.2f %10.1f %10lu %6lu %6lu\n",
+           scenario.name, options.packets, ns / n,
+           counters.syscalls() / n, counters.bytes() / n,
+           counters.collisions, counters.nacks, counters.errors);
+
+    if(options.show_breakdown)
+        printf("    iterations %lu, poll %lu (stalls %lu), read %lu, "
+               "writev %lu, write %lu, spi %lu, gpio %lu, nanosleep %lu, "
+               "clock %lu, bytes read %lu, written %lu, spi %lu, "
+               "virtual time %llu us\n",
+               iterations, counters.poll, counters.stalls, counters.read,
+               counters.writev, counters.write, counters.spi_transfers,
+               counters.gpio_reads, counters.nanosleep, counters.clock_reads,
+               counters.bytes_read, counters.bytes_written, counters.bytes_spi,
+               (unsigned long long)(virtual_time_ns / 1000));
+
+    if(counters.mismatches > 0)
+    {
+        fprintf(stderr, "%s: %lu packets corrupted or unexpected\n",
+                scenario.name, counters.mismatches);
+        ok = false;
+    }
+
+    if(counters.drops > 0 || counters.errors > 0)
+    {
+        fprintf(stderr, "%s: %lu packets dropped, %lu errors\n",
+                scenario.name, counters.drops, counters.errors);
+        ok = false;
+    }
+
+    transaction = nullptr;
+    dcpd = nullptr;
+    slave = nullptr;
+
+    return ok;
+}
+
+static void usage(const char *program)
+{
+    printf("Usage: %s [options]\n"
+           "\n"
+           "Options:\n"
+           "  --help         Show this help.\n"
+           "  --packets N    Number of packets per scenario (default: 10000).\n"
+           "  --scenario S   Run scenario S only.\n"
+           "  --stats        Gather statistics as with dcpspi --stats.\n"
+           "  --no-trace     Do not record transactions in the trace ring.\n"
+           "  --no-read-ahead  Read from DCPD without read-ahead.\n"
+           "  --blocking-spi Wait for the slave inside SPI transfers.\n"
+           "  --slave-fast-path  Process pending slave requests right away.\n"
+           "  --breakdown    Show system call and byte counts in detail.\n"
+           "  --messages     Show errors and info messages.\n"
+           "\n"
+           "Scenarios:\n", program);
+
+    for(const auto &s : scenarios)
+        printf("  %-14s %s\n", s.name, s.description);
+}
+
+static int process_command_line(int argc, char *argv[], Options &options)
+{
+    options.packets = 10000;
+    options.scenario = nullptr;
+    options.gather_statistics = false;
+    options.record_trace = true;
+    options.read_ahead = true;
+    options.nonblocking_spi = true;
+    options.slave_fast_path = false;
+    options.show_breakdown = false;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+
+        if(arg == "--help")
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        else if(arg == "--packets" && i + 1 < argc)
+        {
+            char *endptr;
+            options.packets = strtoul(argv[++i], &endptr, 10);
+
+            if(*endptr != '\0' || options.packets == 0)
+            {
+                fprintf(stderr, "Invalid number of packets \"%s\"\n", argv[i]);
+                return -1;
+            }
+        }
+        else if(arg == "--scenario" && i + 1 < argc)
+            options.scenario = argv[++i];
+        else if(arg == "--stats")
+            options.gather_statistics = true;
+        else if(arg == "--no-trace")
+            options.record_trace = false;
+        else if(arg == "--no-read-ahead")
+            options.read_ahead = false;
+        else if(arg == "--blocking-spi")
+            options.nonblocking_spi = false;
+        else if(arg == "--slave-fast-path")
+            options.slave_fast_path = true;
+        else if(arg == "--breakdown")
+            options.show_breakdown = true;
+        else if(arg == "--messages")
+            show_messages = true;
+        else
+        {
+            fprintf(stderr, "Unknown option \"%s\", see --help\n", argv[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    const int ret = process_command_line(argc, argv, options);
+
+    if(ret != 0)
+        return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+    printf("%-14s %8s %10s %12s %10s %10s %6s %6s\n",
+           "scenario", "packets", "ns/pkt", "syscalls/pkt", "bytes/pkt",
+           "collisions", "nacks", "errors");
+
+    bool ok = true;
+    bool found = false;
+
+    for(const auto &s : scenarios)
+    {
+        if(options.scenario != nullptr && strcmp(options.scenario, s.name) != 0)
+            continue;
+
+        found = true;
+
+        if(!run_scenario(s, options))
+            ok = false;
+    }
+
+    if(!found)
+    {
+        fprintf(stderr, "Unknown scenario \"%s\", see --help\n", options.scenario);
+        return EXIT_FAILURE;
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*!@}*/
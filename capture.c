@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "capture.h"
+#include "messages.h"
+#include "os.h"
+
+/*!
+ * The memory-mapped capture file.
+ *
+ * Only the main loop writes records, so no locking is needed.
+ */
+static struct
+{
+    int fd;
+    const char *filename;
+    uint8_t *map;
+    size_t size;
+    uint16_t serial;
+}
+capture = { .fd = -1, };
+
+static inline struct capture_file_header *get_header(void)
+{
+    return (struct capture_file_header *)capture.map;
+}
+
+int capture_open(const char *filename, size_t size)
+{
+    if(size < sizeof(struct capture_file_header) + sizeof(struct capture_record))
+    {
+        msg_error(EINVAL, LOG_ERR, "Capture file size %zu too small", size);
+        return -1;
+    }
+
+    const int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if(fd < 0)
+    {
+        msg_error(errno, LOG_ERR, "Failed creating capture file \"%s\"", filename);
+        return -1;
+    }
+
+    if(ftruncate(fd, size) < 0)
+    {
+        msg_error(errno, LOG_ERR, "Failed resizing capture file \"%s\"", filename);
+        close(fd);
+        return -1;
+    }
+
+    void *const map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if(map == MAP_FAILED)
+    {
+        msg_error(errno, LOG_ERR, "Failed mapping capture file \"%s\"", filename);
+        close(fd);
+        return -1;
+    }
+
+    capture.fd = fd;
+    capture.filename = filename;
+    capture.map = map;
+    capture.size = size;
+    capture.serial = 0;
+
+    struct capture_file_header *const header = get_header();
+
+    header->magic = CAPTURE_FILE_MAGIC;
+    header->version = CAPTURE_FILE_VERSION;
+    header->header_size = sizeof(*header);
+    header->record_header_size = sizeof(struct capture_record);
+    header->reserved = 0;
+    header->dropped = 0;
+    header->used = 0;
+
+    return 0;
+}
+
+void capture_close(void)
+{
+    if(capture.map == NULL)
+        return;
+
+    const struct capture_file_header *const header = get_header();
+    const uint64_t used = header->used;
+    const uint32_t dropped = header->dropped;
+
+    munmap(capture.map, capture.size);
+    capture.map = NULL;
+
+    if(ftruncate(capture.fd, sizeof(*header) + used) < 0)
+        msg_error(errno, LOG_WARNING,
+                  "Failed truncating capture file \"%s\"", capture.filename);
+
+    close(capture.fd);
+    capture.fd = -1;
+
+    if(dropped > 0)
+        msg_info("Captured %llu bytes to \"%s\", %u records did not fit",
+                 (unsigned long long)used, capture.filename, dropped);
+    else
+        msg_info("Captured %llu bytes to \"%s\"",
+                 (unsigned long long)used, capture.filename);
+}
+
+bool capture_is_enabled(void)
+{
+    return capture.map != NULL;
+}
+
+void capture_set_serial(uint16_t serial)
+{
+    capture.serial = serial;
+}
+
+void capture_record(enum CaptureRecordType type, int result,
+                    const uint8_t *data, size_t length)
+{
+    if(capture.map == NULL)
+        return;
+
+    struct capture_file_header *const header = get_header();
+
+    if(length > UINT16_MAX)
+        length = UINT16_MAX;
+
+    const size_t record_size =
+        (sizeof(struct capture_record) + length + CAPTURE_RECORD_ALIGNMENT - 1) &
+        ~(size_t)(CAPTURE_RECORD_ALIGNMENT - 1);
+
+    if(record_size > capture.size - sizeof(*header) - header->used)
+    {
+        if(header->dropped++ == 0)
+            msg_error(0, LOG_WARNING, "Capture file \"%s\" full", capture.filename);
+
+        return;
+    }
+
+    struct capture_record *const rec =
+        (struct capture_record *)(capture.map + sizeof(*header) + header->used);
+    struct timespec now;
+
+    if(os_clock_gettime(CLOCK_MONOTONIC, &now) == 0)
+        rec->timestamp_ns = (uint64_t)now.tv_sec * 1000000000U + now.tv_nsec;
+    else
+        rec->timestamp_ns = 0;
+
+    rec->result = result;
+    rec->serial = capture.serial;
+    rec->length = length;
+    rec->type = type;
+    memset(rec->reserved, 0, sizeof(rec->reserved));
+    memcpy(rec + 1, data, length);
+
+    /* the record becomes visible in the file only now */
+    header->used += record_size;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define CAPTURE_FILE_MAGIC   0x43504344U  /* "DCPC", little endian */
+#define CAPTURE_FILE_VERSION 1U
+
+/*!
+ * Records start at multiples of this many bytes.
+ */
+#define CAPTURE_RECORD_ALIGNMENT 8U
+
+/*!
+ * Default size of the capture file.
+ */
+#define CAPTURE_DEFAULT_FILE_SIZE (16U * 1024U * 1024U)
+
+enum CaptureRecordType
+{
+    /*! Bytes sent to the slave; \c result is the \c ioctl(2) result. */
+    CAPTURE_RECORD_SPI_TX = 1,
+
+    /*! Bytes received from the slave; \c result is the \c ioctl(2) result. */
+    CAPTURE_RECORD_SPI_RX,
+
+    /*! Poll bytes kept as start of a slave transaction after a collision. */
+    CAPTURE_RECORD_COLLISION,
+
+    /*! Bytes thrown away from the SPI receive buffer. */
+    CAPTURE_RECORD_DISCARDED,
+};
+
+/*!
+ * Header of a capture file, followed by \c used bytes of records.
+ *
+ * All fields are stored in host byte order. The header is kept up to date
+ * while capturing, so that a file left behind by a crashed process is valid.
+ */
+struct capture_file_header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint16_t record_header_size;
+    uint16_t reserved;
+
+    /*! Records which did not fit into the file anymore. */
+    uint32_t dropped;
+
+    uint64_t used;
+};
+
+/*!
+ * Header of a record, followed by \c length bytes of data, padded to
+ * #CAPTURE_RECORD_ALIGNMENT.
+ */
+struct capture_record
+{
+    uint64_t timestamp_ns;  /*!< \c CLOCK_MONOTONIC */
+    int32_t result;
+    uint16_t serial;        /*!< Transaction serial, 0 if unknown. */
+    uint16_t length;
+    uint8_t type;           /*!< One of #CaptureRecordType. */
+    uint8_t reserved[7];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Create capture file of given size and map it into memory.
+ *
+ * Capturing is enabled on success. Any existing file is replaced.
+ *
+ * \returns
+ *     0 on success, -1 on error.
+ */
+int capture_open(const char *filename, size_t size);
+
+/*!
+ * Stop capturing, and truncate the file to the size actually used.
+ */
+void capture_close(void);
+
+bool capture_is_enabled(void);
+
+/*!
+ * Set transaction serial stored with subsequent records.
+ */
+void capture_set_serial(uint16_t serial);
+
+/*!
+ * Append record to the capture file.
+ *
+ * This function does nothing while capturing is disabled. Records which do
+ * not fit into the file anymore are counted, but not stored.
+ */
+void capture_record(enum CaptureRecordType type, int result,
+                    const uint8_t *data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !CAPTURE_H */
@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "dcpd_bridge.h"
+#include "ipc_ring.h"
+#include "messages.h"
+
+static struct
+{
+    bool is_running;
+    pthread_t thread;
+    int stop_fd;
+
+    int fifo_in_fd;
+    int fifo_out_fd;
+    struct ipc_channel *channel;
+
+    /* data read from DCPD which did not fit into the ring yet */
+    uint8_t to_spi[IPC_RING_SIZE];
+    size_t to_spi_pos;
+    size_t to_spi_length;
+
+    uint8_t to_dcpd[IPC_RING_SIZE];
+}
+bridge =
+{
+    .stop_fd = -1,
+};
+
+static bool write_all(int fd, const uint8_t *data, size_t length)
+{
+    while(length > 0)
+    {
+        const ssize_t len = write(fd, data, length);
+
+        if(len < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            msg_error(errno, LOG_EMERG,
+                      "Failed writing %zu bytes to fd %d", length, fd);
+            return false;
+        }
+
+        data += len;
+        length -= len;
+    }
+
+    return true;
+}
+
+/*!
+ * Write whatever the main loop has for DCPD, or discard it if DCPD is gone.
+ *
+ * \returns
+ *     False if DCPD has gone away, true otherwise.
+ */
+static bool forward_to_dcpd(bool is_dcpd_connected)
+{
+    ssize_t len;
+
+    while((len = ipc_channel_peer_read(bridge.channel, bridge.to_dcpd,
+                                       sizeof(bridge.to_dcpd))) > 0)
+    {
+        if(is_dcpd_connected &&
+           !write_all(bridge.fifo_out_fd, bridge.to_dcpd, len))
+            is_dcpd_connected = false;
+    }
+
+    return is_dcpd_connected;
+}
+
+/*!
+ * Read from DCPD if possible.
+ *
+ * \returns
+ *     False if DCPD has gone away, true otherwise.
+ */
+static bool read_from_dcpd(short revents)
+{
+    if(revents & POLLIN)
+    {
+        const ssize_t len =
+            read(bridge.fifo_in_fd, bridge.to_spi, sizeof(bridge.to_spi));
+
+        if(len > 0)
+        {
+            bridge.to_spi_pos = 0;
+            bridge.to_spi_length = len;
+            return true;
+        }
+
+        if(len < 0 && (errno == EINTR || errno == EAGAIN))
+            return true;
+
+        if(len < 0)
+            msg_error(errno, LOG_EMERG,
+                      "Failed reading from fd %d", bridge.fifo_in_fd);
+
+        return false;
+    }
+
+    /* hangup is only reported after everything has been read */
+    return (revents & (POLLHUP | POLLERR)) == 0;
+}
+
+static void forward_to_spi(void)
+{
+    if(bridge.to_spi_length == 0)
+        return;
+
+    const struct iovec iov =
+    {
+        .iov_base = bridge.to_spi + bridge.to_spi_pos,
+        .iov_len = bridge.to_spi_length,
+    };
+
+    const ssize_t len = ipc_channel_peer_writev(bridge.channel, &iov, 1);
+
+    if(len <= 0)
+        return;
+
+    bridge.to_spi_pos += len;
+    bridge.to_spi_length -= len;
+}
+
+static void *bridge_main(void *user_data __attribute__((unused)))
+{
+    bool is_dcpd_connected = true;
+
+    while(true)
+    {
+        struct pollfd fds[4] =
+        {
+            {
+                /* no more reading while the ring is full */
+                .fd = (is_dcpd_connected && bridge.to_spi_length == 0)
+                    ? bridge.fifo_in_fd
+                    : -1,
+                .events = POLLIN,
+            },
+            {
+                .fd = ipc_channel_get_peer_poll_fd(bridge.channel),
+                .events = POLLIN,
+            },
+            {
+                .fd = bridge.stop_fd,
+                .events = POLLIN,
+            },
+            {
+                /* the main loop tells us when it has made room */
+                .fd = bridge.to_spi_length > 0
+                    ? ipc_channel_get_peer_space_poll_fd(bridge.channel)
+                    : -1,
+                .events = POLLIN,
+            },
+        };
+
+        const int ret = poll(fds, sizeof(fds) / sizeof(fds[0]), -1);
+
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            msg_error(errno, LOG_CRIT, "poll() failed in DCPD thread");
+            break;
+        }
+
+        if(fds[2].revents & POLLIN)
+            break;
+
+        if(fds[1].revents & POLLIN)
+            is_dcpd_connected = forward_to_dcpd(is_dcpd_connected);
+
+        if(fds[0].fd >= 0 && !read_from_dcpd(fds[0].revents))
+            is_dcpd_connected = false;
+
+        if(is_dcpd_connected)
+            forward_to_spi();
+        else
+        {
+            /* let the main loop know, it decides what to do */
+            bridge.to_spi_length = 0;
+            ipc_channel_peer_hang_up(bridge.channel);
+        }
+    }
+
+    return NULL;
+}
+
+int dcpd_bridge_start(int fifo_in_fd, int fifo_out_fd,
+                      struct ipc_channel *channel, const cpu_set_t *cpus)
+{
+    if(bridge.is_running)
+    {
+        MSG_BUG("DCPD thread already running");
+        return -1;
+    }
+
+    bridge.fifo_in_fd = fifo_in_fd;
+    bridge.fifo_out_fd = fifo_out_fd;
+    bridge.channel = channel;
+    bridge.to_spi_pos = 0;
+    bridge.to_spi_length = 0;
+
+    bridge.stop_fd = eventfd(0, EFD_CLOEXEC);
+
+    if(bridge.stop_fd < 0)
+    {
+        msg_error(errno, LOG_EMERG, "Failed creating eventfd");
+        return -1;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+
+    /* the main loop may run in real-time, but this thread must not */
+    static const struct sched_param param = { .sched_priority = 0 };
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &param);
+
+    if(cpus != NULL && CPU_COUNT(cpus) > 0)
+        pthread_attr_setaffinity_np(&attr, sizeof(*cpus), cpus);
+
+    const int err = pthread_create(&bridge.thread, &attr, bridge_main, NULL);
+
+    pthread_attr_destroy(&attr);
+
+    if(err != 0)
+    {
+        msg_error(err, LOG_EMERG, "Failed starting DCPD thread");
+        close(bridge.stop_fd);
+        bridge.stop_fd = -1;
+        return -1;
+    }
+
+    bridge.is_running = true;
+
+    return 0;
+}
+
+void dcpd_bridge_stop(void)
+{
+    if(!bridge.is_running)
+        return;
+
+    static const uint64_t one = 1;
+
+    while(write(bridge.stop_fd, &one, sizeof(one)) < 0 && errno == EINTR)
+        ;
+
+    pthread_join(bridge.thread, NULL);
+
+    close(bridge.stop_fd);
+    bridge.stop_fd = -1;
+    bridge.is_running = false;
+}
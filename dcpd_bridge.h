@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef DCPD_BRIDGE_H
+#define DCPD_BRIDGE_H
+
+#include <sched.h>
+
+struct ipc_channel;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Start thread which copies data between the named pipes and a local channel.
+ *
+ * The thread owns the named pipes from now on, so that a slow DCP daemon
+ * only holds up this thread, but not the main loop which serves the SPI
+ * slave through the channel. It always runs with \c SCHED_OTHER, regardless
+ * of the scheduling policy of the calling thread.
+ *
+ * \param fifo_in_fd, fifo_out_fd
+ *     Named pipes from and to DCPD.
+ *
+ * \param channel
+ *     Channel created by #ipc_channel_create_local().
+ *
+ * \param cpus
+ *     CPUs to run on, or \c NULL (or an empty set) for the CPUs of the
+ *     calling thread.
+ *
+ * \returns
+ *     0 on success, -1 on error.
+ */
+int dcpd_bridge_start(int fifo_in_fd, int fifo_out_fd,
+                      struct ipc_channel *channel, const cpu_set_t *cpus);
+
+/*!
+ * Stop the thread, data still in the channel are discarded.
+ */
+void dcpd_bridge_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !DCPD_BRIDGE_H */
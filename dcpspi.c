@@ -29,18 +29,28 @@
 #include <signal.h>
 #include <limits.h>
 #include <errno.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
 
 #include "dcpspi_process.h"
 #include "dcpdefs.h"
 #include "spi.h"
 #include "named_pipe.h"
+#include "ipc_ring.h"
+#include "dcpd_bridge.h"
 #include "gpio.h"
+#include "trace.h"
+#include "capture.h"
+#include "stats_export.h"
+#include "rt_profile.h"
 #include "versioninfo.h"
 #include "messages.h"
 #include "messages_signal.h"
+#include "os_writev.h"
 
 ssize_t (*os_read)(int fd, void *dest, size_t count) = read;
 ssize_t (*os_write)(int fd, const void *buf, size_t count) = write;
+ssize_t (*os_writev)(int fd, const struct iovec *iov, int iovcnt) = writev;
 int (*os_poll)(struct pollfd *fds, nfds_t nfds, int timeout) = poll;
 
 static void show_version_info(void)
@@ -73,6 +83,17 @@ static double compute_io_ratio(const struct stats_io *io)
         : 0.0;
 }
 
+static void dump_histogram(const char *what, const struct stats_histogram *h)
+{
+    msg_info("%-18s - %10" PRIu32 " samples, p50 %" PRIu64 " us, "
+             "p90 %" PRIu64 " us, p99 %" PRIu64 " us, max %" PRIu64 " us",
+             what, stats_histogram_count(h),
+             stats_histogram_percentile(h, 50),
+             stats_histogram_percentile(h, 90),
+             stats_histogram_percentile(h, 99),
+             h->max_usec);
+}
+
 static void dump_statistics(const struct program_statistics *stats)
 {
     const uint64_t total_us =
@@ -128,6 +149,160 @@ static void dump_statistics(const struct program_statistics *stats)
                                 (double)stats->dcpd_reads.blocked.t_usec +
                                 (double)stats->dcpd_writes.blocked.t_usec,
                                 total_us));
+    msg_info("Slave ready wait   - %10" PRIu64 " us, "
+             "%" PRIu32 " waits, %" PRIu32 " probes, avg %0.2f us, max %" PRIu64 " us (%s)",
+             stats->slave_ready.total_usec,
+             stats->slave_ready.waits.count,
+             stats->slave_ready.probes.count,
+             stats->slave_ready.waits.count > 0
+             ? (double)stats->slave_ready.total_usec / stats->slave_ready.waits.count
+             : 0.0,
+             stats->slave_ready.max_usec,
+             spi_slave_ready_strategy_to_string(spi_get_slave_ready_strategy()));
+    msg_info("GPIO debouncing    - %10" PRIu64 " us, "
+             "%" PRIu32 " settled, %" PRIu32 " bounces, avg %0.2f us, max %" PRIu64 " us",
+             stats->debounce.total_usec,
+             stats->debounce.waits.count,
+             stats->debounce.probes.count,
+             stats->debounce.waits.count > 0
+             ? (double)stats->debounce.total_usec / stats->debounce.waits.count
+             : 0.0,
+             stats->debounce.max_usec);
+    dump_histogram("Latency events", &stats->wait_for_events.histogram);
+    dump_histogram("Latency SPI", &stats->spi_transfers.blocked.histogram);
+    dump_histogram("Latency from DCPD", &stats->dcpd_reads.blocked.histogram);
+    dump_histogram("Latency to DCPD", &stats->dcpd_writes.blocked.histogram);
+    dump_histogram("Slave transaction", &stats->slave_transactions);
+    dump_histogram("Master transaction", &stats->master_transactions);
+    dump_histogram("Scheduling delay", &stats->sched_delay);
+
+    for(int i = 0; i < SPI_CLOCK_DIRECTIONS; ++i)
+    {
+        const struct spi_clock_direction_stats *const clk =
+            &stats->spi_clock.directions[i];
+
+        msg_info("SPI %-5s clock    - %10" PRIu32 " Hz%s, "
+                 "%" PRIu32 " raised, %" PRIu32 " lowered for timeouts, "
+                 "%" PRIu32 " lowered for junk",
+                 spi_clock_direction_to_string(i), clk->hz,
+                 stats->spi_clock.is_adaptive ? "" : " (fixed)",
+                 clk->raised, clk->lowered_for_timeout, clk->lowered_for_junk);
+    }
+}
+
+/*!
+ * How we are connected to DCPD.
+ *
+ * For named pipes, \c in_fd and \c out_fd are the pipes; for the seqpacket
+ * socket, both are the same connection and \c listen_fd is kept open to
+ * accept reconnects; for shared memory, \c in_fd is the inbound eventfd and
+ * \c ipc is the channel. In threaded mode, the named pipes are \c fifo_in_fd
+ * and \c fifo_out_fd, owned by the DCPD thread, and the main loop talks to
+ * that thread through a local \c ipc channel as if it was DCPD.
+ *
+ * The name of the named pipe to DCPD is kept in \c out_name so that
+ * \c out_fd can be reopened, and it is \c NULL for all other connections.
+ */
+struct dcpd_channel
+{
+    int in_fd;
+    int out_fd;
+    int listen_fd;
+    struct ipc_channel *ipc;
+    int fifo_in_fd;
+    int fifo_out_fd;
+    const char *out_name;
+};
+
+/*!
+ * Memory for the transaction of one slave.
+ */
+struct transaction_buffers
+{
+    uint8_t dcp[DCPSYNC_HEADER_SIZE + DCP_HEADER_SIZE + DCP_PAYLOAD_MAXSIZE];
+    uint8_t spi[(DCP_HEADER_SIZE + DCP_PAYLOAD_MAXSIZE) * 2];
+};
+
+/*!
+ * Statistics requests forwarded to the threads of additional slaves.
+ */
+enum SlaveRequest
+{
+    SLAVE_REQUEST_DISABLE_STATISTICS = 1U << 0,
+    SLAVE_REQUEST_ENABLE_STATISTICS  = 1U << 1,
+    SLAVE_REQUEST_DUMP_STATISTICS    = 1U << 2,
+    SLAVE_REQUEST_RESET_STATISTICS   = 1U << 3,
+};
+
+/*!
+ * A slave on a bus of its own, in addition to the one given by --spidev.
+ *
+ * Each of these is served by a thread of its own, with its own DCPSPI
+ * context and named pipes.
+ */
+struct extra_slave_parameters
+{
+    const char *spidev_name;
+    unsigned int gpio_num;
+    const char *fifo_in_name;
+    const char *fifo_out_name;
+};
+
+struct extra_slave
+{
+    unsigned int index;
+    const struct extra_slave_parameters *parameters;
+
+    struct dcpspi_context *ctx;
+    struct dcpd_channel dcpd;
+    int spi_fd;
+    struct gpio_handle *gpio;
+
+    pthread_t thread;
+    bool is_running;
+
+    /*! Signaled by the main thread to stop the slave's thread. */
+    int stop_fd;
+    bool is_stopping;
+
+    /*! Bitmask of #SlaveRequest, set by the main thread. */
+    unsigned int requests;
+
+    struct transaction_buffers buffers;
+};
+
+static struct extra_slave extra_slaves[SPI_MAX_SLAVES - 1];
+static unsigned int extra_slaves_count;
+
+static void handle_slave_requests(struct extra_slave *slave)
+{
+    const unsigned int requests =
+        __atomic_exchange_n(&slave->requests, 0, __ATOMIC_ACQUIRE);
+
+    if(requests == 0)
+        return;
+
+    if(requests & SLAVE_REQUEST_DISABLE_STATISTICS)
+        dcpspi_statistics_enable(false);
+
+    if(requests & SLAVE_REQUEST_ENABLE_STATISTICS)
+        dcpspi_statistics_enable(true);
+
+    if(requests & SLAVE_REQUEST_DUMP_STATISTICS)
+    {
+        msg_info("Statistics of slave %u on %s",
+                 slave->index, slave->parameters->spidev_name);
+        dump_statistics(dcpspi_statistics_get());
+    }
+
+    if(requests & SLAVE_REQUEST_RESET_STATISTICS)
+        dcpspi_statistics_reset();
+}
+
+static void forward_slave_request(enum SlaveRequest request)
+{
+    for(unsigned int i = 0; i < extra_slaves_count; ++i)
+        __atomic_fetch_or(&extra_slaves[i].requests, request, __ATOMIC_RELEASE);
 }
 
 /*!
@@ -151,9 +326,12 @@ static volatile struct statistics_control
     bool enable_statistics_flag;
     bool dump_requested;
     bool reset_requested;
+    bool trace_dump_requested;
 }
 statistics_control;
 
+static const char *trace_file_name;
+
 static void handle_statistics_requests(const sigset_t *mask)
 {
     if(!statistics_control.is_anything_requested)
@@ -170,12 +348,17 @@ static void handle_statistics_requests(const sigset_t *mask)
         msg_info("%sable gathering of statistics",
                  statistics_control.enable_statistics_flag ? "En" : "Dis");
         dcpspi_statistics_enable(statistics_control.enable_statistics_flag);
+        forward_slave_request(statistics_control.enable_statistics_flag
+                              ? SLAVE_REQUEST_ENABLE_STATISTICS
+                              : SLAVE_REQUEST_DISABLE_STATISTICS);
         statistics_control.enable_statistics_requested = false;
     }
 
     if(statistics_control.dump_requested)
     {
         dump_statistics(dcpspi_statistics_get());
+        stats_export_tick(dcpspi_statistics_get(), true);
+        forward_slave_request(SLAVE_REQUEST_DUMP_STATISTICS);
         statistics_control.dump_requested = false;
     }
 
@@ -183,15 +366,79 @@ static void handle_statistics_requests(const sigset_t *mask)
     {
         msg_info("Resetting statistics");
         dcpspi_statistics_reset();
+        forward_slave_request(SLAVE_REQUEST_RESET_STATISTICS);
         statistics_control.reset_requested = false;
     }
 
+    if(statistics_control.trace_dump_requested)
+    {
+        trace_dump_to_file(trace_file_name);
+        statistics_control.trace_dump_requested = false;
+    }
+
     statistics_control.is_anything_requested = false;
 
     if(sigprocmask(SIG_UNBLOCK, mask, NULL) < 0)
         msg_error(errno, LOG_CRIT, "Failed resetting signal mask");
 }
 
+static bool accept_dcpd(struct dcpd_channel *dcpd)
+{
+    while(keep_running)
+    {
+        dcpd->in_fd = seqpacket_accept(dcpd->listen_fd);
+
+        if(dcpd->in_fd >= 0)
+        {
+            dcpd->out_fd = dcpd->in_fd;
+            msg_info("DCP daemon connected");
+            return true;
+        }
+
+        if(errno != EINTR)
+            break;
+    }
+
+    dcpd->out_fd = -1;
+
+    return false;
+}
+
+/*!
+ * Restart the byte stream to DCPD after an incomplete packet.
+ *
+ * Closing the named pipe lets DCPD see the end of the stream and drop the
+ * packet. The pipe is reopened once DCPD has opened its end again; until
+ * then, this function is called on each iteration of the main loop and
+ * returns \c false without waiting, so that the slave is still served.
+ *
+ * Cut-through forwarding is only enabled with named pipes, so there is
+ * always a pipe to restart.
+ */
+static bool restart_dcpd_stream(struct dcpd_channel *dcpd)
+{
+    if(dcpd->out_name == NULL)
+    {
+        MSG_BUG("Cannot restart stream to DCPD");
+        return false;
+    }
+
+    if(dcpd->out_fd >= 0)
+    {
+        msg_info("Restarting stream to DCPD");
+        fifo_close(&dcpd->out_fd);
+    }
+
+    dcpd->out_fd = fifo_try_open_for_writing(dcpd->out_name);
+
+    if(dcpd->out_fd < 0)
+        return false;
+
+    msg_info("Stream to DCPD restarted");
+
+    return true;
+}
+
 /*!
  * Copy data back and forth.
  *
@@ -220,13 +467,9 @@ static void handle_statistics_requests(const sigset_t *mask)
  * - Transform for SPI (insert escape sequences)
  * - Send transformed data to SPI
  *
- * \param fifo_in_fd
- *     File descriptor of the ingoing named pipe that DCPD is supposed to
- *     connect to for writing to us.
- *
- * \param fifo_out_fd
- *     File descriptor of the outgoing named pipe that DCPD is supposed to
- *     connect to for reading from us.
+ * \param dcpd
+ *     Connection to DCPD, usually a pair of named pipes. In case of a seqpacket
+ *     socket, the connection is replaced when DCPD reconnects.
  *
  * \param spi_fd
  *     File descriptor of the SPI interface.
@@ -234,29 +477,41 @@ static void handle_statistics_requests(const sigset_t *mask)
  * \param gpio
  *     Structure that represents the request input pin the slave device is
  *     supposed to use for requesting data and data rate limitation.
+ *
+ * \param buffers
+ *     Memory for the transaction.
+ *
+ * \param slave
+ *     The additional slave served by the calling thread, or \c NULL for the
+ *     main thread. Statistics requests are handled by the main thread and
+ *     forwarded to additional slaves, the statistics exporter only sees the
+ *     first slave.
  */
-static void main_loop(const int fifo_in_fd, const int fifo_out_fd,
-                      const int spi_fd, const struct gpio_handle *const gpio)
+static void main_loop(struct dcpd_channel *const dcpd,
+                      const int spi_fd, struct gpio_handle *const gpio,
+                      struct transaction_buffers *const buffers,
+                      struct extra_slave *const slave)
 {
     msg_info("Accepting traffic");
 
-    static uint8_t dcp_backing_buffer[DCPSYNC_HEADER_SIZE + DCP_HEADER_SIZE + DCP_PAYLOAD_MAXSIZE];
-    static uint8_t spi_backing_buffer[(DCP_HEADER_SIZE + DCP_PAYLOAD_MAXSIZE) * 2];
-
     struct dcp_transaction transaction =
     {
         .dcp_buffer =
         {
-            .buffer = dcp_backing_buffer,
-            .size = sizeof(dcp_backing_buffer),
+            .buffer = buffers->dcp,
+            .size = sizeof(buffers->dcp),
         },
         .spi_buffer =
         {
-            .buffer = spi_backing_buffer,
-            .size = sizeof(spi_backing_buffer),
+            .buffer = buffers->spi,
+            .size = sizeof(buffers->spi),
         },
     };
 
+    /* no page faults on the first transactions */
+    rt_profile_prefault(buffers->dcp, sizeof(buffers->dcp));
+    rt_profile_prefault(buffers->spi, sizeof(buffers->spi));
+
     reset_transaction_struct(&transaction, true);
 
     struct slave_request_and_lock_data rldata =
@@ -274,12 +529,36 @@ static void main_loop(const int fifo_in_fd, const int fifo_out_fd,
     sigaddset(&statistics_signal_mask, base_signal + 3);
     sigaddset(&statistics_signal_mask, base_signal + 4);
     sigaddset(&statistics_signal_mask, base_signal + 5);
+    sigaddset(&statistics_signal_mask, base_signal + 6);
 
-    while(keep_running &&
-          dcpspi_process(fifo_in_fd, fifo_out_fd, spi_fd,
-                         &transaction, &rldata))
+    while(keep_running)
     {
-        handle_statistics_requests(&statistics_signal_mask);
+        if(!dcpspi_process(dcpd->in_fd, dcpd->out_fd, spi_fd,
+                           &transaction, &rldata))
+        {
+            if(dcpd->listen_fd < 0)
+                break;
+
+            fifo_close(&dcpd->in_fd);
+            dcpspi_dcpd_disconnected(&transaction);
+
+            msg_info("Waiting for DCP daemon to reconnect");
+
+            if(!accept_dcpd(dcpd))
+                break;
+        }
+
+        if(dcpspi_dcpd_stream_reset_requested() &&
+           restart_dcpd_stream(dcpd))
+            dcpspi_dcpd_stream_restarted();
+
+        if(slave != NULL)
+            handle_slave_requests(slave);
+        else
+        {
+            handle_statistics_requests(&statistics_signal_mask);
+            stats_export_tick(dcpspi_statistics_get(), false);
+        }
     }
 }
 
@@ -318,6 +597,11 @@ static void extra_signals(unsigned int relative_signum)
         statistics_control.reset_requested = true;
         break;
 
+      case 6:
+        statistics_control.is_anything_requested = true;
+        statistics_control.trace_dump_requested = true;
+        break;
+
       default:
         break;
     };
@@ -327,174 +611,771 @@ struct parameters
 {
     const char *fifo_in_name;
     const char *fifo_out_name;
+    const char *ipc_socket_name;
+    const char *seqpacket_socket_name;
+    const char *trace_file_name;
+    const char *capture_file_name;
+    size_t capture_file_size;
+    const char *stats_export_target;
+    enum StatsExportFormat stats_export_format;
+    unsigned int stats_export_interval_ms;
+    struct rt_profile rt_profile;
     const char *spidev_name;
     uint32_t spi_clock;
+    uint32_t spi_clock_min;
+    uint32_t spi_clock_max;
     unsigned int gpio_num;
+    const char *gpio_chip_name;
     enum MessageVerboseLevel verbose_level;
     bool run_in_foreground;
     bool gpio_needs_debouncing;
+    bool gpio_force_sysfs;
     bool dummy_mode;
     bool gather_statistics;
     bool dump_spi_traffic;
+    bool blocking_spi;
+    bool slave_fast_path;
+    unsigned int burst_bytes;
+    unsigned int cut_through_bytes;
+    unsigned int max_payload_size;
+    bool threaded;
+    cpu_set_t fifo_cpus;
+    enum SpiSlaveReadyStrategy slave_ready_strategy;
+    unsigned int slave_ready_min_delay_us;
+    unsigned int slave_ready_busy_poll_us;
+    struct extra_slave_parameters extra_slaves[SPI_MAX_SLAVES - 1];
+    unsigned int extra_slaves_count;
 };
 
-/*!
- * Open devices, daemonize.
- */
-static int setup(const struct parameters *parameters,
-                 int *fifo_in_fd, int *fifo_out_fd,
-                 int *spi_fd, struct gpio_handle **gpio)
+static int open_threaded_dcpd_channel(const struct parameters *parameters,
+                                      struct dcpd_channel *dcpd)
 {
-    msg_enable_syslog(!parameters->run_in_foreground);
-    msg_set_verbose_level(parameters->verbose_level);
-    msg_install_debug_level_signals();
-    msg_install_extra_handler(0, extra_signals);
-    msg_install_extra_handler(1, extra_signals);
-    msg_install_extra_handler(2, extra_signals);
-    msg_install_extra_handler(3, extra_signals);
-    msg_install_extra_handler(4, extra_signals);
-    msg_install_extra_handler(5, extra_signals);
+    dcpd->fifo_in_fd = fifo_create_and_open(parameters->fifo_in_name, false);
+    if(dcpd->fifo_in_fd < 0)
+        return -1;
 
-    dcpspi_statistics_enable(parameters->gather_statistics);
+    dcpd->fifo_out_fd = fifo_create_and_open(parameters->fifo_out_name, true);
+    if(dcpd->fifo_out_fd < 0)
+        goto error_fifo_out;
 
-    if(parameters->dump_spi_traffic)
-        spi_enable_traffic_dump();
+    dcpd->ipc = ipc_channel_create_local();
+    if(dcpd->ipc == NULL)
+        goto error_ipc;
 
-    if(!parameters->run_in_foreground)
+    if(dcpd_bridge_start(dcpd->fifo_in_fd, dcpd->fifo_out_fd, dcpd->ipc,
+                         &parameters->fifo_cpus) < 0)
+        goto error_bridge;
+
+    dcpd->in_fd = ipc_channel_get_poll_fd(dcpd->ipc);
+    dcpspi_set_ipc_channel(dcpd->ipc);
+
+    return 0;
+
+error_bridge:
+    ipc_channel_close(dcpd->ipc);
+    dcpd->ipc = NULL;
+
+error_ipc:
+    fifo_close_and_delete(&dcpd->fifo_out_fd, parameters->fifo_out_name);
+
+error_fifo_out:
+    fifo_close_and_delete(&dcpd->fifo_in_fd, parameters->fifo_in_name);
+    return -1;
+}
+
+static int open_dcpd_channel(const struct parameters *parameters,
+                             struct dcpd_channel *dcpd)
+{
+    dcpd->in_fd = -1;
+    dcpd->out_fd = -1;
+    dcpd->listen_fd = -1;
+    dcpd->ipc = NULL;
+    dcpd->fifo_in_fd = -1;
+    dcpd->fifo_out_fd = -1;
+    dcpd->out_name = NULL;
+
+    if(parameters->ipc_socket_name != NULL)
     {
-        openlog("dcpspi", LOG_PID, LOG_DAEMON);
+        dcpd->ipc = ipc_channel_create(parameters->ipc_socket_name);
+        if(dcpd->ipc == NULL)
+            return -1;
 
-        if(daemon(0, 0) < 0)
+        dcpd->in_fd = ipc_channel_get_poll_fd(dcpd->ipc);
+        dcpspi_set_ipc_channel(dcpd->ipc);
+
+        return 0;
+    }
+
+    if(parameters->seqpacket_socket_name != NULL)
+    {
+        dcpd->listen_fd = seqpacket_listen(parameters->seqpacket_socket_name);
+        if(dcpd->listen_fd < 0)
+            return -1;
+
+        if(!accept_dcpd(dcpd))
         {
-            msg_error(errno, LOG_EMERG, "Failed to run as daemon");
+            seqpacket_close_and_delete(&dcpd->listen_fd,
+                                       parameters->seqpacket_socket_name);
             return -1;
         }
+
+        dcpspi_set_message_mode(true);
+
+        return 0;
     }
 
-    log_version_info();
+    if(parameters->threaded)
+        return open_threaded_dcpd_channel(parameters, dcpd);
 
-    *fifo_in_fd = fifo_create_and_open(parameters->fifo_in_name, false);
-    if(*fifo_in_fd < 0)
+    dcpd->in_fd = fifo_create_and_open(parameters->fifo_in_name, false);
+    if(dcpd->in_fd < 0)
         return -1;
 
-    *fifo_out_fd = fifo_create_and_open(parameters->fifo_out_name, true);
-    if(*fifo_out_fd < 0)
-        goto error_fifo_out;
-
-    if(parameters->dummy_mode)
+    dcpd->out_fd = fifo_create_and_open(parameters->fifo_out_name, true);
+    if(dcpd->out_fd < 0 || fifo_set_nonblocking(dcpd->out_fd) < 0)
     {
-        *spi_fd = -1;
-        *gpio = NULL;
-        return 0;
+        if(dcpd->out_fd >= 0)
+            fifo_close_and_delete(&dcpd->out_fd, parameters->fifo_out_name);
+
+        fifo_close_and_delete(&dcpd->in_fd, parameters->fifo_in_name);
+        return -1;
     }
 
-    *spi_fd = spi_open_device(parameters->spidev_name);
-    if(*spi_fd < 0)
-        goto error_spi_open;
+    dcpd->out_name = parameters->fifo_out_name;
 
-    *gpio = gpio_open(parameters->gpio_num, false);
-    if(*gpio == NULL)
-        goto error_gpio_open;
+    return 0;
+}
 
-    if(parameters->gpio_needs_debouncing)
-        gpio_enable_debouncing(*gpio);
+static void close_dcpd_channel(const struct parameters *parameters,
+                               struct dcpd_channel *dcpd)
+{
+    if(dcpd->ipc != NULL)
+    {
+        /* the DCPD thread must not touch the channel anymore */
+        dcpd_bridge_stop();
 
-    spi_set_speed_hz(parameters->spi_clock);
+        dcpspi_set_ipc_channel(NULL);
+        ipc_channel_close(dcpd->ipc);
+        dcpd->ipc = NULL;
+        dcpd->in_fd = -1;
 
-    return 0;
+        if(parameters->threaded)
+        {
+            fifo_close_and_delete(&dcpd->fifo_in_fd, parameters->fifo_in_name);
+            fifo_close_and_delete(&dcpd->fifo_out_fd, parameters->fifo_out_name);
+        }
 
-error_gpio_open:
-    spi_close_device(*spi_fd);
+        return;
+    }
 
-error_spi_open:
-    fifo_close_and_delete(fifo_out_fd, parameters->fifo_out_name);
+    if(dcpd->listen_fd >= 0)
+    {
+        dcpspi_set_message_mode(false);
 
-error_fifo_out:
-    fifo_close_and_delete(fifo_in_fd, parameters->fifo_in_name);
-    return -1;
+        if(dcpd->in_fd >= 0)
+            fifo_close(&dcpd->in_fd);
+
+        dcpd->out_fd = -1;
+        seqpacket_close_and_delete(&dcpd->listen_fd,
+                                   parameters->seqpacket_socket_name);
+        return;
+    }
+
+    fifo_close_and_delete(&dcpd->in_fd, parameters->fifo_in_name);
+    fifo_close_and_delete(&dcpd->out_fd, parameters->fifo_out_name);
 }
 
-static void usage(const char *program_name)
+/*!
+ * Settings of the current slave's DCPSPI context.
+ */
+static void configure_slave(const struct parameters *parameters)
 {
-    printf("Usage: %s --fifo name --spidev name --irq gpio\n"
-           "\n"
-           "Options:\n"
-           "  --help         Show this help.\n"
-           "  --version      Print version information to stdout.\n"
-           "  --fg           Run in foreground, don't run as daemon.\n"
-           "  --verbose lvl  Set verbosity level to given level.\n"
-           "  --quiet        Short for \"--verbose quite\".\n"
-           "  --dump-traffic Dump SPI traffic to log (independent of verbosity level).\n"
-           "  --stats        Enable gathering statistics.\n"
-           "  --ififo name   Name of the named pipe the DCP daemon writes to.\n"
-           "  --ofifo name   Name of the named pipe the DCP daemon reads from.\n"
-           "  --spidev name  Name of the SPI device.\n"
-           "  --spiclk hz    Clock frequency on SPI bus.\n"
-           "  --gpio num     Number of the slave request pin.\n"
-           "  --debounce     Enable software debouncing of request pin.\n",
-           program_name);
+    dcpspi_statistics_enable(parameters->gather_statistics);
+    dcpspi_read_ahead_enable(true);
+    dcpspi_nonblocking_spi_enable(!parameters->blocking_spi);
+    dcpspi_slave_fast_path_enable(parameters->slave_fast_path);
+    dcpspi_burst_enable(parameters->burst_bytes);
+    dcpspi_cut_through_enable(parameters->cut_through_bytes);
+    dcpspi_set_max_payload_size(parameters->max_payload_size);
 }
 
-static int process_command_line(int argc, char *argv[],
-                                struct parameters *parameters)
+static struct gpio_handle *open_request_gpio(const struct parameters *parameters,
+                                             unsigned int gpio_num)
 {
-    parameters->fifo_in_name = "/tmp/dcp_to_spi";
-    parameters->fifo_out_name = "/tmp/spi_to_dcp";
-    parameters->spidev_name = "/dev/spidev0.0";
-    parameters->spi_clock = 0;
-    parameters->gpio_num = 4;
-    parameters->verbose_level = MESSAGE_LEVEL_NORMAL;
-    parameters->run_in_foreground = false;
-    parameters->gpio_needs_debouncing = false;
-    parameters->dummy_mode = false;
-    parameters->gather_statistics = false;
-    parameters->dump_spi_traffic = false;
+    /* GPIO numbers are sysfs numbers unless a GPIO chip has been named */
+    const bool use_chardev =
+        parameters->gpio_chip_name != NULL && !parameters->gpio_force_sysfs;
 
-#define CHECK_ARGUMENT() \
-    do \
-    { \
-        if(i + 1 >= argc) \
-        { \
-            fprintf(stderr, "Option %s requires an argument.\n", argv[i]); \
-            return -1; \
-        } \
-        ++i; \
-    } \
-    while(0)
+    struct gpio_handle *gpio = use_chardev
+        ? gpio_open_chardev(parameters->gpio_chip_name, gpio_num, false)
+        : NULL;
 
-    for(int i = 1; i < argc; ++i)
+    if(gpio == NULL)
     {
-        if(strcmp(argv[i], "--help") == 0)
-            return 1;
-        else if(strcmp(argv[i], "--version") == 0)
-            return 2;
-        else if(strcmp(argv[i], "--fg") == 0)
-            parameters->run_in_foreground = true;
-        else if(strcmp(argv[i], "--verbose") == 0)
-        {
-            CHECK_ARGUMENT();
-            parameters->verbose_level = msg_verbose_level_name_to_level(argv[i]);
+        if(use_chardev)
+            msg_info("Falling back to sysfs for GPIO %u", gpio_num);
 
-            if(parameters->verbose_level == MESSAGE_LEVEL_IMPOSSIBLE)
-            {
-                fprintf(stderr,
-                        "Invalid verbosity \"%s\". "
-                        "Valid verbosity levels are:\n", argv[i]);
+        gpio = gpio_open(gpio_num, false);
+    }
 
-                const char *const *names = msg_get_verbose_level_names();
+    if(gpio != NULL && parameters->gpio_needs_debouncing)
+        gpio_enable_debouncing(gpio);
 
-                for(const char *name = *names; name != NULL; name = *++names)
-                    fprintf(stderr, "    %s\n", name);
+    return gpio;
+}
 
-                return -1;
-            }
-        }
-        else if(strcmp(argv[i], "--quiet") == 0)
-            parameters->verbose_level = MESSAGE_LEVEL_QUIET;
-        else if(strcmp(argv[i], "--dump-traffic") == 0)
-            parameters->dump_spi_traffic = true;
+/*!
+ * SPI settings of the current slave.
+ */
+static void configure_slave_spi(const struct parameters *parameters,
+                                struct gpio_handle *gpio)
+{
+    spi_set_speed_hz(parameters->spi_clock);
+
+    if(parameters->spi_clock_max > 0)
+        spi_set_speed_range_hz(parameters->spi_clock_min,
+                               parameters->spi_clock_max);
+
+    spi_set_slave_ready_strategy(parameters->slave_ready_strategy,
+                                 parameters->slave_ready_min_delay_us,
+                                 parameters->slave_ready_busy_poll_us,
+                                 gpio_get_poll_fd(gpio),
+                                 gpio_get_poll_events(gpio));
+}
+
+static void close_extra_slave(struct extra_slave *slave)
+{
+    const struct extra_slave_parameters *const sp = slave->parameters;
+
+    if(slave->gpio != NULL)
+        gpio_close(slave->gpio);
+
+    if(slave->spi_fd >= 0)
+        spi_close_device(slave->spi_fd);
+
+    if(slave->dcpd.in_fd >= 0)
+        fifo_close_and_delete(&slave->dcpd.in_fd, sp->fifo_in_name);
+
+    if(slave->dcpd.out_fd >= 0)
+        fifo_close_and_delete(&slave->dcpd.out_fd, sp->fifo_out_name);
+
+    if(slave->stop_fd >= 0)
+        close(slave->stop_fd);
+
+    slave->gpio = NULL;
+    slave->spi_fd = -1;
+    slave->stop_fd = -1;
+}
+
+static int open_extra_slave(const struct parameters *parameters,
+                            struct extra_slave *slave, unsigned int index)
+{
+    const struct extra_slave_parameters *const sp =
+        &parameters->extra_slaves[index - 1];
+
+    slave->index = index;
+    slave->parameters = sp;
+    slave->dcpd.in_fd = -1;
+    slave->dcpd.out_fd = -1;
+    slave->dcpd.listen_fd = -1;
+    slave->dcpd.ipc = NULL;
+    slave->dcpd.fifo_in_fd = -1;
+    slave->dcpd.fifo_out_fd = -1;
+    slave->dcpd.out_name = sp->fifo_out_name;
+    slave->spi_fd = -1;
+    slave->gpio = NULL;
+    slave->is_running = false;
+    slave->stop_fd = -1;
+    slave->is_stopping = false;
+    slave->requests = 0;
+
+    slave->ctx = dcpspi_context_init(index);
+    if(slave->ctx == NULL)
+        return -1;
+
+    struct dcpspi_context *const previous = dcpspi_context_switch(slave->ctx);
+
+    configure_slave(parameters);
+
+    slave->stop_fd = eventfd(0, EFD_CLOEXEC);
+    if(slave->stop_fd < 0)
+    {
+        msg_error(errno, LOG_EMERG, "Failed creating eventfd");
+        goto error_exit;
+    }
+
+    dcpspi_set_stop_fd(slave->stop_fd);
+
+    slave->dcpd.in_fd = fifo_create_and_open(sp->fifo_in_name, false);
+    if(slave->dcpd.in_fd < 0)
+        goto error_exit;
+
+    slave->dcpd.out_fd = fifo_create_and_open(sp->fifo_out_name, true);
+    if(slave->dcpd.out_fd < 0 || fifo_set_nonblocking(slave->dcpd.out_fd) < 0)
+        goto error_exit;
+
+    slave->spi_fd = spi_open_device(sp->spidev_name);
+    if(slave->spi_fd < 0)
+        goto error_exit;
+
+    slave->gpio = open_request_gpio(parameters, sp->gpio_num);
+    if(slave->gpio == NULL)
+        goto error_exit;
+
+    configure_slave_spi(parameters, slave->gpio);
+
+    dcpspi_context_switch(previous);
+
+    return 0;
+
+error_exit:
+    close_extra_slave(slave);
+    dcpspi_context_switch(previous);
+    return -1;
+}
+
+static void *extra_slave_main(void *user_data)
+{
+    struct extra_slave *const slave = user_data;
+
+    dcpspi_context_switch(slave->ctx);
+    main_loop(&slave->dcpd, slave->spi_fd, slave->gpio, &slave->buffers, slave);
+
+    if(keep_running && !__atomic_load_n(&slave->is_stopping, __ATOMIC_ACQUIRE))
+        msg_error(0, LOG_ERR, "Stopped serving slave %u on %s",
+                  slave->index, slave->parameters->spidev_name);
+
+    return NULL;
+}
+
+static void stop_extra_slaves(void)
+{
+    for(unsigned int i = 0; i < extra_slaves_count; ++i)
+    {
+        struct extra_slave *const slave = &extra_slaves[i];
+
+        if(slave->is_running)
+        {
+            /* the thread leaves its main loop at the next poll(2) */
+            static const uint64_t one = 1;
+
+            __atomic_store_n(&slave->is_stopping, true, __ATOMIC_RELEASE);
+
+            while(write(slave->stop_fd, &one, sizeof(one)) < 0 && errno == EINTR)
+                ;
+
+            pthread_join(slave->thread, NULL);
+            slave->is_running = false;
+        }
+
+        close_extra_slave(slave);
+    }
+
+    extra_slaves_count = 0;
+}
+
+/*!
+ * Open devices of additional slaves, serve each one in a thread of its own.
+ *
+ * The threads inherit the real-time profile of the main thread, but no
+ * signals are delivered to them.
+ */
+static int start_extra_slaves(const struct parameters *parameters)
+{
+    for(unsigned int i = 0; i < parameters->extra_slaves_count; ++i)
+    {
+        if(open_extra_slave(parameters, &extra_slaves[i], i + 1) < 0)
+        {
+            stop_extra_slaves();
+            return -1;
+        }
+
+        ++extra_slaves_count;
+    }
+
+    sigset_t all_signals;
+    sigset_t previous_mask;
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &previous_mask);
+
+    int err = 0;
+
+    for(unsigned int i = 0; i < extra_slaves_count && err == 0; ++i)
+    {
+        struct extra_slave *const slave = &extra_slaves[i];
+
+        err = pthread_create(&slave->thread, NULL, extra_slave_main, slave);
+
+        if(err == 0)
+            slave->is_running = true;
+        else
+            msg_error(err, LOG_EMERG, "Failed starting thread for slave %u",
+                      slave->index);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &previous_mask, NULL);
+
+    if(err == 0)
+        return 0;
+
+    stop_extra_slaves();
+
+    return -1;
+}
+
+/*!
+ * Open devices, daemonize.
+ */
+static int setup(const struct parameters *parameters,
+                 struct dcpd_channel *dcpd,
+                 int *spi_fd, struct gpio_handle **gpio)
+{
+    msg_enable_syslog(!parameters->run_in_foreground);
+    msg_set_verbose_level(parameters->verbose_level);
+    msg_install_debug_level_signals();
+    msg_install_extra_handler(0, extra_signals);
+    msg_install_extra_handler(1, extra_signals);
+    msg_install_extra_handler(2, extra_signals);
+    msg_install_extra_handler(3, extra_signals);
+    msg_install_extra_handler(4, extra_signals);
+    msg_install_extra_handler(5, extra_signals);
+    msg_install_extra_handler(6, extra_signals);
+
+    configure_slave(parameters);
+    trace_file_name = parameters->trace_file_name;
+    trace_enable(true);
+
+    if(parameters->dump_spi_traffic)
+        spi_enable_traffic_dump();
+
+    if(!parameters->run_in_foreground)
+    {
+        openlog("dcpspi", LOG_PID, LOG_DAEMON);
+
+        if(daemon(0, 0) < 0)
+        {
+            msg_error(errno, LOG_EMERG, "Failed to run as daemon");
+            return -1;
+        }
+    }
+
+    log_version_info();
+
+    if(parameters->capture_file_name != NULL &&
+       capture_open(parameters->capture_file_name,
+                    parameters->capture_file_size) < 0)
+        return -1;
+
+    /* must be started after daemon() because threads do not survive fork() */
+    if(parameters->stats_export_target != NULL &&
+       stats_export_start(parameters->stats_export_target,
+                          parameters->stats_export_format,
+                          parameters->stats_export_interval_ms) < 0)
+    {
+        capture_close();
+        return -1;
+    }
+
+    /* after starting the exporter so that it does not run in real-time */
+    if(rt_profile_apply(&parameters->rt_profile) < 0)
+        goto error_dcpd_open;
+
+    if(open_dcpd_channel(parameters, dcpd) < 0)
+        goto error_dcpd_open;
+
+    if(parameters->dummy_mode)
+    {
+        *spi_fd = -1;
+        *gpio = NULL;
+        return 0;
+    }
+
+    *spi_fd = spi_open_device(parameters->spidev_name);
+    if(*spi_fd < 0)
+        goto error_spi_open;
+
+    *gpio = open_request_gpio(parameters, parameters->gpio_num);
+    if(*gpio == NULL)
+        goto error_gpio_open;
+
+    configure_slave_spi(parameters, *gpio);
+
+    if(start_extra_slaves(parameters) < 0)
+        goto error_extra_slaves;
+
+    return 0;
+
+error_extra_slaves:
+    gpio_close(*gpio);
+
+error_gpio_open:
+    spi_close_device(*spi_fd);
+
+error_spi_open:
+    close_dcpd_channel(parameters, dcpd);
+
+error_dcpd_open:
+    stats_export_stop();
+    capture_close();
+    return -1;
+}
+
+static void usage(const char *program_name)
+{
+    printf("Usage: %s --fifo name --spidev name --irq gpio\n"
+           "\n"
+           "Options:\n"
+           "  --help         Show this help.\n"
+           "  --version      Print version information to stdout.\n"
+           "  --fg           Run in foreground, don't run as daemon.\n"
+           "  --verbose lvl  Set verbosity level to given level.\n"
+           "  --quiet        Short for \"--verbose quite\".\n"
+           "  --dump-traffic Dump SPI traffic to log (independent of verbosity level).\n"
+           "  --stats        Enable gathering statistics.\n"
+           "  --trace-file name\n"
+           "                 Where to dump the transaction trace on request\n"
+           "                 (default: /run/dcpspi_trace.bin).\n"
+           "  --capture-file name\n"
+           "                 Capture SPI traffic to given binary file.\n"
+           "  --capture-size MiB\n"
+           "                 Size of the capture file (default: 16).\n"
+           "  --stats-export target\n"
+           "                 Export statistics snapshots to given file, or to\n"
+           "                 Unix socket if prefixed with \"unix:\".\n"
+           "  --stats-format fmt\n"
+           "                 Export format (json or prometheus; default: json).\n"
+           "  --stats-interval ms\n"
+           "                 Export statistics periodically (default: 0, only\n"
+           "                 when a statistics dump is requested).\n"
+           "  --sched policy Scheduling policy (fifo, rr, or other; default: other).\n"
+           "  --sched-priority prio\n"
+           "                 Real-time priority for fifo and rr (default: 50).\n"
+           "  --cpus list    Pin to given CPUs (e.g., \"1\" or \"0,2-3\").\n"
+           "  --mlock        Lock all memory to avoid page faults.\n"
+           "  --ififo name   Name of the named pipe the DCP daemon writes to.\n"
+           "  --ofifo name   Name of the named pipe the DCP daemon reads from.\n"
+           "  --ipc name     Talk to the DCP daemon through shared memory, set up\n"
+           "                 via given Unix socket (replaces the named pipes).\n"
+           "  --socket name  Talk to the DCP daemon through given Unix seqpacket\n"
+           "                 socket (replaces the named pipes).\n"
+           "  --threads      Serve the named pipes from a separate thread.\n"
+           "  --fifo-cpus list\n"
+           "                 Pin the named pipe thread to given CPUs.\n"
+           "  --spidev name  Name of the SPI device.\n"
+           "  --spiclk hz    Clock frequency on SPI bus.\n"
+           "  --spiclk-min hz, --spiclk-max hz\n"
+           "                 Adapt clock frequency within given bounds, separately\n"
+           "                 for reading and writing.\n"
+           "  --gpio num     Number of the slave request pin (sysfs GPIO number,\n"
+           "                 or line offset if --gpio-chip is given).\n"
+           "  --gpio-chip name\n"
+           "                 Use GPIO character device instead of sysfs.\n"
+           "  --gpio-sysfs   Use sysfs instead of the GPIO character device.\n"
+           "  --debounce     Enable debouncing of request pin.\n"
+           "  --slave spidev,gpio,ififo,ofifo\n"
+           "                 Serve another slave on given SPI device and request\n"
+           "                 pin, with its own named pipes (up to %u times).\n"
+           "  --ready-wait s How to wait for the slave before sending data\n"
+           "                 (fixed, backoff, busy, or gpio; default: fixed).\n"
+           "  --ready-min-delay us\n"
+           "                 Initial delay for exponential backoff.\n"
+           "  --busy-poll us Probe without delay for this long (\"busy\" only).\n"
+           "  --blocking-spi Wait for the slave inside SPI transfers instead of\n"
+           "                 in the main loop.\n"
+           "  --slave-fast-path\n"
+           "                 Process slave requests seen during a transaction\n"
+           "                 right after it.\n"
+           "  --burst bytes  Send queued master packets in bursts of up to this\n"
+           "                 many bytes per handshake (up to %u; the slave must\n"
+           "                 support it).\n"
+           "  --cut-through bytes\n"
+           "                 Forward slave payloads to DCPD in chunks of this\n"
+           "                 size while reading them (up to %u; named pipes\n"
+           "                 only).\n"
+           "  --max-payload bytes\n"
+           "                 Largest payload accepted from the slave (up to %u;\n"
+           "                 more than %u requires --cut-through).\n",
+           program_name, SPI_MAX_SLAVES - 1, DCPSPI_BURST_MAX_SIZE,
+           DCP_PAYLOAD_MAXSIZE, DCPSPI_MAX_PAYLOAD_SIZE, DCP_PAYLOAD_MAXSIZE);
+}
+
+/*!
+ * Parse "spidev,gpio,ififo,ofifo", modifying the string in place.
+ */
+static bool parse_extra_slave(char *spec, struct extra_slave_parameters *sp)
+{
+    char *fields[4];
+
+    for(size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i)
+    {
+        fields[i] = spec;
+        spec = strchr(spec, ',');
+
+        if(fields[i] == spec || fields[i][0] == '\0')
+            return false;
+
+        if(i < sizeof(fields) / sizeof(fields[0]) - 1)
+        {
+            if(spec == NULL)
+                return false;
+
+            *spec++ = '\0';
+        }
+        else if(spec != NULL)
+            return false;
+    }
+
+    char *endptr;
+    unsigned long temp = strtoul(fields[1], &endptr, 10);
+
+    if(*endptr != '\0' || temp > UINT_MAX || (temp == ULONG_MAX && errno == ERANGE))
+        return false;
+
+    sp->spidev_name = fields[0];
+    sp->gpio_num = temp;
+    sp->fifo_in_name = fields[2];
+    sp->fifo_out_name = fields[3];
+
+    return true;
+}
+
+static bool parse_clock_hz(const char *arg, uint32_t *hz)
+{
+    char *endptr;
+    unsigned long temp = strtoul(arg, &endptr, 10);
+
+    if(*endptr != '\0' || temp > UINT32_MAX || (temp == ULONG_MAX && errno == ERANGE))
+    {
+        fprintf(stderr, "Invalid value \"%s\". Please try --help.\n", arg);
+        return false;
+    }
+
+    *hz = temp;
+    return true;
+}
+
+static int process_command_line(int argc, char *argv[],
+                                struct parameters *parameters)
+{
+    parameters->fifo_in_name = "/tmp/dcp_to_spi";
+    parameters->fifo_out_name = "/tmp/spi_to_dcp";
+    parameters->ipc_socket_name = NULL;
+    parameters->seqpacket_socket_name = NULL;
+    parameters->trace_file_name = "/run/dcpspi_trace.bin";
+    parameters->capture_file_name = NULL;
+    parameters->capture_file_size = CAPTURE_DEFAULT_FILE_SIZE;
+    parameters->stats_export_target = NULL;
+    parameters->stats_export_format = STATS_EXPORT_FORMAT_JSON;
+    parameters->stats_export_interval_ms = 0;
+    rt_profile_init(&parameters->rt_profile);
+    parameters->spidev_name = "/dev/spidev0.0";
+    parameters->spi_clock = 0;
+    parameters->spi_clock_min = 0;
+    parameters->spi_clock_max = 0;
+    parameters->gpio_num = 4;
+    parameters->gpio_chip_name = NULL;
+    parameters->verbose_level = MESSAGE_LEVEL_NORMAL;
+    parameters->run_in_foreground = false;
+    parameters->gpio_needs_debouncing = false;
+    parameters->gpio_force_sysfs = false;
+    parameters->dummy_mode = false;
+    parameters->gather_statistics = false;
+    parameters->dump_spi_traffic = false;
+    parameters->blocking_spi = false;
+    parameters->slave_fast_path = false;
+    parameters->burst_bytes = 0;
+    parameters->cut_through_bytes = 0;
+    parameters->max_payload_size = DCP_PAYLOAD_MAXSIZE;
+    parameters->threaded = false;
+    CPU_ZERO(&parameters->fifo_cpus);
+    parameters->slave_ready_strategy = SPI_SLAVE_READY_FIXED_DELAY;
+    parameters->slave_ready_min_delay_us = 0;
+    parameters->slave_ready_busy_poll_us = 200;
+    parameters->extra_slaves_count = 0;
+
+#define CHECK_ARGUMENT() \
+    do \
+    { \
+        if(i + 1 >= argc) \
+        { \
+            fprintf(stderr, "Option %s requires an argument.\n", argv[i]); \
+            return -1; \
+        } \
+        ++i; \
+    } \
+    while(0)
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--help") == 0)
+            return 1;
+        else if(strcmp(argv[i], "--version") == 0)
+            return 2;
+        else if(strcmp(argv[i], "--fg") == 0)
+            parameters->run_in_foreground = true;
+        else if(strcmp(argv[i], "--verbose") == 0)
+        {
+            CHECK_ARGUMENT();
+            parameters->verbose_level = msg_verbose_level_name_to_level(argv[i]);
+
+            if(parameters->verbose_level == MESSAGE_LEVEL_IMPOSSIBLE)
+            {
+                fprintf(stderr,
+                        "Invalid verbosity \"%s\". "
+                        "Valid verbosity levels are:\n", argv[i]);
+
+                const char *const *names = msg_get_verbose_level_names();
+
+                for(const char *name = *names; name != NULL; name = *++names)
+                    fprintf(stderr, "    %s\n", name);
+
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "--quiet") == 0)
+            parameters->verbose_level = MESSAGE_LEVEL_QUIET;
+        else if(strcmp(argv[i], "--dump-traffic") == 0)
+            parameters->dump_spi_traffic = true;
         else if(strcmp(argv[i], "--stats") == 0)
             parameters->gather_statistics = true;
+        else if(strcmp(argv[i], "--sched") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            if(!rt_profile_policy_from_string(argv[i],
+                                              &parameters->rt_profile.sched_policy))
+            {
+                fprintf(stderr, "Invalid value \"%s\". Please try --help.\n", argv[i]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "--sched-priority") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            char *endptr;
+            unsigned long temp = strtoul(argv[i], &endptr, 10);
+
+            if(*endptr != '\0' || temp < 1 || temp > 99)
+            {
+                fprintf(stderr, "Invalid value \"%s\". Please try --help.\n", argv[i]);
+                return -1;
+            }
+
+            parameters->rt_profile.sched_priority = temp;
+        }
+        else if(strcmp(argv[i], "--cpus") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            if(!rt_profile_cpus_from_string(argv[i], &parameters->rt_profile.cpus))
+            {
+                fprintf(stderr, "Invalid value \"%s\". Please try --help.\n", argv[i]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "--mlock") == 0)
+            parameters->rt_profile.lock_memory = true;
         else if(strcmp(argv[i], "--ififo") == 0)
         {
             CHECK_ARGUMENT();
@@ -505,25 +1386,109 @@ static int process_command_line(int argc, char *argv[],
             CHECK_ARGUMENT();
             parameters->fifo_out_name = argv[i];
         }
-        else if(strcmp(argv[i], "--spidev") == 0)
+        else if(strcmp(argv[i], "--ipc") == 0)
         {
             CHECK_ARGUMENT();
-            parameters->spidev_name = argv[i];
+            parameters->ipc_socket_name = argv[i];
         }
-        else if(strcmp(argv[i], "--spiclk") == 0)
+        else if(strcmp(argv[i], "--socket") == 0)
+        {
+            CHECK_ARGUMENT();
+            parameters->seqpacket_socket_name = argv[i];
+        }
+        else if(strcmp(argv[i], "--threads") == 0)
+            parameters->threaded = true;
+        else if(strcmp(argv[i], "--fifo-cpus") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            if(!rt_profile_cpus_from_string(argv[i], &parameters->fifo_cpus))
+            {
+                fprintf(stderr, "Invalid value \"%s\". Please try --help.\n", argv[i]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "--trace-file") == 0)
+        {
+            CHECK_ARGUMENT();
+            parameters->trace_file_name = argv[i];
+        }
+        else if(strcmp(argv[i], "--capture-file") == 0)
+        {
+            CHECK_ARGUMENT();
+            parameters->capture_file_name = argv[i];
+        }
+        else if(strcmp(argv[i], "--capture-size") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            char *endptr;
+            unsigned long temp = strtoul(argv[i], &endptr, 10);
+
+            if(*endptr != '\0' || temp == 0 || temp > 4096)
+            {
+                fprintf(stderr, "Invalid value \"%s\". Please try --help.\n", argv[i]);
+                return -1;
+            }
+
+            parameters->capture_file_size = temp * 1024U * 1024U;
+        }
+        else if(strcmp(argv[i], "--stats-export") == 0)
+        {
+            CHECK_ARGUMENT();
+            parameters->stats_export_target = argv[i];
+        }
+        else if(strcmp(argv[i], "--stats-format") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            if(!stats_export_format_from_string(argv[i],
+                                                &parameters->stats_export_format))
+            {
+                fprintf(stderr, "Invalid value \"%s\". Please try --help.\n", argv[i]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "--stats-interval") == 0)
         {
             CHECK_ARGUMENT();
 
             char *endptr;
             unsigned long temp = strtoul(argv[i], &endptr, 10);
 
-            if(*endptr != '\0' || temp > UINT32_MAX || (temp == ULONG_MAX && errno == ERANGE))
+            if(*endptr != '\0' || temp > UINT_MAX || (temp == ULONG_MAX && errno == ERANGE))
             {
                 fprintf(stderr, "Invalid value \"%s\". Please try --help.\n", argv[i]);
                 return -1;
             }
 
-            parameters->spi_clock = temp;
+            parameters->stats_export_interval_ms = temp;
+        }
+        else if(strcmp(argv[i], "--spidev") == 0)
+        {
+            CHECK_ARGUMENT();
+            parameters->spidev_name = argv[i];
+        }
+        else if(strcmp(argv[i], "--spiclk") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            if(!parse_clock_hz(argv[i], &parameters->spi_clock))
+                return -1;
+        }
+        else if(strcmp(argv[i], "--spiclk-min") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            if(!parse_clock_hz(argv[i], &parameters->spi_clock_min))
+                return -1;
+        }
+        else if(strcmp(argv[i], "--spiclk-max") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            if(!parse_clock_hz(argv[i], &parameters->spi_clock_max))
+                return -1;
         }
         else if(strcmp(argv[i], "--gpio") == 0)
         {
@@ -540,8 +1505,124 @@ static int process_command_line(int argc, char *argv[],
 
             parameters->gpio_num = temp;
         }
+        else if(strcmp(argv[i], "--gpio-chip") == 0)
+        {
+            CHECK_ARGUMENT();
+            parameters->gpio_chip_name = argv[i];
+        }
+        else if(strcmp(argv[i], "--gpio-sysfs") == 0)
+            parameters->gpio_force_sysfs = true;
         else if(strcmp(argv[i], "--debounce") == 0)
             parameters->gpio_needs_debouncing = true;
+        else if(strcmp(argv[i], "--slave") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            if(parameters->extra_slaves_count >= SPI_MAX_SLAVES - 1)
+            {
+                fprintf(stderr, "Too many slaves, maximum is %u.\n", SPI_MAX_SLAVES);
+                return -1;
+            }
+
+            if(!parse_extra_slave(argv[i],
+                                  &parameters->extra_slaves[parameters->extra_slaves_count]))
+            {
+                fprintf(stderr, "Invalid value \"%s\". Please try --help.\n", argv[i]);
+                return -1;
+            }
+
+            ++parameters->extra_slaves_count;
+        }
+        else if(strcmp(argv[i], "--blocking-spi") == 0)
+            parameters->blocking_spi = true;
+        else if(strcmp(argv[i], "--slave-fast-path") == 0)
+            parameters->slave_fast_path = true;
+        else if(strcmp(argv[i], "--burst") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            char *endptr;
+            unsigned long temp = strtoul(argv[i], &endptr, 10);
+
+            if(*endptr != '\0' || temp > DCPSPI_BURST_MAX_SIZE)
+            {
+                fprintf(stderr, "Invalid value \"%s\". Please try --help.\n", argv[i]);
+                return -1;
+            }
+
+            parameters->burst_bytes = temp;
+        }
+        else if(strcmp(argv[i], "--cut-through") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            char *endptr;
+            unsigned long temp = strtoul(argv[i], &endptr, 10);
+
+            if(*endptr != '\0' || temp > DCP_PAYLOAD_MAXSIZE)
+            {
+                fprintf(stderr, "Invalid value \"%s\". Please try --help.\n", argv[i]);
+                return -1;
+            }
+
+            parameters->cut_through_bytes = temp;
+        }
+        else if(strcmp(argv[i], "--max-payload") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            char *endptr;
+            unsigned long temp = strtoul(argv[i], &endptr, 10);
+
+            if(*endptr != '\0' || temp > DCPSPI_MAX_PAYLOAD_SIZE)
+            {
+                fprintf(stderr, "Invalid value \"%s\". Please try --help.\n", argv[i]);
+                return -1;
+            }
+
+            parameters->max_payload_size = temp;
+        }
+        else if(strcmp(argv[i], "--ready-wait") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            if(!spi_slave_ready_strategy_from_string(argv[i],
+                                                     &parameters->slave_ready_strategy))
+            {
+                fprintf(stderr, "Invalid value \"%s\". Please try --help.\n", argv[i]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "--ready-min-delay") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            char *endptr;
+            unsigned long temp = strtoul(argv[i], &endptr, 10);
+
+            if(*endptr != '\0' || temp > UINT_MAX || (temp == ULONG_MAX && errno == ERANGE))
+            {
+                fprintf(stderr, "Invalid value \"%s\". Please try --help.\n", argv[i]);
+                return -1;
+            }
+
+            parameters->slave_ready_min_delay_us = temp;
+        }
+        else if(strcmp(argv[i], "--busy-poll") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            char *endptr;
+            unsigned long temp = strtoul(argv[i], &endptr, 10);
+
+            if(*endptr != '\0' || temp > UINT_MAX || (temp == ULONG_MAX && errno == ERANGE))
+            {
+                fprintf(stderr, "Invalid value \"%s\". Please try --help.\n", argv[i]);
+                return -1;
+            }
+
+            parameters->slave_ready_busy_poll_us = temp;
+        }
         else
         {
             fprintf(stderr, "Unknown option \"%s\". Please try --help.\n", argv[i]);
@@ -551,9 +1632,60 @@ static int process_command_line(int argc, char *argv[],
 
 #undef CHECK_ARGUMENT
 
+    if(parameters->ipc_socket_name != NULL &&
+       parameters->seqpacket_socket_name != NULL)
+    {
+        fprintf(stderr, "Options --ipc and --socket are mutually exclusive.\n");
+        return -1;
+    }
+
+    if(parameters->threaded &&
+       (parameters->ipc_socket_name != NULL ||
+        parameters->seqpacket_socket_name != NULL))
+    {
+        fprintf(stderr, "Option --threads requires named pipes.\n");
+        return -1;
+    }
+
     if(parameters->spidev_name[0] == '-' && parameters->spidev_name[1] == '\0')
         parameters->dummy_mode = true;
 
+    if(parameters->dummy_mode && parameters->extra_slaves_count > 0)
+    {
+        fprintf(stderr, "Option --slave cannot be used in dummy mode.\n");
+        return -1;
+    }
+
+    if(parameters->spi_clock_min > 0 && parameters->spi_clock_max == 0)
+    {
+        fprintf(stderr, "Option --spiclk-min requires --spiclk-max.\n");
+        return -1;
+    }
+
+    if(parameters->spi_clock_min > parameters->spi_clock_max)
+    {
+        fprintf(stderr, "SPI clock bounds are swapped. Please try --help.\n");
+        return -1;
+    }
+
+    if(parameters->cut_through_bytes > 0 &&
+       (parameters->ipc_socket_name != NULL ||
+        parameters->seqpacket_socket_name != NULL ||
+        parameters->threaded))
+    {
+        fprintf(stderr, "Option --cut-through requires named pipes and "
+                "cannot be used with --threads.\n");
+        return -1;
+    }
+
+    if(parameters->max_payload_size > DCP_PAYLOAD_MAXSIZE &&
+       parameters->cut_through_bytes == 0)
+    {
+        fprintf(stderr, "Option --max-payload above %u requires --cut-through.\n",
+                DCP_PAYLOAD_MAXSIZE);
+        return -1;
+    }
+
     return 0;
 }
 
@@ -581,10 +1713,11 @@ int main(int argc, char *argv[])
         return EXIT_SUCCESS;
     }
 
-    int fifo_in_fd, fifo_out_fd, spi_fd;
+    struct dcpd_channel dcpd;
+    int spi_fd;
     struct gpio_handle *gpio;
 
-    if(setup(&parameters, &fifo_in_fd, &fifo_out_fd, &spi_fd, &gpio) < 0)
+    if(setup(&parameters, &dcpd, &spi_fd, &gpio) < 0)
         return EXIT_FAILURE;
 
     static struct sigaction action =
@@ -597,18 +1730,31 @@ int main(int argc, char *argv[])
     sigaction(SIGINT, &action, NULL);
     sigaction(SIGTERM, &action, NULL);
 
-    main_loop(fifo_in_fd, fifo_out_fd, spi_fd, gpio);
+    if(dcpd.listen_fd >= 0)
+    {
+        /* DCPD going away must not kill us while writing to it */
+        static struct sigaction ignore = { .sa_handler = SIG_IGN };
+        sigemptyset(&ignore.sa_mask);
+        sigaction(SIGPIPE, &ignore, NULL);
+    }
+
+    static struct transaction_buffers buffers;
+    main_loop(&dcpd, spi_fd, gpio, &buffers, NULL);
 
     msg_info("Terminated, shutting down");
 
+    stop_extra_slaves();
+
     if(!parameters.dummy_mode)
         spi_close_device(spi_fd);
 
-    fifo_close_and_delete(&fifo_in_fd, parameters.fifo_in_name);
-    fifo_close_and_delete(&fifo_out_fd, parameters.fifo_out_name);
+    close_dcpd_channel(&parameters, &dcpd);
 
     if(!parameters.dummy_mode)
         gpio_close(gpio);
 
+    stats_export_stop();
+    capture_close();
+
     return EXIT_SUCCESS;
 }
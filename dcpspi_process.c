@@ -24,14 +24,20 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <errno.h>
+#include <string.h>
 
 #include "dcpspi_process.h"
 #include "dcpdefs.h"
 #include "spi.h"
 #include "named_pipe.h"
 #include "gpio.h"
+#include "ipc_ring.h"
+#include "trace.h"
+#include "capture.h"
 #include "messages.h"
+#include "log_level.h"
 #include "os.h"
+#include "os_writev.h"
 
 /*!
  * What has happened on the request pin since we've checked last.
@@ -58,58 +64,425 @@ enum RequestLineChanges
     REQUEST_LINE_ASSERTED_AND_DEASSERTED,
 };
 
-#define EVENT_FD_COUNT 2
+/*
+ * Request GPIO, DCPD FIFO, the optional GPIO debounce timer, the optional
+ * IPC peer socket, the IPC eventfd for free space or the output fd to DCPD
+ * while DCPD is not taking more data, and the optional stop eventfd
+ */
+#define EVENT_FD_COUNT 6
 
-static struct
+/*!
+ * Size of the read-ahead buffer for data from DCPD, must be a power of 2.
+ */
+#define DCPD_READ_AHEAD_SIZE 4096
+
+/*!
+ * Ring buffer for data read ahead from the DCPD named pipe.
+ *
+ * Data is read from the pipe in large chunks and packets are parsed out of
+ * this buffer, so that packets queued back to back by DCPD do not cost a
+ * read(2) each. Head and tail are free-running, so \c tail - \c head is the
+ * number of buffered bytes.
+ */
+struct read_ahead
 {
+    bool is_enabled;
+    size_t head;
+    size_t tail;
+    uint8_t buffer[DCPD_READ_AHEAD_SIZE];
+};
+
+/*!
+ * Maximum number of status messages queued for DCPD before flushing.
+ */
+#define DCPD_OUTPUT_MAX_MESSAGES 8
+
+/*!
+ * Poll timeout while waiting for the stream to DCPD to be restarted.
+ *
+ * There is no event for DCPD reopening its end of the stream, so the caller
+ * of #dcpspi_process() gets a chance to try again this often.
+ */
+#define DCPD_STREAM_RETRY_MS 100
+
+/*!
+ * Data waiting to be written to DCPD.
+ */
+struct output_queue
+{
+    uint8_t status_messages[DCPD_OUTPUT_MAX_MESSAGES][DCPSYNC_HEADER_SIZE];
+    size_t status_messages_count;
+
+    /* one more for a forwarded packet */
+    struct iovec iov[DCPD_OUTPUT_MAX_MESSAGES + 1];
+    size_t iov_first;
+    size_t iov_count;
+
+    /* forwarded packet, if any; there can be only one at a time */
+    const uint8_t *packet;
+    size_t packet_iov;
+
+    /* pipe, socket, or IPC ring full, wait for output fd to become writable
+     * or for #ipc_channel_get_space_poll_fd() */
+    bool is_waiting_for_space;
+};
+
+/*!
+ * Master packets sent to the slave after a single slave-ready handshake.
+ *
+ * The first packet is the one of the transaction in progress, sent straight
+ * from the DCP buffer in several fragments if it contains special characters.
+ * The others are complete packets found in the read-ahead buffer, one fragment
+ * each; they are escaped into the buffer here, but only taken out of the
+ * read-ahead buffer once they have been sent, so that a failed burst leaves
+ * them queued untouched.
+ */
+struct master_burst
+{
+    size_t max_bytes;
+    size_t count;
+    struct spi_packet packets[SPI_TRANSFER_BATCH_MAX_FRAGMENTS];
+    struct iovec iov[SPI_TRANSFER_BATCH_MAX_FRAGMENTS];
+    uint16_t serials[SPI_TRANSFER_BATCH_MAX_FRAGMENTS];
+
+    /* size of the packets after the first in the read-ahead buffer */
+    size_t dcpd_bytes;
+
+    uint8_t buffer[DCPSPI_BURST_MAX_SIZE];
+};
+
+/*!
+ * End-to-end latency measurement of a transaction.
+ */
+struct transaction_latency
+{
+    struct timespec started;
+    bool is_running;
+};
+
+/*!
+ * Everything we need to know about the connection of one slave to DCPD.
+ */
+struct dcpspi_context
+{
+    /* SPI state of the slave, \c NULL for slave 0 */
+    struct spi_context *spi;
+
     uint16_t next_dcpsync_serial;
     struct program_statistics statistics;
+    struct read_ahead dcpd_input;
+    struct output_queue dcpd_output;
+    struct ipc_channel *ipc;
+    bool is_message_mode;
+
+    /* SPI operation of a transaction in one of the WAITING states */
+    bool is_nonblocking_spi;
+    struct spi_operation spi_op;
+
+    /* see #dcpspi_slave_fast_path_enable() */
+    bool is_slave_fast_path;
+
+    /* request line asserted until packet written to DCPD */
+    struct transaction_latency slave_latency;
+
+    /* DCPD readable until ACK written to DCPD */
+    struct transaction_latency master_latency;
+    bool is_master_ack_queued;
+
+    struct master_burst burst;
+
+    /* see #dcpspi_cut_through_enable() */
+    size_t cut_through_chunk_size;
+    size_t max_payload_size;
+
+    /* see #dcpspi_dcpd_stream_reset_requested() */
+    bool is_dcpd_stream_broken;
+
+    /* see #dcpspi_set_stop_fd() */
+    int stop_fd;
+    bool is_stop_requested;
+};
+
+/*!
+ * Preallocated contexts, one per slave.
+ *
+ * Transaction trace and traffic capture only cover slave 0.
+ */
+static struct dcpspi_context dcpspi_contexts[SPI_MAX_SLAVES];
+
+/*!
+ * Context used by the calling thread, see #dcpspi_context_switch().
+ */
+static _Thread_local struct dcpspi_context *dcpspi_ctx = &dcpspi_contexts[0];
+
+static inline bool is_first_slave(void)
+{
+    return dcpspi_ctx == &dcpspi_contexts[0];
 }
-dcpspi_globals;
 
 #define STATISTICS_STRUCT(S) \
-    (dcpspi_globals.statistics.is_enabled ? &dcpspi_globals.statistics.S : NULL)
+    (dcpspi_ctx->statistics.is_enabled ? &dcpspi_ctx->statistics.S : NULL)
 
 static uint16_t mk_serial(void)
 {
-    if(dcpspi_globals.next_dcpsync_serial < DCPSYNC_SLAVE_SERIAL_MIN ||
-       dcpspi_globals.next_dcpsync_serial > DCPSYNC_SLAVE_SERIAL_MAX)
+    if(dcpspi_ctx->next_dcpsync_serial < DCPSYNC_SLAVE_SERIAL_MIN ||
+       dcpspi_ctx->next_dcpsync_serial > DCPSYNC_SLAVE_SERIAL_MAX)
     {
-        dcpspi_globals.next_dcpsync_serial = DCPSYNC_SLAVE_SERIAL_MIN;
+        dcpspi_ctx->next_dcpsync_serial = DCPSYNC_SLAVE_SERIAL_MIN;
     }
 
-    return dcpspi_globals.next_dcpsync_serial++;
+    return dcpspi_ctx->next_dcpsync_serial++;
+}
+
+struct dcpspi_context *dcpspi_context_init(unsigned int slave)
+{
+    if(slave >= SPI_MAX_SLAVES)
+    {
+        MSG_BUG("Invalid DCPSPI slave %u", slave);
+        return NULL;
+    }
+
+    struct dcpspi_context *const ctx = &dcpspi_contexts[slave];
+    ctx->spi = (slave > 0) ? spi_context_init(slave) : NULL;
+
+    struct dcpspi_context *const previous = dcpspi_context_switch(ctx);
+    dcpspi_init();
+
+    dcpspi_context_switch(previous);
+
+    return ctx;
+}
+
+struct dcpspi_context *dcpspi_context_switch(struct dcpspi_context *ctx)
+{
+    struct dcpspi_context *const previous = dcpspi_ctx;
+    dcpspi_ctx = (ctx != NULL) ? ctx : &dcpspi_contexts[0];
+    spi_context_switch(dcpspi_ctx->spi);
+    return previous;
 }
 
 void dcpspi_init(void)
 {
-    dcpspi_globals.next_dcpsync_serial = 0;
+    dcpspi_ctx->next_dcpsync_serial = 0;
+    dcpspi_ctx->dcpd_input.is_enabled = false;
+    dcpspi_ctx->dcpd_input.head = 0;
+    dcpspi_ctx->dcpd_input.tail = 0;
+    memset(&dcpspi_ctx->dcpd_output, 0, sizeof(dcpspi_ctx->dcpd_output));
+    dcpspi_ctx->ipc = NULL;
+    dcpspi_ctx->is_message_mode = false;
+    dcpspi_ctx->is_nonblocking_spi = false;
+    dcpspi_ctx->is_slave_fast_path = false;
+    memset(&dcpspi_ctx->spi_op, 0, sizeof(dcpspi_ctx->spi_op));
+    dcpspi_ctx->burst.max_bytes = 0;
+    dcpspi_ctx->burst.count = 0;
+    dcpspi_ctx->burst.dcpd_bytes = 0;
+    dcpspi_ctx->cut_through_chunk_size = 0;
+    dcpspi_ctx->max_payload_size = DCP_PAYLOAD_MAXSIZE;
+    dcpspi_ctx->is_dcpd_stream_broken = false;
+    dcpspi_ctx->stop_fd = -1;
+    dcpspi_ctx->is_stop_requested = false;
     dcpspi_statistics_reset();
 }
 
 void dcpspi_statistics_reset(void)
 {
-    stats_context_reset(&dcpspi_globals.statistics.busy_unspecific);
-    stats_context_reset(&dcpspi_globals.statistics.busy_gpio);
-    stats_context_reset(&dcpspi_globals.statistics.busy_transaction);
-    stats_context_reset(&dcpspi_globals.statistics.wait_for_events);
-    stats_io_reset(&dcpspi_globals.statistics.spi_transfers);
-    stats_io_reset(&dcpspi_globals.statistics.dcpd_reads);
-    stats_io_reset(&dcpspi_globals.statistics.dcpd_writes);
+    stats_context_reset(&dcpspi_ctx->statistics.busy_unspecific);
+    stats_context_reset(&dcpspi_ctx->statistics.busy_gpio);
+    stats_context_reset(&dcpspi_ctx->statistics.busy_transaction);
+    stats_context_reset(&dcpspi_ctx->statistics.wait_for_events);
+    stats_io_reset(&dcpspi_ctx->statistics.spi_transfers);
+    stats_io_reset(&dcpspi_ctx->statistics.dcpd_reads);
+    stats_io_reset(&dcpspi_ctx->statistics.dcpd_writes);
+    stats_wait_reset(&dcpspi_ctx->statistics.slave_ready);
+    stats_wait_reset(&dcpspi_ctx->statistics.debounce);
+    stats_histogram_reset(&dcpspi_ctx->statistics.slave_transactions);
+    stats_histogram_reset(&dcpspi_ctx->statistics.master_transactions);
+    stats_histogram_reset(&dcpspi_ctx->statistics.sched_delay);
+    memset(&dcpspi_ctx->statistics.spi_clock, 0,
+           sizeof(dcpspi_ctx->statistics.spi_clock));
+
+    if(dcpspi_ctx->statistics.is_enabled)
+        spi_set_clock_statistics(&dcpspi_ctx->statistics.spi_clock);
+    dcpspi_ctx->slave_latency.is_running = false;
+    dcpspi_ctx->master_latency.is_running = false;
+    dcpspi_ctx->is_master_ack_queued = false;
 }
 
 const struct program_statistics *dcpspi_statistics_get(void)
 {
-    return &dcpspi_globals.statistics;
+    return &dcpspi_ctx->statistics;
 }
 
 bool dcpspi_statistics_enable(bool enable)
 {
-    const bool result = dcpspi_globals.statistics.is_enabled;
-    dcpspi_globals.statistics.is_enabled = enable;
+    const bool result = dcpspi_ctx->statistics.is_enabled;
+    dcpspi_ctx->statistics.is_enabled = enable;
+    spi_set_sched_delay_histogram(enable
+                                  ? &dcpspi_ctx->statistics.sched_delay
+                                  : NULL);
+    spi_set_clock_statistics(enable ? &dcpspi_ctx->statistics.spi_clock : NULL);
+    return result;
+}
+
+bool dcpspi_read_ahead_enable(bool enable)
+{
+    struct read_ahead *const ra = &dcpspi_ctx->dcpd_input;
+    const bool result = ra->is_enabled;
+
+    if(enable == result)
+        return result;
+
+    if(!enable && ra->tail != ra->head)
+        MSG_BUG("Disabling read-ahead with %zu bytes buffered", ra->tail - ra->head);
+
+    ra->is_enabled = enable;
+    ra->head = 0;
+    ra->tail = 0;
+
+    return result;
+}
+
+bool dcpspi_nonblocking_spi_enable(bool enable)
+{
+    const bool result = dcpspi_ctx->is_nonblocking_spi;
+    dcpspi_ctx->is_nonblocking_spi = enable;
+    return result;
+}
+
+bool dcpspi_slave_fast_path_enable(bool enable)
+{
+    const bool result = dcpspi_ctx->is_slave_fast_path;
+    dcpspi_ctx->is_slave_fast_path = enable;
+    return result;
+}
+
+size_t dcpspi_burst_enable(size_t max_bytes)
+{
+    const size_t result = dcpspi_ctx->burst.max_bytes;
+
+    if(max_bytes > DCPSPI_BURST_MAX_SIZE)
+    {
+        MSG_BUG("Burst size %zu exceeds maximum of %u bytes",
+                max_bytes, DCPSPI_BURST_MAX_SIZE);
+        max_bytes = DCPSPI_BURST_MAX_SIZE;
+    }
+
+    dcpspi_ctx->burst.max_bytes = max_bytes;
+
+    return result;
+}
+
+size_t dcpspi_cut_through_enable(size_t chunk_size)
+{
+    const size_t result = dcpspi_ctx->cut_through_chunk_size;
+
+    if(chunk_size > DCP_PAYLOAD_MAXSIZE)
+    {
+        MSG_BUG("Cut-through chunk size %zu exceeds maximum of %u bytes",
+                chunk_size, DCP_PAYLOAD_MAXSIZE);
+        chunk_size = DCP_PAYLOAD_MAXSIZE;
+    }
+
+    dcpspi_ctx->cut_through_chunk_size = chunk_size;
+
+    return result;
+}
+
+size_t dcpspi_set_max_payload_size(size_t max_size)
+{
+    const size_t result = dcpspi_ctx->max_payload_size;
+
+    if(max_size > DCPSPI_MAX_PAYLOAD_SIZE)
+    {
+        MSG_BUG("Payload size %zu exceeds maximum of %u bytes",
+                max_size, DCPSPI_MAX_PAYLOAD_SIZE);
+        max_size = DCPSPI_MAX_PAYLOAD_SIZE;
+    }
+
+    dcpspi_ctx->max_payload_size = max_size;
+
     return result;
 }
 
+static void latency_begin(struct transaction_latency *lat)
+{
+    if(!dcpspi_ctx->statistics.is_enabled)
+        return;
+
+    lat->is_running =
+        os_clock_gettime(CLOCK_MONOTONIC, &lat->started) == 0;
+}
+
+static void latency_end(struct transaction_latency *lat,
+                        struct stats_histogram *h)
+{
+    if(!lat->is_running)
+        return;
+
+    lat->is_running = false;
+    stats_histogram_add_elapsed(h, &lat->started);
+}
+
+void dcpspi_set_ipc_channel(struct ipc_channel *channel)
+{
+    dcpspi_ctx->ipc = channel;
+}
+
+void dcpspi_set_message_mode(bool enable)
+{
+    dcpspi_ctx->is_message_mode = enable;
+}
+
+void dcpspi_set_stop_fd(int fd)
+{
+    dcpspi_ctx->stop_fd = fd;
+    dcpspi_ctx->is_stop_requested = false;
+}
+
+static size_t read_ahead_buffered(const struct read_ahead *ra)
+{
+    return ra->tail - ra->head;
+}
+
+static size_t take_from_read_ahead(struct read_ahead *ra,
+                                   uint8_t *dest, size_t count)
+{
+    const size_t available = read_ahead_buffered(ra);
+
+    if(count > available)
+        count = available;
+
+    const size_t offset = ra->head & (DCPD_READ_AHEAD_SIZE - 1);
+    const size_t first = (count < DCPD_READ_AHEAD_SIZE - offset)
+        ? count
+        : DCPD_READ_AHEAD_SIZE - offset;
+
+    memcpy(dest, ra->buffer + offset, first);
+    memcpy(dest + first, ra->buffer, count - first);
+
+    ra->head += count;
+
+    return count;
+}
+
+/*!
+ * Copy data from read-ahead buffer without taking it out.
+ *
+ * \param pos
+ *     Free-running position of the first byte, at least \c ra->head.
+ */
+static void peek_read_ahead(const struct read_ahead *ra, size_t pos,
+                            uint8_t *dest, size_t count)
+{
+    const size_t offset = pos & (DCPD_READ_AHEAD_SIZE - 1);
+    const size_t first = (count < DCPD_READ_AHEAD_SIZE - offset)
+        ? count
+        : DCPD_READ_AHEAD_SIZE - offset;
+
+    memcpy(dest, ra->buffer + offset, first);
+    memcpy(dest + first, ra->buffer, count - first);
+}
+
 /*!
  * Whether or not the DCP process is allowed to send any data.
  */
@@ -138,29 +511,23 @@ static bool is_buffer_full(const struct buffer *buffer)
     return buffer->pos >= buffer->size;
 }
 
-static int fill_buffer_from_fd(struct buffer *buffer, size_t count, int fd,
-                               struct stats_io *io)
+static ssize_t read_from_fd(uint8_t *dest, size_t count, int fd,
+                            struct stats_io *io)
 {
-    if(count == 0)
-        return 0;
-
     struct stats_context *prev_ctx = stats_io_begin(io);
 
-    ssize_t len = os_read(fd, buffer->buffer + buffer->pos, count);
+    ssize_t len = dcpspi_ctx->ipc != NULL
+        ? ipc_channel_read(dcpspi_ctx->ipc, dest, count)
+        : os_read(fd, dest, count);
 
     stats_io_end(io, prev_ctx, len <= 0 ? 1 : 0, len >= 0 ? len : 0);
 
-    if(len > 0)
-    {
-        count -= len;
-        buffer->pos += len;
-    }
-    else if(len == 0)
+    if(len == 0)
     {
         msg_error(errno, LOG_NOTICE,
                   "Premature end of input on named pipe %d", fd);
     }
-    else if(errno != EINTR && errno != EAGAIN)
+    else if(len < 0 && errno != EINTR && errno != EAGAIN)
     {
         msg_error(errno, LOG_EMERG,
                   "Failed reading %zu bytes from fd %d", count, fd);
@@ -170,25 +537,92 @@ static int fill_buffer_from_fd(struct buffer *buffer, size_t count, int fd,
     return len;
 }
 
-static ssize_t send_buffer_to_fd(struct buffer *buffer,
-                                 size_t offset, size_t count, int fd,
-                                 struct stats_io *io)
+/*!
+ * Read as much as fits into the contiguous free space of the ring.
+ */
+static ssize_t fill_read_ahead(struct read_ahead *ra, int fd,
+                               struct stats_io *io)
+{
+    /* an empty ring is rewound so that a whole message fits in one go */
+    if(read_ahead_buffered(ra) == 0)
+    {
+        ra->head = 0;
+        ra->tail = 0;
+    }
+
+    const size_t offset = ra->tail & (DCPD_READ_AHEAD_SIZE - 1);
+    const size_t space = DCPD_READ_AHEAD_SIZE - read_ahead_buffered(ra);
+    const size_t count = (space < DCPD_READ_AHEAD_SIZE - offset)
+        ? space
+        : DCPD_READ_AHEAD_SIZE - offset;
+
+    const ssize_t len = read_from_fd(ra->buffer + offset, count, fd, io);
+
+    if(len > 0)
+        ra->tail += len;
+
+    return len;
+}
+
+static int fill_buffer_from_fd(struct buffer *buffer, size_t count, int fd,
+                               struct stats_io *io)
 {
-    errno = 0;
+    if(count == 0)
+        return 0;
 
-    struct stats_context *prev_ctx = stats_io_begin(io);
+    struct read_ahead *const ra = &dcpspi_ctx->dcpd_input;
 
-    ssize_t len = os_write(fd, buffer->buffer + offset, count);
+    if(!ra->is_enabled)
+    {
+        const ssize_t len =
+            read_from_fd(buffer->buffer + buffer->pos, count, fd, io);
 
-    stats_io_end(io, prev_ctx, len <= 0 ? 1 : 0, len >= 0 ? len : 0);
+        if(len > 0)
+            buffer->pos += len;
 
-    if(len > 0)
         return len;
+    }
+
+    size_t done = take_from_read_ahead(ra, buffer->buffer + buffer->pos, count);
+
+    if(done < count)
+    {
+        /* buffer is empty now, so there is plenty of space */
+        const ssize_t len = fill_read_ahead(ra, fd, io);
+
+        if(len < 0 && done == 0)
+            return len;
 
-    msg_error(errno, LOG_EMERG,
-              "Failed writing %zu bytes to fd %d (write() returned %zd)",
-              count, fd, len);
-    return len < 0 ? -1 : 0;
+        done += take_from_read_ahead(ra, buffer->buffer + buffer->pos + done,
+                                     count - done);
+    }
+
+    buffer->pos += done;
+
+    return done;
+}
+
+/*!
+ * Queue up status messages and forwarded packets for DCPD.
+ *
+ * Status messages are stored in the queue itself, forwarded packets are
+ * referenced where they are (the DCP buffer of the transaction). Everything
+ * is written by a single writev(2) on flush, and partially written data
+ * remains queued for the next flush. The output fd should be non-blocking so
+ * that a slow DCPD does not hold up the SPI side.
+ */
+static ssize_t flush_output_queue(int fd);
+
+static void begin_slave_transaction(struct dcp_transaction *transaction,
+                                    bool is_chained)
+{
+    transaction->state = TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE;
+    latency_begin(&dcpspi_ctx->slave_latency);
+
+    if(is_chained)
+        spi_chain_transaction();
+    else
+        spi_new_transaction();
 }
 
 bool reset_transaction_struct(struct dcp_transaction *transaction,
@@ -200,6 +634,7 @@ bool reset_transaction_struct(struct dcp_transaction *transaction,
     transaction->serial = 0;
     transaction->pending_size_of_transaction = 0;
     transaction->flush_to_dcpd_buffer_pos = 0;
+    transaction->cut_through = CUT_THROUGH_OFF;
 
     clear_buffer(&transaction->spi_buffer);
 
@@ -213,6 +648,9 @@ bool reset_transaction_struct(struct dcp_transaction *transaction,
     {
       case REQSTATE_IDLE:
       case REQSTATE_RELEASED:
+        /* bytes left in the SPI input buffer are kept for the next slave
+         * request, but the request line has the final word on whether or not
+         * there is another packet */
         transaction->request_state = REQSTATE_IDLE;
         break;
 
@@ -221,8 +659,13 @@ bool reset_transaction_struct(struct dcp_transaction *transaction,
         return true;
 
       case REQSTATE_NEXT_PENDING:
-        msg_vinfo(MESSAGE_LEVEL_DIAG, "Processing pending slave transaction");
+        MSG_VINFO(MESSAGE_LEVEL_DIAG, "Processing pending slave transaction");
         transaction->request_state = REQSTATE_LOCKED;
+
+        /* the request line has been seen already, no need to wait for it */
+        if(dcpspi_ctx->is_slave_fast_path)
+            begin_slave_transaction(transaction, true);
+
         return true;
 
       case REQSTATE_MISSED:
@@ -233,9 +676,18 @@ bool reset_transaction_struct(struct dcp_transaction *transaction,
     return false;
 }
 
+static inline void trace_transaction(const struct dcp_transaction *transaction,
+                                     enum TraceEventType type, uint8_t arg)
+{
+    if(is_first_slave())
+        trace_record(type, transaction->state, transaction->request_state,
+                     transaction->serial, transaction->ttl, arg);
+}
+
 static void reuse_transaction_for_collision(struct dcp_transaction *transaction)
 {
     transaction->state = TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE;
+    latency_begin(&dcpspi_ctx->slave_latency);
 
     transaction->serial = 0;
     transaction->spi_buffer.pos = 0;
@@ -251,15 +703,17 @@ static bool reset_transaction(struct dcp_transaction *transaction)
       case TR_MASTER_COMMAND_FORWARDING_TO_SLAVE:
       case TR_MASTER_COMMAND_SKIPPING_DATA_FROM_DCPD:
       case TR_MASTER_COMMAND_SKIPPED:
+      case TR_MASTER_COMMAND_WAITING_FOR_SLAVE:
         break;
 
       case TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE:
       case TR_SLAVE_COMMAND_RECEIVING_DATA_FROM_SLAVE:
       case TR_SLAVE_COMMAND_FORWARDING_TO_DCPD:
       case TR_SLAVE_COMMAND_WAIT_FOR_REQUEST_DEASSERT:
+      case TR_SLAVE_COMMAND_WAITING_FOR_SLAVE_DATA:
         if(transaction->request_state == REQSTATE_LOCKED)
         {
-            msg_vinfo(MESSAGE_LEVEL_DEBUG,
+            MSG_VINFO(MESSAGE_LEVEL_DEBUG,
                       "About to end transaction 0x%04x in state %d, "
                       "waiting for slave to release request line",
                       transaction->serial, transaction->state);
@@ -276,7 +730,7 @@ static bool reset_transaction(struct dcp_transaction *transaction)
                     ? "looking for missed transactions"
                     : "return to idle state"));
 
-            msg_vinfo(MESSAGE_LEVEL_DEBUG,
+            MSG_VINFO(MESSAGE_LEVEL_DEBUG,
                       "End of transaction 0x%04x in state %d, %s",
                       transaction->serial, transaction->state, what_next);
         }
@@ -311,6 +765,10 @@ static size_t compute_read_size(const struct dcp_transaction *transaction)
     if(read_size > transaction->pending_size_of_transaction)
         read_size = transaction->pending_size_of_transaction;
 
+    if(transaction->cut_through != CUT_THROUGH_OFF &&
+       read_size > dcpspi_ctx->cut_through_chunk_size)
+        read_size = dcpspi_ctx->cut_through_chunk_size;
+
     return read_size;
 }
 
@@ -335,32 +793,195 @@ static void fill_dcpsync_header_for_slave(uint8_t *dcpsync_header,
     fill_dcpsync_header_generic(dcpsync_header, 'c', 0, serial, dcp_packet_size);
 }
 
-static void send_packet_accepted_message(struct buffer *buffer,
-                                         uint16_t serial, int fd)
+static void clear_output_queue(struct output_queue *q)
+{
+    q->status_messages_count = 0;
+    q->iov_first = 0;
+    q->iov_count = 0;
+    q->packet = NULL;
+    q->is_waiting_for_space = false;
+}
+
+static size_t output_queue_pending_bytes(const struct output_queue *q)
+{
+    size_t result = 0;
+
+    for(size_t i = q->iov_first; i < q->iov_count; ++i)
+        result += q->iov[i].iov_len;
+
+    return result;
+}
+
+static void queue_status_message(uint8_t command, uint8_t ttl, uint16_t serial,
+                                 int fd)
+{
+    struct output_queue *const q = &dcpspi_ctx->dcpd_output;
+
+    if(q->status_messages_count >= DCPD_OUTPUT_MAX_MESSAGES)
+        flush_output_queue(fd);
+
+    if(q->status_messages_count >= DCPD_OUTPUT_MAX_MESSAGES)
+    {
+        msg_error(0, LOG_ERR,
+                  "Output queue full, lost status message for 0x%04x", serial);
+        return;
+    }
+
+    uint8_t *const msg = q->status_messages[q->status_messages_count++];
+
+    fill_dcpsync_header_generic(msg, command, ttl, serial, 0);
+
+    q->iov[q->iov_count].iov_base = msg;
+    q->iov[q->iov_count].iov_len = DCPSYNC_HEADER_SIZE;
+    ++q->iov_count;
+}
+
+/*!
+ * Queue DCPSYNC packet for DCPD.
+ *
+ * The packet is not copied, so the buffer must remain untouched until
+ * #output_queue_packet_bytes_written() tells that it has been written.
+ */
+static void queue_packet(const uint8_t *packet, size_t size)
+{
+    struct output_queue *const q = &dcpspi_ctx->dcpd_output;
+
+    if(q->packet != NULL)
+    {
+        MSG_BUG("Queued DCPD packet while another one is pending");
+        return;
+    }
+
+    q->packet = packet;
+    q->packet_iov = q->iov_count;
+    q->iov[q->iov_count].iov_base = (void *)packet;
+    q->iov[q->iov_count].iov_len = size;
+    ++q->iov_count;
+}
+
+/*!
+ * How much of the queued packet has been written, if any.
+ *
+ * \returns
+ *     Number of bytes written, \p size if the packet has been written
+ *     completely (or there is none).
+ */
+static size_t output_queue_packet_bytes_written(size_t size)
+{
+    const struct output_queue *const q = &dcpspi_ctx->dcpd_output;
+
+    if(q->packet == NULL)
+        return size;
+
+    if(q->packet_iov > q->iov_first)
+        return 0;
+
+    return size - q->iov[q->packet_iov].iov_len;
+}
+
+static ssize_t flush_output_queue(int fd)
+{
+    struct output_queue *const q = &dcpspi_ctx->dcpd_output;
+    struct stats_io *const io = STATISTICS_STRUCT(dcpd_writes);
+    size_t written = 0;
+
+    /* anything we write now would be taken for the rest of the broken
+     * packet, so keep it for the restarted stream */
+    if(dcpspi_ctx->is_dcpd_stream_broken)
+        return 0;
+
+    while(q->iov_first < q->iov_count)
+    {
+        errno = 0;
+
+        /* each vector is a complete message, and goes out as one */
+        const int iovcnt = dcpspi_ctx->is_message_mode
+            ? 1
+            : q->iov_count - q->iov_first;
+
+        struct stats_context *prev_ctx = stats_io_begin(io);
+
+        ssize_t len = dcpspi_ctx->ipc != NULL
+            ? ipc_channel_writev(dcpspi_ctx->ipc, q->iov + q->iov_first,
+                                 iovcnt)
+            : os_writev(fd, q->iov + q->iov_first, iovcnt);
+
+        stats_io_end(io, prev_ctx, len <= 0 ? 1 : 0, len >= 0 ? len : 0);
+
+        if(len < 0 && errno == EINTR)
+            continue;
+
+        if(len <= 0)
+        {
+            if(len < 0 && errno == EAGAIN)
+            {
+                /* the rest goes out once there is space, see
+                 * #wait_for_events() */
+                q->is_waiting_for_space = true;
+                break;
+            }
+
+            msg_error(errno, LOG_EMERG,
+                      "Failed writing %zu bytes to fd %d (writev() returned %zd)",
+                      output_queue_pending_bytes(q), fd, len);
+
+            if(len < 0)
+            {
+                clear_output_queue(q);
+                return -1;
+            }
+
+            break;
+        }
+
+        written += len;
+        q->is_waiting_for_space = false;
+
+        /* skip over what has been written, keep the rest */
+        for(size_t remaining = len; remaining > 0; /* nothing */)
+        {
+            struct iovec *const iov = &q->iov[q->iov_first];
+
+            if(remaining < iov->iov_len)
+            {
+                iov->iov_base = (uint8_t *)iov->iov_base + remaining;
+                iov->iov_len -= remaining;
+                break;
+            }
+
+            remaining -= iov->iov_len;
+            ++q->iov_first;
+        }
+
+        if(q->packet != NULL && q->packet_iov < q->iov_first)
+            q->packet = NULL;
+    }
+
+    if(q->iov_first >= q->iov_count)
+        clear_output_queue(q);
+
+    return written;
+}
+
+static void send_packet_accepted_message(uint16_t serial, int fd)
 {
-    msg_vinfo(MESSAGE_LEVEL_TRACE, "ACK 0x%04x", serial);
-    fill_dcpsync_header_generic(buffer->buffer, 'a', 0, serial, 0);
-    send_buffer_to_fd(buffer, 0, DCPSYNC_HEADER_SIZE, fd,
-                      STATISTICS_STRUCT(dcpd_writes));
+    MSG_VINFO(MESSAGE_LEVEL_TRACE, "ACK 0x%04x", serial);
+    queue_status_message('a', 0, serial, fd);
 }
 
-static void send_packet_rejected_message(struct buffer *buffer,
-                                         uint16_t serial, uint8_t ttl, int fd)
+static void send_packet_rejected_message(uint16_t serial, uint8_t ttl, int fd)
 {
     if(ttl > 0)
-        msg_vinfo(MESSAGE_LEVEL_TRACE, "NACK 0x%04x", serial);
+        MSG_VINFO(MESSAGE_LEVEL_TRACE, "NACK 0x%04x", serial);
     else
-        msg_vinfo(MESSAGE_LEVEL_TRACE, "DROP 0x%04x", serial);
+        MSG_VINFO(MESSAGE_LEVEL_TRACE, "DROP 0x%04x", serial);
 
-    fill_dcpsync_header_generic(buffer->buffer, 'n', ttl, serial, 0);
-    send_buffer_to_fd(buffer, 0, DCPSYNC_HEADER_SIZE, fd,
-                      STATISTICS_STRUCT(dcpd_writes));
+    queue_status_message('n', ttl, serial, fd);
 }
 
-static void send_packet_dropped_message(struct buffer *buffer,
-                                        uint16_t serial, int fd)
+static void send_packet_dropped_message(uint16_t serial, int fd)
 {
-    send_packet_rejected_message(buffer, serial, 0, fd);
+    send_packet_rejected_message(serial, 0, fd);
 }
 
 static inline uint8_t get_dcpsync_command(const uint8_t *dcpsync_header)
@@ -395,38 +1016,67 @@ static const char *tr_log_prefix(enum transaction_state state)
       case TR_MASTER_COMMAND_FORWARDING_TO_SLAVE:
       case TR_MASTER_COMMAND_SKIPPING_DATA_FROM_DCPD:
       case TR_MASTER_COMMAND_SKIPPED:
+      case TR_MASTER_COMMAND_WAITING_FOR_SLAVE:
         return "Master transaction";
 
       case TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE:
       case TR_SLAVE_COMMAND_RECEIVING_DATA_FROM_SLAVE:
       case TR_SLAVE_COMMAND_FORWARDING_TO_DCPD:
       case TR_SLAVE_COMMAND_WAIT_FOR_REQUEST_DEASSERT:
+      case TR_SLAVE_COMMAND_WAITING_FOR_SLAVE_DATA:
         return "Slave transaction";
     }
 
     return "INVALID transaction";
 }
 
-static bool process_transaction_receive_data(struct dcp_transaction *transaction,
-                                             struct slave_request_and_lock_data *rldata,
-                                             int fifo_in_fd, int spi_fd)
+/*!
+ * Continue reading from slave, enter or leave the waiting state.
+ *
+ * Whether a DCP header or payload is being read is told by the pending size
+ * of the transaction, which is only known after the header has been read.
+ */
+static ssize_t continue_reading_from_slave(struct dcp_transaction *transaction,
+                                           int spi_fd)
+{
+    const ssize_t bytes_read =
+        spi_read_continue(spi_fd, &dcpspi_ctx->spi_op,
+                          STATISTICS_STRUCT(spi_transfers));
+
+    if(bytes_read == SPI_READ_PENDING)
+        transaction->state = TR_SLAVE_COMMAND_WAITING_FOR_SLAVE_DATA;
+    else if(transaction->pending_size_of_transaction > 0)
+        transaction->state = TR_SLAVE_COMMAND_RECEIVING_DATA_FROM_SLAVE;
+    else
+        transaction->state = TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE;
+
+    return bytes_read;
+}
+
+static bool process_received_data(struct dcp_transaction *transaction,
+                                  ssize_t bytes_read)
 {
     const char *read_peer =
         (transaction->state == TR_SLAVE_COMMAND_RECEIVING_DATA_FROM_SLAVE) ? "slave" : "DCPD";
 
-    const size_t read_size = compute_read_size(transaction);
-    const int bytes_read =
-        (transaction->state == TR_SLAVE_COMMAND_RECEIVING_DATA_FROM_SLAVE)
-        ? spi_read_buffer(spi_fd,
-                          transaction->dcp_buffer.buffer + transaction->dcp_buffer.pos,
-                          read_size, STATISTICS_STRUCT(spi_transfers))
-        : fill_buffer_from_fd(&transaction->dcp_buffer, read_size, fifo_in_fd,
-                              STATISTICS_STRUCT(dcpd_reads));
-
     if(bytes_read < 0)
     {
         msg_error(0, LOG_ERR, "%s: communication with %s broken",
                   tr_log_prefix(transaction->state), read_peer);
+
+        if(transaction->cut_through == CUT_THROUGH_STREAMING)
+        {
+            /* DCPD has seen part of the packet already and would take
+             * whatever comes next for the rest of it */
+            msg_error(0, LOG_ERR,
+                      "%s: packet 0x%04x incomplete, %u bytes missing, "
+                      "stream to DCPD must be restarted",
+                      tr_log_prefix(transaction->state), transaction->serial,
+                      transaction->pending_size_of_transaction);
+            dcpspi_ctx->is_dcpd_stream_broken = true;
+            clear_output_queue(&dcpspi_ctx->dcpd_output);
+        }
+
         return reset_transaction(transaction);
     }
 
@@ -436,7 +1086,8 @@ static bool process_transaction_receive_data(struct dcp_transaction *transaction
     transaction->pending_size_of_transaction -= (size_t)bytes_read;
 
     if(transaction->pending_size_of_transaction == 0 ||
-       is_buffer_full(&transaction->dcp_buffer))
+       is_buffer_full(&transaction->dcp_buffer) ||
+       (transaction->cut_through != CUT_THROUGH_OFF && bytes_read > 0))
     {
         transaction->flush_to_dcpd_buffer_pos = 0;
         if(transaction->state == TR_MASTER_COMMAND_RECEIVING_DATA_FROM_DCPD)
@@ -454,6 +1105,34 @@ static bool process_transaction_receive_data(struct dcp_transaction *transaction
     return false;
 }
 
+static bool process_transaction_receive_data(struct dcp_transaction *transaction,
+                                             struct slave_request_and_lock_data *rldata,
+                                             int fifo_in_fd, int spi_fd)
+{
+    const size_t read_size = compute_read_size(transaction);
+    uint8_t *const dest =
+        transaction->dcp_buffer.buffer + transaction->dcp_buffer.pos;
+    ssize_t bytes_read;
+
+    if(transaction->state != TR_SLAVE_COMMAND_RECEIVING_DATA_FROM_SLAVE)
+        bytes_read = fill_buffer_from_fd(&transaction->dcp_buffer, read_size,
+                                         fifo_in_fd,
+                                         STATISTICS_STRUCT(dcpd_reads));
+    else if(!dcpspi_ctx->is_nonblocking_spi)
+        bytes_read = spi_read_payload(spi_fd, dest, read_size,
+                                      STATISTICS_STRUCT(spi_transfers));
+    else
+    {
+        spi_read_begin(&dcpspi_ctx->spi_op, dest, read_size, true);
+        bytes_read = continue_reading_from_slave(transaction, spi_fd);
+
+        if(bytes_read == SPI_READ_PENDING)
+            return false;
+    }
+
+    return process_received_data(transaction, bytes_read);
+}
+
 static void reject_or_drop(struct dcp_transaction *transaction,
                            int fifo_out_fd)
 {
@@ -461,20 +1140,320 @@ static void reject_or_drop(struct dcp_transaction *transaction,
     {
         --transaction->ttl;
 
-        send_packet_rejected_message(&transaction->dcp_buffer,
-                                     transaction->serial, transaction->ttl,
+        send_packet_rejected_message(transaction->serial, transaction->ttl,
                                      fifo_out_fd);
     }
-    else
-        msg_vinfo(MESSAGE_LEVEL_DIAG,
-                  "Silently dropping 0x%04x", transaction->serial);
+    else
+        MSG_VINFO(MESSAGE_LEVEL_DIAG,
+                  "Silently dropping 0x%04x", transaction->serial);
+}
+
+/*!
+ * Escape master packet of the transaction for sending it to the slave.
+ *
+ * Nothing is copied unless the packet contains too many special characters to
+ * be described by the fragments available, in which case it is escaped into
+ * the SPI buffer.
+ *
+ * \returns
+ *     Number of fragments used in \c dcpspi_ctx->burst.iov, or 0 if the
+ *     escaped packet does not fit into the SPI buffer.
+ */
+static size_t escape_master_packet(struct dcp_transaction *transaction)
+{
+    struct master_burst *const burst = &dcpspi_ctx->burst;
+    const uint8_t *const raw_data =
+        transaction->dcp_buffer.buffer + DCPSYNC_HEADER_SIZE;
+    const size_t raw_size =
+        transaction->dcp_buffer.pos - DCPSYNC_HEADER_SIZE;
+
+    const size_t count =
+        spi_escape_to_fragments(burst->iov,
+                                sizeof(burst->iov) / sizeof(burst->iov[0]),
+                                raw_data, raw_size);
+
+    if(count > 0)
+        return count;
+
+    const size_t escaped_size = spi_escaped_length(raw_data, raw_size);
+
+    if(escaped_size > transaction->spi_buffer.size)
+    {
+        MSG_BUG("%s: escaped packet size %zu exceeds SPI buffer size %zu",
+                tr_log_prefix(transaction->state),
+                escaped_size, transaction->spi_buffer.size);
+        return 0;
+    }
+
+    transaction->spi_buffer.pos =
+        spi_fill_buffer_from_raw_data(transaction->spi_buffer.buffer,
+                                      transaction->spi_buffer.size,
+                                      raw_data, raw_size);
+
+    burst->iov[0].iov_base = transaction->spi_buffer.buffer;
+    burst->iov[0].iov_len = transaction->spi_buffer.pos;
+
+    return 1;
+}
+
+/*!
+ * Collect master packets to be sent along with the one of the transaction.
+ *
+ * Only complete, regular master packets from the read-ahead buffer are taken,
+ * and collecting stops at the first packet that does not qualify so that the
+ * order of packets is retained.
+ *
+ * \param transaction
+ *     The transaction whose packet has been escaped by
+ *     #escape_master_packet().
+ *
+ * \param fragments
+ *     Number of fragments of the packet of the transaction.
+ *
+ * \returns
+ *     Number of packets in the burst, including the one of the transaction.
+ */
+static size_t prepare_burst(const struct dcp_transaction *transaction,
+                            size_t fragments)
+{
+    struct master_burst *const burst = &dcpspi_ctx->burst;
+    const struct read_ahead *const ra = &dcpspi_ctx->dcpd_input;
+
+    burst->packets[0].fragments = burst->iov;
+    burst->packets[0].count = fragments;
+    burst->serials[0] = transaction->serial;
+    burst->count = 1;
+    burst->dcpd_bytes = 0;
+
+    if(burst->max_bytes == 0 || !ra->is_enabled)
+        return burst->count;
+
+    size_t total_bytes = 0;
+    size_t buffer_pos = 0;
+
+    for(size_t i = 0; i < fragments; ++i)
+        total_bytes += burst->iov[i].iov_len;
+
+    while(fragments < SPI_TRANSFER_BATCH_MAX_FRAGMENTS)
+    {
+        const size_t pos = ra->head + burst->dcpd_bytes;
+        const size_t available = ra->tail - pos;
+        uint8_t dcpsync_header[DCPSYNC_HEADER_SIZE];
+        uint8_t raw_data[DCP_HEADER_SIZE + DCP_PAYLOAD_MAXSIZE];
+
+        if(available < DCPSYNC_HEADER_SIZE + DCP_HEADER_SIZE)
+            break;
+
+        peek_read_ahead(ra, pos, dcpsync_header, sizeof(dcpsync_header));
+
+        const size_t raw_size = get_dcpsync_data_size(dcpsync_header);
+
+        if(get_dcpsync_command(dcpsync_header) != 'c' ||
+           raw_size < DCP_HEADER_SIZE || raw_size > sizeof(raw_data) ||
+           available < DCPSYNC_HEADER_SIZE + raw_size)
+            break;
+
+        peek_read_ahead(ra, pos + DCPSYNC_HEADER_SIZE, raw_data, raw_size);
+
+        /* dummy packets are answered without talking to the slave */
+        if(raw_data[0] == UINT8_MAX)
+            break;
+
+        const size_t escaped_size = spi_escaped_length(raw_data, raw_size);
+
+        if(total_bytes + escaped_size > burst->max_bytes ||
+           buffer_pos + escaped_size > sizeof(burst->buffer))
+            break;
+
+        uint8_t *const dest = burst->buffer + buffer_pos;
+
+        spi_fill_buffer_from_raw_data(dest, escaped_size, raw_data, raw_size);
+
+        burst->iov[fragments].iov_base = dest;
+        burst->iov[fragments].iov_len = escaped_size;
+        burst->packets[burst->count].fragments = &burst->iov[fragments];
+        burst->packets[burst->count].count = 1;
+        burst->serials[burst->count] = get_dcpsync_serial(dcpsync_header);
+        ++burst->count;
+        ++fragments;
+
+        burst->dcpd_bytes += DCPSYNC_HEADER_SIZE + raw_size;
+        total_bytes += escaped_size;
+        buffer_pos += escaped_size;
+    }
+
+    if(burst->count > 1)
+        MSG_VINFO(MESSAGE_LEVEL_DIAG,
+                  "%s: sending %zu packets, %zu bytes in one burst",
+                  tr_log_prefix(transaction->state), burst->count, total_bytes);
+
+    return burst->count;
+}
+
+/*!
+ * ACK the packets sent along with the one of the transaction.
+ */
+static void accept_burst(int fifo_out_fd)
+{
+    struct master_burst *const burst = &dcpspi_ctx->burst;
+
+    for(size_t i = 1; i < burst->count; ++i)
+        send_packet_accepted_message(burst->serials[i], fifo_out_fd);
+
+    dcpspi_ctx->dcpd_input.head += burst->dcpd_bytes;
+}
+
+/*!
+ * Answer DCPD according to result of sending a master packet to the slave.
+ *
+ * In case of a burst, the packets following the first one are only affected
+ * on success.
+ */
+static bool finish_master_transaction(struct dcp_transaction *transaction,
+                                      enum SpiSendResult ret, int fifo_out_fd)
+{
+    bool retval = false;
+
+    trace_transaction(transaction, TRACE_EVENT_SPI_RESULT, ret);
+
+    switch(ret)
+    {
+      case SPI_SEND_RESULT_OK:
+        send_packet_accepted_message(transaction->serial, fifo_out_fd);
+        accept_burst(fifo_out_fd);
+        dcpspi_ctx->is_master_ack_queued =
+            dcpspi_ctx->master_latency.is_running;
+        retval = reset_transaction(transaction);
+
+        break;
+
+      case SPI_SEND_RESULT_FAILURE:
+        /* hard failure or timeout; abort transaction */
+        send_packet_dropped_message(transaction->serial, fifo_out_fd);
+        retval = reset_transaction(transaction);
+
+        break;
+
+      case SPI_SEND_RESULT_TIMEOUT:
+        reject_or_drop(transaction, fifo_out_fd);
+        retval = reset_transaction(transaction);
+
+        break;
+
+      case SPI_SEND_RESULT_COLLISION:
+        /* slave coincidentally interrupted our attempt to tell something,
+         * need to try again later */
+        reject_or_drop(transaction, fifo_out_fd);
+        reuse_transaction_for_collision(transaction);
+
+        break;
+
+      case SPI_SEND_RESULT_PENDING:
+        MSG_BUG("%s: finished pending SPI transfer",
+                tr_log_prefix(transaction->state));
+        break;
+    }
+
+    dcpspi_ctx->burst.count = 0;
+    dcpspi_ctx->burst.dcpd_bytes = 0;
+
+    return retval;
+}
+
+/*!
+ * Evaluate DCP header read from slave.
+ *
+ * \returns
+ *     True if the payload is to be read next, false if the transaction has
+ *     been processed as far as possible. In the latter case, \p retval is set
+ *     to the return value of #do_process_transaction().
+ */
+static bool process_slave_header(struct dcp_transaction *transaction,
+                                 ssize_t bytes_read, bool *retval)
+{
+    if(bytes_read < DCP_HEADER_SIZE)
+    {
+        *retval = reset_transaction(transaction);
+        return false;
+    }
+
+    transaction->dcp_buffer.pos = DCPSYNC_HEADER_SIZE + DCP_HEADER_SIZE;
+
+    MSG_VINFO(MESSAGE_LEVEL_DIAG,
+              "%s: command header from SPI: 0x%02x 0x%02x 0x%02x 0x%02x",
+              tr_log_prefix(transaction->state),
+              transaction->dcp_buffer.buffer[DCPSYNC_HEADER_SIZE + 0],
+              transaction->dcp_buffer.buffer[DCPSYNC_HEADER_SIZE + 1],
+              transaction->dcp_buffer.buffer[DCPSYNC_HEADER_SIZE + 2],
+              transaction->dcp_buffer.buffer[DCPSYNC_HEADER_SIZE + 3]);
+
+    const uint16_t dcp_payload_size =
+        get_dcp_data_size(transaction->dcp_buffer.buffer + DCPSYNC_HEADER_SIZE);
+
+    /* junk is still forwarded below, but the clock may be too fast for it */
+    const bool is_junk =
+        transaction->dcp_buffer.buffer[DCPSYNC_HEADER_SIZE + 0] >
+        DCP_COMMAND_MULTI_READ_REGISTER;
+
+    if(is_junk)
+        spi_report_junk();
+
+    /* junk is not streamed to DCPD before we have seen all of it */
+    const bool is_cut_through =
+        !is_junk && !dcpspi_ctx->is_message_mode &&
+        dcpspi_ctx->cut_through_chunk_size > 0 &&
+        dcp_payload_size > dcpspi_ctx->cut_through_chunk_size;
+    const size_t max_payload_size = is_cut_through
+        ? dcpspi_ctx->max_payload_size
+        : transaction->dcp_buffer.size - DCP_HEADER_SIZE;
+
+    if(dcp_payload_size > max_payload_size)
+    {
+        spi_report_junk();
+        msg_error(EINVAL, LOG_ERR,
+                  "%s: transaction size %u exceeds maximum size of %zu",
+                  tr_log_prefix(transaction->state),
+                  dcp_payload_size, max_payload_size);
+        *retval = reset_transaction(transaction);
+        return false;
+    }
+
+    if(is_cut_through)
+    {
+        MSG_VINFO(MESSAGE_LEVEL_DIAG,
+                  "%s: forwarding %u bytes of payload in chunks",
+                  tr_log_prefix(transaction->state), dcp_payload_size);
+        transaction->cut_through = CUT_THROUGH_FIRST_CHUNK;
+    }
+
+    transaction->serial = mk_serial();
+    if(is_first_slave())
+        capture_set_serial(transaction->serial);
+
+    fill_dcpsync_header_for_slave(transaction->dcp_buffer.buffer,
+                                  transaction->serial,
+                                  DCP_HEADER_SIZE + dcp_payload_size);
+
+    *retval = false;
+
+    if(dcp_payload_size > 0)
+    {
+        transaction->pending_size_of_transaction = dcp_payload_size;
+        transaction->state = TR_SLAVE_COMMAND_RECEIVING_DATA_FROM_SLAVE;
+        return true;
+    }
+
+    transaction->pending_size_of_transaction = transaction->dcp_buffer.pos;
+    transaction->state = TR_SLAVE_COMMAND_FORWARDING_TO_DCPD;
+
+    return false;
 }
 
 static bool do_process_transaction(struct dcp_transaction *transaction,
                                    struct slave_request_and_lock_data *rldata,
                                    int fifo_in_fd, int fifo_out_fd, int spi_fd)
 {
-    msg_vinfo(MESSAGE_LEVEL_DEBUG,
+    MSG_VINFO(MESSAGE_LEVEL_DEBUG,
               "Process transaction state %d, serial 0x%04x, lock state %d, "
               "pending size %u, flush pos %zu",
               transaction->state, transaction->serial,
@@ -482,6 +1461,10 @@ static bool do_process_transaction(struct dcp_transaction *transaction,
               transaction->pending_size_of_transaction,
               transaction->flush_to_dcpd_buffer_pos);
 
+    trace_transaction(transaction, TRACE_EVENT_TRANSACTION, 0);
+    if(is_first_slave())
+        capture_set_serial(transaction->serial);
+
     bool retval = false;
 
     switch(transaction->state)
@@ -491,11 +1474,11 @@ static bool do_process_transaction(struct dcp_transaction *transaction,
         {
           case REQSTATE_IDLE:
             transaction->state = TR_MASTER_COMMAND_RECEIVING_HEADER_FROM_DCPD;
+            latency_begin(&dcpspi_ctx->master_latency);
             break;
 
           case REQSTATE_LOCKED:
-            transaction->state = TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE;
-            spi_new_transaction();
+            begin_slave_transaction(transaction, false);
             return false;
 
           case REQSTATE_RELEASED:
@@ -513,6 +1496,7 @@ static bool do_process_transaction(struct dcp_transaction *transaction,
 
             msg_info("Possibly found lost packet(s) in SPI input buffer");
             transaction->state = TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE;
+            latency_begin(&dcpspi_ctx->slave_latency);
 
             return true;
 
@@ -538,7 +1522,7 @@ static bool do_process_transaction(struct dcp_transaction *transaction,
 
         if(transaction->dcp_buffer.pos != DCPSYNC_HEADER_SIZE + DCP_HEADER_SIZE)
         {
-            msg_vinfo(MESSAGE_LEVEL_DIAG,
+            MSG_VINFO(MESSAGE_LEVEL_DIAG,
                       "%s: header from DCPD incomplete, waiting for more input",
                       tr_log_prefix(transaction->state));
             break;
@@ -549,7 +1533,7 @@ static bool do_process_transaction(struct dcp_transaction *transaction,
          * validate the header content here because this is going to be done by
          * the receiver of the data. We rely on the DCPSYNC header instead.
          */
-        msg_vinfo(MESSAGE_LEVEL_DIAG,
+        MSG_VINFO(MESSAGE_LEVEL_DIAG,
                   "%s: command header from DCPD: 0x%02x 0x%02x 0x%02x 0x%02x",
                   tr_log_prefix(transaction->state),
                   transaction->dcp_buffer.buffer[DCPSYNC_HEADER_SIZE + 0],
@@ -601,103 +1585,72 @@ static bool do_process_transaction(struct dcp_transaction *transaction,
 
         const bool is_dummy_header =
             transaction->dcp_buffer.buffer[DCPSYNC_HEADER_SIZE] == UINT8_MAX;
-
-        if(!is_dummy_header)
-            transaction->spi_buffer.pos =
-                spi_fill_buffer_from_raw_data(transaction->spi_buffer.buffer,
-                                              transaction->spi_buffer.size,
-                                              transaction->dcp_buffer.buffer + DCPSYNC_HEADER_SIZE,
-                                              transaction->dcp_buffer.pos - DCPSYNC_HEADER_SIZE);
-
-        const enum SpiSendResult ret = is_dummy_header
-            ? SPI_SEND_RESULT_OK
-            : spi_send_buffer(spi_fd, transaction->spi_buffer.buffer,
-                              transaction->spi_buffer.pos,
-                              STATISTICS_STRUCT(spi_transfers));
-        switch(ret)
+        const size_t fragments =
+            is_dummy_header ? 0 : escape_master_packet(transaction);
+
+        enum SpiSendResult ret;
+
+        if(is_dummy_header)
+            ret = SPI_SEND_RESULT_OK;
+        else if(fragments == 0)
+            ret = SPI_SEND_RESULT_FAILURE;
+        else if(!dcpspi_ctx->is_nonblocking_spi)
+            ret = spi_send_burst(spi_fd, dcpspi_ctx->burst.packets,
+                                 prepare_burst(transaction, fragments),
+                                 STATISTICS_STRUCT(spi_transfers),
+                                 STATISTICS_STRUCT(slave_ready));
+        else
         {
-          case SPI_SEND_RESULT_OK:
-            send_packet_accepted_message(&transaction->dcp_buffer,
-                                         transaction->serial, fifo_out_fd);
-            retval = reset_transaction(transaction);
-
-            break;
-
-          case SPI_SEND_RESULT_FAILURE:
-            /* hard failure or timeout; abort transaction */
-            send_packet_dropped_message(&transaction->dcp_buffer,
-                                        transaction->serial, fifo_out_fd);
-            retval = reset_transaction(transaction);
-
-            break;
+            spi_send_begin_burst(spi_fd, &dcpspi_ctx->spi_op,
+                                 dcpspi_ctx->burst.packets,
+                                 prepare_burst(transaction, fragments));
+            transaction->state = TR_MASTER_COMMAND_WAITING_FOR_SLAVE;
 
-          case SPI_SEND_RESULT_TIMEOUT:
-            reject_or_drop(transaction, fifo_out_fd);
-            retval = reset_transaction(transaction);
-
-            break;
-
-          case SPI_SEND_RESULT_COLLISION:
-            /* slave coincidentally interrupted our attempt to tell something,
-             * need to try again later */
-            reject_or_drop(transaction, fifo_out_fd);
-            reuse_transaction_for_collision(transaction);
+            ret = spi_send_continue(spi_fd, &dcpspi_ctx->spi_op,
+                                    STATISTICS_STRUCT(spi_transfers),
+                                    STATISTICS_STRUCT(slave_ready));
 
-            break;
+            if(ret == SPI_SEND_RESULT_PENDING)
+                break;
         }
 
+        retval = finish_master_transaction(transaction, ret, fifo_out_fd);
         break;
 
-      case TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE:
-        if(spi_read_buffer(spi_fd,
-                           transaction->dcp_buffer.buffer + DCPSYNC_HEADER_SIZE,
-                           DCP_HEADER_SIZE,
-                           STATISTICS_STRUCT(spi_transfers)) < DCP_HEADER_SIZE)
+      case TR_MASTER_COMMAND_WAITING_FOR_SLAVE:
         {
-            retval = reset_transaction(transaction);
-            break;
-        }
+            const enum SpiSendResult ret =
+                spi_send_continue(spi_fd, &dcpspi_ctx->spi_op,
+                                  STATISTICS_STRUCT(spi_transfers),
+                                  STATISTICS_STRUCT(slave_ready));
 
-        transaction->dcp_buffer.pos = DCPSYNC_HEADER_SIZE + DCP_HEADER_SIZE;
-
-        msg_vinfo(MESSAGE_LEVEL_DIAG,
-                  "%s: command header from SPI: 0x%02x 0x%02x 0x%02x 0x%02x",
-                  tr_log_prefix(transaction->state),
-                  transaction->dcp_buffer.buffer[DCPSYNC_HEADER_SIZE + 0],
-                  transaction->dcp_buffer.buffer[DCPSYNC_HEADER_SIZE + 1],
-                  transaction->dcp_buffer.buffer[DCPSYNC_HEADER_SIZE + 2],
-                  transaction->dcp_buffer.buffer[DCPSYNC_HEADER_SIZE + 3]);
+            if(ret != SPI_SEND_RESULT_PENDING)
+                retval = finish_master_transaction(transaction, ret, fifo_out_fd);
+        }
 
-        const uint16_t dcp_payload_size =
-            get_dcp_data_size(transaction->dcp_buffer.buffer + DCPSYNC_HEADER_SIZE);
+        break;
 
-        if(dcp_payload_size > (transaction->dcp_buffer.size - DCP_HEADER_SIZE))
+      case TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE:
         {
-            msg_error(EINVAL, LOG_ERR,
-                      "%s: transaction size %u exceeds maximum size of %zu",
-                      tr_log_prefix(transaction->state),
-                      dcp_payload_size,
-                      transaction->dcp_buffer.size - DCP_HEADER_SIZE);
-            retval = reset_transaction(transaction);
-            break;
-        }
+            uint8_t *const dest =
+                transaction->dcp_buffer.buffer + DCPSYNC_HEADER_SIZE;
+            ssize_t bytes_read;
 
-        transaction->serial = mk_serial();
+            if(!dcpspi_ctx->is_nonblocking_spi)
+                bytes_read = spi_read_buffer(spi_fd, dest, DCP_HEADER_SIZE,
+                                             STATISTICS_STRUCT(spi_transfers));
+            else
+            {
+                spi_read_begin(&dcpspi_ctx->spi_op, dest, DCP_HEADER_SIZE,
+                               false);
+                bytes_read = continue_reading_from_slave(transaction, spi_fd);
 
-        fill_dcpsync_header_for_slave(transaction->dcp_buffer.buffer,
-                                      transaction->serial,
-                                      DCP_HEADER_SIZE + dcp_payload_size);
+                if(bytes_read == SPI_READ_PENDING)
+                    break;
+            }
 
-        if(dcp_payload_size> 0)
-        {
-            transaction->pending_size_of_transaction = dcp_payload_size;
-            transaction->state = TR_SLAVE_COMMAND_RECEIVING_DATA_FROM_SLAVE;
-        }
-        else
-        {
-            transaction->pending_size_of_transaction = transaction->dcp_buffer.pos;
-            transaction->state = TR_SLAVE_COMMAND_FORWARDING_TO_DCPD;
-            break;
+            if(!process_slave_header(transaction, bytes_read, &retval))
+                break;
         }
 
         /* fall-through */
@@ -710,40 +1663,71 @@ static bool do_process_transaction(struct dcp_transaction *transaction,
         break;
 
       case TR_MASTER_COMMAND_SKIPPED:
-        send_packet_dropped_message(&transaction->dcp_buffer,
-                                    transaction->serial, fifo_out_fd);
+        send_packet_dropped_message(transaction->serial, fifo_out_fd);
         retval = reset_transaction(transaction);
         break;
 
       case TR_SLAVE_COMMAND_FORWARDING_TO_DCPD:
+        if(transaction->flush_to_dcpd_buffer_pos == 0 &&
+           dcpspi_ctx->dcpd_output.packet == NULL)
+            queue_packet(transaction->dcp_buffer.buffer,
+                         transaction->dcp_buffer.pos);
+
+        /* packet refers to our buffer, so we cannot wait for more */
+        if(flush_output_queue(fifo_out_fd) < 0)
         {
-            ssize_t sent_bytes =
-                send_buffer_to_fd(&transaction->dcp_buffer,
-                                  transaction->flush_to_dcpd_buffer_pos,
-                                  transaction->dcp_buffer.pos - transaction->flush_to_dcpd_buffer_pos,
-                                  fifo_out_fd,
-                                  STATISTICS_STRUCT(dcpd_writes));
-
-            if(sent_bytes < 0)
-            {
-                msg_error(0, LOG_ERR, "%s: communication with DCPD broken (send)",
-                          tr_log_prefix(transaction->state));
-                retval = reset_transaction(transaction);
-                break;
-            }
+            msg_error(0, LOG_ERR, "%s: communication with DCPD broken (send)",
+                      tr_log_prefix(transaction->state));
+            retval = reset_transaction(transaction);
+            break;
+        }
+
+        transaction->flush_to_dcpd_buffer_pos =
+            output_queue_packet_bytes_written(transaction->dcp_buffer.pos);
+
+        if(transaction->flush_to_dcpd_buffer_pos < transaction->dcp_buffer.pos)
+            break;
 
-            transaction->flush_to_dcpd_buffer_pos += sent_bytes;
+        if(transaction->cut_through != CUT_THROUGH_OFF &&
+           transaction->pending_size_of_transaction > 0)
+        {
+            /* chunk is out, reuse buffer for the next one */
+            clear_buffer(&transaction->dcp_buffer);
+            transaction->flush_to_dcpd_buffer_pos = 0;
 
+            if(transaction->cut_through == CUT_THROUGH_FIRST_CHUNK)
+                transaction->cut_through = CUT_THROUGH_STREAMING;
+
+            transaction->state = TR_SLAVE_COMMAND_RECEIVING_DATA_FROM_SLAVE;
+            break;
         }
 
-        if(transaction->flush_to_dcpd_buffer_pos >= transaction->dcp_buffer.pos)
-            retval = reset_transaction(transaction);
+        latency_end(&dcpspi_ctx->slave_latency,
+                    STATISTICS_STRUCT(slave_transactions));
+        retval = reset_transaction(transaction);
 
         break;
 
       case TR_SLAVE_COMMAND_WAIT_FOR_REQUEST_DEASSERT:
         retval = reset_transaction(transaction);
         break;
+
+      case TR_SLAVE_COMMAND_WAITING_FOR_SLAVE_DATA:
+        {
+            const ssize_t bytes_read =
+                continue_reading_from_slave(transaction, spi_fd);
+
+            if(bytes_read == SPI_READ_PENDING)
+                break;
+
+            if(transaction->state == TR_SLAVE_COMMAND_RECEIVING_DATA_FROM_SLAVE)
+                retval = process_received_data(transaction, bytes_read);
+            else if(process_slave_header(transaction, bytes_read, &retval))
+                retval = process_transaction_receive_data(transaction, rldata,
+                                                          fifo_in_fd, spi_fd);
+        }
+
+        break;
     }
 
     return retval;
@@ -768,11 +1752,11 @@ static enum RequestLineChanges determine_gpio_changes(bool current_state,
 {
     if(current_state != prev_state)
     {
-        msg_vinfo(MESSAGE_LEVEL_TRACE, "*** GPIO %d -> %d ***", prev_state, current_state);
+        MSG_VINFO(MESSAGE_LEVEL_TRACE, "*** GPIO %d -> %d ***", prev_state, current_state);
         return current_state ? REQUEST_LINE_ASSERTED : REQUEST_LINE_DEASSERTED;
     }
 
-    msg_vinfo(MESSAGE_LEVEL_TRACE, "*** GPIO %d -> %d -> %d ***",
+    MSG_VINFO(MESSAGE_LEVEL_TRACE, "*** GPIO %d -> %d -> %d ***",
               current_state, !current_state, current_state);
 
     return current_state
@@ -780,26 +1764,13 @@ static enum RequestLineChanges determine_gpio_changes(bool current_state,
         : REQUEST_LINE_ASSERTED_AND_DEASSERTED;
 }
 
-static bool process_request_line(struct dcp_transaction *transaction,
-                                 struct slave_request_and_lock_data *rldata,
-                                 int fifo_in_fd, int fifo_out_fd, int spi_fd)
+static bool apply_request_line_changes(struct dcp_transaction *transaction,
+                                       struct slave_request_and_lock_data *rldata,
+                                       enum RequestLineChanges changes,
+                                       int fifo_in_fd, int fifo_out_fd,
+                                       int spi_fd)
 {
-    struct stats_context *prev_ctx =
-        stats_context_switch(STATISTICS_STRUCT(busy_gpio));
-
     bool need_more_processing = false;
-    bool current_gpio_state = gpio_is_active(rldata->gpio);
-
-    enum RequestLineChanges changes =
-        determine_gpio_changes(current_gpio_state, rldata->previous_gpio_state);
-
-    rldata->previous_gpio_state = current_gpio_state;
-
-    if(!current_gpio_state &&
-       transaction->state == TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE)
-        MSG_APPLIANCE_BUG("Transaction was requested by slave, but request pin is deasserted now. "
-                          "We will try to process this pending transaction anyway.");
-
     bool processing = true;
 
     while(processing)
@@ -820,7 +1791,7 @@ static bool process_request_line(struct dcp_transaction *transaction,
                                         fifo_in_fd, fifo_out_fd, spi_fd);
                 }
                 else
-                    msg_vinfo(MESSAGE_LEVEL_DIAG,
+                    MSG_VINFO(MESSAGE_LEVEL_DIAG,
                               "Transaction 0x%04x interrupted by slave request",
                               transaction->serial);
 
@@ -830,7 +1801,7 @@ static bool process_request_line(struct dcp_transaction *transaction,
               case REQSTATE_MISSED:
                 transaction->request_state = REQSTATE_NEXT_PENDING;
 
-                msg_vinfo(MESSAGE_LEVEL_DIAG,
+                MSG_VINFO(MESSAGE_LEVEL_DIAG,
                           "Pending slave request while processing transaction 0x%04x",
                           transaction->serial);
 
@@ -918,14 +1889,175 @@ static bool process_request_line(struct dcp_transaction *transaction,
         }
     }
 
+    return need_more_processing;
+}
+
+/*!
+ * Maximum number of GPIO edge events fetched from the kernel at once.
+ */
+#define MAX_GPIO_EDGE_EVENTS 16
+
+/*!
+ * Fetch queued edge events, drop those which do not change the line state.
+ *
+ * \returns
+ *     Number of real state transitions stored in \p events, 0 in case no
+ *     transitions have been queued.
+ */
+static size_t fetch_request_line_edges(struct slave_request_and_lock_data *rldata,
+                                       struct gpio_edge_event *events)
+{
+    const ssize_t count =
+        gpio_read_edge_events(rldata->gpio, events, MAX_GPIO_EDGE_EVENTS);
+
+    if(count <= 0)
+        return 0;
+
+    bool state = rldata->previous_gpio_state;
+    size_t transitions = 0;
+
+    for(ssize_t i = 0; i < count; ++i)
+    {
+        if(events[i].is_active == state)
+            continue;
+
+        state = events[i].is_active;
+        events[transitions++] = events[i];
+    }
+
+    if(transitions < (size_t)count)
+        MSG_VINFO(MESSAGE_LEVEL_TRACE, "*** Dropped %zu redundant GPIO edge(s) ***",
+                  (size_t)count - transitions);
+
+    return transitions;
+}
+
+static bool handle_request_line_changes(struct dcp_transaction *transaction,
+                                        struct slave_request_and_lock_data *rldata,
+                                        enum RequestLineChanges changes,
+                                        int fifo_in_fd, int fifo_out_fd,
+                                        int spi_fd)
+{
+    const enum transaction_request_state previous_request_state =
+        transaction->request_state;
+
+    const bool need_more_processing =
+        apply_request_line_changes(transaction, rldata, changes,
+                                   fifo_in_fd, fifo_out_fd, spi_fd);
+
+    if(transaction->request_state != previous_request_state)
+        trace_transaction(transaction, TRACE_EVENT_REQUEST_STATE,
+                          previous_request_state);
+
+    return need_more_processing;
+}
+
+static bool process_request_line(struct dcp_transaction *transaction,
+                                 struct slave_request_and_lock_data *rldata,
+                                 int fifo_in_fd, int fifo_out_fd, int spi_fd,
+                                 bool is_debounce_timer_event)
+{
+    struct stats_context *prev_ctx =
+        stats_context_switch(STATISTICS_STRUCT(busy_gpio));
+
+    const bool is_debouncing =
+        rldata->gpio != NULL && gpio_get_debounce_fd(rldata->gpio) >= 0;
+
+    if(is_debouncing &&
+       gpio_debounce(rldata->gpio, is_debounce_timer_event,
+                     STATISTICS_STRUCT(debounce)) == GPIO_DEBOUNCE_BOUNCING)
+    {
+        /* come back when the debounce timer has expired */
+        stats_context_switch(prev_ctx);
+        return false;
+    }
+
+    struct gpio_edge_event events[MAX_GPIO_EDGE_EVENTS];
+    const size_t transitions =
+        (rldata->gpio != NULL && gpio_has_edge_events(rldata->gpio))
+        ? fetch_request_line_edges(rldata, events)
+        : 0;
+
+    const bool current_gpio_state = (transitions > 0)
+        ? events[transitions - 1].is_active
+        : gpio_is_active(rldata->gpio);
+
+    if(is_debouncing && current_gpio_state == rldata->previous_gpio_state)
+    {
+        /* line has bounced, but settled in its previous state */
+        stats_context_switch(prev_ctx);
+        return false;
+    }
+
+    if(!current_gpio_state &&
+       transaction->state == TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE)
+        MSG_APPLIANCE_BUG("Transaction was requested by slave, but request pin is deasserted now. "
+                          "We will try to process this pending transaction anyway.");
+
+    bool need_more_processing;
+
+    if(transitions == 0)
+    {
+        /* no edge queue, we only know the current state */
+        const enum RequestLineChanges changes =
+            determine_gpio_changes(current_gpio_state, rldata->previous_gpio_state);
+
+        rldata->previous_gpio_state = current_gpio_state;
+
+        need_more_processing =
+            handle_request_line_changes(transaction, rldata, changes,
+                                        fifo_in_fd, fifo_out_fd, spi_fd);
+    }
+    else
+    {
+        /* the kernel has told us about each edge, so we can replay them one
+         * by one in the order they have happened */
+        need_more_processing = false;
+
+        for(size_t i = 0; i < transitions; ++i)
+        {
+            const bool state = events[i].is_active;
+            const enum RequestLineChanges changes =
+                state ? REQUEST_LINE_ASSERTED : REQUEST_LINE_DEASSERTED;
+
+            MSG_VINFO(MESSAGE_LEVEL_TRACE, "*** GPIO edge -> %d at %llu ns ***",
+                      state, (unsigned long long)events[i].timestamp_ns);
+
+            rldata->previous_gpio_state = state;
+
+            need_more_processing =
+                handle_request_line_changes(transaction, rldata, changes,
+                                            fifo_in_fd, fifo_out_fd, spi_fd);
+        }
+    }
+
     stats_context_switch(prev_ctx);
 
     return need_more_processing;
 }
 
+static short request_line_poll_events(const struct slave_request_and_lock_data *rldata)
+{
+    return rldata->gpio != NULL
+        ? gpio_get_poll_events(rldata->gpio)
+        : (POLLPRI | POLLERR);
+}
+
+static int request_line_debounce_fd(const struct slave_request_and_lock_data *rldata)
+{
+    return rldata->gpio != NULL ? gpio_get_debounce_fd(rldata->gpio) : -1;
+}
+
+static inline bool is_request_line_event(short revents, short gpio_events)
+{
+    return (revents & gpio_events & ~POLLERR) != 0;
+}
+
 static bool wait_for_events(const struct dcp_transaction *const transaction,
-                            const int gpio_fd, int fifo_in_fd,
-                            bool is_quick_check, struct pollfd *fds)
+                            const int gpio_fd, const short gpio_events,
+                            int fifo_in_fd, const int fifo_out_fd,
+                            const int debounce_fd,
+                            int timeout_ms, struct pollfd *fds)
 {
     if(transaction->state == TR_SLAVE_COMMAND_WAIT_FOR_REQUEST_DEASSERT)
     {
@@ -933,32 +2065,62 @@ static bool wait_for_events(const struct dcp_transaction *const transaction,
         fifo_in_fd = -1;
     }
 
-    if(gpio_fd < 0 && fifo_in_fd < 0)
+    const int space_fd = !dcpspi_ctx->dcpd_output.is_waiting_for_space
+        ? -1
+        : (dcpspi_ctx->ipc != NULL
+           ? ipc_channel_get_space_poll_fd(dcpspi_ctx->ipc)
+           : fifo_out_fd);
+
+    if(gpio_fd < 0 && fifo_in_fd < 0 && space_fd < 0 && timeout_ms < 0)
         MSG_BUG("No fds to wait for");
 
     fds[0].fd = gpio_fd;
-    fds[0].events = POLLPRI | POLLERR;
+    fds[0].events = gpio_events;
     fds[1].fd = fifo_in_fd;
     fds[1].events = POLLIN;
+    fds[2].fd = debounce_fd;
+    fds[2].events = POLLIN;
+    fds[2].revents = 0;
+
+    /* only hangups are of interest here, the data come through fds[1] */
+    fds[3].fd = (dcpspi_ctx->ipc != NULL && fifo_in_fd >= 0)
+        ? ipc_channel_get_peer_fd(dcpspi_ctx->ipc)
+        : -1;
+    fds[3].events = 0;
+    fds[3].revents = 0;
+    fds[4].fd = space_fd;
+    fds[4].events = dcpspi_ctx->ipc != NULL ? POLLIN : POLLOUT;
+    fds[4].revents = 0;
+    fds[5].fd = dcpspi_ctx->stop_fd;
+    fds[5].events = POLLIN;
+    fds[5].revents = 0;
 
     struct stats_context *prev_ctx =
         stats_context_switch(STATISTICS_STRUCT(wait_for_events));
 
-    const int ret = os_poll(fds, EVENT_FD_COUNT, is_quick_check ? 0 : -1);
+    nfds_t nfds = EVENT_FD_COUNT;
+
+    while(nfds > 2 && fds[nfds - 1].fd < 0)
+        --nfds;
+
+    const int ret = os_poll(fds, nfds, timeout_ms);
 
     stats_context_switch(prev_ctx);
 
     if(ret > 0)
     {
-        if(fds[0].fd >= 0 && (fds[0].revents & POLLPRI) != 0)
-            msg_vinfo(MESSAGE_LEVEL_TRACE, "*** GPIO poll(2) event ***");
+        if(fds[5].revents & POLLIN)
+            dcpspi_ctx->is_stop_requested = true;
+
+        if(fds[0].fd >= 0 && is_request_line_event(fds[0].revents, gpio_events))
+            MSG_VINFO(MESSAGE_LEVEL_TRACE, "*** GPIO poll(2) event ***");
 
         return true;
     }
 
     if(ret == 0)
     {
-        if(!is_quick_check)
+        if(timeout_ms < 0)
             msg_error(errno, LOG_WARNING, "poll() unexpected timeout");
     }
     else if(errno != EINTR)
@@ -967,33 +2129,62 @@ static bool wait_for_events(const struct dcp_transaction *const transaction,
     return false;
 }
 
+/*!
+ * Poll timeout for waiting on DCPD, returns every now and then while the
+ * stream to DCPD is being restarted.
+ */
+static inline int dcpd_wait_timeout_ms(void)
+{
+    return dcpspi_ctx->is_dcpd_stream_broken ? DCPD_STREAM_RETRY_MS : -1;
+}
+
 static bool wait_for_dcp_data(struct dcp_transaction *transaction,
                               const int fifo_in_fd, const int fifo_out_fd,
                               const int spi_fd,
                               struct slave_request_and_lock_data *rldata)
 {
     struct pollfd fds[EVENT_FD_COUNT];
+    const short gpio_events = request_line_poll_events(rldata);
 
-    if(!wait_for_events(transaction, rldata->gpio_fd, fifo_in_fd, false, fds))
+    if(!wait_for_events(transaction, rldata->gpio_fd, gpio_events,
+                        fifo_in_fd, fifo_out_fd,
+                        request_line_debounce_fd(rldata),
+                        dcpd_wait_timeout_ms(), fds))
         return true;
 
-    if(fds[0].revents & POLLPRI)
+    if(is_request_line_event(fds[0].revents, gpio_events))
+    {
+        if(process_request_line(transaction, rldata,
+                                fifo_in_fd, fifo_out_fd, spi_fd, false))
+            process_transaction(transaction, rldata,
+                                fifo_in_fd, fifo_out_fd, spi_fd);
+    }
+
+    if(fds[2].revents & POLLIN)
     {
         if(process_request_line(transaction, rldata,
-                                fifo_in_fd, fifo_out_fd, spi_fd))
+                                fifo_in_fd, fifo_out_fd, spi_fd, true))
             process_transaction(transaction, rldata,
                                 fifo_in_fd, fifo_out_fd, spi_fd);
     }
 
-    if(fds[0].revents & ~(POLLPRI | POLLERR))
+    if(fds[0].revents & ~gpio_events)
         msg_error(0, LOG_WARNING,
                   "Unexpected poll() events on gpio_fd %d: %04x",
                   fds[0].fd, fds[0].revents);
 
     bool keep_running = true;
 
-    if(fds[1].revents & POLLHUP)
+    if((fds[1].revents & POLLHUP) || (fds[3].revents & (POLLHUP | POLLERR)))
     {
+        if(dcpspi_ctx->is_message_mode)
+        {
+            /* whatever is left in either direction is for a peer that is gone */
+            msg_error(0, LOG_NOTICE, "DCP daemon disconnected");
+            clear_output_queue(&dcpspi_ctx->dcpd_output);
+            return false;
+        }
+
         msg_error(0, LOG_ERR, "DCP daemon died, terminating");
         keep_running = false;
     }
@@ -1013,23 +2204,95 @@ static bool wait_for_dcp_data(struct dcp_transaction *transaction,
     return keep_running;
 }
 
-bool dcpspi_process(const int fifo_in_fd, const int fifo_out_fd,
-                    const int spi_fd,
-                    struct dcp_transaction *const transaction,
-                    struct slave_request_and_lock_data *const rldata)
+static bool is_waiting_for_slave(const struct dcp_transaction *transaction)
 {
-    stats_context_switch(STATISTICS_STRUCT(busy_unspecific));
+    return (transaction->state == TR_MASTER_COMMAND_WAITING_FOR_SLAVE ||
+            transaction->state == TR_SLAVE_COMMAND_WAITING_FOR_SLAVE_DATA);
+}
+
+/*!
+ * Give the slave some time, take care of the request line meanwhile.
+ *
+ * The poll(2) timeout stands in for the sleep which would otherwise be done
+ * by the SPI code between two attempts. DCPD is not served while waiting
+ * because the transaction in progress is not finished yet.
+ */
+static void wait_for_slave(struct dcp_transaction *transaction,
+                           const int fifo_in_fd, const int fifo_out_fd,
+                           const int spi_fd,
+                           struct slave_request_and_lock_data *rldata)
+{
+    const unsigned int delay_us =
+        spi_operation_retry_delay_us(&dcpspi_ctx->spi_op);
+    struct pollfd fds[EVENT_FD_COUNT];
+    const short gpio_events = request_line_poll_events(rldata);
+
+    if(wait_for_events(transaction, rldata->gpio_fd, gpio_events,
+                       -1, fifo_out_fd, request_line_debounce_fd(rldata),
+                       (delay_us + 999U) / 1000U, fds))
+    {
+        if(is_request_line_event(fds[0].revents, gpio_events))
+            process_request_line(transaction, rldata,
+                                 fifo_in_fd, fifo_out_fd, spi_fd, false);
+
+        if(fds[2].revents & POLLIN)
+            process_request_line(transaction, rldata,
+                                 fifo_in_fd, fifo_out_fd, spi_fd, true);
+    }
+
+    if(is_waiting_for_slave(transaction))
+        process_transaction(transaction, rldata,
+                            fifo_in_fd, fifo_out_fd, spi_fd);
+}
+
+static bool do_dcpspi_process(const int fifo_in_fd, const int fifo_out_fd,
+                              const int spi_fd,
+                              struct dcp_transaction *const transaction,
+                              struct slave_request_and_lock_data *const rldata)
+{
+    if(is_waiting_for_slave(transaction))
+    {
+        wait_for_slave(transaction, fifo_in_fd, fifo_out_fd, spi_fd, rldata);
+        return true;
+    }
 
     if(rldata->is_running_for_real)
     {
         struct pollfd fds[EVENT_FD_COUNT];
-
-        if(wait_for_events(transaction, rldata->gpio_fd, -1, true, fds) &&
-           (fds[0].revents & POLLPRI) != 0)
+        const short gpio_events = request_line_poll_events(rldata);
+
+        /* nothing to do but wait if DCPD is not taking our packet */
+        const int timeout_ms =
+            (transaction->state == TR_SLAVE_COMMAND_FORWARDING_TO_DCPD &&
+             (dcpspi_ctx->dcpd_output.is_waiting_for_space ||
+              dcpspi_ctx->is_dcpd_stream_broken))
+            ? dcpd_wait_timeout_ms()
+            : 0;
+
+        if(wait_for_events(transaction, rldata->gpio_fd, gpio_events,
+                           -1, fifo_out_fd, request_line_debounce_fd(rldata),
+                           timeout_ms, fds))
         {
-            process_request_line(transaction, rldata,
-                                 fifo_in_fd, fifo_out_fd, spi_fd);
+            if(is_request_line_event(fds[0].revents, gpio_events))
+                process_request_line(transaction, rldata,
+                                     fifo_in_fd, fifo_out_fd, spi_fd, false);
+
+            if(fds[2].revents & POLLIN)
+                process_request_line(transaction, rldata,
+                                     fifo_in_fd, fifo_out_fd, spi_fd, true);
         }
+
+        if(dcpspi_ctx->is_stop_requested)
+            return false;
+    }
+
+    if(expecting_dcp_data(transaction) &&
+       read_ahead_buffered(&dcpspi_ctx->dcpd_input) > 0)
+    {
+        /* more input from DCPD has already been read, no need to wait */
+        process_transaction(transaction, rldata,
+                            fifo_in_fd, fifo_out_fd, spi_fd);
+        return true;
     }
 
     if(expecting_dcp_data(transaction) || expecting_gpio_change(transaction))
@@ -1040,3 +2303,65 @@ bool dcpspi_process(const int fifo_in_fd, const int fifo_out_fd,
 
     return true;
 }
+
+void dcpspi_dcpd_disconnected(struct dcp_transaction *transaction)
+{
+    struct read_ahead *const ra = &dcpspi_ctx->dcpd_input;
+
+    ra->head = 0;
+    ra->tail = 0;
+    clear_output_queue(&dcpspi_ctx->dcpd_output);
+
+    switch(transaction->state)
+    {
+      case TR_MASTER_COMMAND_RECEIVING_HEADER_FROM_DCPD:
+      case TR_MASTER_COMMAND_RECEIVING_DATA_FROM_DCPD:
+      case TR_MASTER_COMMAND_SKIPPING_DATA_FROM_DCPD:
+        msg_info("Dropping incomplete packet from DCPD");
+        reset_transaction_struct(transaction, false);
+        break;
+
+      case TR_SLAVE_COMMAND_FORWARDING_TO_DCPD:
+        transaction->flush_to_dcpd_buffer_pos = 0;
+        break;
+
+      default:
+        break;
+    }
+}
+
+bool dcpspi_dcpd_stream_reset_requested(void)
+{
+    return dcpspi_ctx->is_dcpd_stream_broken;
+}
+
+void dcpspi_dcpd_stream_restarted(void)
+{
+    dcpspi_ctx->is_dcpd_stream_broken = false;
+}
+
+bool dcpspi_process(const int fifo_in_fd, const int fifo_out_fd,
+                    const int spi_fd,
+                    struct dcp_transaction *const transaction,
+                    struct slave_request_and_lock_data *const rldata)
+{
+    stats_context_switch(STATISTICS_STRUCT(busy_unspecific));
+
+    const bool keep_running =
+        do_dcpspi_process(fifo_in_fd, fifo_out_fd, spi_fd, transaction, rldata) &&
+        !dcpspi_ctx->is_stop_requested;
+
+    /* whatever has been queued for DCPD in this iteration goes out now */
+    if(flush_output_queue(fifo_out_fd) < 0)
+        msg_error(0, LOG_ERR, "Communication with DCPD broken (send)");
+
+    if(dcpspi_ctx->is_master_ack_queued &&
+       output_queue_pending_bytes(&dcpspi_ctx->dcpd_output) == 0)
+    {
+        dcpspi_ctx->is_master_ack_queued = false;
+        latency_end(&dcpspi_ctx->master_latency,
+                    STATISTICS_STRUCT(master_transactions));
+    }
+
+    return keep_running;
+}
@@ -27,6 +27,20 @@
 #include <stdlib.h>
 
 #include "statistics.h"
+#include "spi_clock.h"
+
+/*!
+ * Maximum size of a burst of master packets, see #dcpspi_burst_enable().
+ */
+#define DCPSPI_BURST_MAX_SIZE 4096U
+
+/*!
+ * Largest slave payload that fits into a DCPSYNC packet.
+ *
+ * Payloads larger than the DCP buffer are only accepted with cut-through
+ * forwarding, see #dcpspi_set_max_payload_size().
+ */
+#define DCPSPI_MAX_PAYLOAD_SIZE (UINT16_MAX - DCP_HEADER_SIZE)
 
 /*!
  * Current state of the DCP transaction.
@@ -47,6 +61,10 @@ enum transaction_state
     TR_SLAVE_COMMAND_RECEIVING_DATA_FROM_SLAVE,    /*!< Reading data from slave over SPI. */
     TR_SLAVE_COMMAND_FORWARDING_TO_DCPD,           /*!< Sending request to DCP process. */
     TR_SLAVE_COMMAND_WAIT_FOR_REQUEST_DEASSERT,    /*!< Wait for slave to deassert request. */
+
+    /* non-blocking SPI, see #dcpspi_nonblocking_spi_enable() */
+    TR_MASTER_COMMAND_WAITING_FOR_SLAVE,           /*!< Probing slave until it is ready. */
+    TR_SLAVE_COMMAND_WAITING_FOR_SLAVE_DATA,       /*!< Slave sent only NOPs, read again. */
 };
 
 /*!
@@ -120,6 +138,21 @@ enum transaction_request_state
     REQSTATE_MISSED,
 };
 
+/*!
+ * How a slave payload is forwarded to DCPD.
+ */
+enum cut_through_state
+{
+    /*! Whole packet is read from the slave before it is forwarded. */
+    CUT_THROUGH_OFF = 0,
+
+    /*! First chunk, DCPSYNC and DCP headers have not been forwarded yet. */
+    CUT_THROUGH_FIRST_CHUNK,
+
+    /*! Headers and some payload have been forwarded already. */
+    CUT_THROUGH_STREAMING,
+};
+
 /*!
  * State of the DCP transaction in progress.
  *
@@ -181,6 +214,14 @@ struct dcp_transaction
     size_t flush_to_dcpd_buffer_pos;
     bool pending_escape_sequence_in_spi_buffer;
 
+    /*!
+     * Cut-through forwarding of a slave payload in chunks.
+     *
+     * The DCP buffer holds one chunk at a time, see
+     * #dcpspi_cut_through_enable().
+     */
+    enum cut_through_state cut_through;
+
     /*!
      * Request line state changes while the transaction is processed.
      */
@@ -190,7 +231,7 @@ struct dcp_transaction
 struct slave_request_and_lock_data
 {
     const bool is_running_for_real;
-    const struct gpio_handle *gpio;
+    struct gpio_handle *gpio;
     const int gpio_fd;
 
     bool previous_gpio_state;
@@ -206,6 +247,22 @@ struct program_statistics
     struct stats_io spi_transfers;
     struct stats_io dcpd_reads;
     struct stats_io dcpd_writes;
+    struct stats_wait slave_ready;
+
+    /*! Software debouncing of the request line; probes are bounces. */
+    struct stats_wait debounce;
+
+    /*! Request line asserted until packet has been written to DCPD. */
+    struct stats_histogram slave_transactions;
+
+    /*! DCPD packet read until ACK has been written to DCPD. */
+    struct stats_histogram master_transactions;
+
+    /*! Actual minus requested time of each sleep while waiting for the slave. */
+    struct stats_histogram sched_delay;
+
+    /*! Current SPI clock rates and why they have changed. */
+    struct spi_clock_stats spi_clock;
 };
 
 #ifdef __cplusplus
@@ -215,12 +272,206 @@ extern "C" {
 bool reset_transaction_struct(struct dcp_transaction *transaction,
                               bool is_initial_reset);
 
+/*!
+ * Per-slave state of the transaction processing code.
+ */
+struct dcpspi_context;
+
+/*!
+ * Reset state of given slave, including its SPI state, to defaults.
+ *
+ * All other functions in this file work on the calling thread's current
+ * context, which is the one of slave 0 unless switched by
+ * #dcpspi_context_switch(). Settings such as statistics and read-ahead must be
+ * configured for each slave while its context is current. Each context must
+ * only be used by one thread at a time; transaction trace and traffic capture
+ * are only recorded for slave 0.
+ *
+ * \returns
+ *     The context of given slave, or \c NULL if \p slave is out of range,
+ *     see #SPI_MAX_SLAVES.
+ */
+struct dcpspi_context *dcpspi_context_init(unsigned int slave);
+
+/*!
+ * Make given context, and its SPI context, the calling thread's current one.
+ *
+ * Pass \c NULL to switch back to the context of slave 0.
+ *
+ * \returns
+ *     The previous context.
+ */
+struct dcpspi_context *dcpspi_context_switch(struct dcpspi_context *ctx);
+
 void dcpspi_init(void);
 
 void dcpspi_statistics_reset(void);
 const struct program_statistics *dcpspi_statistics_get(void);
 bool dcpspi_statistics_enable(bool enable);
 
+/*!
+ * Read data from DCPD ahead into an internal buffer.
+ *
+ * Without read-ahead, exactly the number of bytes required by the
+ * transaction state machine are read from the named pipe. With read-ahead,
+ * the pipe is drained in large chunks, and consecutive packets are parsed
+ * out of the buffer without further system calls.
+ *
+ * \returns
+ *     The previous setting.
+ */
+bool dcpspi_read_ahead_enable(bool enable);
+
+/*!
+ * Do not block while waiting for the slave.
+ *
+ * Without this, waiting for the slave to become ready for a master packet or
+ * to send more data for a slave packet happens inside the SPI code, and
+ * request line changes are only seen afterwards. With non-blocking SPI, the
+ * transaction enters one of the \c WAITING states instead, and the main loop
+ * waits for the next attempt in \c poll(2) along with the request line and
+ * its debounce timer.
+ *
+ * \returns
+ *     The previous setting.
+ */
+bool dcpspi_nonblocking_spi_enable(bool enable);
+
+/*!
+ * Process pending slave requests right after the current transaction.
+ *
+ * Without the fast path, a slave request seen while another transaction is
+ * running is processed after the next pass through the main loop, which
+ * polls and reads the request line again, and discards anything left in the
+ * SPI input buffer. With the fast path, the pending slave transaction starts
+ * right away, and bytes which may belong to it are kept.
+ *
+ * \returns
+ *     The previous setting.
+ */
+bool dcpspi_slave_fast_path_enable(bool enable);
+
+/*!
+ * Send queued master packets to the slave in bursts.
+ *
+ * Without bursts, each master packet is sent after a handshake of its own.
+ * With bursts, complete master packets waiting in the read-ahead buffer are
+ * sent along with the current one after a single handshake, as long as the
+ * escaped packets fit into \p max_bytes. Each packet is answered by its own
+ * ACK. If the handshake fails, only the current packet is rejected, and the
+ * packets that would have followed remain queued with their TTLs untouched.
+ *
+ * The slave firmware must be able to take the given number of bytes in one
+ * go. Bursts require read-ahead, see #dcpspi_read_ahead_enable().
+ *
+ * \param max_bytes
+ *     Maximum number of bytes per burst, at most #DCPSPI_BURST_MAX_SIZE. Pass
+ *     0 to disable bursts.
+ *
+ * \returns
+ *     The previous setting.
+ */
+size_t dcpspi_burst_enable(size_t max_bytes);
+
+/*!
+ * Forward slave payloads to DCPD while they are read from the slave.
+ *
+ * Without cut-through, a slave packet is read completely before it is
+ * forwarded to DCPD. With cut-through, payloads larger than \p chunk_size are
+ * read in chunks of this size, and each chunk is forwarded before the next
+ * one is read. The DCPSYNC header tells DCPD the final size of the packet in
+ * advance. If the slave fails in the middle of a packet, the stream to DCPD
+ * must be restarted, see #dcpspi_dcpd_stream_reset_requested().
+ *
+ * Packets with invalid command headers are still read completely before they
+ * are forwarded, and cut-through is not used with message sockets because
+ * each message must contain a complete packet.
+ *
+ * \param chunk_size
+ *     Number of payload bytes read before forwarding, at most
+ *     #DCP_PAYLOAD_MAXSIZE. Pass 0 to disable cut-through.
+ *
+ * \returns
+ *     The previous setting.
+ */
+size_t dcpspi_cut_through_enable(size_t chunk_size);
+
+/*!
+ * Set largest payload accepted from the slave.
+ *
+ * Payloads larger than #DCP_PAYLOAD_MAXSIZE do not fit into the DCP buffer,
+ * so they are only accepted with cut-through forwarding. Bulk transfers such
+ * as firmware images can be moved this way without larger buffers.
+ *
+ * \param max_size
+ *     Maximum payload size, at most #DCPSPI_MAX_PAYLOAD_SIZE.
+ *
+ * \returns
+ *     The previous setting.
+ */
+size_t dcpspi_set_max_payload_size(size_t max_size);
+
+struct ipc_channel;
+
+/*!
+ * Exchange data with DCPD through shared memory instead of named pipes.
+ *
+ * The file descriptors passed to #dcpspi_process() must be the channel's
+ * eventfds in this case. Pass \c NULL to switch back to named pipes.
+ */
+void dcpspi_set_ipc_channel(struct ipc_channel *channel);
+
+/*!
+ * Tell whether or not the connection to DCPD preserves message boundaries.
+ *
+ * In message mode, each status message or forwarded packet is written as a
+ * message of its own, and a hangup of DCPD is reported to the caller of
+ * #dcpspi_process() without terminating, so that the connection can be
+ * accepted again. Read-ahead must be enabled for message mode.
+ */
+void dcpspi_set_message_mode(bool enable);
+
+/*!
+ * Give #dcpspi_process() an fd which tells it to stop.
+ *
+ * The fd is polled along with all others, and #dcpspi_process() returns
+ * \c false once it has become readable. This is how threads serving a slave
+ * are stopped at a point where no transfer is in progress. Pass -1 if there
+ * is no such fd.
+ */
+void dcpspi_set_stop_fd(int fd);
+
+/*!
+ * Forget about data exchanged with a DCPD that has gone away.
+ *
+ * Buffered input and queued output are discarded, and master transactions
+ * still receiving data from DCPD are reset.
+ */
+void dcpspi_dcpd_disconnected(struct dcp_transaction *transaction);
+
+/*!
+ * Check if the stream to DCPD must be restarted.
+ *
+ * This is the case if the slave has failed in the middle of a packet which
+ * has been forwarded to DCPD in part already (see
+ * #dcpspi_cut_through_enable()). DCPD would take the following bytes for the
+ * rest of that packet, so the caller must close the connection and open a
+ * new one, then call #dcpspi_dcpd_stream_restarted().
+ *
+ * Until then, nothing is written to DCPD, and #dcpspi_process() returns
+ * every now and then instead of waiting for DCPD so that the caller can try
+ * to open the new connection without blocking. Pass -1 as output fd
+ * meanwhile.
+ */
+bool dcpspi_dcpd_stream_reset_requested(void);
+
+/*!
+ * Tell that a new stream to DCPD has been opened.
+ *
+ * Status messages queued in the meantime are written to the new stream.
+ */
+void dcpspi_dcpd_stream_restarted(void);
+
 bool dcpspi_process(const int fifo_in_fd, const int fifo_out_fd,
                     const int spi_fd,
                     struct dcp_transaction *const transaction,
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "deadline.h"
+#include "os.h"
+
+static void compute_expiration_time(struct timespec *t, unsigned int timeout_ms)
+{
+    os_clock_gettime(DEADLINE_CLOCK, t);
+
+    if(timeout_ms == 0)
+        return;
+
+    const unsigned long timeout_remainder_ns =
+        (timeout_ms % 1000U) * 1000ULL * 1000ULL;
+
+    t->tv_sec += timeout_ms / 1000U;
+
+    if(timeout_remainder_ns < 1000ULL * 1000ULL * 1000ULL - t->tv_nsec)
+        t->tv_nsec += timeout_remainder_ns;
+    else
+    {
+        ++t->tv_sec;
+        t->tv_nsec =
+            timeout_remainder_ns - (1000ULL * 1000ULL * 1000ULL - t->tv_nsec);
+    }
+}
+
+static bool timeout_expired(const struct timespec *restrict timeout,
+                            const struct timespec *restrict current)
+{
+    if(current->tv_sec > timeout->tv_sec)
+        return true;
+    else if(current->tv_sec < timeout->tv_sec)
+        return false;
+
+    return current->tv_nsec >= timeout->tv_nsec;
+}
+
+void deadline_start(struct deadline *dl, unsigned int period_ms,
+                    unsigned int periods, struct timespec *now)
+{
+    compute_expiration_time(&dl->expires, 0);
+    *now = dl->expires;
+
+    dl->period_ms = period_ms;
+    dl->periods = periods;
+    dl->expirations_left = periods + 1;
+    dl->needs_rearm = false;
+}
+
+bool deadline_check(struct deadline *dl, struct timespec *now)
+{
+    if(dl->needs_rearm)
+        return false;
+
+    os_clock_gettime(DEADLINE_CLOCK, now);
+
+    if(!timeout_expired(&dl->expires, now))
+        return false;
+
+    if(--dl->expirations_left == 0)
+        return true;
+
+    dl->needs_rearm = true;
+    return false;
+}
+
+void deadline_rearm(struct deadline *dl)
+{
+    if(!dl->needs_rearm)
+        return;
+
+    compute_expiration_time(&dl->expires, dl->period_ms);
+    dl->needs_rearm = false;
+}
+
+void deadline_restart(struct deadline *dl)
+{
+    dl->expirations_left = dl->periods;
+    dl->needs_rearm = true;
+}
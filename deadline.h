@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <stdbool.h>
+#include <time.h>
+
+/*!
+ * Clock used for deadlines and time measurements.
+ *
+ * Unlike \c CLOCK_MONOTONIC_RAW, this clock is served by the vDSO on all our
+ * kernels, so reading it does not enter the kernel.
+ */
+#define DEADLINE_CLOCK CLOCK_MONOTONIC
+
+/*!
+ * Timeout made of several consecutive periods.
+ *
+ * A process which has been starved for longer than the whole timeout must not
+ * fail the operation it was starved in, so at most one period can expire per
+ * check. The first check after #deadline_start() always consumes a period
+ * regardless of time so that the slave has had at least one chance to answer
+ * before the first real period starts.
+ */
+struct deadline
+{
+    struct timespec expires;
+    unsigned int period_ms;
+    unsigned int periods;
+    unsigned int expirations_left;
+    bool needs_rearm;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Start deadline of \p periods periods of \p period_ms milliseconds each.
+ *
+ * \param dl
+ *     Deadline to start.
+ *
+ * \param period_ms, periods
+ *     Length and number of periods.
+ *
+ * \param now
+ *     Current time as read from #DEADLINE_CLOCK is returned here.
+ */
+void deadline_start(struct deadline *dl, unsigned int period_ms,
+                    unsigned int periods, struct timespec *now);
+
+/*!
+ * Check whether or not the deadline has been reached.
+ *
+ * If only a single period has expired, the deadline is marked for re-arming
+ * by #deadline_rearm(). While marked, this function returns false without
+ * reading the clock, leaving \p now untouched.
+ *
+ * \returns
+ *     True if the last period has expired.
+ */
+bool deadline_check(struct deadline *dl, struct timespec *now);
+
+/*!
+ * Start next period now if the deadline is marked for re-arming.
+ */
+void deadline_rearm(struct deadline *dl);
+
+/*!
+ * Grant all periods again after progress has been made.
+ *
+ * The next period starts with the next call of #deadline_rearm().
+ */
+void deadline_restart(struct deadline *dl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !DEADLINE_H */
@@ -26,23 +26,67 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <errno.h>
+#include <linux/gpio.h>
 
 #include "gpio.h"
 #include "os.h"
 #include "messages.h"
+#include "log_level.h"
+
+#ifdef GPIO_V2_GET_LINE_IOCTL
+#define HAVE_GPIO_CDEV_V2 1
+#else
+#define HAVE_GPIO_CDEV_V2 0
+#endif
+
+enum GpioBackend
+{
+    GPIO_BACKEND_SYSFS,
+    GPIO_BACKEND_CDEV,
+};
 
 struct gpio_handle
 {
     bool is_in_use;
     bool is_active_low;
     bool is_debouncing_enabled;
+    enum GpioBackend backend;
     unsigned int gpio_num;
+
+    /*! Value file for sysfs, line request fd for cdev. */
     int value_fd;
+
+    /*! Last line sequence number seen (cdev only). */
+    uint32_t line_seqno;
+
+    /*! Timer for software debouncing, -1 if not debouncing in software. */
+    int debounce_fd;
+
+    /*! Last stable GPIO value (raw, not corrected by polarity). */
+    bool debounced_value;
+
+    /*! Waiting for the line to settle. */
+    bool is_bouncing;
+
+    /*! GPIO changes seen while waiting for the line to settle. */
+    uint32_t bounces;
+
+    /*! When the line has started bouncing. */
+    struct timespec bounce_started;
 };
 
+/*!
+ * How long the GPIO must be stable to be considered debounced.
+ */
+static const unsigned int gpio_debounce_period_us = 45000;
+
 static struct gpio_handle the_gpio;
 
 static int write_to_gpio_file(const char *filename, const char *buffer,
@@ -107,7 +151,7 @@ static int wait_for_path(const char *path, int tries,
         if(access(path, W_OK) == 0)
         {
             const int tried = tries - tries_left + 1;
-            msg_vinfo(MESSAGE_LEVEL_DIAG,
+            MSG_VINFO(MESSAGE_LEVEL_DIAG,
                       "Path \"%s\" accessible after %d %s",
                       path, tried, tried == 1 ? "try" : "tries");
 
@@ -215,6 +259,9 @@ static void unhook_from_gpio(struct gpio_handle *gpio)
 
     gpio->value_fd = -1;
 
+    if(gpio->backend != GPIO_BACKEND_SYSFS)
+        return;
+
     char buffer[10];
     size_t buffer_length =
         snprintf(buffer, sizeof(buffer), "%u", gpio->gpio_num);
@@ -233,17 +280,113 @@ struct gpio_handle *gpio_open(unsigned int gpio_num, bool is_active_low)
 
     the_gpio.is_active_low = is_active_low;
     the_gpio.is_debouncing_enabled = false;
+    the_gpio.backend = GPIO_BACKEND_SYSFS;
     the_gpio.gpio_num = gpio_num;
+    the_gpio.line_seqno = 0;
+    the_gpio.debounce_fd = -1;
+    the_gpio.is_bouncing = false;
     the_gpio.is_in_use = true;
 
     return &the_gpio;
 }
 
+#if HAVE_GPIO_CDEV_V2
+
+static int request_gpio_line(const char *chip_name, unsigned int line_offset)
+{
+    int chip_fd;
+
+    while((chip_fd = open(chip_name, O_RDONLY | O_CLOEXEC)) == -1 && errno == EINTR)
+        ;
+
+    if(chip_fd < 0)
+    {
+        msg_error(errno, LOG_NOTICE,
+                  "Failed opening GPIO chip \"%s\"", chip_name);
+        return -1;
+    }
+
+    struct gpio_v2_line_request req;
+    memset(&req, 0, sizeof(req));
+
+    req.offsets[0] = line_offset;
+    req.num_lines = 1;
+    snprintf(req.consumer, sizeof(req.consumer), "dcpspi");
+    req.config.flags =
+        GPIO_V2_LINE_FLAG_INPUT |
+        GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+
+    const int ret = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req);
+
+    if(ret < 0)
+        msg_error(errno, LOG_NOTICE,
+                  "Failed requesting line %u on GPIO chip \"%s\"",
+                  line_offset, chip_name);
+
+    os_file_close(chip_fd);
+
+    if(ret < 0)
+        return -1;
+
+    /* we must never block on reading edge events */
+    const int flags = fcntl(req.fd, F_GETFL);
+
+    if(flags < 0 || fcntl(req.fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        msg_error(errno, LOG_EMERG,
+                  "Failed making GPIO line fd %d non-blocking", req.fd);
+        os_file_close(req.fd);
+        return -1;
+    }
+
+    return req.fd;
+}
+
+#endif /* HAVE_GPIO_CDEV_V2 */
+
+struct gpio_handle *gpio_open_chardev(const char *chip_name,
+                                      unsigned int line_offset,
+                                      bool is_active_low)
+{
+#if HAVE_GPIO_CDEV_V2
+    if(the_gpio.is_in_use)
+        return NULL;
+
+    the_gpio.value_fd = request_gpio_line(chip_name, line_offset);
+    if(the_gpio.value_fd < 0)
+        return NULL;
+
+    the_gpio.is_active_low = is_active_low;
+    the_gpio.is_debouncing_enabled = false;
+    the_gpio.backend = GPIO_BACKEND_CDEV;
+    the_gpio.gpio_num = line_offset;
+    the_gpio.line_seqno = 0;
+    the_gpio.debounce_fd = -1;
+    the_gpio.is_bouncing = false;
+    the_gpio.is_in_use = true;
+
+    MSG_VINFO(MESSAGE_LEVEL_DIAG, "Using line %u on GPIO chip \"%s\"",
+              line_offset, chip_name);
+
+    return &the_gpio;
+#else /* !HAVE_GPIO_CDEV_V2 */
+    msg_error(ENOSYS, LOG_NOTICE,
+              "GPIO character device support not available");
+    return NULL;
+#endif /* HAVE_GPIO_CDEV_V2 */
+}
+
 void gpio_close(struct gpio_handle *gpio)
 {
     if(!gpio->is_in_use)
         return;
 
+    if(gpio->debounce_fd >= 0)
+    {
+        os_file_close(gpio->debounce_fd);
+        gpio->debounce_fd = -1;
+    }
+
     unhook_from_gpio(gpio);
 
     gpio->is_in_use = false;
@@ -254,8 +397,100 @@ int gpio_get_poll_fd(const struct gpio_handle *gpio)
     return gpio->value_fd;
 }
 
+short gpio_get_poll_events(const struct gpio_handle *gpio)
+{
+    return gpio->backend == GPIO_BACKEND_CDEV ? POLLIN : (POLLPRI | POLLERR);
+}
+
+bool gpio_has_edge_events(const struct gpio_handle *gpio)
+{
+    /* software debouncing works on sampled values, so the event queue is of
+     * no use in that case */
+    return gpio->backend == GPIO_BACKEND_CDEV && !gpio->is_debouncing_enabled;
+}
+
+ssize_t gpio_read_edge_events(struct gpio_handle *gpio,
+                              struct gpio_edge_event *events, size_t max_events)
+{
+#if HAVE_GPIO_CDEV_V2
+    if(gpio->backend != GPIO_BACKEND_CDEV)
+        return -1;
+
+    struct gpio_v2_line_event kernel_events[16];
+
+    if(max_events > sizeof(kernel_events) / sizeof(kernel_events[0]))
+        max_events = sizeof(kernel_events) / sizeof(kernel_events[0]);
+
+    ssize_t bytes;
+
+    while((bytes = read(gpio->value_fd, kernel_events,
+                        max_events * sizeof(kernel_events[0]))) == -1 &&
+          errno == EINTR)
+        ;
+
+    if(bytes < 0)
+    {
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+
+        msg_error(errno, LOG_EMERG,
+                  "Failed reading GPIO events from fd %d", gpio->value_fd);
+        return -1;
+    }
+
+    const size_t count = (size_t)bytes / sizeof(kernel_events[0]);
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        const struct gpio_v2_line_event *const ev = &kernel_events[i];
+        const uint32_t expected_seqno = gpio->line_seqno + 1;
+
+        if(gpio->line_seqno != 0 && ev->line_seqno != expected_seqno)
+            msg_error(0, LOG_WARNING, "Lost %u GPIO event(s)",
+                      ev->line_seqno - expected_seqno);
+
+        gpio->line_seqno = ev->line_seqno;
+
+        const bool value = ev->id == GPIO_V2_LINE_EVENT_RISING_EDGE;
+
+        events[i].is_active = gpio->is_active_low ? !value : value;
+        events[i].timestamp_ns = ev->timestamp_ns;
+    }
+
+    return count;
+#else /* !HAVE_GPIO_CDEV_V2 */
+    return -1;
+#endif /* HAVE_GPIO_CDEV_V2 */
+}
+
+#if HAVE_GPIO_CDEV_V2
+
+static bool sample_gpio_line_value(const struct gpio_handle *gpio)
+{
+    struct gpio_v2_line_values values =
+    {
+        .mask = 1,
+    };
+
+    if(ioctl(gpio->value_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0)
+    {
+        msg_error(errno, LOG_EMERG,
+                  "Failed reading GPIO line value from fd %d", gpio->value_fd);
+        return false;
+    }
+
+    return (values.bits & 1) != 0;
+}
+
+#endif /* HAVE_GPIO_CDEV_V2 */
+
 static bool sample_gpio_value(const struct gpio_handle *gpio)
 {
+#if HAVE_GPIO_CDEV_V2
+    if(gpio->backend == GPIO_BACKEND_CDEV)
+        return sample_gpio_line_value(gpio);
+#endif /* HAVE_GPIO_CDEV_V2 */
+
     ssize_t bytes;
     char buffer[10];
 
@@ -277,31 +512,171 @@ static bool sample_gpio_value(const struct gpio_handle *gpio)
 
 bool gpio_is_active(const struct gpio_handle *gpio)
 {
-    bool value = sample_gpio_value(gpio);
+    const bool value = gpio->is_debouncing_enabled
+        ? gpio->debounced_value
+        : sample_gpio_value(gpio);
 
-    if(gpio->is_debouncing_enabled)
-    {
-        static const int debounce_count = 10;
+    return gpio->is_active_low ? !value : value;
+}
 
-        int debounce = debounce_count;
+int gpio_get_debounce_fd(const struct gpio_handle *gpio)
+{
+    return gpio->is_debouncing_enabled ? gpio->debounce_fd : -1;
+}
 
-        while(--debounce > 0)
+static bool arm_debounce_timer(const struct gpio_handle *gpio)
+{
+    const struct itimerspec its =
+    {
+        .it_value =
         {
-            usleep(5000);
-
-            bool temp = sample_gpio_value(gpio);
-            if(temp != value)
-            {
-                value = temp;
-                debounce = debounce_count;
-            }
-        }
+            .tv_sec = gpio_debounce_period_us / 1000000U,
+            .tv_nsec = (gpio_debounce_period_us % 1000000U) * 1000U,
+        },
+    };
+
+    if(timerfd_settime(gpio->debounce_fd, 0, &its, NULL) == 0)
+        return true;
+
+    msg_error(errno, LOG_ERR,
+              "Failed arming debounce timer fd %d", gpio->debounce_fd);
+
+    return false;
+}
+
+/*!
+ * Consume the timer expiration.
+ *
+ * \returns
+ *     False if the timer has not expired, i.e., it was re-armed after it had
+ *     been reported as expired by \c poll(2).
+ */
+static bool acknowledge_debounce_timer(const struct gpio_handle *gpio)
+{
+    uint64_t expirations;
+
+    if(read(gpio->debounce_fd, &expirations, sizeof(expirations)) ==
+       sizeof(expirations))
+        return true;
+
+    if(errno != EAGAIN)
+        msg_error(errno, LOG_ERR,
+                  "Failed reading debounce timer fd %d", gpio->debounce_fd);
+
+    return false;
+}
+
+static void discard_edge_events(const struct gpio_handle *gpio)
+{
+#if HAVE_GPIO_CDEV_V2
+    if(gpio->backend != GPIO_BACKEND_CDEV)
+        return;
+
+    struct gpio_v2_line_event kernel_events[16];
+
+    while(read(gpio->value_fd, kernel_events, sizeof(kernel_events)) > 0)
+        ;
+#endif /* HAVE_GPIO_CDEV_V2 */
+}
+
+enum GpioDebounceResult gpio_debounce(struct gpio_handle *gpio,
+                                      bool is_timer_event,
+                                      struct stats_wait *stats)
+{
+    if(!gpio->is_debouncing_enabled)
+        return GPIO_DEBOUNCE_SETTLED;
+
+    if(is_timer_event)
+    {
+        if(!acknowledge_debounce_timer(gpio))
+            return gpio->is_bouncing ? GPIO_DEBOUNCE_BOUNCING : GPIO_DEBOUNCE_SETTLED;
+
+        if(!gpio->is_bouncing)
+            return GPIO_DEBOUNCE_SETTLED;
+
+        gpio->debounced_value = sample_gpio_value(gpio);
+        gpio->is_bouncing = false;
+        stats_wait_end(stats, &gpio->bounce_started, gpio->bounces);
+
+        return GPIO_DEBOUNCE_SETTLED;
     }
 
-    return gpio->is_active_low ? !value : value;
+    discard_edge_events(gpio);
+
+    const bool value = sample_gpio_value(gpio);
+
+    if(gpio->is_bouncing)
+        ++gpio->bounces;
+    else if(value == gpio->debounced_value)
+        return GPIO_DEBOUNCE_SETTLED;
+    else
+    {
+        gpio->is_bouncing = true;
+        gpio->bounces = 0;
+        os_clock_gettime(CLOCK_MONOTONIC, &gpio->bounce_started);
+    }
+
+    /* restart the debounce period on each change */
+    if(arm_debounce_timer(gpio))
+        return GPIO_DEBOUNCE_BOUNCING;
+
+    /* no timer, so take what we have */
+    gpio->debounced_value = value;
+    gpio->is_bouncing = false;
+
+    return GPIO_DEBOUNCE_SETTLED;
 }
 
+#if HAVE_GPIO_CDEV_V2
+
+static bool set_kernel_debounce_period(const struct gpio_handle *gpio)
+{
+    struct gpio_v2_line_config config;
+    memset(&config, 0, sizeof(config));
+
+    config.flags =
+        GPIO_V2_LINE_FLAG_INPUT |
+        GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+    config.num_attrs = 1;
+    config.attrs[0].mask = 1;
+    config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_DEBOUNCE;
+    config.attrs[0].attr.debounce_period_us = gpio_debounce_period_us;
+
+    if(ioctl(gpio->value_fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &config) < 0)
+    {
+        msg_error(errno, LOG_NOTICE,
+                  "Kernel debouncing not available, debouncing in software");
+        return false;
+    }
+
+    MSG_VINFO(MESSAGE_LEVEL_DIAG, "GPIO debounced by kernel, %u us",
+              gpio_debounce_period_us);
+
+    return true;
+}
+
+#endif /* HAVE_GPIO_CDEV_V2 */
+
 void gpio_enable_debouncing(struct gpio_handle *gpio)
 {
+    if(gpio->is_debouncing_enabled)
+        return;
+
+#if HAVE_GPIO_CDEV_V2
+    if(gpio->backend == GPIO_BACKEND_CDEV && set_kernel_debounce_period(gpio))
+        return;
+#endif /* HAVE_GPIO_CDEV_V2 */
+
+    gpio->debounce_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if(gpio->debounce_fd < 0)
+    {
+        msg_error(errno, LOG_ERR,
+                  "Failed creating debounce timer, GPIO not debounced");
+        return;
+    }
+
+    gpio->debounced_value = sample_gpio_value(gpio);
+    gpio->is_bouncing = false;
     gpio->is_debouncing_enabled = true;
 }
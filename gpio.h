@@ -22,18 +22,125 @@
 #ifndef GPIO_H
 #define GPIO_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include "statistics.h"
+
 struct gpio_handle;
 
+/*!
+ * Edge on the GPIO, as reported by the GPIO character device.
+ */
+struct gpio_edge_event
+{
+    /*! GPIO state after the edge, polarity already applied. */
+    bool is_active;
+
+    /*! Time of the edge in ns, as measured by the kernel. */
+    uint64_t timestamp_ns;
+};
+
+/*!
+ * Result of feeding a GPIO change into the software debouncer.
+ */
+enum GpioDebounceResult
+{
+    /*! The GPIO is stable, #gpio_is_active() returns its current state. */
+    GPIO_DEBOUNCE_SETTLED,
+
+    /*! The GPIO has changed recently, wait for the debounce fd. */
+    GPIO_DEBOUNCE_BOUNCING,
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*!
+ * Open GPIO through sysfs.
+ */
 struct gpio_handle *gpio_open(unsigned int gpio_num, bool is_active_low);
+
+/*!
+ * Open GPIO through GPIO character device (uAPI v2).
+ *
+ * \returns
+ *     A GPIO handle, or \c NULL if the GPIO chip or line is not available or
+ *     if the character device uAPI v2 is not supported. Callers may fall back
+ *     to #gpio_open() in this case.
+ */
+struct gpio_handle *gpio_open_chardev(const char *chip_name,
+                                      unsigned int line_offset,
+                                      bool is_active_low);
+
 void gpio_close(struct gpio_handle *gpio);
 int gpio_get_poll_fd(const struct gpio_handle *gpio);
+
+/*!
+ * Which \c poll(2) events indicate changes on the fd returned by
+ * #gpio_get_poll_fd().
+ */
+short gpio_get_poll_events(const struct gpio_handle *gpio);
+
+/*!
+ * Whether or not the GPIO backend delivers a queue of edge events.
+ */
+bool gpio_has_edge_events(const struct gpio_handle *gpio);
+
+/*!
+ * Read pending edge events, oldest first, without blocking.
+ *
+ * \returns
+ *     Number of events stored in \p events, 0 if there are none, or -1 on
+ *     error or if the backend does not support edge events.
+ */
+ssize_t gpio_read_edge_events(struct gpio_handle *gpio,
+                              struct gpio_edge_event *events, size_t max_events);
+
 bool gpio_is_active(const struct gpio_handle *gpio);
+
+/*!
+ * Debounce the GPIO, either by the kernel or in software.
+ *
+ * The kernel is asked to debounce the line if the character device is used.
+ * Otherwise, the GPIO is debounced in software by a timer which must be
+ * watched by the caller (see #gpio_get_debounce_fd()). Nothing blocks in
+ * either case.
+ */
 void gpio_enable_debouncing(struct gpio_handle *gpio);
 
+/*!
+ * File descriptor of the software debounce timer, -1 if there is none.
+ *
+ * The fd becomes readable (\c POLLIN) when the GPIO has been stable for long
+ * enough. Call #gpio_debounce() with \p is_timer_event set to true then.
+ */
+int gpio_get_debounce_fd(const struct gpio_handle *gpio);
+
+/*!
+ * Feed GPIO change or debounce timer expiry into the software debouncer.
+ *
+ * \param gpio
+ *     The GPIO to debounce.
+ *
+ * \param is_timer_event
+ *     True if the debounce fd has become readable, false if the GPIO poll fd
+ *     has reported a change.
+ *
+ * \param stats
+ *     Debounce latency and bounces are recorded here, may be \c NULL.
+ *
+ * \returns
+ *     #GPIO_DEBOUNCE_SETTLED if the GPIO is stable (not necessarily changed),
+ *     #GPIO_DEBOUNCE_BOUNCING if the caller should wait for the debounce
+ *     timer. Always #GPIO_DEBOUNCE_SETTLED if not debouncing in software.
+ */
+enum GpioDebounceResult gpio_debounce(struct gpio_handle *gpio,
+                                      bool is_timer_event,
+                                      struct stats_wait *stats);
+
 #ifdef __cplusplus
 }
 #endif
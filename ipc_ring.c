@@ -0,0 +1,530 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/eventfd.h>
+
+#include "ipc_ring.h"
+#include "messages.h"
+
+struct ipc_channel
+{
+    bool is_in_use;
+    const char *socket_path;
+    int peer_fd;
+    int memfd;
+    int efd_to_spi;
+    int efd_to_dcpd;
+    int efd_space_to_spi;
+    int efd_space_to_dcpd;
+    struct ipc_shared *shared;
+
+    /* write end of the pipe behind \c peer_fd for local channels */
+    int hangup_fd;
+};
+
+static struct ipc_channel the_channel;
+
+size_t ipc_ring_used(const struct ipc_ring *ring)
+{
+    const uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    const uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+    return tail - head;
+}
+
+size_t ipc_ring_put(struct ipc_ring *ring,
+                    const struct iovec *iov, size_t iovcnt)
+{
+    const uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    size_t space = IPC_RING_SIZE - (tail - head);
+    size_t total = 0;
+
+    for(size_t i = 0; i < iovcnt && space > 0; ++i)
+    {
+        const uint8_t *src = iov[i].iov_base;
+        size_t len = iov[i].iov_len < space ? iov[i].iov_len : space;
+
+        space -= len;
+        total += len;
+
+        while(len > 0)
+        {
+            const size_t offset = tail & (IPC_RING_SIZE - 1);
+            const size_t chunk =
+                len < IPC_RING_SIZE - offset ? len : IPC_RING_SIZE - offset;
+
+            memcpy(ring->data + offset, src, chunk);
+            src += chunk;
+            tail += chunk;
+            len -= chunk;
+        }
+    }
+
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+    return total;
+}
+
+size_t ipc_ring_get(struct ipc_ring *ring, uint8_t *dest, size_t count)
+{
+    const uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    const size_t used = tail - head;
+
+    if(count > used)
+        count = used;
+
+    for(size_t remaining = count; remaining > 0; /* nothing */)
+    {
+        const size_t offset = head & (IPC_RING_SIZE - 1);
+        const size_t chunk = remaining < IPC_RING_SIZE - offset
+            ? remaining
+            : IPC_RING_SIZE - offset;
+
+        memcpy(dest, ring->data + offset, chunk);
+        dest += chunk;
+        head += chunk;
+        remaining -= chunk;
+    }
+
+    __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+static void close_fd(int *fd)
+{
+    if(*fd < 0)
+        return;
+
+    int ret;
+    while((ret = close(*fd)) < 0 && errno == EINTR)
+        ;
+
+    if(ret < 0)
+        msg_error(errno, LOG_ERR, "Failed closing fd %d", *fd);
+
+    *fd = -1;
+}
+
+static int wait_for_peer(const char *socket_path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    if(strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+        msg_error(ENAMETOOLONG, LOG_EMERG,
+                  "Socket name \"%s\" too long", socket_path);
+        return -1;
+    }
+
+    strcpy(addr.sun_path, socket_path);
+
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if(listen_fd < 0)
+    {
+        msg_error(errno, LOG_EMERG, "Failed creating Unix socket");
+        return -1;
+    }
+
+    unlink(socket_path);
+
+    if(bind(listen_fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+       listen(listen_fd, 1) < 0)
+    {
+        msg_error(errno, LOG_EMERG,
+                  "Failed listening on socket \"%s\"", socket_path);
+        close(listen_fd);
+        return -1;
+    }
+
+    msg_info("Waiting for DCP daemon on \"%s\"", socket_path);
+
+    int peer_fd;
+    while((peer_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC)) < 0 &&
+          errno == EINTR)
+        ;
+
+    if(peer_fd < 0)
+        msg_error(errno, LOG_EMERG,
+                  "Failed accepting connection on \"%s\"", socket_path);
+
+    close(listen_fd);
+
+    return peer_fd;
+}
+
+static bool send_handshake(const struct ipc_channel *ch)
+{
+    const struct ipc_handshake hs =
+    {
+        .magic = IPC_RING_MAGIC,
+        .version = IPC_RING_VERSION,
+        .ring_size = IPC_RING_SIZE,
+    };
+    const int fds[5] =
+    {
+        ch->memfd, ch->efd_to_spi, ch->efd_to_dcpd,
+        ch->efd_space_to_spi, ch->efd_space_to_dcpd,
+    };
+
+    union
+    {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(fds))];
+    }
+    control;
+
+    struct iovec iov =
+    {
+        .iov_base = (void *)&hs,
+        .iov_len = sizeof(hs),
+    };
+
+    struct msghdr msg =
+    {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf),
+    };
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t ret;
+    while((ret = sendmsg(ch->peer_fd, &msg, MSG_NOSIGNAL)) < 0 &&
+          errno == EINTR)
+        ;
+
+    if(ret != (ssize_t)sizeof(hs))
+    {
+        msg_error(errno, LOG_EMERG, "Failed sending IPC handshake");
+        return false;
+    }
+
+    return true;
+}
+
+static bool create_eventfds(struct ipc_channel *ch)
+{
+    ch->efd_to_spi = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ch->efd_to_dcpd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ch->efd_space_to_spi = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ch->efd_space_to_dcpd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if(ch->efd_to_spi >= 0 && ch->efd_to_dcpd >= 0 &&
+       ch->efd_space_to_spi >= 0 && ch->efd_space_to_dcpd >= 0)
+        return true;
+
+    msg_error(errno, LOG_EMERG, "Failed creating eventfd");
+
+    return false;
+}
+
+struct ipc_channel *ipc_channel_create(const char *socket_path)
+{
+    struct ipc_channel *ch = &the_channel;
+
+    if(ch->is_in_use)
+    {
+        MSG_BUG("IPC channel already in use");
+        return NULL;
+    }
+
+    ch->socket_path = socket_path;
+    ch->memfd = -1;
+    ch->efd_to_spi = -1;
+    ch->efd_to_dcpd = -1;
+    ch->efd_space_to_spi = -1;
+    ch->efd_space_to_dcpd = -1;
+    ch->shared = NULL;
+    ch->hangup_fd = -1;
+
+    ch->peer_fd = wait_for_peer(socket_path);
+    if(ch->peer_fd < 0)
+        return NULL;
+
+    ch->memfd = memfd_create("dcpspi_ipc", MFD_CLOEXEC);
+    if(ch->memfd < 0)
+    {
+        msg_error(errno, LOG_EMERG, "Failed creating shared memory");
+        goto error_exit;
+    }
+
+    if(ftruncate(ch->memfd, sizeof(*ch->shared)) < 0)
+    {
+        msg_error(errno, LOG_EMERG, "Failed resizing shared memory");
+        goto error_exit;
+    }
+
+    ch->shared = mmap(NULL, sizeof(*ch->shared), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, ch->memfd, 0);
+    if(ch->shared == MAP_FAILED)
+    {
+        ch->shared = NULL;
+        msg_error(errno, LOG_EMERG, "Failed mapping shared memory");
+        goto error_exit;
+    }
+
+    memset(ch->shared, 0, sizeof(*ch->shared));
+
+    if(!create_eventfds(ch))
+        goto error_exit;
+
+    if(!send_handshake(ch))
+        goto error_exit;
+
+    ch->is_in_use = true;
+
+    msg_info("DCP daemon connected via shared memory");
+
+    return ch;
+
+error_exit:
+    ch->is_in_use = true;
+    ipc_channel_close(ch);
+    return NULL;
+}
+
+struct ipc_channel *ipc_channel_create_local(void)
+{
+    struct ipc_channel *ch = &the_channel;
+
+    if(ch->is_in_use)
+    {
+        MSG_BUG("IPC channel already in use");
+        return NULL;
+    }
+
+    ch->socket_path = NULL;
+    ch->peer_fd = -1;
+    ch->memfd = -1;
+    ch->efd_to_spi = -1;
+    ch->efd_to_dcpd = -1;
+    ch->efd_space_to_spi = -1;
+    ch->efd_space_to_dcpd = -1;
+    ch->hangup_fd = -1;
+
+    /* private memory is fine, both ends are in this process */
+    ch->shared = mmap(NULL, sizeof(*ch->shared), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ch->shared == MAP_FAILED)
+    {
+        ch->shared = NULL;
+        msg_error(errno, LOG_EMERG, "Failed mapping ring buffers");
+        goto error_exit;
+    }
+
+    if(!create_eventfds(ch))
+        goto error_exit;
+
+    int hangup_pipe[2];
+
+    if(pipe2(hangup_pipe, O_CLOEXEC) < 0)
+    {
+        msg_error(errno, LOG_EMERG, "Failed creating hangup pipe");
+        goto error_exit;
+    }
+
+    ch->peer_fd = hangup_pipe[0];
+    ch->hangup_fd = hangup_pipe[1];
+    ch->is_in_use = true;
+
+    return ch;
+
+error_exit:
+    ch->is_in_use = true;
+    ipc_channel_close(ch);
+    return NULL;
+}
+
+void ipc_channel_close(struct ipc_channel *channel)
+{
+    if(channel == NULL || !channel->is_in_use)
+        return;
+
+    if(channel->shared != NULL)
+    {
+        munmap(channel->shared, sizeof(*channel->shared));
+        channel->shared = NULL;
+    }
+
+    close_fd(&channel->efd_space_to_dcpd);
+    close_fd(&channel->efd_space_to_spi);
+    close_fd(&channel->efd_to_dcpd);
+    close_fd(&channel->efd_to_spi);
+    close_fd(&channel->memfd);
+    close_fd(&channel->hangup_fd);
+    close_fd(&channel->peer_fd);
+
+    if(channel->socket_path != NULL &&
+       unlink(channel->socket_path) < 0 && errno != ENOENT)
+        msg_error(errno, LOG_ERR,
+                  "Failed deleting socket \"%s\"", channel->socket_path);
+
+    channel->is_in_use = false;
+}
+
+int ipc_channel_get_poll_fd(const struct ipc_channel *channel)
+{
+    return channel->efd_to_spi;
+}
+
+int ipc_channel_get_peer_fd(const struct ipc_channel *channel)
+{
+    return channel->peer_fd;
+}
+
+static void signal_eventfd(int fd)
+{
+    static const uint64_t one = 1;
+
+    while(write(fd, &one, sizeof(one)) < 0 && errno == EINTR)
+        ;
+}
+
+static void reset_eventfd(int fd)
+{
+    uint64_t dummy;
+
+    while(read(fd, &dummy, sizeof(dummy)) < 0 && errno == EINTR)
+        ;
+}
+
+static ssize_t read_from_ring(struct ipc_ring *ring, int efd, int space_efd,
+                              uint8_t *dest, size_t count)
+{
+    /* reset wake-up before looking at the ring so that no signal is lost */
+    reset_eventfd(efd);
+
+    const size_t len = ipc_ring_get(ring, dest, count);
+
+    if(ipc_ring_used(ring) > 0)
+        signal_eventfd(efd);
+
+    if(len == 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    /* pairs with the fence in #write_to_ring() */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if(__atomic_load_n(&ring->is_producer_waiting, __ATOMIC_RELAXED) != 0 &&
+       __atomic_exchange_n(&ring->is_producer_waiting, 0, __ATOMIC_RELAXED) != 0)
+        signal_eventfd(space_efd);
+
+    return len;
+}
+
+static ssize_t write_to_ring(struct ipc_ring *ring, int efd, int space_efd,
+                             const struct iovec *iov, int iovcnt)
+{
+    size_t len = ipc_ring_put(ring, iov, iovcnt);
+
+    if(len == 0)
+    {
+        /* ask for a wake-up, then look again in case the consumer has made
+         * room before it could have seen our request */
+        reset_eventfd(space_efd);
+        __atomic_store_n(&ring->is_producer_waiting, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+        len = ipc_ring_put(ring, iov, iovcnt);
+    }
+
+    if(len == 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    signal_eventfd(efd);
+
+    return len;
+}
+
+ssize_t ipc_channel_read(struct ipc_channel *channel,
+                         uint8_t *dest, size_t count)
+{
+    return read_from_ring(&channel->shared->to_spi, channel->efd_to_spi,
+                          channel->efd_space_to_spi, dest, count);
+}
+
+ssize_t ipc_channel_writev(struct ipc_channel *channel,
+                           const struct iovec *iov, int iovcnt)
+{
+    return write_to_ring(&channel->shared->to_dcpd, channel->efd_to_dcpd,
+                         channel->efd_space_to_dcpd, iov, iovcnt);
+}
+
+int ipc_channel_get_space_poll_fd(const struct ipc_channel *channel)
+{
+    return channel->efd_space_to_dcpd;
+}
+
+int ipc_channel_get_peer_poll_fd(const struct ipc_channel *channel)
+{
+    return channel->efd_to_dcpd;
+}
+
+ssize_t ipc_channel_peer_read(struct ipc_channel *channel,
+                              uint8_t *dest, size_t count)
+{
+    return read_from_ring(&channel->shared->to_dcpd, channel->efd_to_dcpd,
+                          channel->efd_space_to_dcpd, dest, count);
+}
+
+ssize_t ipc_channel_peer_writev(struct ipc_channel *channel,
+                                const struct iovec *iov, int iovcnt)
+{
+    return write_to_ring(&channel->shared->to_spi, channel->efd_to_spi,
+                         channel->efd_space_to_spi, iov, iovcnt);
+}
+
+int ipc_channel_get_peer_space_poll_fd(const struct ipc_channel *channel)
+{
+    return channel->efd_space_to_spi;
+}
+
+void ipc_channel_peer_hang_up(struct ipc_channel *channel)
+{
+    close_fd(&channel->hangup_fd);
+}
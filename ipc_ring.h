@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef IPC_RING_H
+#define IPC_RING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/*!
+ * Size of the data area of each ring, must be a power of 2.
+ */
+#define IPC_RING_SIZE 16384
+
+/*!
+ * Magic number sent along with the shared memory file descriptors.
+ */
+#define IPC_RING_MAGIC   0x44435052U
+
+/*!
+ * Version of the shared memory layout.
+ */
+#define IPC_RING_VERSION 2U
+
+/*!
+ * Lock-free ring buffer for a single producer and a single consumer.
+ *
+ * Head and tail are free-running 32 bit indices, so \c tail - \c head is the
+ * number of bytes in the ring. The producer owns \c tail, the consumer owns
+ * \c head; each is put on its own cache line so that producer and consumer do
+ * not fight over the same line.
+ *
+ * A producer which finds the ring full sets \c is_producer_waiting. The
+ * consumer clears it after taking data out, and signals the producer's
+ * eventfd for free space.
+ */
+struct ipc_ring
+{
+    uint32_t head;
+    uint32_t is_producer_waiting;
+    uint8_t pad_head[64 - 2 * sizeof(uint32_t)];
+    uint32_t tail;
+    uint8_t pad_tail[64 - sizeof(uint32_t)];
+    uint8_t data[IPC_RING_SIZE];
+};
+
+/*!
+ * Layout of the shared memory region.
+ *
+ * The DCP daemon is the producer of \c to_spi and the consumer of
+ * \c to_dcpd. Both rings carry the usual DCPSYNC-framed byte stream, just as
+ * the named pipes do.
+ */
+struct ipc_shared
+{
+    struct ipc_ring to_spi;
+    struct ipc_ring to_dcpd;
+};
+
+/*!
+ * Handshake payload sent along with the file descriptors.
+ *
+ * The file descriptors are passed in a single \c SCM_RIGHTS message in this
+ * order: shared memory, eventfd for data sent to dcpspi, eventfd for data
+ * sent to DCPD, eventfd for space in the ring to dcpspi (signaled by
+ * dcpspi), eventfd for space in the ring to DCPD (signaled by DCPD).
+ */
+struct ipc_handshake
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ring_size;
+};
+
+struct ipc_channel;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Number of bytes stored in the ring, consumer side.
+ */
+size_t ipc_ring_used(const struct ipc_ring *ring);
+
+/*!
+ * Copy data from an I/O vector into the ring, producer side.
+ *
+ * \returns
+ *     Number of bytes copied, which may be less than requested if the ring
+ *     does not have enough space.
+ */
+size_t ipc_ring_put(struct ipc_ring *ring,
+                    const struct iovec *iov, size_t iovcnt);
+
+/*!
+ * Remove up to \p count bytes from the ring, consumer side.
+ *
+ * \returns
+ *     Number of bytes copied to \p dest.
+ */
+size_t ipc_ring_get(struct ipc_ring *ring, uint8_t *dest, size_t count);
+
+/*!
+ * Wait for the DCP daemon on a Unix socket and set up shared memory.
+ *
+ * This function blocks until the daemon has connected.
+ *
+ * \returns
+ *     The channel, or \c NULL on error.
+ */
+struct ipc_channel *ipc_channel_create(const char *socket_path);
+
+/*!
+ * Set up a channel within this process, without DCPD.
+ *
+ * The other end is served by a thread of our own through the \c peer
+ * functions, see #ipc_channel_peer_read(). There is no socket; the peer file
+ * descriptor is the read end of a pipe which reports \c POLLHUP after
+ * #ipc_channel_peer_hang_up() so that disconnects look the same as for DCPD.
+ *
+ * \returns
+ *     The channel, or \c NULL on error.
+ */
+struct ipc_channel *ipc_channel_create_local(void);
+
+/*!
+ * Tear down the channel and remove the socket.
+ */
+void ipc_channel_close(struct ipc_channel *channel);
+
+/*!
+ * File descriptor which becomes readable when DCPD has sent data.
+ */
+int ipc_channel_get_poll_fd(const struct ipc_channel *channel);
+
+/*!
+ * Connected socket, reports \c POLLHUP when DCPD goes away.
+ */
+int ipc_channel_get_peer_fd(const struct ipc_channel *channel);
+
+/*!
+ * Drop-in replacement for \c read(2) on the inbound ring.
+ *
+ * \returns
+ *     Number of bytes read, or -1 with \c errno set to \c EAGAIN if the
+ *     ring is empty.
+ */
+ssize_t ipc_channel_read(struct ipc_channel *channel,
+                         uint8_t *dest, size_t count);
+
+/*!
+ * Drop-in replacement for \c writev(2) on the outbound ring.
+ *
+ * \returns
+ *     Number of bytes written, or -1 with \c errno set to \c EAGAIN if the
+ *     ring is full. Wait for #ipc_channel_get_space_poll_fd() in the latter
+ *     case.
+ */
+ssize_t ipc_channel_writev(struct ipc_channel *channel,
+                           const struct iovec *iov, int iovcnt);
+
+/*!
+ * File descriptor which becomes readable when DCPD has made room in a full
+ * outbound ring.
+ *
+ * Only meaningful after #ipc_channel_writev() has failed with \c EAGAIN.
+ */
+int ipc_channel_get_space_poll_fd(const struct ipc_channel *channel);
+
+/*!
+ * File descriptor which becomes readable when data for DCPD are available.
+ *
+ * This and the following functions are for the DCPD end of a local channel.
+ */
+int ipc_channel_get_peer_poll_fd(const struct ipc_channel *channel);
+
+/*!
+ * Like #ipc_channel_read(), but on the outbound ring.
+ */
+ssize_t ipc_channel_peer_read(struct ipc_channel *channel,
+                              uint8_t *dest, size_t count);
+
+/*!
+ * Like #ipc_channel_writev(), but on the inbound ring.
+ */
+ssize_t ipc_channel_peer_writev(struct ipc_channel *channel,
+                                const struct iovec *iov, int iovcnt);
+
+/*!
+ * Like #ipc_channel_get_space_poll_fd(), but for the inbound ring.
+ */
+int ipc_channel_get_peer_space_poll_fd(const struct ipc_channel *channel);
+
+/*!
+ * Tell the channel user that DCPD has gone away.
+ */
+void ipc_channel_peer_hang_up(struct ipc_channel *channel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !IPC_RING_H */
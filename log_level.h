@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+
+#ifndef LOG_LEVEL_H
+#define LOG_LEVEL_H
+
+#include "messages.h"
+
+/*!
+ * \file
+ * Verbose messages which can be compiled out.
+ *
+ * Messages more verbose than #MSG_COMPILED_LEVEL_MAX are removed by the
+ * compiler, including the evaluation of their arguments. For the remaining
+ * levels, the current verbosity is checked before any arguments are
+ * evaluated.
+ */
+
+/*!
+ * Least important verbosity level compiled into the program.
+ *
+ * Set by the build system, all levels are compiled in by default. Levels
+ * down to #MESSAGE_LEVEL_NORMAL can be removed this way.
+ */
+#ifndef MSG_COMPILED_LEVEL_MAX
+#define MSG_COMPILED_LEVEL_MAX MESSAGE_LEVEL_TRACE
+#endif /* !MSG_COMPILED_LEVEL_MAX */
+
+/*!
+ * Whether or not messages of given level are compiled in.
+ */
+#define MSG_LEVEL_IS_COMPILED(LEVEL) ((LEVEL) <= MSG_COMPILED_LEVEL_MAX)
+
+/*!
+ * Whether or not messages of given level would be emitted now.
+ */
+#define MSG_IS_VERBOSE(LEVEL) \
+    (MSG_LEVEL_IS_COMPILED(LEVEL) && msg_is_verbose(LEVEL))
+
+/*!
+ * Like \c msg_vinfo(), but compiled out above #MSG_COMPILED_LEVEL_MAX.
+ */
+#define MSG_VINFO(LEVEL, ...) \
+    do \
+    { \
+        if(MSG_IS_VERBOSE(LEVEL)) \
+            msg_vinfo((LEVEL), __VA_ARGS__); \
+    } \
+    while(0)
+
+/*!
+ * Like \c hexdump_to_log(), but compiled out above #MSG_COMPILED_LEVEL_MAX.
+ *
+ * Requires \c hexdump.h.
+ */
+#define MSG_HEXDUMP(LEVEL, ...) \
+    do \
+    { \
+        if(MSG_IS_VERBOSE(LEVEL)) \
+            hexdump_to_log((LEVEL), __VA_ARGS__); \
+    } \
+    while(0)
+
+#endif /* !LOG_LEVEL_H */
@@ -28,9 +28,13 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "named_pipe.h"
 #include "messages.h"
+#include "log_level.h"
 
 int fifo_create_and_open(const char *devname, bool write_not_read)
 {
@@ -57,15 +61,52 @@ int fifo_open(const char *devname, bool write_not_read)
         msg_error(errno, LOG_EMERG,
                   "Failed opening named pipe \"%s\"", devname);
     else
-        msg_vinfo(MESSAGE_LEVEL_TRACE,
+        MSG_VINFO(MESSAGE_LEVEL_TRACE,
                   "Opened %sable pipe \"%s\", fd %d",
                   write_not_read ? "writ" : "read", devname, ret);
 
     return ret;
 }
 
+int fifo_set_nonblocking(int fd)
+{
+    const int flags = fcntl(fd, F_GETFL);
+
+    if(flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        msg_error(errno, LOG_ERR,
+                  "Failed making named pipe fd %d non-blocking", fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+int fifo_try_open_for_writing(const char *devname)
+{
+    int ret = open(devname, O_WRONLY | O_NONBLOCK);
+
+    if(ret < 0)
+    {
+        if(errno != ENXIO)
+            msg_error(errno, LOG_ERR,
+                      "Failed opening named pipe \"%s\"", devname);
+
+        return -1;
+    }
+
+    MSG_VINFO(MESSAGE_LEVEL_TRACE,
+              "Opened writable pipe \"%s\", fd %d", devname, ret);
+
+    return ret;
+}
+
 void fifo_close(int *fd)
 {
+    /* the pipe to DCPD is not open while its stream is being restarted */
+    if(*fd < 0)
+        return;
+
     int ret;
 
     while((ret = close(*fd)) < 0 && errno == EINTR)
@@ -85,3 +126,69 @@ void fifo_close_and_delete(int *fd, const char *devname)
         msg_error(errno, LOG_ERR,
                   "Failed deleting named pipe \"%s\"", devname);
 }
+
+int seqpacket_listen(const char *sockname)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    if(strlen(sockname) >= sizeof(addr.sun_path))
+    {
+        msg_error(ENAMETOOLONG, LOG_EMERG,
+                  "Failed creating socket \"%s\"", sockname);
+        return -1;
+    }
+
+    strcpy(addr.sun_path, sockname);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+    if(fd < 0)
+    {
+        msg_error(errno, LOG_EMERG, "Failed creating socket \"%s\"", sockname);
+        return -1;
+    }
+
+    if(unlink(sockname) < 0 && errno != ENOENT)
+        msg_error(errno, LOG_WARNING,
+                  "Failed deleting stale socket \"%s\"", sockname);
+
+    if(bind(fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+       listen(fd, 1) < 0)
+    {
+        msg_error(errno, LOG_EMERG,
+                  "Failed listening on socket \"%s\"", sockname);
+        fifo_close(&fd);
+        return -1;
+    }
+
+    MSG_VINFO(MESSAGE_LEVEL_TRACE,
+              "Listening on socket \"%s\", fd %d", sockname, fd);
+
+    return fd;
+}
+
+int seqpacket_accept(int listen_fd)
+{
+    const int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if(fd < 0)
+    {
+        if(errno != EINTR)
+            msg_error(errno, LOG_EMERG,
+                      "Failed accepting connection on fd %d", listen_fd);
+    }
+    else
+        MSG_VINFO(MESSAGE_LEVEL_TRACE,
+                  "Accepted connection on fd %d, fd %d", listen_fd, fd);
+
+    return fd;
+}
+
+void seqpacket_close_and_delete(int *listen_fd, const char *sockname)
+{
+    fifo_close(listen_fd);
+
+    if(unlink(sockname) < 0)
+        msg_error(errno, LOG_ERR,
+                  "Failed deleting socket \"%s\"", sockname);
+}
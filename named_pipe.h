@@ -33,6 +33,38 @@ int fifo_open(const char *devname, bool write_not_read);
 void fifo_close_and_delete(int *fd, const char *devname);
 void fifo_close(int *fd);
 
+/*!
+ * Make writes to a named pipe fail with \c EAGAIN instead of blocking.
+ */
+int fifo_set_nonblocking(int fd);
+
+/*!
+ * Open named pipe for writing if some process has it open for reading.
+ *
+ * Unlike #fifo_open(), this function does not wait for the reader. It
+ * returns -1 with \c errno set to \c ENXIO if there is none yet, so that the
+ * caller can try again later. The pipe is opened in non-blocking mode.
+ */
+int fifo_try_open_for_writing(const char *devname);
+
+/*!
+ * Create a Unix domain socket of type \c SOCK_SEQPACKET and listen on it.
+ *
+ * Unlike the named pipes, each \c recv() on a connection returns exactly one
+ * packet written by DCPD, and the socket can be connected to again after DCPD
+ * has gone away.
+ */
+int seqpacket_listen(const char *sockname);
+
+/*!
+ * Wait for DCPD to connect, return non-blocking connection.
+ *
+ * Returns -1 with \c errno set to \c EINTR if interrupted by a signal.
+ */
+int seqpacket_accept(int listen_fd);
+
+void seqpacket_close_and_delete(int *listen_fd, const char *sockname);
+
 #ifdef __cplusplus
 }
 #endif
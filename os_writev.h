@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+
+#ifndef OS_WRITEV_H
+#define OS_WRITEV_H
+
+#include <sys/uio.h>
+
+#include "os.h"
+
+/*!
+ * \file
+ * Vectored write hook missing from os.h.
+ *
+ * Declared here until it is available in the common code, next to the
+ * #os_read() and #os_write() hooks declared there. Like these, it is defined
+ * by the program (or by the tests) so that it can be redirected.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Vectored write to DCPD, defined along with \c os_write().
+ */
+extern ssize_t (*os_writev)(int fd, const struct iovec *iov, int iovcnt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !OS_WRITEV_H */
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "rt_profile.h"
+#include "messages.h"
+
+void rt_profile_init(struct rt_profile *profile)
+{
+    profile->sched_policy = SCHED_OTHER;
+    profile->sched_priority = 50;
+    CPU_ZERO(&profile->cpus);
+    profile->lock_memory = false;
+}
+
+bool rt_profile_policy_from_string(const char *name, int *policy)
+{
+    if(strcmp(name, "fifo") == 0)
+        *policy = SCHED_FIFO;
+    else if(strcmp(name, "rr") == 0)
+        *policy = SCHED_RR;
+    else if(strcmp(name, "other") == 0)
+        *policy = SCHED_OTHER;
+    else
+        return false;
+
+    return true;
+}
+
+static bool parse_cpu_number(const char **list, unsigned long *cpu)
+{
+    if(**list < '0' || **list > '9')
+        return false;
+
+    char *endptr;
+    *cpu = strtoul(*list, &endptr, 10);
+    *list = endptr;
+
+    return *cpu < CPU_SETSIZE;
+}
+
+bool rt_profile_cpus_from_string(const char *list, cpu_set_t *cpus)
+{
+    CPU_ZERO(cpus);
+
+    while(true)
+    {
+        unsigned long first;
+        unsigned long last;
+
+        if(!parse_cpu_number(&list, &first))
+            return false;
+
+        if(*list == '-')
+        {
+            ++list;
+
+            if(!parse_cpu_number(&list, &last) || last < first)
+                return false;
+        }
+        else
+            last = first;
+
+        for(unsigned long cpu = first; cpu <= last; ++cpu)
+            CPU_SET(cpu, cpus);
+
+        if(*list == '\0')
+            return true;
+
+        if(*list != ',')
+            return false;
+
+        ++list;
+    }
+}
+
+void rt_profile_prefault(void *buffer, size_t size)
+{
+    const long page_size = sysconf(_SC_PAGESIZE);
+    volatile uint8_t *const p = buffer;
+
+    if(size == 0)
+        return;
+
+    for(size_t i = 0; i < size; i += page_size)
+        p[i] = p[i];
+
+    p[size - 1] = p[size - 1];
+}
+
+static void __attribute__ ((noinline)) prefault_stack(void)
+{
+    uint8_t dummy[RT_PROFILE_STACK_PREFAULT_SIZE];
+    rt_profile_prefault(dummy, sizeof(dummy));
+}
+
+int rt_profile_apply(const struct rt_profile *profile)
+{
+    if(profile->lock_memory)
+    {
+        if(mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+        {
+            msg_error(errno, LOG_EMERG, "Failed locking memory");
+            return -1;
+        }
+
+        prefault_stack();
+        msg_info("Memory locked");
+    }
+
+    if(CPU_COUNT(&profile->cpus) > 0)
+    {
+        if(sched_setaffinity(0, sizeof(profile->cpus), &profile->cpus) < 0)
+        {
+            msg_error(errno, LOG_EMERG, "Failed setting CPU affinity");
+            return -1;
+        }
+
+        msg_info("Pinned to %d CPU%s",
+                 CPU_COUNT(&profile->cpus),
+                 CPU_COUNT(&profile->cpus) == 1 ? "" : "s");
+    }
+
+    if(profile->sched_policy != SCHED_OTHER)
+    {
+        const struct sched_param param =
+        {
+            .sched_priority = profile->sched_priority,
+        };
+
+        if(sched_setscheduler(0, profile->sched_policy, &param) < 0)
+        {
+            msg_error(errno, LOG_EMERG,
+                      "Failed setting %s scheduling with priority %d",
+                      profile->sched_policy == SCHED_FIFO ? "FIFO" : "RR",
+                      profile->sched_priority);
+            return -1;
+        }
+
+        msg_info("Running with %s scheduling, priority %d",
+                 profile->sched_policy == SCHED_FIFO ? "FIFO" : "RR",
+                 profile->sched_priority);
+    }
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef RT_PROFILE_H
+#define RT_PROFILE_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sched.h>
+
+/*!
+ * How much stack to fault in before entering the main loop.
+ */
+#define RT_PROFILE_STACK_PREFAULT_SIZE (128U * 1024U)
+
+/*!
+ * Execution environment for the main loop.
+ *
+ * Nothing is changed for members left at their defaults, see
+ * #rt_profile_init().
+ */
+struct rt_profile
+{
+    /*! \c SCHED_FIFO, \c SCHED_RR, or \c SCHED_OTHER to leave alone. */
+    int sched_policy;
+
+    /*! Only used for real-time policies, defaults to 50. */
+    int sched_priority;
+
+    /*! CPUs to run on, empty to leave alone. */
+    cpu_set_t cpus;
+
+    /*! Lock all current and future memory, prefault stack. */
+    bool lock_memory;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void rt_profile_init(struct rt_profile *profile);
+
+bool rt_profile_policy_from_string(const char *name, int *policy);
+
+/*!
+ * Parse list of CPUs such as "1", "0,2", or "0-1,3".
+ *
+ * \returns
+ *     True on success, false if the list is invalid or empty. The set is
+ *     undefined in the latter case.
+ */
+bool rt_profile_cpus_from_string(const char *list, cpu_set_t *cpus);
+
+/*!
+ * Apply profile to the calling thread, and to the process memory.
+ *
+ * Must be called after \c daemon(3) because memory locks are not inherited
+ * by child processes. Threads started before are not affected by scheduling
+ * policy and CPU affinity.
+ *
+ * \returns
+ *     0 on success, -1 on error.
+ */
+int rt_profile_apply(const struct rt_profile *profile);
+
+/*!
+ * Touch each page of given buffer so that it is mapped before use.
+ */
+void rt_profile_prefault(void *buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !RT_PROFILE_H */
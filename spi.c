@@ -25,19 +25,18 @@
 
 #include <string.h>
 #include <errno.h>
+#include <poll.h>
 
 #include "spi.h"
 #include "spi_hw.h"
 #include "dcpdefs.h"
 #include "messages.h"
+#include "log_level.h"
 #include "hexdump.h"
+#include "capture.h"
+#include "deadline.h"
 #include "os.h"
 
-/*!
- * SPI speed in Hz for all transfers.
- */
-static uint32_t spi_speed_hz = 900U * 1000U;
-
 /*!
  * Kernel spidev driver defaults to writing hard-coded 0's in case we
  * don't pass a tx_buf, but we need 0xff.
@@ -55,6 +54,29 @@ static const unsigned int spi_wait_for_slave_timeout_max_iterations = 3;
 static const unsigned int spi_read_from_slave_timeout_ms = 1000;
 static const unsigned int spi_read_from_slave_timeout_max_iterations = 5;
 
+/*!
+ * Extra bytes to read beyond the expected payload size.
+ *
+ * The slave may send a few NOPs before the payload, and the payload may
+ * contain escape sequences. Must not exceed the size of the SPI input buffer
+ * because surplus bytes end up there.
+ */
+static const size_t spi_payload_read_headroom = 16;
+
+/*!
+ * Size of the receive buffer for reading whole payloads in a single transfer.
+ */
+#define SPI_PAYLOAD_BUFFER_SIZE (2 * DCP_PAYLOAD_MAXSIZE)
+
+/*!
+ * Like #spi_dummy_bytes, but large enough for payload transfers.
+ *
+ * Filled with NOPs on first use, or by #spi_context_init().
+ */
+static uint8_t spi_payload_dummy_bytes[SPI_PAYLOAD_BUFFER_SIZE];
+
+static const unsigned int spi_slave_ready_max_delay_us = 5U * 1000U;
+
 static enum MessageVerboseLevel hexdump_traffic_level   = MESSAGE_LEVEL_TRACE;
 static enum MessageVerboseLevel hexdump_discarded_level = MESSAGE_LEVEL_DEBUG;
 static enum MessageVerboseLevel hexdump_collision_level = MESSAGE_LEVEL_DIAG;
@@ -73,54 +95,140 @@ void spi_enable_traffic_dump(void)
     hexdump_collision_level = MESSAGE_LEVEL_INFO_MIN;
 }
 
+/*!
+ * Bytes read from the slave, but not consumed yet.
+ *
+ * Bytes are consumed from \c read_pos on, and bytes are only appended while
+ * the buffer is empty, so nothing needs to be moved around. Bytes beyond the
+ * current packet are kept across transactions as long as they look like the
+ * beginning of another packet.
+ */
 struct spi_input_buffer
 {
     uint8_t buffer[sizeof(spi_dummy_bytes)];
+    size_t read_pos;
     size_t buffer_pos;
     bool pending_escape_sequence;
 };
 
-int spi_open_device(const char *devname)
+static inline size_t input_buffer_fill(const struct spi_input_buffer *in)
 {
-    return spi_hw_open_device(devname);
+    return in->buffer_pos - in->read_pos;
 }
 
-void spi_close_device(int fd)
+/*!
+ * Everything we need to know about one SPI slave.
+ */
+struct spi_context
 {
-    spi_hw_close_device(fd);
-}
+    /*! SPI speeds in Hz for reading and writing. */
+    struct spi_clock clock;
 
-static void compute_expiration_time(struct timespec *t, unsigned int timeout_ms)
-{
-    os_clock_gettime(CLOCK_MONOTONIC_RAW, t);
+    /*! How to wait between two slave ready probes. */
+    struct
+    {
+        enum SpiSlaveReadyStrategy strategy;
+        unsigned int min_delay_us;
+        unsigned int busy_poll_window_us;
+        int gpio_fd;
+        short gpio_events;
+    }
+    slave_ready;
 
-    if(timeout_ms == 0)
-        return;
+    /*!
+     * Where to record how much later than requested we wake up from sleeping.
+     *
+     * Measuring requires reading the clock around each sleep, so this is only
+     * done while statistics are enabled.
+     */
+    struct stats_histogram *sched_delay_histogram;
+
+    struct spi_input_buffer input_buffer;
 
-    const unsigned long timeout_remainder_ns =
-        (timeout_ms % 1000U) * 1000ULL * 1000ULL;
+    /*! Receive buffer for reading whole payloads in a single transfer. */
+    uint8_t payload_buffer[SPI_PAYLOAD_BUFFER_SIZE];
+};
 
-    t->tv_sec += timeout_ms / 1000U;
+#define SPI_CONTEXT_DEFAULTS \
+    { \
+        .clock = SPI_CLOCK_FIXED(900U * 1000U), \
+        .slave_ready = \
+        { \
+            .strategy = SPI_SLAVE_READY_FIXED_DELAY, \
+            .min_delay_us = 20, \
+            .busy_poll_window_us = 0, \
+            .gpio_fd = -1, \
+            .gpio_events = POLLPRI | POLLERR, \
+        }, \
+    }
 
-    if(timeout_remainder_ns < 1000ULL * 1000ULL * 1000ULL - t->tv_nsec)
-        t->tv_nsec += timeout_remainder_ns;
-    else
+/*!
+ * Preallocated contexts, one per slave.
+ *
+ * Only the first one is initialized statically, the others are set up by
+ * #spi_context_init() before use. Traffic capture only covers the first one.
+ */
+static struct spi_context spi_contexts[SPI_MAX_SLAVES] =
+{
+    [0] = SPI_CONTEXT_DEFAULTS,
+};
+
+/*!
+ * Context used by the calling thread, see #spi_context_switch().
+ */
+static _Thread_local struct spi_context *spi_ctx = &spi_contexts[0];
+
+struct spi_context *spi_context_init(unsigned int slave)
+{
+    if(slave >= SPI_MAX_SLAVES)
     {
-        ++t->tv_sec;
-        t->tv_nsec =
-            timeout_remainder_ns - (1000ULL * 1000ULL * 1000ULL - t->tv_nsec);
+        MSG_BUG("Invalid SPI slave %u", slave);
+        return NULL;
     }
+
+    static const struct spi_context defaults = SPI_CONTEXT_DEFAULTS;
+    spi_contexts[slave] = defaults;
+
+    /* not to be filled on first use when more than one thread may use it */
+    memset(spi_payload_dummy_bytes, UINT8_MAX, sizeof(spi_payload_dummy_bytes));
+
+    return &spi_contexts[slave];
 }
 
-static bool timeout_expired(const struct timespec *restrict timeout,
-                            const struct timespec *restrict current)
+struct spi_context *spi_context_switch(struct spi_context *ctx)
 {
-    if(current->tv_sec > timeout->tv_sec)
-        return true;
-    else if(current->tv_sec < timeout->tv_sec)
-        return false;
+    struct spi_context *const previous = spi_ctx;
+    spi_ctx = (ctx != NULL) ? ctx : &spi_contexts[0];
+    return previous;
+}
+
+static inline bool is_capturing(void)
+{
+    return spi_ctx == &spi_contexts[0] && capture_is_enabled();
+}
+
+static void report_to_clock(enum SpiClockDirection dir, enum SpiClockEvent event)
+{
+    if(spi_clock_report(&spi_ctx->clock, dir, event))
+        MSG_VINFO(MESSAGE_LEVEL_DIAG, "SPI %s clock set to %" PRIu32 " Hz (%s)",
+                  spi_clock_direction_to_string(dir),
+                  spi_clock_get_hz(&spi_ctx->clock, dir),
+                  spi_clock_event_to_string(event));
+}
+
+static inline bool is_dummy_tx(const void *tx)
+{
+    return tx == spi_dummy_bytes || tx == spi_payload_dummy_bytes;
+}
+
+int spi_open_device(const char *devname)
+{
+    return spi_hw_open_device(devname);
+}
 
-    return current->tv_nsec >= timeout->tv_nsec;
+void spi_close_device(int fd)
+{
+    spi_hw_close_device(fd);
 }
 
 static inline uint8_t unescape_byte(uint8_t byte)
@@ -140,8 +248,8 @@ static bool skip_nops(const uint8_t *const src, size_t src_size,
     return false;
 }
 
-static size_t filter_input(uint8_t *const buffer, size_t buffer_size,
-                           bool *const pending_escape_sequence)
+size_t spi_filter_input_reference(uint8_t *const buffer, size_t buffer_size,
+                                  bool *const pending_escape_sequence)
 {
     size_t src_pos = 0;
 
@@ -177,336 +285,917 @@ static size_t filter_input(uint8_t *const buffer, size_t buffer_size,
     return dest_pos;
 }
 
-static inline bool has_timeout_expired(struct timespec *expiration_time,
-                                       unsigned int *expirations_left,
-                                       bool *need_recompute_timeout)
-{
-    struct timespec current_time;
-    os_clock_gettime(CLOCK_MONOTONIC_RAW, &current_time);
-
-    if(!timeout_expired(expiration_time, &current_time))
-        return false;
+typedef unsigned long filter_word_t;
 
-    if(--*expirations_left == 0)
-        return true;
+#define FILTER_WORD_ONES   ((filter_word_t)-1 / 0xff)
+#define FILTER_WORD_HIGHS  (FILTER_WORD_ONES * 0x80)
 
-    *need_recompute_timeout = true;
-    return false;
+static inline filter_word_t load_filter_word(const uint8_t *src)
+{
+    filter_word_t w;
+    memcpy(&w, src, sizeof(w));
+    return w;
 }
 
-static enum SpiSendResult
-wait_for_spi_slave(int fd, uint8_t *const buffer, const size_t buffer_size,
-                   bool *have_significant_data, struct stats_io *io)
+/*!
+ * Nonzero if any byte in \p w is zero.
+ */
+static inline filter_word_t word_has_zero_byte(filter_word_t w)
 {
-    const struct spi_ioc_transfer spi_transfer[] =
-    {
-        {
-            .tx_buf = (unsigned long)spi_dummy_bytes,
-            .rx_buf = (unsigned long)buffer,
-            .len = buffer_size,
-            .speed_hz = spi_speed_hz,
-            .bits_per_word = 8,
-        },
-    };
+    return (w - FILTER_WORD_ONES) & ~w & FILTER_WORD_HIGHS;
+}
 
-    *have_significant_data = false;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
 
-    /*
-     * We need to try a few times because we may suffer from starvation by a
-     * real-time process. Our system scheduler isn't fair anymore, so we need
-     * to get a little sophisticated here.
-     *
-     * Worst case: we compute the expiration time, and then get preempted. It
-     * is possible that we have to wait for a few seconds before we can start
-     * our hardware transfer. Thus, our timeout may have expired well before
-     * the slave got the chance to take note of our attempt at communication.
-     * It may not have been ready to send anything, so we would run into the
-     * timeout after a single try.
-     *
-     * Second worst case: we get preempted before checking our timeout for the
-     * first time. Again, the timeout would be exceeded after a single try.
-     *
-     * To make our communication more robust, we make sure the first iteration
-     * has been executed and the SPI slave knows that we are communicating
-     * before we consider any timeouts. Then we compute the expiration time,
-     * and allow the timeout to expire at least 2 times so that the slave got a
-     * real chance for sending data. The jitter for the observed total timeout
-     * depends on the duration of the partial timeouts.
-     */
-    unsigned int expirations_left = spi_wait_for_slave_timeout_max_iterations + 1;
-    struct timespec expiration_time;
-    compute_expiration_time(&expiration_time, 0);
+#include <arm_neon.h>
 
-    while(1)
-    {
-        struct stats_context *prev_ctx = stats_io_begin(io);
+static inline bool neon_any_set(uint8x16_t v)
+{
+#if defined(__aarch64__)
+    return vmaxvq_u8(v) != 0;
+#else
+    const uint8x8_t folded = vorr_u8(vget_low_u8(v), vget_high_u8(v));
+    return vget_lane_u64(vreinterpret_u64_u8(folded), 0) != 0;
+#endif
+}
 
-        int ret =
-            spi_hw_do_transfer(fd, spi_transfer,
-                               sizeof(spi_transfer) / sizeof(spi_transfer[0]));
+#endif /* __ARM_NEON */
 
-        if(ret < 0)
-        {
-            stats_io_end(io, prev_ctx, 1, 0);
-            msg_error(errno, LOG_EMERG,
-                      "Failed waiting for slave device on fd %d", fd);
-            return SPI_SEND_RESULT_FAILURE;
-        }
+/*!
+ * Find first byte in \p src at or after \p pos which is not a NOP.
+ */
+static size_t find_non_nop(const uint8_t *const src, size_t src_size,
+                           size_t pos)
+{
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for(/* nothing */; pos + 16 <= src_size; pos += 16)
+    {
+        const uint8x16_t v = vld1q_u8(src + pos);
 
-        stats_io_end(io, prev_ctx, 0, spi_transfer[0].len);
+        if(neon_any_set(vmvnq_u8(v)))
+            break;
+    }
+#endif /* __ARM_NEON */
 
-        hexdump_to_log(hexdump_traffic_level, buffer, buffer_size, "Received");
+    for(/* nothing */; pos + sizeof(filter_word_t) <= src_size;
+        pos += sizeof(filter_word_t))
+    {
+        if(load_filter_word(src + pos) != (filter_word_t)-1)
+            break;
+    }
 
-        for(size_t i = 0; i < buffer_size; ++i)
-        {
-            if(buffer[i] == 0)
-                return SPI_SEND_RESULT_OK;
+    for(/* nothing */; pos < src_size; ++pos)
+    {
+        if(src[pos] != UINT8_MAX)
+            break;
+    }
 
-            if(buffer[i] != UINT8_MAX)
-            {
-                msg_error(0, LOG_NOTICE, "Collision detected (got funny poll bytes)");
-                *have_significant_data = true;
-                return SPI_SEND_RESULT_COLLISION;
-            }
-        }
+    return pos;
+}
 
-        /* only NOPs, try again if we are within the specified timeout... */
-        bool need_recompute_timeout = false;
-        if(has_timeout_expired(&expiration_time, &expirations_left,
-                               &need_recompute_timeout))
-        {
-            msg_error(0, LOG_NOTICE,
-                      "SPI write timeout, slave didn't get ready within %u ms",
-                      spi_wait_for_slave_timeout_max_iterations *
-                      spi_wait_for_slave_timeout_ms);
-            return SPI_SEND_RESULT_TIMEOUT;
-        }
+/*!
+ * Find first NOP or escape character in \p src at or after \p pos.
+ */
+static size_t find_special_byte(const uint8_t *const src, size_t src_size,
+                                size_t pos)
+{
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const uint8x16_t nops = vdupq_n_u8(UINT8_MAX);
+    const uint8x16_t escapes = vdupq_n_u8(DCP_ESCAPE_CHARACTER);
 
-        /* give the slave (and ourselves) a break */
-        static const struct timespec delay_between_slave_ready_probes =
-        {
-            .tv_nsec = 5L * 1000L * 1000L,
-        };
-        os_nanosleep(&delay_between_slave_ready_probes);
+    for(/* nothing */; pos + 16 <= src_size; pos += 16)
+    {
+        const uint8x16_t v = vld1q_u8(src + pos);
 
-        if(need_recompute_timeout)
-            compute_expiration_time(&expiration_time,
-                                    spi_wait_for_slave_timeout_ms);
+        if(neon_any_set(vorrq_u8(vceqq_u8(v, nops), vceqq_u8(v, escapes))))
+            break;
     }
-}
+#endif /* __ARM_NEON */
 
-static void handle_collision(uint8_t *const poll_bytes_buffer,
-                             const size_t poll_bytes_buffer_size,
-                             struct spi_input_buffer *in)
-{
-    bool pending_escape_sequence = false;
-    const size_t bytes_left = filter_input(poll_bytes_buffer,
-                                           poll_bytes_buffer_size,
-                                           &pending_escape_sequence);
+    static const filter_word_t escapes_word =
+        FILTER_WORD_ONES * DCP_ESCAPE_CHARACTER;
 
-    if(in->buffer_pos > 0)
-        MSG_BUG("Discarding %zu bytes from SPI receive buffer after collision",
-                in->buffer_pos);
+    for(/* nothing */; pos + sizeof(filter_word_t) <= src_size;
+        pos += sizeof(filter_word_t))
+    {
+        const filter_word_t w = load_filter_word(src + pos);
 
-    if(bytes_left > 0)
+        if(word_has_zero_byte(~w) || word_has_zero_byte(w ^ escapes_word))
+            break;
+    }
+
+    for(/* nothing */; pos < src_size; ++pos)
     {
-        memcpy(in->buffer, poll_bytes_buffer, bytes_left);
-        hexdump_to_log(hexdump_collision_level,
-                       in->buffer, bytes_left, "Colliding poll bytes");
+        if(src[pos] == UINT8_MAX || src[pos] == DCP_ESCAPE_CHARACTER)
+            break;
     }
 
-    in->buffer_pos = bytes_left;
-    in->pending_escape_sequence = pending_escape_sequence;
+    return pos;
 }
 
-static struct spi_input_buffer global_spi_input_buffer;
-
-enum SpiSendResult spi_send_buffer(int fd, const uint8_t *buffer, size_t length,
-                                   struct stats_io *io)
+size_t spi_filter_input(uint8_t *const buffer, size_t buffer_size,
+                        bool *const pending_escape_sequence)
 {
-    if(fd < 0)
+    size_t src_pos = find_non_nop(buffer, buffer_size, 0);
+
+    if(src_pos >= buffer_size)
+        return 0;
+
+    size_t dest_pos = 0;
+
+    if(*pending_escape_sequence)
     {
-        /* operating in dummy mode */
-        return SPI_SEND_RESULT_OK;
+        buffer[dest_pos++] = unescape_byte(buffer[src_pos++]);
+        *pending_escape_sequence = false;
     }
 
-    uint8_t poll_bytes_buffer[sizeof(spi_dummy_bytes) > 2 ? 2 : sizeof(spi_dummy_bytes)];
-    bool have_significant_data;
-    const enum SpiSendResult wait_result =
-        wait_for_spi_slave(fd, poll_bytes_buffer, sizeof(poll_bytes_buffer),
-                           &have_significant_data, io);
-
-    if(wait_result != SPI_SEND_RESULT_OK)
+    while((src_pos = find_non_nop(buffer, buffer_size, src_pos)) < buffer_size)
     {
-        if(wait_result == SPI_SEND_RESULT_COLLISION)
+        const size_t span_end = find_special_byte(buffer, buffer_size, src_pos);
+
+        if(span_end > src_pos)
         {
-            hexdump_to_log(hexdump_collision_level,
-                           buffer, length, "Tried to send during collision");
+            /* bulk-move a span of plain data */
+            if(dest_pos != src_pos)
+                memmove(buffer + dest_pos, buffer + src_pos, span_end - src_pos);
 
-            if(have_significant_data)
-                hexdump_to_log(hexdump_collision_level,
-                               poll_bytes_buffer, sizeof(poll_bytes_buffer),
-                               "Received poll bytes during collision");
+            dest_pos += span_end - src_pos;
+            src_pos = span_end;
+            continue;
         }
 
-        if(wait_result == SPI_SEND_RESULT_COLLISION && have_significant_data)
-            handle_collision(poll_bytes_buffer, sizeof(poll_bytes_buffer),
-                             &global_spi_input_buffer);
-
-        return wait_result;
-    }
+        /* escape character */
+        src_pos = find_non_nop(buffer, buffer_size, src_pos + 1);
 
-    const struct spi_ioc_transfer spi_transfer[] =
-    {
+        if(src_pos >= buffer_size)
         {
-            .tx_buf = (unsigned long)buffer,
-            .len = length,
-            .speed_hz = spi_speed_hz,
-            .bits_per_word = 8,
-        },
-    };
-
-    struct stats_context *prev_ctx = stats_io_begin(io);
-
-    const int ret =
-        spi_hw_do_transfer(fd, spi_transfer,
-                           sizeof(spi_transfer) / sizeof(spi_transfer[0]));
+            *pending_escape_sequence = true;
+            return dest_pos;
+        }
 
-    if(ret < 0)
-    {
-        stats_io_end(io, prev_ctx, 1, 0);
-        msg_error(errno, LOG_EMERG,
-                  "Failed writing %zu bytes to SPI device fd %d", length, fd);
-        return SPI_SEND_RESULT_FAILURE;
-    }
-    else
-    {
-        stats_io_end(io, prev_ctx, 0, spi_transfer[0].len);
-        hexdump_to_log(hexdump_traffic_level, buffer, length, "Sent");
-        return SPI_SEND_RESULT_OK;
+        buffer[dest_pos++] = unescape_byte(buffer[src_pos++]);
     }
+
+    return dest_pos;
 }
 
-size_t spi_fill_buffer_from_raw_data(uint8_t *dest, size_t dest_size,
-                                     const uint8_t *src, size_t src_size)
+void spi_transfer_batch_init(struct spi_transfer_batch *batch)
 {
-    size_t pos = 0;
+    memset(batch, 0, sizeof(*batch));
+}
 
-    for(size_t i = 0; i < src_size && pos < dest_size; ++i)
+bool spi_transfer_batch_add(struct spi_transfer_batch *batch,
+                            const uint8_t *tx_buffer, uint8_t *rx_buffer,
+                            size_t length, uint16_t delay_usecs,
+                            bool cs_change)
+{
+    if(batch->count >= SPI_TRANSFER_BATCH_MAX_FRAGMENTS)
     {
-        const uint8_t ch = src[i];
+        MSG_BUG("Too many SPI transfer fragments");
+        return false;
+    }
+
+    const enum SpiClockDirection dir =
+        tx_buffer == NULL ? SPI_CLOCK_READ : SPI_CLOCK_WRITE;
 
-        if(ch == UINT8_MAX)
+    if(tx_buffer == NULL)
+    {
+        if(length <= sizeof(spi_dummy_bytes))
+            tx_buffer = spi_dummy_bytes;
+        else if(length <= sizeof(spi_payload_dummy_bytes))
         {
-            dest[pos++] = DCP_ESCAPE_CHARACTER;
-            if(pos < dest_size)
-                dest[pos++] = 0x01;
+            if(spi_payload_dummy_bytes[0] != UINT8_MAX)
+                memset(spi_payload_dummy_bytes, UINT8_MAX,
+                       sizeof(spi_payload_dummy_bytes));
+
+            tx_buffer = spi_payload_dummy_bytes;
         }
-        else if(ch == DCP_ESCAPE_CHARACTER)
+        else
         {
-            dest[pos++] = DCP_ESCAPE_CHARACTER;
-            if(pos < dest_size)
-                dest[pos++] = DCP_ESCAPE_CHARACTER;
+            MSG_BUG("Cannot send %zu NOPs in one SPI transfer fragment", length);
+            return false;
         }
-        else
-            dest[pos++] = ch;
     }
 
-    return pos;
+    struct spi_ioc_transfer *const fragment = &batch->fragments[batch->count++];
+
+    fragment->tx_buf = (unsigned long)tx_buffer;
+    fragment->rx_buf = (unsigned long)rx_buffer;
+    fragment->len = length;
+    fragment->speed_hz = spi_clock_get_hz(&spi_ctx->clock, dir);
+    fragment->delay_usecs = delay_usecs;
+    fragment->bits_per_word = 8;
+    fragment->cs_change = cs_change ? 1 : 0;
+
+    batch->total_bytes += length;
+
+    return true;
 }
 
 /*!
- * Read a few, fixed number of bytes from SPI, return them filtered.
+ * Append all fragments of a submitted batch to the capture file.
  *
- * The buffer size must be at least as big as the #spi_dummy_bytes array.
+ * NOPs sent while reading are not captured, and neither are the bytes
+ * received by a failed transfer.
  */
-static ssize_t read_chunk(int fd, struct spi_input_buffer *const in,
-                          struct stats_io *io)
+static void capture_transfers(const struct spi_transfer_batch *batch, int ret)
 {
-    const struct spi_ioc_transfer spi_transfer[] =
+    const int save_errno = errno;
+
+    for(size_t i = 0; i < batch->count; ++i)
     {
-        {
-            .tx_buf = (unsigned long)spi_dummy_bytes,
-            .rx_buf = (unsigned long)in->buffer,
-            .len = sizeof(spi_dummy_bytes),
-            .speed_hz = spi_speed_hz,
-            .bits_per_word = 8,
-        },
-    };
+        const struct spi_ioc_transfer *const fragment = &batch->fragments[i];
+        const uint8_t *const tx = (const uint8_t *)(unsigned long)fragment->tx_buf;
+        const uint8_t *const rx = (const uint8_t *)(unsigned long)fragment->rx_buf;
+
+        if(tx != NULL && !is_dummy_tx(tx))
+            capture_record(CAPTURE_RECORD_SPI_TX, ret, tx, fragment->len);
+
+        if(rx != NULL)
+            capture_record(CAPTURE_RECORD_SPI_RX, ret, rx,
+                           ret < 0 ? 0 : fragment->len);
+    }
+
+    errno = save_errno;
+}
 
+int spi_transfer_batch_submit(int fd, struct spi_transfer_batch *batch,
+                              struct stats_io *io)
+{
     struct stats_context *prev_ctx = stats_io_begin(io);
 
-    int ret =
-        spi_hw_do_transfer(fd, spi_transfer,
-                           sizeof(spi_transfer) / sizeof(spi_transfer[0]));
+    const int ret = spi_hw_do_transfer(fd, batch->fragments, batch->count);
+
+    if(is_capturing())
+        capture_transfers(batch, ret);
 
     if(ret < 0)
     {
+        const int save_errno = errno;
         stats_io_end(io, prev_ctx, 1, 0);
-        msg_error(errno, LOG_EMERG,
-                  "Failed reading %u bytes from SPI device fd %d",
-                  spi_transfer[0].len, fd);
-        return -1;
+        errno = save_errno;
     }
+    else
+    {
+        stats_io_end(io, prev_ctx, 0, batch->total_bytes);
+
+        bool have_read = false;
+        bool have_written = false;
 
-    stats_io_end(io, prev_ctx, 0, spi_transfer[0].len);
+        for(size_t i = 0; i < batch->count; ++i)
+        {
+            if(is_dummy_tx((const void *)(uintptr_t)batch->fragments[i].tx_buf))
+                have_read = true;
+            else
+                have_written = true;
+        }
+
+        if(have_read)
+            report_to_clock(SPI_CLOCK_READ, SPI_CLOCK_EVENT_SUCCESS);
+
+        if(have_written)
+            report_to_clock(SPI_CLOCK_WRITE, SPI_CLOCK_EVENT_SUCCESS);
+    }
 
-    hexdump_to_log(hexdump_traffic_level,
-                   in->buffer, sizeof(spi_dummy_bytes), "Received");
+    batch->count = 0;
+    batch->total_bytes = 0;
 
-    return filter_input(in->buffer, sizeof(spi_dummy_bytes),
-                        &in->pending_escape_sequence);
+    return ret;
 }
 
-static size_t consume_from_buffer(struct spi_input_buffer *const restrict src,
-                                  uint8_t *const restrict dest, size_t dest_size)
+/*!
+ * Next delay for exponential backoff, advance to next step.
+ */
+static unsigned int next_backoff_delay_us(unsigned int *step)
 {
-    if(src->buffer_pos == 0 || dest_size == 0)
-        return 0;
+    unsigned int delay_us = spi_ctx->slave_ready.min_delay_us;
 
-    const size_t consumed =
-        src->buffer_pos < dest_size ? src->buffer_pos : dest_size;
-
-    if(dest != NULL)
-        memcpy(dest, src->buffer, consumed);
+    for(unsigned int i = 0; i < *step && delay_us < spi_slave_ready_max_delay_us; ++i)
+        delay_us *= 2;
 
-    if(consumed < src->buffer_pos)
-    {
-        memmove(src->buffer, src->buffer + consumed,
-                src->buffer_pos - consumed);
-        src->buffer_pos -= consumed;
-    }
+    if(delay_us < spi_slave_ready_max_delay_us)
+        ++*step;
     else
-        src->buffer_pos = 0;
+        delay_us = spi_slave_ready_max_delay_us;
 
-    return consumed;
+    return delay_us;
 }
 
-ssize_t spi_read_buffer(int fd, uint8_t *buffer, size_t length,
-                        struct stats_io *io)
+static void sleep_and_measure(const struct timespec *delay)
 {
-    /*
-     * Please read the comment in #wait_for_spi_slave() for why we are using a
-     * non-obvious timeout strategy.
-     */
-    bool need_recompute_timeout = false;
-    unsigned int expirations_left = spi_read_from_slave_timeout_max_iterations + 1;
-    struct timespec expiration_time;
-    compute_expiration_time(&expiration_time, 0);
-
-    /* first consume bytes from the buffer, if any */
-    size_t output_buffer_pos =
-        consume_from_buffer(&global_spi_input_buffer, buffer, length);
+    struct timespec before;
 
-    while(output_buffer_pos < length)
+    if(spi_ctx->sched_delay_histogram == NULL ||
+       os_clock_gettime(DEADLINE_CLOCK, &before) < 0)
     {
-        msg_log_assert(global_spi_input_buffer.buffer_pos == 0);
-
-        /* read a few bytes from SPI into our buffer (with escape characters
-         * removed); keep them around for potential extra bytes that have been
-         * read, but were not requested by the caller (we cannot "unread" on
-         * SPI) */
-        const ssize_t chunk_size = read_chunk(fd, &global_spi_input_buffer, io);
+        os_nanosleep(delay);
+        return;
+    }
+
+    os_nanosleep(delay);
+
+    struct timespec after;
+
+    if(os_clock_gettime(DEADLINE_CLOCK, &after) < 0)
+        return;
+
+    const uint64_t requested_us =
+        (uint64_t)delay->tv_sec * 1000U * 1000U + delay->tv_nsec / 1000L;
+    const uint64_t elapsed_us = stats_delta_usec(&before, &after);
+
+    stats_histogram_add(spi_ctx->sched_delay_histogram,
+                        elapsed_us > requested_us ? elapsed_us - requested_us : 0);
+}
+
+static void sleep_us(unsigned int delay_us)
+{
+    const struct timespec delay =
+    {
+        .tv_sec = delay_us / (1000U * 1000U),
+        .tv_nsec = (delay_us % (1000U * 1000U)) * 1000L,
+    };
+
+    sleep_and_measure(&delay);
+}
+
+/*!
+ * Wait for the request GPIO to change, but not longer than \p timeout_us.
+ *
+ * Note that the GPIO event is not consumed here. It remains pending so that
+ * the main loop is going to see it as well.
+ *
+ * \returns True if the GPIO has changed, false on timeout or error.
+ */
+static bool wait_for_gpio_edge(int gpio_fd, short gpio_events,
+                               unsigned int timeout_us)
+{
+    struct pollfd fds =
+    {
+        .fd = gpio_fd,
+        .events = gpio_events,
+    };
+
+    const int ret = os_poll(&fds, 1, (timeout_us + 999U) / 1000U);
+
+    if(ret > 0)
+        return (fds.revents & gpio_events & ~POLLERR) != 0;
+
+    if(ret < 0 && errno != EINTR)
+        msg_error(errno, LOG_ERR, "poll() on GPIO fd %d failed", gpio_fd);
+
+    return false;
+}
+
+/*!
+ * Give the slave (and ourselves) a break between two slave ready probes.
+ */
+static void delay_next_slave_ready_probe(const struct timespec *wait_started,
+                                         const struct timespec *current_time,
+                                         unsigned int *backoff_step,
+                                         bool *gpio_edge_seen)
+{
+    switch(spi_ctx->slave_ready.strategy)
+    {
+      case SPI_SLAVE_READY_FIXED_DELAY:
+        break;
+
+      case SPI_SLAVE_READY_BUSY_POLL:
+        if(stats_delta_usec(wait_started, current_time) <
+           spi_ctx->slave_ready.busy_poll_window_us)
+            return;
+
+        sleep_us(next_backoff_delay_us(backoff_step));
+        return;
+
+      case SPI_SLAVE_READY_GPIO_EDGE:
+        /* GPIO events are only useful until we have seen the first one
+         * because we must not consume it; back off normally after that */
+        if(spi_ctx->slave_ready.gpio_fd >= 0 && !*gpio_edge_seen)
+        {
+            *gpio_edge_seen =
+                wait_for_gpio_edge(spi_ctx->slave_ready.gpio_fd,
+                                   spi_ctx->slave_ready.gpio_events,
+                                   next_backoff_delay_us(backoff_step));
+            return;
+        }
+
+        /* fall-through */
+
+      case SPI_SLAVE_READY_BACKOFF:
+        sleep_us(next_backoff_delay_us(backoff_step));
+        return;
+    }
+
+    static const struct timespec delay_between_slave_ready_probes =
+    {
+        .tv_nsec = 5L * 1000L * 1000L,
+    };
+    sleep_and_measure(&delay_between_slave_ready_probes);
+}
+
+/*!
+ * Probe slave once, check the timeout if it is not ready yet.
+ */
+static enum SpiSendResult
+probe_spi_slave(int fd, struct spi_operation *op, bool *have_significant_data,
+                struct stats_io *io, struct stats_wait *wait)
+{
+    uint8_t *const buffer = op->poll_bytes;
+    const size_t buffer_size = sizeof(op->poll_bytes);
+
+    *have_significant_data = false;
+
+    deadline_rearm(&op->deadline);
+
+    struct spi_transfer_batch batch;
+    spi_transfer_batch_init(&batch);
+    spi_transfer_batch_add(&batch, NULL, buffer, buffer_size, 0, false);
+
+    if(spi_transfer_batch_submit(fd, &batch, io) < 0)
+    {
+        msg_error(errno, LOG_EMERG,
+                  "Failed waiting for slave device on fd %d", fd);
+        return SPI_SEND_RESULT_FAILURE;
+    }
+
+    ++op->probes;
+
+    MSG_HEXDUMP(hexdump_traffic_level, buffer, buffer_size, "Received");
+
+    for(size_t i = 0; i < buffer_size; ++i)
+    {
+        if(buffer[i] == 0)
+        {
+            stats_wait_end(wait, &op->started, op->probes);
+            return SPI_SEND_RESULT_OK;
+        }
+
+        if(buffer[i] != UINT8_MAX)
+        {
+            msg_error(0, LOG_NOTICE, "Collision detected (got funny poll bytes)");
+            *have_significant_data = true;
+            stats_wait_end(wait, &op->started, op->probes);
+            return SPI_SEND_RESULT_COLLISION;
+        }
+    }
+
+    /* only NOPs, try again if we are within the specified timeout... */
+    if(deadline_check(&op->deadline, &op->current_time))
+    {
+        msg_error(0, LOG_NOTICE,
+                  "SPI write timeout, slave didn't get ready within %u ms",
+                  spi_wait_for_slave_timeout_max_iterations *
+                  spi_wait_for_slave_timeout_ms);
+        stats_wait_end(wait, &op->started, op->probes);
+        report_to_clock(SPI_CLOCK_WRITE, SPI_CLOCK_EVENT_TIMEOUT);
+        return SPI_SEND_RESULT_TIMEOUT;
+    }
+
+    return SPI_SEND_RESULT_PENDING;
+}
+
+static void handle_collision(uint8_t *const poll_bytes_buffer,
+                             const size_t poll_bytes_buffer_size,
+                             struct spi_input_buffer *in)
+{
+    bool pending_escape_sequence = false;
+    const size_t bytes_left = spi_filter_input(poll_bytes_buffer,
+                                               poll_bytes_buffer_size,
+                                               &pending_escape_sequence);
+
+    if(input_buffer_fill(in) > 0)
+        MSG_BUG("Discarding %zu bytes from SPI receive buffer after collision",
+                input_buffer_fill(in));
+
+    if(bytes_left > 0)
+    {
+        memcpy(in->buffer, poll_bytes_buffer, bytes_left);
+        MSG_HEXDUMP(hexdump_collision_level,
+                    in->buffer, bytes_left, "Colliding poll bytes");
+
+        if(is_capturing())
+            capture_record(CAPTURE_RECORD_COLLISION, 0, in->buffer, bytes_left);
+    }
+
+    in->read_pos = 0;
+    in->buffer_pos = bytes_left;
+    in->pending_escape_sequence = pending_escape_sequence;
+}
+
+void spi_send_begin(int fd, struct spi_operation *op,
+                    const uint8_t *buffer, size_t length)
+{
+    op->is_read = false;
+    op->tx_buffer = buffer;
+    op->tx_length = length;
+    op->tx_packets = NULL;
+    op->tx_packets_count = 0;
+    op->probes = 0;
+    op->backoff_step = 0;
+    op->gpio_edge_seen = false;
+
+    if(fd < 0)
+        return;
+
+    /*
+     * We need to try a few times because we may suffer from starvation by a
+     * real-time process. Our system scheduler isn't fair anymore, so we need
+     * to get a little sophisticated here.
+     *
+     * Worst case: we compute the expiration time, and then get preempted. It
+     * is possible that we have to wait for a few seconds before we can start
+     * our hardware transfer. Thus, our timeout may have expired well before
+     * the slave got the chance to take note of our attempt at communication.
+     * It may not have been ready to send anything, so we would run into the
+     * timeout after a single try.
+     *
+     * Second worst case: we get preempted before checking our timeout for the
+     * first time. Again, the timeout would be exceeded after a single try.
+     *
+     * To make our communication more robust, we make sure the first iteration
+     * has been executed and the SPI slave knows that we are communicating
+     * before we consider any timeouts. Then we compute the expiration time,
+     * and allow the timeout to expire at least 2 times so that the slave got a
+     * real chance for sending data. The jitter for the observed total timeout
+     * depends on the duration of the partial timeouts. All of this is taken
+     * care of by #deadline.
+     */
+    deadline_start(&op->deadline, spi_wait_for_slave_timeout_ms,
+                   spi_wait_for_slave_timeout_max_iterations, &op->started);
+    op->current_time = op->started;
+}
+
+void spi_send_begin_burst(int fd, struct spi_operation *op,
+                          const struct spi_packet *packets, size_t count)
+{
+    size_t fragments = 0;
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        if(fragments + packets[i].count > SPI_TRANSFER_BATCH_MAX_FRAGMENTS)
+        {
+            MSG_BUG("Cannot send %zu packets in one burst", count);
+            count = i;
+            break;
+        }
+
+        fragments += packets[i].count;
+    }
+
+    spi_send_begin(fd, op, NULL, 0);
+
+    op->tx_packets = packets;
+    op->tx_packets_count = count;
+}
+
+static void dump_tx_data(enum MessageVerboseLevel level,
+                         const struct spi_operation *op, const char *what)
+{
+    if(op->tx_packets_count == 0)
+    {
+        MSG_HEXDUMP(level, op->tx_buffer, op->tx_length, what);
+        return;
+    }
+
+    for(size_t i = 0; i < op->tx_packets_count; ++i)
+        for(size_t j = 0; j < op->tx_packets[i].count; ++j)
+            MSG_HEXDUMP(level, op->tx_packets[i].fragments[j].iov_base,
+                        op->tx_packets[i].fragments[j].iov_len, what);
+}
+
+enum SpiSendResult spi_send_continue(int fd, struct spi_operation *op,
+                                     struct stats_io *io,
+                                     struct stats_wait *wait)
+{
+    if(fd < 0)
+    {
+        /* operating in dummy mode */
+        return SPI_SEND_RESULT_OK;
+    }
+
+    bool have_significant_data;
+    const enum SpiSendResult wait_result =
+        probe_spi_slave(fd, op, &have_significant_data, io, wait);
+
+    if(wait_result == SPI_SEND_RESULT_PENDING)
+        return wait_result;
+
+    if(wait_result != SPI_SEND_RESULT_OK)
+    {
+        if(wait_result == SPI_SEND_RESULT_COLLISION)
+        {
+            dump_tx_data(hexdump_collision_level, op,
+                         "Tried to send during collision");
+
+            if(have_significant_data)
+                MSG_HEXDUMP(hexdump_collision_level,
+                            op->poll_bytes, sizeof(op->poll_bytes),
+                            "Received poll bytes during collision");
+        }
+
+        if(wait_result == SPI_SEND_RESULT_COLLISION && have_significant_data)
+            handle_collision(op->poll_bytes, sizeof(op->poll_bytes),
+                             &spi_ctx->input_buffer);
+
+        return wait_result;
+    }
+
+    struct spi_transfer_batch batch;
+    spi_transfer_batch_init(&batch);
+
+    if(op->tx_packets_count == 0)
+        spi_transfer_batch_add(&batch, op->tx_buffer, NULL, op->tx_length,
+                               0, false);
+    else
+    {
+        /* chip select is held across the fragments of a packet, and toggles
+         * between packets, but not after the last one */
+        for(size_t i = 0; i < op->tx_packets_count; ++i)
+        {
+            const struct spi_packet *const packet = &op->tx_packets[i];
+
+            for(size_t j = 0; j < packet->count; ++j)
+                spi_transfer_batch_add(&batch, packet->fragments[j].iov_base,
+                                       NULL, packet->fragments[j].iov_len, 0,
+                                       j + 1 == packet->count &&
+                                       i + 1 < op->tx_packets_count);
+        }
+    }
+
+    if(spi_transfer_batch_submit(fd, &batch, io) < 0)
+    {
+        msg_error(errno, LOG_EMERG,
+                  "Failed writing %zu bytes to SPI device fd %d",
+                  batch.total_bytes, fd);
+        return SPI_SEND_RESULT_FAILURE;
+    }
+
+    dump_tx_data(hexdump_traffic_level, op, "Sent");
+
+    return SPI_SEND_RESULT_OK;
+}
+
+static enum SpiSendResult send_until_done(int fd, struct spi_operation *op,
+                                          struct stats_io *io,
+                                          struct stats_wait *wait)
+{
+    enum SpiSendResult result;
+
+    while((result = spi_send_continue(fd, op, io, wait)) == SPI_SEND_RESULT_PENDING)
+        delay_next_slave_ready_probe(&op->started, &op->current_time,
+                                     &op->backoff_step, &op->gpio_edge_seen);
+
+    return result;
+}
+
+enum SpiSendResult spi_send_buffer(int fd, const uint8_t *buffer, size_t length,
+                                   struct stats_io *io, struct stats_wait *wait)
+{
+    struct spi_operation op;
+    spi_send_begin(fd, &op, buffer, length);
+
+    return send_until_done(fd, &op, io, wait);
+}
+
+enum SpiSendResult spi_send_burst(int fd, const struct spi_packet *packets, size_t count,
+                                  struct stats_io *io, struct stats_wait *wait)
+{
+    struct spi_operation op;
+    spi_send_begin_burst(fd, &op, packets, count);
+
+    return send_until_done(fd, &op, io, wait);
+}
+
+size_t spi_escaped_length(const uint8_t *src, size_t src_size)
+{
+    size_t length = src_size;
+
+    for(size_t i = find_special_byte(src, src_size, 0);
+        i < src_size;
+        i = find_special_byte(src, src_size, i + 1))
+        ++length;
+
+    return length;
+}
+
+size_t spi_escape_to_fragments(struct iovec *fragments, size_t max_fragments,
+                               const uint8_t *src, size_t src_size)
+{
+    static const uint8_t escape_sequences[2][2] =
+    {
+        { DCP_ESCAPE_CHARACTER, 0x01, },
+        { DCP_ESCAPE_CHARACTER, DCP_ESCAPE_CHARACTER, },
+    };
+
+    size_t count = 0;
+
+    for(size_t i = 0; i < src_size; /* nothing */)
+    {
+        const size_t span_end = find_special_byte(src, src_size, i);
+
+        if(span_end > i)
+        {
+            if(count >= max_fragments)
+                return 0;
+
+            fragments[count].iov_base = (void *)(src + i);
+            fragments[count].iov_len = span_end - i;
+            ++count;
+            i = span_end;
+        }
+
+        if(i < src_size)
+        {
+            if(count >= max_fragments)
+                return 0;
+
+            const uint8_t *const seq =
+                escape_sequences[src[i++] == UINT8_MAX ? 0 : 1];
+
+            fragments[count].iov_base = (void *)seq;
+            fragments[count].iov_len = 2;
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+size_t spi_fill_buffer_from_raw_data(uint8_t *dest, size_t dest_size,
+                                     const uint8_t *src, size_t src_size)
+{
+    size_t pos = 0;
+
+    for(size_t i = 0; i < src_size && pos < dest_size; /* nothing */)
+    {
+        /* copy span of bytes which need no escaping */
+        const size_t span_end = find_special_byte(src, src_size, i);
+        size_t count = span_end - i;
+
+        if(count > dest_size - pos)
+            count = dest_size - pos;
+
+        memcpy(dest + pos, src + i, count);
+        pos += count;
+        i += count;
+
+        if(i >= span_end && i < src_size && pos < dest_size)
+        {
+            const uint8_t ch = src[i++];
+
+            dest[pos++] = DCP_ESCAPE_CHARACTER;
+            if(pos < dest_size)
+                dest[pos++] = (ch == UINT8_MAX) ? 0x01 : DCP_ESCAPE_CHARACTER;
+        }
+    }
+
+    return pos;
+}
+
+/*!
+ * Read a few, fixed number of bytes from SPI, return them filtered.
+ *
+ * The buffer size must be at least as big as the #spi_dummy_bytes array.
+ */
+static ssize_t do_read_transfer(int fd, uint8_t *const buffer, size_t length,
+                                bool *const pending_escape_sequence,
+                                struct stats_io *io)
+{
+    struct spi_transfer_batch batch;
+    spi_transfer_batch_init(&batch);
+    spi_transfer_batch_add(&batch, NULL, buffer, length, 0, false);
+
+    if(spi_transfer_batch_submit(fd, &batch, io) < 0)
+    {
+        msg_error(errno, LOG_EMERG,
+                  "Failed reading %zu bytes from SPI device fd %d",
+                  length, fd);
+        return -1;
+    }
+
+    MSG_HEXDUMP(hexdump_traffic_level, buffer, length, "Received");
+
+    return spi_filter_input(buffer, length, pending_escape_sequence);
+}
+
+static ssize_t read_chunk(int fd, struct spi_input_buffer *const in,
+                          struct stats_io *io)
+{
+    msg_log_assert(input_buffer_fill(in) == 0);
+    in->read_pos = 0;
+    in->buffer_pos = 0;
+
+    return do_read_transfer(fd, in->buffer, sizeof(in->buffer),
+                            &in->pending_escape_sequence, io);
+}
+
+/*!
+ * Read up to \p length bytes plus some headroom in a single transfer.
+ *
+ * Bytes beyond \p length are kept in the SPI input buffer.
+ *
+ * \returns Number of bytes written to \p dest, or -1 on error.
+ */
+static ssize_t read_payload(int fd, struct spi_input_buffer *const in,
+                            uint8_t *const dest, size_t length,
+                            struct stats_io *io)
+{
+    msg_log_assert(input_buffer_fill(in) == 0);
+
+    size_t transfer_size = length + spi_payload_read_headroom;
+
+    if(transfer_size > sizeof(spi_ctx->payload_buffer))
+        transfer_size = sizeof(spi_ctx->payload_buffer);
+
+    const ssize_t filtered =
+        do_read_transfer(fd, spi_ctx->payload_buffer, transfer_size,
+                         &in->pending_escape_sequence, io);
+
+    if(filtered <= 0)
+        return filtered;
+
+    const size_t consumed = (size_t)filtered < length ? (size_t)filtered : length;
+    const size_t surplus = (size_t)filtered - consumed;
+
+    memcpy(dest, spi_ctx->payload_buffer, consumed);
+
+    msg_log_assert(surplus <= sizeof(in->buffer));
+    memcpy(in->buffer, spi_ctx->payload_buffer + consumed, surplus);
+    in->read_pos = 0;
+    in->buffer_pos = surplus;
+
+    return consumed;
+}
+
+static size_t consume_from_buffer(struct spi_input_buffer *const restrict src,
+                                  uint8_t *const restrict dest, size_t dest_size)
+{
+    const size_t fill = input_buffer_fill(src);
+
+    if(fill == 0 || dest_size == 0)
+        return 0;
+
+    const size_t consumed = fill < dest_size ? fill : dest_size;
+
+    if(dest != NULL)
+        memcpy(dest, src->buffer + src->read_pos, consumed);
+
+    if(consumed < fill)
+        src->read_pos += consumed;
+    else
+    {
+        src->read_pos = 0;
+        src->buffer_pos = 0;
+    }
+
+    return consumed;
+}
+
+void spi_read_begin(struct spi_operation *op, uint8_t *buffer, size_t length,
+                    bool is_payload)
+{
+    op->is_read = true;
+    op->rx_buffer = buffer;
+    op->rx_length = length;
+    op->is_size_aware = is_payload;
+
+    /*
+     * Please read the comment in #spi_send_begin() for why we are using a
+     * non-obvious timeout strategy.
+     */
+    deadline_start(&op->deadline, spi_read_from_slave_timeout_ms,
+                   spi_read_from_slave_timeout_max_iterations, &op->current_time);
+
+    /* first consume bytes from the buffer, if any */
+    op->rx_pos = consume_from_buffer(&spi_ctx->input_buffer, buffer, length);
+}
+
+ssize_t spi_read_continue(int fd, struct spi_operation *op,
+                          struct stats_io *io)
+{
+    uint8_t *const buffer = op->rx_buffer;
+    const size_t length = op->rx_length;
+
+    deadline_rearm(&op->deadline);
+
+    while(op->rx_pos < length)
+    {
+        msg_log_assert(input_buffer_fill(&spi_ctx->input_buffer) == 0);
+
+        /* fetch the remaining payload in one go if it doesn't fit into a
+         * single chunk, use small chunks for retries; otherwise, read a few
+         * bytes from SPI into our buffer (with escape characters removed) and
+         * keep them around for potential extra bytes that have been read, but
+         * were not requested by the caller (we cannot "unread" on SPI) */
+        const bool is_payload_read =
+            op->is_size_aware &&
+            length - op->rx_pos + spi_payload_read_headroom > sizeof(spi_dummy_bytes);
+        const ssize_t chunk_size = is_payload_read
+            ? read_payload(fd, &spi_ctx->input_buffer,
+                           buffer + op->rx_pos, length - op->rx_pos, io)
+            : read_chunk(fd, &spi_ctx->input_buffer, io);
+
+        op->is_size_aware = false;
 
         /* error out in case of hard communication error and return what got so
          * far */
@@ -516,102 +1205,280 @@ ssize_t spi_read_buffer(int fd, uint8_t *buffer, size_t length,
         /* slave not ready, try again... */
         if(chunk_size == 0)
         {
-            if(!need_recompute_timeout &&
-               has_timeout_expired(&expiration_time, &expirations_left,
-                                   &need_recompute_timeout))
+            if(deadline_check(&op->deadline, &op->current_time))
             {
                 msg_error(0, LOG_NOTICE,
                           "SPI read timeout, returning %zu of %zu bytes",
-                          output_buffer_pos, length);
-                if(output_buffer_pos > 0)
-                    hexdump_to_log(MESSAGE_LEVEL_NORMAL, buffer,
-                                   output_buffer_pos, "Partial buffer");
+                          op->rx_pos, length);
+                if(op->rx_pos > 0)
+                    MSG_HEXDUMP(MESSAGE_LEVEL_NORMAL, buffer,
+                                op->rx_pos, "Partial buffer");
+                report_to_clock(SPI_CLOCK_READ, SPI_CLOCK_EVENT_TIMEOUT);
                 break;
             }
 
-            /* give the slave (and ourselves) a break */
-            static const struct timespec delay_between_slave_reads =
-            {
-                .tv_nsec = 5L * 1000L * 1000L,
-            };
-            os_nanosleep(&delay_between_slave_reads);
+            return SPI_READ_PENDING;
+        }
 
-            if(need_recompute_timeout)
-            {
-                compute_expiration_time(&expiration_time,
-                                        spi_read_from_slave_timeout_ms);
-                need_recompute_timeout = false;
-            }
+        /* got something */
+        deadline_restart(&op->deadline);
 
+        if(is_payload_read)
+        {
+            op->rx_pos += chunk_size;
             continue;
         }
 
-        /* got something */
-        msg_log_assert((size_t)chunk_size <= sizeof(global_spi_input_buffer.buffer));
+        msg_log_assert((size_t)chunk_size <= sizeof(spi_ctx->input_buffer.buffer));
+
+        spi_ctx->input_buffer.buffer_pos += chunk_size;
+        op->rx_pos +=
+            consume_from_buffer(&spi_ctx->input_buffer,
+                                buffer + op->rx_pos, length - op->rx_pos);
+    }
+
+    return op->rx_pos;
+}
+
+/*!
+ * Give the slave (and ourselves) a break between two reads.
+ */
+static const unsigned int spi_delay_between_slave_reads_us = 5U * 1000U;
+
+static ssize_t read_buffer(int fd, uint8_t *buffer, size_t length,
+                           bool is_size_aware, struct stats_io *io)
+{
+    struct spi_operation op;
+    spi_read_begin(&op, buffer, length, is_size_aware);
+
+    ssize_t result;
+
+    while((result = spi_read_continue(fd, &op, io)) == SPI_READ_PENDING)
+        sleep_us(spi_delay_between_slave_reads_us);
+
+    return result;
+}
+
+ssize_t spi_read_buffer(int fd, uint8_t *buffer, size_t length,
+                        struct stats_io *io)
+{
+    return read_buffer(fd, buffer, length, false, io);
+}
+
+ssize_t spi_read_payload(int fd, uint8_t *buffer, size_t length,
+                         struct stats_io *io)
+{
+    return read_buffer(fd, buffer, length, true, io);
+}
+
+unsigned int spi_operation_retry_delay_us(struct spi_operation *op)
+{
+    if(op->is_read)
+        return spi_delay_between_slave_reads_us;
 
-        need_recompute_timeout = true;
-        expirations_left = spi_read_from_slave_timeout_max_iterations;
+    switch(spi_ctx->slave_ready.strategy)
+    {
+      case SPI_SLAVE_READY_FIXED_DELAY:
+        break;
+
+      case SPI_SLAVE_READY_BUSY_POLL:
+        if(stats_delta_usec(&op->started, &op->current_time) <
+           spi_ctx->slave_ready.busy_poll_window_us)
+            return 0;
 
-        global_spi_input_buffer.buffer_pos += chunk_size;
-        output_buffer_pos +=
-            consume_from_buffer(&global_spi_input_buffer,
-                                buffer + output_buffer_pos,
-                                length - output_buffer_pos);
+        /* fall-through */
+
+      case SPI_SLAVE_READY_BACKOFF:
+      case SPI_SLAVE_READY_GPIO_EDGE:
+        return next_backoff_delay_us(&op->backoff_step);
     }
 
-    return output_buffer_pos;
+    return spi_slave_ready_max_delay_us;
 }
 
-bool spi_input_buffer_weed(void)
+/*!
+ * Find the beginning of a DCP packet in the SPI input buffer.
+ *
+ * The first byte must be zero, and the DCP command is expected right after
+ * it, or after a second zero byte. The command byte must be a non-zero DCP
+ * command, and the whole DCP header must be in the buffer unless
+ * \p accept_incomplete_header is set. Anything else is junk, and we do not
+ * dig any deeper because the protocol lacks sync marks.
+ *
+ * Note that #DCP_COMMAND_WRITE_REGISTER cannot be told apart from padding
+ * this way, so such packets are never found.
+ *
+ * \returns
+ *     Number of padding bytes in front of the header, or -1 if there is no
+ *     header in the buffer (or only an incomplete one while
+ *     \p accept_incomplete_header is not set).
+ */
+static ssize_t find_dcp_header(const struct spi_input_buffer *in,
+                               bool accept_incomplete_header)
 {
-    if(global_spi_input_buffer.buffer_pos == 0)
-        return false;
+    size_t pos = in->read_pos;
 
-    /* first byte must be zero, otherwise it's junk */
-    if(global_spi_input_buffer.buffer[0] != 0x00)
-        return false;
+    if(pos >= in->buffer_pos || in->buffer[pos] != 0x00)
+        return -1;
 
-    int cmd_idx;
+    ++pos;
 
-    if(global_spi_input_buffer.buffer_pos > 0 && global_spi_input_buffer.buffer[1] != 0x00)
-        cmd_idx = 1;
-    else if(global_spi_input_buffer.buffer_pos > 1 && global_spi_input_buffer.buffer[2] != 0x00)
-        cmd_idx = 2;
-    else
-        cmd_idx = -1;
+    if(pos < in->buffer_pos && in->buffer[pos] == 0x00)
+        ++pos;
 
-    if(cmd_idx < 0)
-        return false;
+    if(in->buffer_pos - pos < (accept_incomplete_header ? 1 : DCP_HEADER_SIZE))
+        return -1;
+
+    if(in->buffer[pos] == 0x00 ||
+       in->buffer[pos] > DCP_COMMAND_MULTI_READ_REGISTER)
+        return -1;
 
-    if(global_spi_input_buffer.buffer[cmd_idx] > DCP_COMMAND_MULTI_READ_REGISTER)
+    return pos - in->read_pos;
+}
+
+static bool skip_to_dcp_header(struct spi_input_buffer *in,
+                               bool accept_incomplete_header)
+{
+    const ssize_t padding = find_dcp_header(in, accept_incomplete_header);
+
+    if(padding < 0)
         return false;
 
-    consume_from_buffer(&global_spi_input_buffer, NULL, cmd_idx);
+    consume_from_buffer(in, NULL, padding);
 
     return true;
 }
 
-void spi_new_transaction(void)
+bool spi_input_buffer_weed(void)
+{
+    return skip_to_dcp_header(&spi_ctx->input_buffer, true);
+}
+
+static void begin_transaction(bool accept_incomplete_header)
 {
-    if(global_spi_input_buffer.buffer_pos > 0)
+    struct spi_input_buffer *const in = &spi_ctx->input_buffer;
+
+    if(skip_to_dcp_header(in, accept_incomplete_header))
     {
-        msg_info("Discarding %zu bytes from SPI receive buffer",
-                 global_spi_input_buffer.buffer_pos);
-        hexdump_to_log(hexdump_discarded_level,
-                       global_spi_input_buffer.buffer,
-                       global_spi_input_buffer.buffer_pos, "Discarded buffer");
+        MSG_VINFO(MESSAGE_LEVEL_DIAG,
+                  "Keeping %zu bytes in SPI receive buffer for next packet",
+                  input_buffer_fill(in));
+        return;
     }
 
-    spi_reset();
+    const size_t fill = input_buffer_fill(in);
+
+    if(fill > 0)
+    {
+        const uint8_t *const discarded = in->buffer + in->read_pos;
+
+        msg_info("Discarding %zu bytes from SPI receive buffer", fill);
+        MSG_HEXDUMP(hexdump_discarded_level,
+                    discarded, fill, "Discarded buffer");
+
+        if(is_capturing())
+            capture_record(CAPTURE_RECORD_DISCARDED, 0, discarded, fill);
+    }
+
+    memset(&spi_ctx->input_buffer, 0, sizeof(spi_ctx->input_buffer));
+}
+
+void spi_new_transaction(void)
+{
+    begin_transaction(false);
+}
+
+void spi_chain_transaction(void)
+{
+    begin_transaction(true);
 }
 
 void spi_reset(void)
 {
-    memset(&global_spi_input_buffer, 0, sizeof(global_spi_input_buffer));
+    memset(&spi_ctx->input_buffer, 0, sizeof(spi_ctx->input_buffer));
+    spi_ctx->sched_delay_histogram = NULL;
 }
 
 void spi_set_speed_hz(uint32_t hz)
 {
     if(hz > 0)
-        spi_speed_hz = hz;
+        spi_clock_configure(&spi_ctx->clock, hz, 0, 0);
+}
+
+void spi_set_speed_range_hz(uint32_t min_hz, uint32_t max_hz)
+{
+    struct spi_clock *const clk = &spi_ctx->clock;
+    spi_clock_configure(clk, spi_clock_get_hz(clk, SPI_CLOCK_WRITE),
+                        min_hz, max_hz);
+}
+
+void spi_report_junk(void)
+{
+    report_to_clock(SPI_CLOCK_READ, SPI_CLOCK_EVENT_JUNK);
+}
+
+void spi_set_clock_statistics(struct spi_clock_stats *stats)
+{
+    spi_clock_set_statistics(&spi_ctx->clock, stats);
+}
+
+void spi_set_slave_ready_strategy(enum SpiSlaveReadyStrategy strategy,
+                                  unsigned int min_delay_us,
+                                  unsigned int busy_poll_window_us,
+                                  int gpio_fd, short gpio_events)
+{
+    spi_ctx->slave_ready.strategy = strategy;
+
+    if(min_delay_us > 0)
+        spi_ctx->slave_ready.min_delay_us =
+            min_delay_us < spi_slave_ready_max_delay_us
+            ? min_delay_us
+            : spi_slave_ready_max_delay_us;
+
+    spi_ctx->slave_ready.busy_poll_window_us = busy_poll_window_us;
+    spi_ctx->slave_ready.gpio_fd = gpio_fd;
+    spi_ctx->slave_ready.gpio_events = gpio_events;
+}
+
+void spi_set_sched_delay_histogram(struct stats_histogram *h)
+{
+    spi_ctx->sched_delay_histogram = h;
+}
+
+enum SpiSlaveReadyStrategy spi_get_slave_ready_strategy(void)
+{
+    return spi_ctx->slave_ready.strategy;
+}
+
+static const char *const slave_ready_strategy_names[] =
+{
+    [SPI_SLAVE_READY_FIXED_DELAY] = "fixed",
+    [SPI_SLAVE_READY_BACKOFF]     = "backoff",
+    [SPI_SLAVE_READY_BUSY_POLL]   = "busy",
+    [SPI_SLAVE_READY_GPIO_EDGE]   = "gpio",
+};
+
+const char *spi_slave_ready_strategy_to_string(enum SpiSlaveReadyStrategy strategy)
+{
+    if((size_t)strategy < sizeof(slave_ready_strategy_names) / sizeof(slave_ready_strategy_names[0]))
+        return slave_ready_strategy_names[strategy];
+
+    return "INVALID";
+}
+
+bool spi_slave_ready_strategy_from_string(const char *name,
+                                          enum SpiSlaveReadyStrategy *strategy)
+{
+    for(size_t i = 0;
+        i < sizeof(slave_ready_strategy_names) / sizeof(slave_ready_strategy_names[0]);
+        ++i)
+    {
+        if(strcmp(name, slave_ready_strategy_names[i]) == 0)
+        {
+            *strategy = (enum SpiSlaveReadyStrategy)i;
+            return true;
+        }
+    }
+
+    return false;
 }
@@ -25,8 +25,47 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <sys/uio.h>
 
+#include "spi_hw.h"
 #include "statistics.h"
+#include "deadline.h"
+#include "spi_clock.h"
+
+/*!
+ * Maximum number of fragments in a #spi_transfer_batch.
+ */
+#define SPI_TRANSFER_BATCH_MAX_FRAGMENTS  8
+
+/*!
+ * Maximum number of slaves on separate buses, see #spi_context_init().
+ */
+#define SPI_MAX_SLAVES  4U
+
+/*!
+ * Several SPI transfer fragments submitted in a single kernel call.
+ *
+ * Initialize with #spi_transfer_batch_init(), add fragments with
+ * #spi_transfer_batch_add(), submit with #spi_transfer_batch_submit().
+ */
+struct spi_transfer_batch
+{
+    struct spi_ioc_transfer fragments[SPI_TRANSFER_BATCH_MAX_FRAGMENTS];
+    size_t count;
+    size_t total_bytes;
+};
+
+/*!
+ * Escaped packet scattered over several fragments.
+ *
+ * Chip select is held across the fragments of a packet, so the slave does not
+ * see the difference to a packet sent from a single buffer.
+ */
+struct spi_packet
+{
+    const struct iovec *fragments;
+    size_t count;
+};
 
 enum SpiSendResult
 {
@@ -34,12 +73,101 @@ enum SpiSendResult
     SPI_SEND_RESULT_FAILURE,
     SPI_SEND_RESULT_TIMEOUT,
     SPI_SEND_RESULT_COLLISION,
+
+    /*! Slave not ready yet, continue with #spi_send_continue() later. */
+    SPI_SEND_RESULT_PENDING,
 };
 
+/*!
+ * Returned by #spi_read_continue() while the slave has not sent enough data.
+ */
+#define SPI_READ_PENDING ((ssize_t)-2)
+
+/*!
+ * Send or read operation which is carried out step by step.
+ *
+ * Operations are started by #spi_send_begin() or #spi_read_begin(), and each
+ * call of #spi_send_continue() or #spi_read_continue() does as much as can be
+ * done without waiting for the slave. The caller is responsible for waiting
+ * #spi_operation_retry_delay_us() between two steps, and is free to do other
+ * work meanwhile. The blocking functions #spi_send_buffer() and
+ * #spi_read_buffer() are implemented in terms of these.
+ */
+struct spi_operation
+{
+    bool is_read;
+    struct deadline deadline;
+    struct timespec started;
+    struct timespec current_time;
+
+    /* sending */
+    const uint8_t *tx_buffer;
+    size_t tx_length;
+    const struct spi_packet *tx_packets;
+    size_t tx_packets_count;
+    uint8_t poll_bytes[2];
+    unsigned int probes;
+    unsigned int backoff_step;
+    bool gpio_edge_seen;
+
+    /* reading */
+    uint8_t *rx_buffer;
+    size_t rx_length;
+    size_t rx_pos;
+    bool is_size_aware;
+};
+
+/*!
+ * How to wait for the slave to become ready before sending data.
+ */
+enum SpiSlaveReadyStrategy
+{
+    /*! Sleep for 5 ms between two probes (default). */
+    SPI_SLAVE_READY_FIXED_DELAY,
+
+    /*! Exponential backoff, starting at some minimum delay. */
+    SPI_SLAVE_READY_BACKOFF,
+
+    /*! Probe without delay for some time, then back off. */
+    SPI_SLAVE_READY_BUSY_POLL,
+
+    /*! Wait for request GPIO changes, back off if there is none. */
+    SPI_SLAVE_READY_GPIO_EDGE,
+};
+
+/*!
+ * Per-slave state of the SPI code.
+ */
+struct spi_context;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*!
+ * Reset state of given slave to defaults.
+ *
+ * All other functions in this file work on the calling thread's current
+ * context, which is the one of slave 0 unless switched by
+ * #spi_context_switch(). A context must only be used by one thread at a time.
+ * Slaves other than slave 0 must be initialized before use, and before any
+ * thread starts using the SPI code.
+ *
+ * \returns
+ *     The context of given slave, or \c NULL if \p slave is out of range.
+ */
+struct spi_context *spi_context_init(unsigned int slave);
+
+/*!
+ * Make given context the calling thread's current context.
+ *
+ * Pass \c NULL to switch back to the context of slave 0.
+ *
+ * \returns
+ *     The previous context.
+ */
+struct spi_context *spi_context_switch(struct spi_context *ctx);
+
 /*!
  * Open SPI device by name.
  *
@@ -55,12 +183,65 @@ void spi_close_device(int fd);
 /*!
  * Copy buffer content, escape special characters according to DCP specs.
  *
+ * Spans without any special characters are copied in one go. The output is
+ * truncated at \p dest_size, possibly in the middle of an escape sequence;
+ * use #spi_escaped_length() to avoid this.
+ *
  * \returns
  *     The number of bytes written to \p dest.
  */
 size_t spi_fill_buffer_from_raw_data(uint8_t *dest, size_t dest_size,
                                      const uint8_t *src, size_t src_size);
 
+/*!
+ * Compute size of buffer content after escaping special characters.
+ *
+ * \returns
+ *     The number of bytes #spi_fill_buffer_from_raw_data() needs for \p src.
+ */
+size_t spi_escaped_length(const uint8_t *src, size_t src_size);
+
+/*!
+ * Escape special characters without copying buffer content.
+ *
+ * Spans without any special characters are referenced in \p src, escape
+ * sequences are taken from a static table. This is what
+ * #spi_fill_buffer_from_raw_data() would produce, but as a list of fragments
+ * to be sent as a #spi_packet.
+ *
+ * \returns
+ *     The number of fragments written to \p fragments, or 0 in case more than
+ *     \p max_fragments would be needed. Callers should fall back to
+ *     #spi_fill_buffer_from_raw_data() in the latter case.
+ */
+size_t spi_escape_to_fragments(struct iovec *fragments, size_t max_fragments,
+                               const uint8_t *src, size_t src_size);
+
+/*!
+ * Remove NOPs and escape sequences from data received over SPI, in place.
+ *
+ * Runs of NOPs and plain data are found a block at a time (using NEON where
+ * available, one machine word at a time otherwise).
+ *
+ * \param buffer, buffer_size
+ *     Data received over SPI.
+ *
+ * \param pending_escape_sequence
+ *     Set if \p buffer ends with an escape character so that the next call
+ *     can complete the escape sequence. Must be initialized by the caller.
+ *
+ * \returns
+ *     The number of bytes left in \p buffer.
+ */
+size_t spi_filter_input(uint8_t *buffer, size_t buffer_size,
+                        bool *pending_escape_sequence);
+
+/*!
+ * Byte-by-byte reference implementation of #spi_filter_input().
+ */
+size_t spi_filter_input_reference(uint8_t *buffer, size_t buffer_size,
+                                  bool *pending_escape_sequence);
+
 /*!
  * Send buffer as is over SPI.
  *
@@ -73,6 +254,9 @@ size_t spi_fill_buffer_from_raw_data(uint8_t *dest, size_t dest_size,
  * \param io
  *     Structure for gathering I/O statistics.
  *
+ * \param wait
+ *     Structure for gathering statistics about waiting for the slave.
+ *
  * \retval #SPI_SEND_RESULT_OK         On success.
  * \retval #SPI_SEND_RESULT_FAILURE    On unrecoverable, hard error.
  * \retval #SPI_SEND_RESULT_TIMEOUT    On timeout.
@@ -80,7 +264,29 @@ size_t spi_fill_buffer_from_raw_data(uint8_t *dest, size_t dest_size,
  *                                     transaction).
  */
 enum SpiSendResult spi_send_buffer(int fd, const uint8_t *buffer, size_t length,
-                                   struct stats_io *io);
+                                   struct stats_io *io, struct stats_wait *wait);
+
+/*!
+ * Wait until SPI slave is ready, then send several packets in one go.
+ *
+ * The packets are sent in a single SPI message with chip select toggled
+ * between packets, so the slave sees them as if they had been sent one after
+ * the other, but the master does not wait for the slave between them. A message cannot be stopped once it is in flight, so
+ * collisions are only detected before the first byte is sent. In that case,
+ * none of the packets has been sent.
+ *
+ * \param fd, io, wait
+ *     See #spi_send_buffer().
+ *
+ * \param packets, count
+ *     Escaped packets to send, with at most #SPI_TRANSFER_BATCH_MAX_FRAGMENTS
+ *     fragments in total.
+ *
+ * \returns
+ *     See #spi_send_buffer().
+ */
+enum SpiSendResult spi_send_burst(int fd, const struct spi_packet *packets, size_t count,
+                                  struct stats_io *io, struct stats_wait *wait);
 
 /*!
  * Fill buffer from SPI, but remove 0xff NOP bytes.
@@ -99,24 +305,151 @@ enum SpiSendResult spi_send_buffer(int fd, const uint8_t *buffer, size_t length,
 ssize_t spi_read_buffer(int fd, uint8_t *buffer, size_t length,
                         struct stats_io *io);
 
+/*!
+ * Like #spi_read_buffer(), but for reading payloads of known size.
+ *
+ * In case \p length doesn't fit into a single small chunk, the first transfer
+ * is sized to fetch all of it at once, with some headroom for NOPs and escape
+ * sequences. Retries and bytes missing due to escape sequences are read in
+ * small chunks.
+ */
+ssize_t spi_read_payload(int fd, uint8_t *buffer, size_t length,
+                         struct stats_io *io);
+
+/*!
+ * Start sending buffer, see #spi_send_buffer().
+ *
+ * The buffer must remain untouched until the operation has finished.
+ */
+void spi_send_begin(int fd, struct spi_operation *op,
+                    const uint8_t *buffer, size_t length);
+
+/*!
+ * Start sending several packets, see #spi_send_burst().
+ *
+ * The packets and the array describing them must remain untouched until the
+ * operation has finished.
+ */
+void spi_send_begin_burst(int fd, struct spi_operation *op,
+                          const struct spi_packet *packets, size_t count);
+
+/*!
+ * Probe slave once, send buffer if it is ready.
+ *
+ * \returns
+ *     #SPI_SEND_RESULT_PENDING if the slave is not ready yet, the final result
+ *     of the operation as for #spi_send_buffer() otherwise.
+ */
+enum SpiSendResult spi_send_continue(int fd, struct spi_operation *op,
+                                     struct stats_io *io,
+                                     struct stats_wait *wait);
+
+/*!
+ * Start reading into buffer, see #spi_read_buffer() and #spi_read_payload().
+ *
+ * Bytes left in the internal receive buffer are taken right away.
+ */
+void spi_read_begin(struct spi_operation *op, uint8_t *buffer, size_t length,
+                    bool is_payload);
+
+/*!
+ * Read from slave until the buffer is full or the slave sends only NOPs.
+ *
+ * \returns
+ *     #SPI_READ_PENDING if the slave has nothing to send at the moment, the
+ *     final result of the operation as for #spi_read_buffer() otherwise.
+ */
+ssize_t spi_read_continue(int fd, struct spi_operation *op,
+                          struct stats_io *io);
+
+/*!
+ * How long to wait before continuing a pending operation.
+ *
+ * For sending, this depends on the strategy configured by
+ * #spi_set_slave_ready_strategy() and advances its backoff. For
+ * #SPI_SLAVE_READY_GPIO_EDGE, the caller is expected to continue as soon as
+ * the request GPIO changes.
+ */
+unsigned int spi_operation_retry_delay_us(struct spi_operation *op);
+
+/*!
+ * Prepare empty transfer batch.
+ */
+void spi_transfer_batch_init(struct spi_transfer_batch *batch);
+
+/*!
+ * Append fragment to transfer batch.
+ *
+ * \param batch
+ *     Batch to append the fragment to.
+ *
+ * \param tx_buffer
+ *     Data to send. Pass \c NULL to send NOPs.
+ *
+ * \param rx_buffer
+ *     Where to store received data. Pass \c NULL to ignore the answer.
+ *
+ * \param length
+ *     Size of the fragment. When sending NOPs, this is limited by the size of
+ *     the internal dummy buffer.
+ *
+ * \param delay_usecs
+ *     Delay after this fragment before the next fragment is started, or before
+ *     CS is deasserted after the last fragment.
+ *
+ * \param cs_change
+ *     Deassert CS after this fragment before starting the next fragment. For
+ *     the last fragment, keep CS asserted after the transfer.
+ *
+ * \returns True on success, false if the batch is full or the fragment is
+ *     invalid.
+ */
+bool spi_transfer_batch_add(struct spi_transfer_batch *batch,
+                            const uint8_t *tx_buffer, uint8_t *rx_buffer,
+                            size_t length, uint16_t delay_usecs,
+                            bool cs_change);
+
+/*!
+ * Submit all fragments in a single \c SPI_IOC_MESSAGE(n) ioctl and empty the
+ * batch.
+ *
+ * \returns The result of #spi_hw_do_transfer(), i.e., -1 on error with
+ *     \c errno set. The error is not logged.
+ */
+int spi_transfer_batch_submit(int fd, struct spi_transfer_batch *batch,
+                              struct stats_io *io);
+
 /*!
  * Check if there could be another packet in the internal receive buffer.
  *
- * Also move the content so that a possible next packet is aligned with the
- * beginning of the buffer. This function is useful to find out if there is any
- * useful pending data in the buffer that would otherwise be discarded during
- * the next slave transaction.
+ * Also skip padding so that a possible next packet is the next thing to be
+ * read. A packet is recognized by the ready signal followed by a DCP command
+ * byte, the rest of its DCP header may still be pending on the SPI side. This
+ * function is useful to find out if there is any useful pending data in the
+ * buffer, such as packets sent back-to-back by the slave.
  */
 bool spi_input_buffer_weed(void);
 
 /*!
  * Begin new transaction, clear internal receive buffer.
  *
- * This just calls #spi_reset(), but it also prints a log message in case there
- * were any bytes left in the input buffer.
+ * Unlike #spi_reset(), this function only clears the input buffer, but it
+ * also prints a log message in case there were any bytes left in it. A packet
+ * whose DCP header has been received completely is kept, and so is the
+ * configuration (such as #spi_set_sched_delay_histogram()).
  */
 void spi_new_transaction(void);
 
+/*!
+ * Begin transaction the slave has requested while the previous one was
+ * still running.
+ *
+ * Like #spi_new_transaction(), but an incomplete DCP header at the end of the
+ * buffer is kept as well because the slave may have started sending it
+ * already.
+ */
+void spi_chain_transaction(void);
+
 /*!
  * Reset internal state.
  *
@@ -125,10 +458,71 @@ void spi_new_transaction(void);
 void spi_reset(void);
 
 /*!
- * Set clock speed for SPI transfers in Hz.
+ * Set fixed clock speed for SPI transfers in Hz.
  */
 void spi_set_speed_hz(uint32_t hz);
 
+/*!
+ * Let the clock adapt within given bounds, starting at the current speed.
+ *
+ * Pass 0 for both bounds to go back to a fixed clock.
+ */
+void spi_set_speed_range_hz(uint32_t min_hz, uint32_t max_hz);
+
+/*!
+ * Tell the clock controller that junk has been read from the slave.
+ *
+ * Only the DCP layer can tell, so it must call this function.
+ */
+void spi_report_junk(void);
+
+/*!
+ * Publish clock rates and changes in given structure.
+ *
+ * Pass \c NULL to stop.
+ */
+void spi_set_clock_statistics(struct spi_clock_stats *stats);
+
+/*!
+ * Configure how to wait for the slave before sending data.
+ *
+ * \param strategy
+ *     Which strategy to use.
+ *
+ * \param min_delay_us
+ *     Initial delay for exponential backoff, capped at 5 ms. Pass 0 to keep
+ *     the current setting.
+ *
+ * \param busy_poll_window_us
+ *     For #SPI_SLAVE_READY_BUSY_POLL, probe without any delay for this long
+ *     before backing off.
+ *
+ * \param gpio_fd
+ *     For #SPI_SLAVE_READY_GPIO_EDGE, the poll fd of the request GPIO. The
+ *     strategy degrades to #SPI_SLAVE_READY_BACKOFF if this is -1.
+ *
+ * \param gpio_events
+ *     The \c poll(2) events to wait for on \p gpio_fd, see
+ *     #gpio_get_poll_events().
+ */
+void spi_set_slave_ready_strategy(enum SpiSlaveReadyStrategy strategy,
+                                  unsigned int min_delay_us,
+                                  unsigned int busy_poll_window_us,
+                                  int gpio_fd, short gpio_events);
+
+/*!
+ * Record scheduling delay after each sleep in given histogram.
+ *
+ * The scheduling delay is the time between the requested and the actual
+ * wake-up. Pass \c NULL to stop measuring.
+ */
+void spi_set_sched_delay_histogram(struct stats_histogram *h);
+
+enum SpiSlaveReadyStrategy spi_get_slave_ready_strategy(void);
+const char *spi_slave_ready_strategy_to_string(enum SpiSlaveReadyStrategy strategy);
+bool spi_slave_ready_strategy_from_string(const char *name,
+                                          enum SpiSlaveReadyStrategy *strategy);
+
 /*!
  * Dump all SPI traffic only at highest debug level.
  *
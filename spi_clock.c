@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdlib.h>
+
+#include "spi_clock.h"
+
+static uint32_t clamp(uint32_t hz, uint32_t min_hz, uint32_t max_hz)
+{
+    if(hz < min_hz)
+        return min_hz;
+
+    if(hz > max_hz)
+        return max_hz;
+
+    return hz;
+}
+
+static void publish(const struct spi_clock *clk)
+{
+    if(clk->stats == NULL)
+        return;
+
+    clk->stats->is_adaptive = clk->is_adaptive;
+
+    for(int i = 0; i < SPI_CLOCK_DIRECTIONS; ++i)
+        clk->stats->directions[i].hz = clk->directions[i].hz;
+}
+
+void spi_clock_configure(struct spi_clock *clk, uint32_t hz,
+                         uint32_t min_hz, uint32_t max_hz)
+{
+    clk->is_adaptive = (max_hz > 0 && min_hz < max_hz);
+
+    if(clk->is_adaptive)
+    {
+        clk->min_hz = min_hz > 0 ? min_hz : 1;
+        clk->max_hz = max_hz;
+        hz = clamp(hz, clk->min_hz, clk->max_hz);
+    }
+    else
+    {
+        clk->min_hz = hz;
+        clk->max_hz = hz;
+    }
+
+    for(int i = 0; i < SPI_CLOCK_DIRECTIONS; ++i)
+    {
+        clk->directions[i].hz = hz;
+        clk->directions[i].ceiling_hz = clk->max_hz;
+        clk->directions[i].successes = 0;
+    }
+
+    publish(clk);
+}
+
+static bool raise_rate(struct spi_clock *clk, struct spi_clock_direction *d)
+{
+    ++d->successes;
+
+    if(d->hz < d->ceiling_hz)
+    {
+        if(d->successes < SPI_CLOCK_RAISE_AFTER_SUCCESSES)
+            return false;
+    }
+    else if(d->ceiling_hz < clk->max_hz)
+    {
+        if(d->successes < SPI_CLOCK_RETRY_AFTER_SUCCESSES)
+            return false;
+
+        d->ceiling_hz = clamp(d->ceiling_hz + d->ceiling_hz / 16U + 1U,
+                              clk->min_hz, clk->max_hz);
+    }
+    else
+    {
+        /* at the top, nothing to do */
+        d->successes = 0;
+        return false;
+    }
+
+    d->successes = 0;
+    d->hz = clamp(d->hz + d->hz / 16U + 1U, clk->min_hz, d->ceiling_hz);
+
+    return true;
+}
+
+static bool lower_rate(struct spi_clock *clk, struct spi_clock_direction *d)
+{
+    d->successes = 0;
+
+    const uint32_t failed_hz = d->hz;
+
+    d->ceiling_hz = clamp(failed_hz - failed_hz / 16U, clk->min_hz, clk->max_hz);
+    d->hz = clamp(failed_hz - failed_hz / 4U, clk->min_hz, clk->max_hz);
+
+    return d->hz != failed_hz;
+}
+
+bool spi_clock_report(struct spi_clock *clk, enum SpiClockDirection dir,
+                      enum SpiClockEvent event)
+{
+    if(!clk->is_adaptive)
+        return false;
+
+    struct spi_clock_direction *const d = &clk->directions[dir];
+    struct spi_clock_direction_stats *const st =
+        clk->stats != NULL ? &clk->stats->directions[dir] : NULL;
+
+    bool changed = false;
+
+    switch(event)
+    {
+      case SPI_CLOCK_EVENT_SUCCESS:
+        changed = raise_rate(clk, d);
+
+        if(changed && st != NULL)
+            ++st->raised;
+
+        break;
+
+      case SPI_CLOCK_EVENT_TIMEOUT:
+        changed = lower_rate(clk, d);
+
+        if(changed && st != NULL)
+            ++st->lowered_for_timeout;
+
+        break;
+
+      case SPI_CLOCK_EVENT_JUNK:
+        changed = lower_rate(clk, d);
+
+        if(changed && st != NULL)
+            ++st->lowered_for_junk;
+
+        break;
+    }
+
+    if(changed && st != NULL)
+        st->hz = d->hz;
+
+    return changed;
+}
+
+void spi_clock_set_statistics(struct spi_clock *clk,
+                              struct spi_clock_stats *stats)
+{
+    clk->stats = stats;
+    publish(clk);
+}
+
+const char *spi_clock_direction_to_string(enum SpiClockDirection dir)
+{
+    switch(dir)
+    {
+      case SPI_CLOCK_READ:
+        return "read";
+
+      case SPI_CLOCK_WRITE:
+        return "write";
+
+      case SPI_CLOCK_DIRECTIONS:
+        break;
+    }
+
+    return "INVALID";
+}
+
+const char *spi_clock_event_to_string(enum SpiClockEvent event)
+{
+    switch(event)
+    {
+      case SPI_CLOCK_EVENT_SUCCESS:
+        return "success";
+
+      case SPI_CLOCK_EVENT_TIMEOUT:
+        return "timeout";
+
+      case SPI_CLOCK_EVENT_JUNK:
+        return "junk";
+    }
+
+    return "INVALID";
+}
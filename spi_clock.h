@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef SPI_CLOCK_H
+#define SPI_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*!
+ * Number of successful transfers before the clock is raised.
+ */
+#define SPI_CLOCK_RAISE_AFTER_SUCCESSES 256U
+
+/*!
+ * Number of successful transfers before a rate that has failed is tried again.
+ *
+ * The safe rate depends on temperature, so failures must be forgotten after a
+ * while.
+ */
+#define SPI_CLOCK_RETRY_AFTER_SUCCESSES (64U * SPI_CLOCK_RAISE_AFTER_SUCCESSES)
+
+enum SpiClockDirection
+{
+    /*! Transfers which read from the slave, including readiness probes. */
+    SPI_CLOCK_READ,
+
+    /*! Transfers which write data to the slave. */
+    SPI_CLOCK_WRITE,
+
+    SPI_CLOCK_DIRECTIONS,
+};
+
+enum SpiClockEvent
+{
+    /*! Transfer went through. */
+    SPI_CLOCK_EVENT_SUCCESS,
+
+    /*! The slave did not answer in time. */
+    SPI_CLOCK_EVENT_TIMEOUT,
+
+    /*! The slave sent garbage. */
+    SPI_CLOCK_EVENT_JUNK,
+};
+
+/*!
+ * Rate and changes in one direction, for the statistics.
+ */
+struct spi_clock_direction_stats
+{
+    uint32_t hz;
+    uint32_t raised;
+    uint32_t lowered_for_timeout;
+    uint32_t lowered_for_junk;
+};
+
+struct spi_clock_stats
+{
+    bool is_adaptive;
+    struct spi_clock_direction_stats directions[SPI_CLOCK_DIRECTIONS];
+};
+
+struct spi_clock_direction
+{
+    uint32_t hz;
+
+    /*! Highest rate known to work, raised again after a long time. */
+    uint32_t ceiling_hz;
+
+    /*! Successful transfers since the last change. */
+    uint32_t successes;
+};
+
+/*!
+ * Clock rate controller for one slave.
+ *
+ * With a fixed clock, reports are ignored. An adaptive clock is raised by
+ * 1/16 after #SPI_CLOCK_RAISE_AFTER_SUCCESSES successful transfers in a row,
+ * and lowered by 1/4 on each timeout or junk. A rate that has failed becomes
+ * the new ceiling so that the clock does not keep failing at the same rate;
+ * the ceiling is raised again after #SPI_CLOCK_RETRY_AFTER_SUCCESSES
+ * successful transfers.
+ */
+struct spi_clock
+{
+    bool is_adaptive;
+    uint32_t min_hz;
+    uint32_t max_hz;
+    struct spi_clock_direction directions[SPI_CLOCK_DIRECTIONS];
+
+    /*! Where to publish rates and changes, may be \c NULL. */
+    struct spi_clock_stats *stats;
+};
+
+/*!
+ * Static initializer for a fixed clock.
+ */
+#define SPI_CLOCK_FIXED(HZ) \
+    { \
+        .is_adaptive = false, \
+        .min_hz = (HZ), \
+        .max_hz = (HZ), \
+        .directions = \
+        { \
+            { .hz = (HZ), .ceiling_hz = (HZ), .successes = 0, }, \
+            { .hz = (HZ), .ceiling_hz = (HZ), .successes = 0, }, \
+        }, \
+        .stats = NULL, \
+    }
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Use given rate in both directions.
+ *
+ * The statistics pointer is left alone.
+ *
+ * \param clk
+ *     Clock to configure.
+ *
+ * \param hz
+ *     Rate in Hz.
+ *
+ * \param min_hz, max_hz
+ *     Bounds for an adaptive clock starting at \p hz, or both 0 for a fixed
+ *     clock. The start rate is moved into the bounds.
+ */
+void spi_clock_configure(struct spi_clock *clk, uint32_t hz,
+                         uint32_t min_hz, uint32_t max_hz);
+
+static inline uint32_t spi_clock_get_hz(const struct spi_clock *clk,
+                                        enum SpiClockDirection dir)
+{
+    return clk->directions[dir].hz;
+}
+
+/*!
+ * Tell the controller how a transfer went.
+ *
+ * \returns
+ *     True if the rate in direction \p dir has been changed.
+ */
+bool spi_clock_report(struct spi_clock *clk, enum SpiClockDirection dir,
+                      enum SpiClockEvent event);
+
+/*!
+ * Publish rates and changes in given structure from now on.
+ *
+ * The current rates are stored right away. Pass \c NULL to stop.
+ */
+void spi_clock_set_statistics(struct spi_clock *clk,
+                              struct spi_clock_stats *stats);
+
+const char *spi_clock_direction_to_string(enum SpiClockDirection dir);
+const char *spi_clock_event_to_string(enum SpiClockEvent event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !SPI_CLOCK_H */
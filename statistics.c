@@ -145,17 +145,123 @@ static bool add_to_itime(struct stats_context *ctx, uint64_t usec)
     return false;
 }
 
-static struct stats_context *global_current_content;
+/* each thread measures its own contexts */
+static _Thread_local struct stats_context *global_current_content;
 
 void stats_init(void)
 {
     global_current_content = NULL;
 }
 
+void stats_histogram_reset(struct stats_histogram *const h)
+{
+    for(unsigned int i = 0; i < STATS_HISTOGRAM_BUCKETS; ++i)
+        h->buckets[i] = 0;
+
+    h->sum_usec = 0;
+    h->max_usec = 0;
+}
+
+unsigned int stats_histogram_bucket(uint64_t usec)
+{
+    if(usec == 0)
+        return 0;
+
+    const unsigned int bucket = 64 - __builtin_clzll(usec);
+
+    return bucket < STATS_HISTOGRAM_BUCKETS
+        ? bucket
+        : STATS_HISTOGRAM_BUCKETS - 1;
+}
+
+void stats_histogram_add(struct stats_histogram *const h, uint64_t usec)
+{
+    if(h == NULL)
+        return;
+
+    uint32_t *const bucket = &h->buckets[stats_histogram_bucket(usec)];
+
+    if(*bucket < UINT32_MAX)
+        ++*bucket;
+
+    h->sum_usec += usec;
+
+    if(usec > h->max_usec)
+        h->max_usec = usec;
+}
+
+void stats_histogram_add_elapsed(struct stats_histogram *const h,
+                                 const struct timespec *const started)
+{
+    if(h == NULL)
+        return;
+
+    int save_errno = errno;
+    struct timespec now;
+
+    if(os_clock_gettime(CLOCK_MONOTONIC, &now) == 0)
+        stats_histogram_add(h, compute_delta_usec(started, &now));
+    else
+        msg_error(errno, LOG_ERR, "Failed to get current time");
+
+    errno = save_errno;
+}
+
+uint32_t stats_histogram_count(const struct stats_histogram *const h)
+{
+    uint64_t count = 0;
+
+    for(unsigned int i = 0; i < STATS_HISTOGRAM_BUCKETS; ++i)
+        count += h->buckets[i];
+
+    return count <= UINT32_MAX ? count : UINT32_MAX;
+}
+
+/*!
+ * Upper bound of the bucket the given percentile falls into.
+ *
+ * The result is never greater than the maximum duration seen so far.
+ */
+uint64_t stats_histogram_percentile(const struct stats_histogram *const h,
+                                    unsigned int percent)
+{
+    uint64_t count = 0;
+
+    for(unsigned int i = 0; i < STATS_HISTOGRAM_BUCKETS; ++i)
+        count += h->buckets[i];
+
+    if(count == 0)
+        return 0;
+
+    if(percent > 100)
+        percent = 100;
+
+    /* rank of the sample we are looking for, rounded up, at least 1 */
+    uint64_t rank = (count * percent + 99) / 100;
+    if(rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+
+    for(unsigned int i = 0; i < STATS_HISTOGRAM_BUCKETS - 1; ++i)
+    {
+        seen += h->buckets[i];
+
+        if(seen >= rank)
+        {
+            const uint64_t upper = i == 0 ? 0 : (UINT64_C(1) << i) - 1;
+            return upper < h->max_usec ? upper : h->max_usec;
+        }
+    }
+
+    return h->max_usec;
+}
+
 void stats_context_reset(struct stats_context *const ctx)
 {
     ctx->t_usec = 0;
     ctx->ti_usec = 0;
+    stats_histogram_reset(&ctx->histogram);
 }
 
 struct stats_context *stats_context_switch(struct stats_context *const ctx)
@@ -169,7 +275,7 @@ struct stats_context *stats_context_switch(struct stats_context *const ctx)
         return ctx;
 
     const int temp =
-        os_clock_gettime(CLOCK_MONOTONIC_RAW, &ctx->context_entered);
+        os_clock_gettime(CLOCK_MONOTONIC, &ctx->context_entered);
 
     global_current_content = ctx;
 
@@ -181,6 +287,7 @@ struct stats_context *stats_context_switch(struct stats_context *const ctx)
                                                       &ctx->context_entered);
             add_to_time(prev, delta);
             add_to_itime(prev, delta);
+            stats_histogram_add(&prev->histogram, delta);
         }
     }
     else
@@ -269,3 +376,45 @@ void stats_io_end(struct stats_io *const io,
 
     errno = save_errno;
 }
+
+void stats_wait_reset(struct stats_wait *const w)
+{
+    stats_event_counter_reset(&w->waits);
+    stats_event_counter_reset(&w->probes);
+    w->total_usec = 0;
+    w->max_usec = 0;
+}
+
+void stats_wait_end(struct stats_wait *const w,
+                    const struct timespec *const wait_started, uint32_t probes)
+{
+    if(w == NULL)
+        return;
+
+    int save_errno = errno;
+
+    stats_event(&w->waits);
+    stats_events(&w->probes, probes);
+
+    struct timespec now;
+
+    if(os_clock_gettime(CLOCK_MONOTONIC, &now) == 0)
+    {
+        const uint64_t delta = compute_delta_usec(wait_started, &now);
+
+        add_saturated(delta, UINT64_MAX, false, &w->total_usec);
+
+        if(delta > w->max_usec)
+            w->max_usec = delta;
+    }
+    else
+        msg_error(errno, LOG_ERR, "Failed to get current time");
+
+    errno = save_errno;
+}
+
+uint64_t stats_delta_usec(const struct timespec *past,
+                          const struct timespec *now)
+{
+    return compute_delta_usec(past, now);
+}
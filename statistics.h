@@ -26,11 +26,33 @@
 
 #include "os.h"
 
+/*!
+ * Number of buckets in a latency histogram.
+ *
+ * Bucket 0 counts durations of 0 us, bucket \e n counts durations from
+ * 2^(n-1) us up to 2^n - 1 us. The last bucket takes everything of 2^22 us
+ * (about 4 s) and longer.
+ */
+#define STATS_HISTOGRAM_BUCKETS 24
+
+/*!
+ * Log2 latency histogram, fixed size, saturating counters.
+ */
+struct stats_histogram
+{
+    uint32_t buckets[STATS_HISTOGRAM_BUCKETS];
+    uint64_t sum_usec;
+    uint64_t max_usec;
+};
+
 struct stats_context
 {
     uint64_t t_usec;
     uint64_t ti_usec;
 
+    /*! Duration of each stay in this context. */
+    struct stats_histogram histogram;
+
     struct timespec context_entered;  /* private */
 };
 
@@ -43,16 +65,35 @@ struct stats_io
 {
     struct stats_event_counter ops;
     struct stats_event_counter failures;
+
+    /*! Time spent in I/O, histogram holds the latency of each operation. */
     struct stats_context blocked;
     size_t bytes_transferred;
 };
 
+struct stats_wait
+{
+    struct stats_event_counter waits;
+    struct stats_event_counter probes;
+    uint64_t total_usec;
+    uint64_t max_usec;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 void stats_init(void);
 
+void stats_histogram_reset(struct stats_histogram *h);
+unsigned int stats_histogram_bucket(uint64_t usec);
+void stats_histogram_add(struct stats_histogram *h, uint64_t usec);
+void stats_histogram_add_elapsed(struct stats_histogram *h,
+                                 const struct timespec *started);
+uint32_t stats_histogram_count(const struct stats_histogram *h);
+uint64_t stats_histogram_percentile(const struct stats_histogram *h,
+                                    unsigned int percent);
+
 void stats_context_reset(struct stats_context *ctx);
 struct stats_context *stats_context_switch(struct stats_context *ctx);
 struct stats_context *
@@ -67,6 +108,13 @@ struct stats_context *stats_io_begin(struct stats_io *io);
 void stats_io_end(struct stats_io *io, struct stats_context *previous_ctx,
                   size_t failures, size_t bytes);
 
+void stats_wait_reset(struct stats_wait *w);
+void stats_wait_end(struct stats_wait *w, const struct timespec *wait_started,
+                    uint32_t probes);
+
+uint64_t stats_delta_usec(const struct timespec *past,
+                          const struct timespec *now);
+
 #ifdef __cplusplus
 }
 #endif
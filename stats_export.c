@@ -0,0 +1,732 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "stats_export.h"
+#include "messages.h"
+#include "os.h"
+
+struct text_buffer
+{
+    char *buffer;
+    size_t size;
+    size_t length;
+};
+
+static void append(struct text_buffer *tb, const char *fmt, ...)
+    __attribute__ ((format (printf, 2, 3)));
+
+static void append(struct text_buffer *tb, const char *fmt, ...)
+{
+    const size_t avail = tb->length < tb->size ? tb->size - tb->length : 0;
+    va_list va;
+
+    va_start(va, fmt);
+    const int len = vsnprintf(avail > 0 ? tb->buffer + tb->length : NULL,
+                              avail, fmt, va);
+    va_end(va);
+
+    if(len > 0)
+        tb->length += len;
+}
+
+struct named_context
+{
+    const char *name;
+    const struct stats_context *ctx;
+};
+
+struct named_io
+{
+    const char *name;
+    const struct stats_io *io;
+};
+
+struct named_wait
+{
+    const char *name;
+    const struct stats_wait *wait;
+};
+
+struct named_histogram
+{
+    const char *name;
+    const struct stats_histogram *h;
+};
+
+#define CONTEXTS_OF(S) \
+    { \
+        { "wait_for_events", &(S)->wait_for_events, }, \
+        { "busy_unspecific", &(S)->busy_unspecific, }, \
+        { "busy_gpio",       &(S)->busy_gpio, }, \
+        { "busy_transaction", &(S)->busy_transaction, }, \
+    }
+
+#define IOS_OF(S) \
+    { \
+        { "spi",         &(S)->spi_transfers, }, \
+        { "dcpd_read",   &(S)->dcpd_reads, }, \
+        { "dcpd_write",  &(S)->dcpd_writes, }, \
+    }
+
+#define WAITS_OF(S) \
+    { \
+        { "slave_ready", &(S)->slave_ready, }, \
+        { "debounce",    &(S)->debounce, }, \
+    }
+
+#define TRANSACTIONS_OF(S) \
+    { \
+        { "slave",  &(S)->slave_transactions, }, \
+        { "master", &(S)->master_transactions, }, \
+    }
+
+#define ARRAY_SIZE(A) (sizeof(A) / sizeof((A)[0]))
+
+/*!
+ * Upper bound of histogram bucket, see #STATS_HISTOGRAM_BUCKETS.
+ */
+static inline uint64_t bucket_upper_bound(unsigned int i)
+{
+    return (UINT64_C(1) << i) - 1;
+}
+
+static void json_histogram(struct text_buffer *tb,
+                           const struct stats_histogram *h)
+{
+    append(tb, "{\"count\":%" PRIu32 ",\"sum_us\":%" PRIu64
+           ",\"max_us\":%" PRIu64 ",\"buckets\":[",
+           stats_histogram_count(h), h->sum_usec, h->max_usec);
+
+    for(unsigned int i = 0; i < STATS_HISTOGRAM_BUCKETS; ++i)
+        append(tb, i == 0 ? "%" PRIu32 : ",%" PRIu32, h->buckets[i]);
+
+    append(tb, "]}");
+}
+
+static void render_json(struct text_buffer *tb,
+                        const struct program_statistics *stats,
+                        uint64_t timestamp_usec)
+{
+    const struct named_context contexts[] = CONTEXTS_OF(stats);
+    const struct named_io ios[] = IOS_OF(stats);
+    const struct named_wait waits[] = WAITS_OF(stats);
+    const struct named_histogram transactions[] = TRANSACTIONS_OF(stats);
+
+    append(tb, "{\"timestamp_monotonic_us\":%" PRIu64 ",\"enabled\":%s",
+           timestamp_usec, stats->is_enabled ? "true" : "false");
+
+    append(tb, ",\"contexts\":{");
+
+    for(size_t i = 0; i < ARRAY_SIZE(contexts); ++i)
+    {
+        append(tb, "%s\"%s\":{\"t_us\":%" PRIu64 ",\"ti_us\":%" PRIu64
+               ",\"histogram\":",
+               i == 0 ? "" : ",", contexts[i].name,
+               contexts[i].ctx->t_usec, contexts[i].ctx->ti_usec);
+        json_histogram(tb, &contexts[i].ctx->histogram);
+        append(tb, "}");
+    }
+
+    append(tb, "},\"io\":{");
+
+    for(size_t i = 0; i < ARRAY_SIZE(ios); ++i)
+    {
+        const struct stats_io *io = ios[i].io;
+
+        append(tb, "%s\"%s\":{\"ops\":%" PRIu32 ",\"failures\":%" PRIu32
+               ",\"bytes\":%zu,\"blocked_us\":%" PRIu64 ",\"histogram\":",
+               i == 0 ? "" : ",", ios[i].name,
+               io->ops.count, io->failures.count, io->bytes_transferred,
+               io->blocked.t_usec);
+        json_histogram(tb, &io->blocked.histogram);
+        append(tb, "}");
+    }
+
+    append(tb, "},\"waits\":{");
+
+    for(size_t i = 0; i < ARRAY_SIZE(waits); ++i)
+    {
+        const struct stats_wait *w = waits[i].wait;
+
+        append(tb, "%s\"%s\":{\"waits\":%" PRIu32 ",\"probes\":%" PRIu32
+               ",\"total_us\":%" PRIu64 ",\"max_us\":%" PRIu64 "}",
+               i == 0 ? "" : ",", waits[i].name,
+               w->waits.count, w->probes.count, w->total_usec, w->max_usec);
+    }
+
+    append(tb, "},\"transactions\":{");
+
+    for(size_t i = 0; i < ARRAY_SIZE(transactions); ++i)
+    {
+        append(tb, "%s\"%s\":", i == 0 ? "" : ",", transactions[i].name);
+        json_histogram(tb, transactions[i].h);
+    }
+
+    append(tb, "},\"spi_clock\":{\"adaptive\":%s",
+           stats->spi_clock.is_adaptive ? "true" : "false");
+
+    for(int i = 0; i < SPI_CLOCK_DIRECTIONS; ++i)
+    {
+        const struct spi_clock_direction_stats *clk =
+            &stats->spi_clock.directions[i];
+
+        append(tb, ",\"%s\":{\"hz\":%" PRIu32 ",\"raised\":%" PRIu32
+               ",\"lowered_for_timeout\":%" PRIu32
+               ",\"lowered_for_junk\":%" PRIu32 "}",
+               spi_clock_direction_to_string(i), clk->hz, clk->raised,
+               clk->lowered_for_timeout, clk->lowered_for_junk);
+    }
+
+    append(tb, "},\"sched_delay\":");
+    json_histogram(tb, &stats->sched_delay);
+
+    append(tb, "}\n");
+}
+
+static void prometheus_histogram(struct text_buffer *tb, const char *family,
+                                 const char *label, const char *value,
+                                 const struct stats_histogram *h)
+{
+    uint64_t cumulative = 0;
+
+    for(unsigned int i = 0; i < STATS_HISTOGRAM_BUCKETS - 1; ++i)
+    {
+        cumulative += h->buckets[i];
+        append(tb, "%s_bucket{%s=\"%s\",le=\"%" PRIu64 "\"} %" PRIu64 "\n",
+               family, label, value, bucket_upper_bound(i), cumulative);
+    }
+
+    cumulative += h->buckets[STATS_HISTOGRAM_BUCKETS - 1];
+    append(tb, "%s_bucket{%s=\"%s\",le=\"+Inf\"} %" PRIu64 "\n",
+           family, label, value, cumulative);
+    append(tb, "%s_sum{%s=\"%s\"} %" PRIu64 "\n",
+           family, label, value, h->sum_usec);
+    append(tb, "%s_count{%s=\"%s\"} %" PRIu64 "\n",
+           family, label, value, cumulative);
+}
+
+static void prometheus_family(struct text_buffer *tb, const char *family,
+                              const char *type, const char *help)
+{
+    append(tb, "# HELP %s %s\n# TYPE %s %s\n", family, help, family, type);
+}
+
+static void render_prometheus(struct text_buffer *tb,
+                              const struct program_statistics *stats,
+                              uint64_t timestamp_usec)
+{
+    const struct named_context contexts[] = CONTEXTS_OF(stats);
+    const struct named_io ios[] = IOS_OF(stats);
+    const struct named_wait waits[] = WAITS_OF(stats);
+    const struct named_histogram transactions[] = TRANSACTIONS_OF(stats);
+
+    prometheus_family(tb, "dcpspi_snapshot_timestamp_microseconds", "gauge",
+                      "CLOCK_MONOTONIC time of the snapshot.");
+    append(tb, "dcpspi_snapshot_timestamp_microseconds %" PRIu64 "\n",
+           timestamp_usec);
+
+    prometheus_family(tb, "dcpspi_statistics_enabled", "gauge",
+                      "Whether or not statistics are being gathered.");
+    append(tb, "dcpspi_statistics_enabled %d\n", stats->is_enabled ? 1 : 0);
+
+    prometheus_family(tb, "dcpspi_context_microseconds_total", "counter",
+                      "Time spent in context.");
+    for(size_t i = 0; i < ARRAY_SIZE(contexts); ++i)
+        append(tb, "dcpspi_context_microseconds_total{context=\"%s\"} %" PRIu64 "\n",
+               contexts[i].name, contexts[i].ctx->t_usec);
+
+    prometheus_family(tb, "dcpspi_context_inclusive_microseconds_total", "counter",
+                      "Time spent in context, including nested contexts.");
+    for(size_t i = 0; i < ARRAY_SIZE(contexts); ++i)
+        append(tb, "dcpspi_context_inclusive_microseconds_total{context=\"%s\"} %" PRIu64 "\n",
+               contexts[i].name, contexts[i].ctx->ti_usec);
+
+    prometheus_family(tb, "dcpspi_context_stay_microseconds", "histogram",
+                      "Duration of each stay in context.");
+    for(size_t i = 0; i < ARRAY_SIZE(contexts); ++i)
+        prometheus_histogram(tb, "dcpspi_context_stay_microseconds",
+                             "context", contexts[i].name,
+                             &contexts[i].ctx->histogram);
+
+    prometheus_family(tb, "dcpspi_io_operations_total", "counter",
+                      "Number of I/O operations.");
+    for(size_t i = 0; i < ARRAY_SIZE(ios); ++i)
+        append(tb, "dcpspi_io_operations_total{channel=\"%s\"} %" PRIu32 "\n",
+               ios[i].name, ios[i].io->ops.count);
+
+    prometheus_family(tb, "dcpspi_io_failures_total", "counter",
+                      "Number of failed I/O operations.");
+    for(size_t i = 0; i < ARRAY_SIZE(ios); ++i)
+        append(tb, "dcpspi_io_failures_total{channel=\"%s\"} %" PRIu32 "\n",
+               ios[i].name, ios[i].io->failures.count);
+
+    prometheus_family(tb, "dcpspi_io_bytes_total", "counter",
+                      "Number of bytes transferred.");
+    for(size_t i = 0; i < ARRAY_SIZE(ios); ++i)
+        append(tb, "dcpspi_io_bytes_total{channel=\"%s\"} %zu\n",
+               ios[i].name, ios[i].io->bytes_transferred);
+
+    prometheus_family(tb, "dcpspi_io_blocked_microseconds_total", "counter",
+                      "Time spent blocked in I/O.");
+    for(size_t i = 0; i < ARRAY_SIZE(ios); ++i)
+        append(tb, "dcpspi_io_blocked_microseconds_total{channel=\"%s\"} %" PRIu64 "\n",
+               ios[i].name, ios[i].io->blocked.t_usec);
+
+    prometheus_family(tb, "dcpspi_io_latency_microseconds", "histogram",
+                      "Latency of each I/O operation.");
+    for(size_t i = 0; i < ARRAY_SIZE(ios); ++i)
+        prometheus_histogram(tb, "dcpspi_io_latency_microseconds",
+                             "channel", ios[i].name,
+                             &ios[i].io->blocked.histogram);
+
+    prometheus_family(tb, "dcpspi_waits_total", "counter",
+                      "Number of waits.");
+    for(size_t i = 0; i < ARRAY_SIZE(waits); ++i)
+        append(tb, "dcpspi_waits_total{wait=\"%s\"} %" PRIu32 "\n",
+               waits[i].name, waits[i].wait->waits.count);
+
+    prometheus_family(tb, "dcpspi_wait_probes_total", "counter",
+                      "Number of probes while waiting.");
+    for(size_t i = 0; i < ARRAY_SIZE(waits); ++i)
+        append(tb, "dcpspi_wait_probes_total{wait=\"%s\"} %" PRIu32 "\n",
+               waits[i].name, waits[i].wait->probes.count);
+
+    prometheus_family(tb, "dcpspi_wait_microseconds_total", "counter",
+                      "Time spent waiting.");
+    for(size_t i = 0; i < ARRAY_SIZE(waits); ++i)
+        append(tb, "dcpspi_wait_microseconds_total{wait=\"%s\"} %" PRIu64 "\n",
+               waits[i].name, waits[i].wait->total_usec);
+
+    prometheus_family(tb, "dcpspi_wait_max_microseconds", "gauge",
+                      "Longest wait.");
+    for(size_t i = 0; i < ARRAY_SIZE(waits); ++i)
+        append(tb, "dcpspi_wait_max_microseconds{wait=\"%s\"} %" PRIu64 "\n",
+               waits[i].name, waits[i].wait->max_usec);
+
+    prometheus_family(tb, "dcpspi_transaction_microseconds", "histogram",
+                      "End-to-end latency of transactions.");
+    for(size_t i = 0; i < ARRAY_SIZE(transactions); ++i)
+        prometheus_histogram(tb, "dcpspi_transaction_microseconds",
+                             "kind", transactions[i].name, transactions[i].h);
+
+    prometheus_family(tb, "dcpspi_sched_delay_microseconds", "histogram",
+                      "Wake-up later than requested after sleeping.");
+    prometheus_histogram(tb, "dcpspi_sched_delay_microseconds",
+                         "thread", "main", &stats->sched_delay);
+
+    prometheus_family(tb, "dcpspi_spi_clock_adaptive", "gauge",
+                      "Whether or not the SPI clock adapts to the slave.");
+    append(tb, "dcpspi_spi_clock_adaptive %d\n",
+           stats->spi_clock.is_adaptive ? 1 : 0);
+
+    prometheus_family(tb, "dcpspi_spi_clock_hertz", "gauge",
+                      "Current SPI clock rate.");
+    for(int i = 0; i < SPI_CLOCK_DIRECTIONS; ++i)
+        append(tb, "dcpspi_spi_clock_hertz{direction=\"%s\"} %" PRIu32 "\n",
+               spi_clock_direction_to_string(i),
+               stats->spi_clock.directions[i].hz);
+
+    prometheus_family(tb, "dcpspi_spi_clock_changes_total", "counter",
+                      "Number of SPI clock rate changes.");
+    for(int i = 0; i < SPI_CLOCK_DIRECTIONS; ++i)
+    {
+        const struct spi_clock_direction_stats *clk =
+            &stats->spi_clock.directions[i];
+        const char *dir = spi_clock_direction_to_string(i);
+
+        append(tb, "dcpspi_spi_clock_changes_total{direction=\"%s\",reason=\"success\"} %" PRIu32 "\n",
+               dir, clk->raised);
+        append(tb, "dcpspi_spi_clock_changes_total{direction=\"%s\",reason=\"timeout\"} %" PRIu32 "\n",
+               dir, clk->lowered_for_timeout);
+        append(tb, "dcpspi_spi_clock_changes_total{direction=\"%s\",reason=\"junk\"} %" PRIu32 "\n",
+               dir, clk->lowered_for_junk);
+    }
+}
+
+bool stats_export_format_from_string(const char *name,
+                                     enum StatsExportFormat *format)
+{
+    if(strcmp(name, "json") == 0)
+        *format = STATS_EXPORT_FORMAT_JSON;
+    else if(strcmp(name, "prometheus") == 0)
+        *format = STATS_EXPORT_FORMAT_PROMETHEUS;
+    else
+        return false;
+
+    return true;
+}
+
+size_t stats_export_render(char *buffer, size_t size,
+                           const struct program_statistics *stats,
+                           enum StatsExportFormat format,
+                           uint64_t timestamp_usec)
+{
+    struct text_buffer tb =
+    {
+        .buffer = buffer,
+        .size = size,
+        .length = 0,
+    };
+
+    if(size > 0)
+        buffer[0] = '\0';
+
+    switch(format)
+    {
+      case STATS_EXPORT_FORMAT_JSON:
+        render_json(&tb, stats, timestamp_usec);
+        break;
+
+      case STATS_EXPORT_FORMAT_PROMETHEUS:
+        render_prometheus(&tb, stats, timestamp_usec);
+        break;
+    }
+
+    return tb.length;
+}
+
+static int send_all(int fd, const char *text, size_t length)
+{
+    while(length > 0)
+    {
+        /* collector going away must not kill us */
+        const ssize_t ret = send(fd, text, length, MSG_NOSIGNAL);
+
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            return -1;
+        }
+
+        text += ret;
+        length -= ret;
+    }
+
+    return 0;
+}
+
+/*!
+ * Send text to Unix socket.
+ *
+ * On error, \c errno is left as set by the failed operation, and \p what
+ * describes it. The same applies to #write_to_file().
+ */
+static int write_to_socket(const char *sockname, const char *text,
+                           size_t length, const char **what)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    if(strlen(sockname) >= sizeof(addr.sun_path))
+    {
+        *what = "using too long statistics socket name";
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    strcpy(addr.sun_path, sockname);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if(fd < 0)
+    {
+        *what = "creating statistics socket for";
+        return -1;
+    }
+
+    int ret = connect(fd, (const struct sockaddr *)&addr, sizeof(addr));
+
+    if(ret < 0)
+        *what = "connecting to statistics socket";
+    else if((ret = send_all(fd, text, length)) < 0)
+        *what = "sending statistics to";
+
+    const int save_errno = errno;
+    close(fd);
+    errno = save_errno;
+
+    return ret;
+}
+
+static int write_to_file(const char *filename, const char *text,
+                         size_t length, const char **what)
+{
+    char tempname[1024];
+
+    if(snprintf(tempname, sizeof(tempname), "%s.XXXXXX", filename) >= (int)sizeof(tempname))
+    {
+        *what = "using too long statistics file name";
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    /* unique name next to the target so that rename(2) replaces it
+     * atomically, and nobody can plant anything under a predictable name */
+    const int fd = mkstemp(tempname);
+
+    if(fd < 0)
+    {
+        *what = "creating temporary file for statistics file";
+        return -1;
+    }
+
+    /* readable by the collector, like a file created by fopen(3) */
+    FILE *f = fchmod(fd, 0644) == 0 ? fdopen(fd, "w") : NULL;
+
+    if(f == NULL)
+    {
+        *what = "opening temporary file for statistics file";
+
+        const int save_errno = errno;
+        close(fd);
+        unlink(tempname);
+        errno = save_errno;
+
+        return -1;
+    }
+
+    const bool ok = fwrite(text, 1, length, f) == length;
+
+    if(fclose(f) != 0 || !ok)
+        *what = "writing temporary file for statistics file";
+    else if(rename(tempname, filename) < 0)
+        *what = "renaming temporary file to statistics file";
+    else
+        return 0;
+
+    const int save_errno = errno;
+    unlink(tempname);
+    errno = save_errno;
+
+    return -1;
+}
+
+static const char *get_socket_name(const char *target)
+{
+    const size_t prefix_length = strlen(STATS_EXPORT_SOCKET_PREFIX);
+
+    return strncmp(target, STATS_EXPORT_SOCKET_PREFIX, prefix_length) == 0
+        ? target + prefix_length
+        : NULL;
+}
+
+static int write_to_target(const char *target, const char *text,
+                           size_t length, const char **what)
+{
+    const char *const sockname = get_socket_name(target);
+
+    return sockname != NULL
+        ? write_to_socket(sockname, text, length, what)
+        : write_to_file(target, text, length, what);
+}
+
+int stats_export_write(const char *target, const char *text, size_t length)
+{
+    const char *what;
+
+    if(write_to_target(target, text, length, &what) == 0)
+        return 0;
+
+    msg_error(errno, LOG_ERR, "Failed %s \"%s\"", what, target);
+
+    return -1;
+}
+
+/*!
+ * Exporter thread and its double buffer.
+ *
+ * The main loop copies the statistics into \c shared with the mutex held, but
+ * only if it can get the mutex without waiting. The exporter copies \c shared
+ * into its own buffer and releases the mutex before it starts rendering and
+ * writing, so the main loop is never held up by slow I/O.
+ */
+static struct
+{
+    bool is_running;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    const char *target;
+    enum StatsExportFormat format;
+    uint64_t interval_usec;
+    uint64_t next_due_usec;
+
+    bool is_snapshot_pending;
+    bool is_stop_requested;
+    uint64_t shared_timestamp_usec;
+    struct program_statistics shared;
+}
+exporter =
+{
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void *exporter_main(void *user_data __attribute__((unused)))
+{
+    static struct program_statistics snapshot;
+    static char text[64 * 1024];
+    bool previous_write_failed = false;
+
+    pthread_mutex_lock(&exporter.lock);
+
+    while(true)
+    {
+        while(!exporter.is_snapshot_pending && !exporter.is_stop_requested)
+            pthread_cond_wait(&exporter.cond, &exporter.lock);
+
+        /* pending snapshot is still written when asked to stop */
+        if(!exporter.is_snapshot_pending)
+            break;
+
+        snapshot = exporter.shared;
+        const uint64_t timestamp_usec = exporter.shared_timestamp_usec;
+        exporter.is_snapshot_pending = false;
+
+        pthread_mutex_unlock(&exporter.lock);
+
+        const size_t length =
+            stats_export_render(text, sizeof(text), &snapshot,
+                                exporter.format, timestamp_usec);
+
+        if(length >= sizeof(text))
+            MSG_BUG("Statistics export buffer too small (need %zu bytes)",
+                    length + 1);
+        else
+        {
+            const char *what;
+
+            if(write_to_target(exporter.target, text, length, &what) == 0)
+            {
+                if(previous_write_failed)
+                    msg_info("Statistics export to \"%s\" resumed",
+                             exporter.target);
+
+                previous_write_failed = false;
+            }
+            else if(!previous_write_failed)
+            {
+                /* a collector which is not running must not flood the log */
+                msg_error(errno, LOG_ERR, "Failed %s \"%s\"",
+                          what, exporter.target);
+                previous_write_failed = true;
+            }
+        }
+
+        pthread_mutex_lock(&exporter.lock);
+    }
+
+    pthread_mutex_unlock(&exporter.lock);
+
+    return NULL;
+}
+
+int stats_export_start(const char *target, enum StatsExportFormat format,
+                       unsigned int interval_ms)
+{
+    if(exporter.is_running)
+    {
+        MSG_BUG("Statistics exporter already running");
+        return -1;
+    }
+
+    exporter.target = target;
+    exporter.format = format;
+    exporter.interval_usec = (uint64_t)interval_ms * 1000U;
+    exporter.next_due_usec = 0;
+    exporter.is_snapshot_pending = false;
+    exporter.is_stop_requested = false;
+
+    const int err = pthread_create(&exporter.thread, NULL, exporter_main, NULL);
+
+    if(err != 0)
+    {
+        msg_error(err, LOG_ERR, "Failed starting statistics exporter");
+        return -1;
+    }
+
+    exporter.is_running = true;
+
+    return 0;
+}
+
+void stats_export_tick(const struct program_statistics *stats, bool force)
+{
+    if(!exporter.is_running)
+        return;
+
+    if(!force && exporter.interval_usec == 0)
+        return;
+
+    struct timespec now;
+
+    if(os_clock_gettime(CLOCK_MONOTONIC, &now) < 0)
+        return;
+
+    const uint64_t now_usec =
+        (uint64_t)now.tv_sec * 1000000U + now.tv_nsec / 1000U;
+
+    if(!force && now_usec < exporter.next_due_usec)
+        return;
+
+    if(pthread_mutex_trylock(&exporter.lock) != 0)
+        return;
+
+    exporter.shared = *stats;
+    exporter.shared_timestamp_usec = now_usec;
+    exporter.is_snapshot_pending = true;
+    exporter.next_due_usec = now_usec + exporter.interval_usec;
+
+    pthread_cond_signal(&exporter.cond);
+    pthread_mutex_unlock(&exporter.lock);
+}
+
+void stats_export_stop(void)
+{
+    if(!exporter.is_running)
+        return;
+
+    pthread_mutex_lock(&exporter.lock);
+    exporter.is_stop_requested = true;
+    pthread_cond_signal(&exporter.cond);
+    pthread_mutex_unlock(&exporter.lock);
+
+    pthread_join(exporter.thread, NULL);
+    exporter.is_running = false;
+}
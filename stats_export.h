@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef STATS_EXPORT_H
+#define STATS_EXPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "dcpspi_process.h"
+
+/*!
+ * Prefix of an export target that names a Unix stream socket.
+ */
+#define STATS_EXPORT_SOCKET_PREFIX "unix:"
+
+enum StatsExportFormat
+{
+    STATS_EXPORT_FORMAT_JSON,
+    STATS_EXPORT_FORMAT_PROMETHEUS,
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool stats_export_format_from_string(const char *name,
+                                     enum StatsExportFormat *format);
+
+/*!
+ * Render statistics snapshot as text.
+ *
+ * \param buffer, size
+ *     Where to write the text to. Output is always zero-terminated, unless
+ *     \p size is 0.
+ *
+ * \param stats
+ *     The snapshot.
+ *
+ * \param format
+ *     Which format to render.
+ *
+ * \param timestamp_usec
+ *     \c CLOCK_MONOTONIC time the snapshot was taken at.
+ *
+ * \returns
+ *     Length of the complete text, not including the zero-terminator. The
+ *     output has been truncated if this is not less than \p size.
+ */
+size_t stats_export_render(char *buffer, size_t size,
+                           const struct program_statistics *stats,
+                           enum StatsExportFormat format,
+                           uint64_t timestamp_usec);
+
+/*!
+ * Write rendered text to file or socket.
+ *
+ * Files are written to a temporary file first, which is then renamed to the
+ * target name so that readers never see a partial snapshot. Targets starting
+ * with #STATS_EXPORT_SOCKET_PREFIX are Unix stream sockets; a connection is
+ * made, the text is sent, and the connection is closed again.
+ *
+ * \returns
+ *     0 on success, -1 on error.
+ */
+int stats_export_write(const char *target, const char *text, size_t length);
+
+/*!
+ * Start exporter thread.
+ *
+ * \param target
+ *     File name or socket, see #stats_export_write().
+ *
+ * \param format
+ *     Output format.
+ *
+ * \param interval_ms
+ *     Minimum time between periodic snapshots, 0 for export on request only.
+ *
+ * \returns
+ *     0 on success, -1 on error.
+ */
+int stats_export_start(const char *target, enum StatsExportFormat format,
+                       unsigned int interval_ms);
+
+/*!
+ * Hand over a snapshot to the exporter thread if one is due.
+ *
+ * To be called from the main loop between transactions. This function
+ * never blocks: if the exporter is still busy with the previous snapshot,
+ * the current one is skipped.
+ *
+ * \param stats
+ *     Statistics to be copied, usually from #dcpspi_statistics_get().
+ *
+ * \param force
+ *     Take a snapshot regardless of the interval.
+ */
+void stats_export_tick(const struct program_statistics *stats, bool force);
+
+/*!
+ * Stop exporter thread.
+ */
+void stats_export_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !STATS_EXPORT_H */
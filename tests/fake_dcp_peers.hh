@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef FAKE_DCP_PEERS_HH
+#define FAKE_DCP_PEERS_HH
+
+#include <algorithm>
+#include <vector>
+#include <cerrno>
+#include <cstdint>
+#include <sys/types.h>
+
+#include "dcpdefs.h"
+#include "spi.h"
+
+/*!
+ * \addtogroup fake_dcp_peers Fake DCPD and SPI slave building blocks
+ *
+ * Byte level behavior of the peers of #dcpspi_process(), shared by the
+ * latency tests and the CPU benchmark. These do not expect anything, they
+ * only move bytes the way DCPD and a well-behaved SPI slave would; what to
+ * send when is left to the user.
+ */
+/*!@{*/
+
+namespace fake_dcp_peers
+{
+
+/*!
+ * Fill \p packet with a DCP write command for register \p reg.
+ *
+ * The payload bytes are taken from \p next_byte.
+ */
+template <typename F>
+void make_dcp_packet(std::vector<uint8_t> &packet, uint8_t reg,
+                     size_t payload_size, F &&next_byte)
+{
+    packet.clear();
+    packet.push_back(DCP_COMMAND_MULTI_WRITE_REGISTER);
+    packet.push_back(reg);
+    packet.push_back((payload_size >> 0) & UINT8_MAX);
+    packet.push_back((payload_size >> 8) & UINT8_MAX);
+
+    for(size_t i = 0; i < payload_size; ++i)
+        packet.push_back(next_byte(i));
+}
+
+/*!
+ * Both directions of the named pipes as seen from DCPD.
+ *
+ * Packets sent by DCPD are wrapped into the DCPSYNC header, packets written
+ * by #dcpspi_process() are taken apart again as soon as they are complete.
+ */
+class DCPDPipe
+{
+  private:
+    std::vector<uint8_t> input_;
+    size_t input_pos_;
+    std::vector<uint8_t> output_;
+
+  public:
+    DCPDPipe(const DCPDPipe &) = delete;
+    DCPDPipe &operator=(const DCPDPipe &) = delete;
+
+    explicit DCPDPipe(): input_pos_(0) {}
+
+    void send(uint8_t command, uint8_t ttl, uint16_t serial,
+              const std::vector<uint8_t> &packet)
+    {
+        input_.push_back(command);
+        input_.push_back(ttl);
+        input_.push_back((serial >> 8) & UINT8_MAX);
+        input_.push_back((serial >> 0) & UINT8_MAX);
+        input_.push_back((packet.size() >> 8) & UINT8_MAX);
+        input_.push_back((packet.size() >> 0) & UINT8_MAX);
+        input_.insert(input_.end(), packet.begin(), packet.end());
+    }
+
+    bool has_input() const { return input_pos_ < input_.size(); }
+
+    /*!
+     * Like \c read(2) on a non-blocking pipe.
+     */
+    ssize_t read(void *dest, size_t count)
+    {
+        const size_t avail = input_.size() - input_pos_;
+
+        if(avail == 0)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        count = std::min(count, avail);
+        std::copy_n(input_.begin() + input_pos_, count,
+                    static_cast<uint8_t *>(dest));
+        input_pos_ += count;
+
+        if(input_pos_ == input_.size())
+        {
+            input_.clear();
+            input_pos_ = 0;
+        }
+
+        return count;
+    }
+
+    void write(const void *src, size_t count)
+    {
+        const auto *const p = static_cast<const uint8_t *>(src);
+        output_.insert(output_.end(), p, p + count);
+    }
+
+    /*!
+     * Pass all complete packets written so far to \p fn.
+     *
+     * The function is called with command, TTL, serial, and payload of each
+     * packet. It may send packets through this pipe.
+     */
+    template <typename F>
+    void process_output(F &&fn)
+    {
+        size_t pos = 0;
+
+        while(output_.size() - pos >= DCPSYNC_HEADER_SIZE)
+        {
+            const uint8_t *const header = output_.data() + pos;
+            const size_t size = (header[4] << 8) | header[5];
+
+            if(output_.size() - pos < DCPSYNC_HEADER_SIZE + size)
+                break;
+
+            fn(header[0], header[1], uint16_t((header[2] << 8) | header[3]),
+               header + DCPSYNC_HEADER_SIZE, size);
+            pos += DCPSYNC_HEADER_SIZE + size;
+        }
+
+        output_.erase(output_.begin(), output_.begin() + pos);
+    }
+};
+
+/*!
+ * Bytes an SPI slave sends for a packet.
+ *
+ * The packet is escaped and preceded by a NOP. Once the stream has been
+ * read completely, the slave sends NOPs.
+ */
+class SlaveStream
+{
+  private:
+    std::vector<uint8_t> stream_;
+    size_t stream_pos_;
+    std::vector<uint8_t> tx_buffer_;
+
+  public:
+    SlaveStream(const SlaveStream &) = delete;
+    SlaveStream &operator=(const SlaveStream &) = delete;
+
+    explicit SlaveStream():
+        stream_pos_(0),
+        tx_buffer_(2 * (DCP_HEADER_SIZE + DCP_PAYLOAD_MAXSIZE))
+    {}
+
+    void start(const std::vector<uint8_t> &packet)
+    {
+        const size_t length =
+            spi_fill_buffer_from_raw_data(tx_buffer_.data(), tx_buffer_.size(),
+                                          packet.data(), packet.size());
+
+        stream_.clear();
+        stream_.push_back(UINT8_MAX);
+        stream_.insert(stream_.end(), tx_buffer_.begin(), tx_buffer_.begin() + length);
+        stream_pos_ = 0;
+    }
+
+    bool is_sending() const { return stream_pos_ < stream_.size(); }
+
+    /*!
+     * Fill \p rx with the next \p len bytes of the stream.
+     */
+    void transfer(uint8_t *rx, size_t len)
+    {
+        const size_t count = std::min(len, stream_.size() - stream_pos_);
+
+        std::copy_n(stream_.begin() + stream_pos_, count, rx);
+        std::fill_n(rx + count, len - count, UINT8_MAX);
+        stream_pos_ += count;
+    }
+};
+
+}
+
+/*!@}*/
+
+#endif /* !FAKE_DCP_PEERS_HH */
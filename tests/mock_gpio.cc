@@ -24,15 +24,19 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <stdlib.h>
+#include <poll.h>
+#include <algorithm>
 
 #include "mock_gpio.hh"
 
 enum class GpioFn
 {
     is_active,
+    read_edge_events,
+    debounce,
 
     first_valid_gpio_fn_id = is_active,
-    last_valid_gpio_fn_id = is_active,
+    last_valid_gpio_fn_id = debounce,
 };
 
 static std::ostream &operator<<(std::ostream &os, const GpioFn id)
@@ -49,6 +53,14 @@ static std::ostream &operator<<(std::ostream &os, const GpioFn id)
       case GpioFn::is_active:
         os << "gpio_is_active";
         break;
+
+      case GpioFn::read_edge_events:
+        os << "gpio_read_edge_events";
+        break;
+
+      case GpioFn::debounce:
+        os << "gpio_debounce";
+        break;
     }
 
     os << "()";
@@ -64,12 +76,17 @@ class MockGPIO::Expectation
         const GpioFn function_id_;
 
         bool ret_bool_;
+        std::vector<struct gpio_edge_event> ret_events_;
+        enum GpioDebounceResult ret_debounce_;
         const struct gpio_handle *arg_gpio_;
+        bool arg_is_timer_event_;
 
         explicit Data(GpioFn fn):
             function_id_(fn),
             ret_bool_(false),
-            arg_gpio_(nullptr)
+            ret_debounce_(GPIO_DEBOUNCE_SETTLED),
+            arg_gpio_(nullptr),
+            arg_is_timer_event_(false)
         {}
     };
 
@@ -90,6 +107,23 @@ class MockGPIO::Expectation
         data_.arg_gpio_ = gpio;
     }
 
+    explicit Expectation(GpioFn fn, std::vector<struct gpio_edge_event> &&events,
+                         const struct gpio_handle *gpio):
+        d(fn)
+    {
+        data_.ret_events_ = std::move(events);
+        data_.arg_gpio_ = gpio;
+    }
+
+    explicit Expectation(GpioFn fn, enum GpioDebounceResult ret,
+                         bool is_timer_event, const struct gpio_handle *gpio):
+        d(fn)
+    {
+        data_.ret_debounce_ = ret;
+        data_.arg_gpio_ = gpio;
+        data_.arg_is_timer_event_ = is_timer_event;
+    }
+
     Expectation(Expectation &&) = default;
 };
 
@@ -119,6 +153,8 @@ void MockGPIO::check() const
 struct gpio_handle
 {
     int fd;
+    bool has_edge_events;
+    int debounce_fd;
 };
 
 struct gpio_handle *MockGPIO::get_handle(int expected_fd)
@@ -127,10 +163,24 @@ struct gpio_handle *MockGPIO::get_handle(int expected_fd)
     cppcut_assert_not_null(gpio);
 
     gpio->fd = expected_fd;
+    gpio->has_edge_events = false;
+    gpio->debounce_fd = -1;
 
     return gpio;
 }
 
+void MockGPIO::set_has_edge_events(struct gpio_handle *gpio, bool has_edge_events)
+{
+    cppcut_assert_not_null(gpio);
+    gpio->has_edge_events = has_edge_events;
+}
+
+void MockGPIO::set_debounce_fd(struct gpio_handle *gpio, int debounce_fd)
+{
+    cppcut_assert_not_null(gpio);
+    gpio->debounce_fd = debounce_fd;
+}
+
 void MockGPIO::close_handle(struct gpio_handle *&gpio)
 {
     if(gpio != nullptr)
@@ -145,6 +195,19 @@ void MockGPIO::expect_gpio_is_active(bool ret, const struct gpio_handle *gpio)
     expectations_->add(Expectation(GpioFn::is_active, ret, gpio));
 }
 
+void MockGPIO::expect_gpio_read_edge_events(std::vector<struct gpio_edge_event> &&events,
+                                            const struct gpio_handle *gpio)
+{
+    expectations_->add(Expectation(GpioFn::read_edge_events, std::move(events), gpio));
+}
+
+void MockGPIO::expect_gpio_debounce(enum GpioDebounceResult ret,
+                                    bool is_timer_event,
+                                    const struct gpio_handle *gpio)
+{
+    expectations_->add(Expectation(GpioFn::debounce, ret, is_timer_event, gpio));
+}
+
 
 MockGPIO *mock_gpio_singleton = nullptr;
 
@@ -157,3 +220,50 @@ bool gpio_is_active(const struct gpio_handle *gpio)
 
     return expect.d.ret_bool_;
 }
+
+short gpio_get_poll_events(const struct gpio_handle *gpio)
+{
+    cppcut_assert_not_null(gpio);
+    return gpio->has_edge_events ? POLLIN : (POLLPRI | POLLERR);
+}
+
+bool gpio_has_edge_events(const struct gpio_handle *gpio)
+{
+    cppcut_assert_not_null(gpio);
+    return gpio->has_edge_events;
+}
+
+ssize_t gpio_read_edge_events(struct gpio_handle *gpio,
+                              struct gpio_edge_event *events, size_t max_events)
+{
+    const auto &expect(mock_gpio_singleton->expectations_->get_next_expectation(__func__));
+
+    cppcut_assert_not_null(gpio);
+    cppcut_assert_equal(expect.d.function_id_, GpioFn::read_edge_events);
+    cppcut_assert_equal(expect.d.arg_gpio_, static_cast<const struct gpio_handle *>(gpio));
+    cppcut_assert_operator(expect.d.ret_events_.size(), <=, max_events);
+
+    std::copy(expect.d.ret_events_.begin(), expect.d.ret_events_.end(), events);
+
+    return expect.d.ret_events_.size();
+}
+
+int gpio_get_debounce_fd(const struct gpio_handle *gpio)
+{
+    cppcut_assert_not_null(gpio);
+    return gpio->debounce_fd;
+}
+
+enum GpioDebounceResult gpio_debounce(struct gpio_handle *gpio,
+                                      bool is_timer_event,
+                                      struct stats_wait *stats)
+{
+    const auto &expect(mock_gpio_singleton->expectations_->get_next_expectation(__func__));
+
+    cppcut_assert_not_null(gpio);
+    cppcut_assert_equal(expect.d.function_id_, GpioFn::debounce);
+    cppcut_assert_equal(expect.d.arg_gpio_, static_cast<const struct gpio_handle *>(gpio));
+    cppcut_assert_equal(expect.d.arg_is_timer_event_, is_timer_event);
+
+    return expect.d.ret_debounce_;
+}
@@ -25,6 +25,8 @@
 #include "gpio.h"
 #include "mock_expectation.hh"
 
+#include <vector>
+
 struct gpio_handle;
 
 class MockGPIO
@@ -44,9 +46,15 @@ class MockGPIO
     void check() const;
 
     static struct gpio_handle *get_handle(int expected_fd);
+    static void set_has_edge_events(struct gpio_handle *gpio, bool has_edge_events);
+    static void set_debounce_fd(struct gpio_handle *gpio, int debounce_fd);
     static void close_handle(struct gpio_handle *&gpio);
 
     void expect_gpio_is_active(bool ret, const struct gpio_handle *gpio);
+    void expect_gpio_read_edge_events(std::vector<struct gpio_edge_event> &&events,
+                                      const struct gpio_handle *gpio);
+    void expect_gpio_debounce(enum GpioDebounceResult ret, bool is_timer_event,
+                              const struct gpio_handle *gpio);
 };
 
 extern MockGPIO *mock_gpio_singleton;
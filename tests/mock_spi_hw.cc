@@ -76,6 +76,7 @@ class MockSPIHW::Expectation
     const std::string arg_devname_;
     const int arg_fd_;
     const size_t arg_number_of_fragments_;
+    const std::vector<Fragment> arg_fragments_;
     spi_hw_do_transfer_callback_t spi_hw_do_transfer_callback_;
 
     Expectation(const Expectation &) = delete;
@@ -114,6 +115,16 @@ class MockSPIHW::Expectation
         spi_hw_do_transfer_callback_(fn)
     {}
 
+    explicit Expectation(int fd, std::vector<Fragment> &&fragments,
+                         spi_hw_do_transfer_callback_t fn):
+        function_id_(SpiHwFn::do_transfer),
+        ret_code_(0),
+        arg_fd_(fd),
+        arg_number_of_fragments_(fragments.size()),
+        arg_fragments_(std::move(fragments)),
+        spi_hw_do_transfer_callback_(fn)
+    {}
+
     Expectation(Expectation &&) = default;
 };
 
@@ -159,6 +170,12 @@ void MockSPIHW::expect_spi_hw_do_transfer_callback(MockSPIHW::spi_hw_do_transfer
     expectations_->add(Expectation(fn));
 }
 
+void MockSPIHW::expect_spi_hw_do_transfer_fragments(int fd, std::vector<MockSPIHW::Fragment> &&fragments,
+                                                    MockSPIHW::spi_hw_do_transfer_callback_t fn)
+{
+    expectations_->add(Expectation(fd, std::move(fragments), fn));
+}
+
 
 MockSPIHW *mock_spi_hw_singleton = nullptr;
 
@@ -185,6 +202,26 @@ int spi_hw_do_transfer(int fd, const struct spi_ioc_transfer spi_transfer[], siz
 
     cppcut_assert_equal(expect.function_id_, SpiHwFn::do_transfer);
 
+    if(!expect.arg_fragments_.empty())
+    {
+        cppcut_assert_equal(expect.arg_fd_, fd);
+        cppcut_assert_equal(expect.arg_number_of_fragments_, number_of_fragments);
+
+        for(size_t i = 0; i < number_of_fragments; ++i)
+        {
+            const auto &f(expect.arg_fragments_[i]);
+
+            cppcut_assert_equal(f.len_, size_t(spi_transfer[i].len));
+            cppcut_assert_equal(f.delay_usecs_, spi_transfer[i].delay_usecs);
+            cppcut_assert_equal(f.cs_change_, spi_transfer[i].cs_change != 0);
+            cppcut_assert_equal(f.has_tx_, spi_transfer[i].tx_buf != 0);
+            cppcut_assert_equal(f.has_rx_, spi_transfer[i].rx_buf != 0);
+        }
+
+        if(expect.spi_hw_do_transfer_callback_ == nullptr)
+            return expect.ret_code_;
+    }
+
     if(expect.spi_hw_do_transfer_callback_ != nullptr)
         return expect.spi_hw_do_transfer_callback_(fd, spi_transfer, number_of_fragments);
 
@@ -22,6 +22,8 @@
 #ifndef MOCK_SPI_HW_HH
 #define MOCK_SPI_HW_HH
 
+#include <vector>
+
 #include "spi_hw.h"
 #include "mock_expectation.hh"
 
@@ -44,9 +46,23 @@ class MockSPIHW
     void expect_spi_hw_open_device(int ret, const char *devname);
     void expect_spi_hw_close_device(int fd);
 
+    /*!
+     * Expected layout of a single fragment in a multi-fragment transfer.
+     */
+    struct Fragment
+    {
+        size_t len_;
+        uint16_t delay_usecs_;
+        bool cs_change_;
+        bool has_tx_;
+        bool has_rx_;
+    };
+
     typedef int (*spi_hw_do_transfer_callback_t)(int fd, const struct spi_ioc_transfer spi_transfer[], size_t number_of_fragments);
     void expect_spi_hw_do_transfer(int ret, int fd, size_t number_of_fragments);
     void expect_spi_hw_do_transfer_callback(spi_hw_do_transfer_callback_t fn);
+    void expect_spi_hw_do_transfer_fragments(int fd, std::vector<Fragment> &&fragments,
+                                             spi_hw_do_transfer_callback_t fn);
 };
 
 extern MockSPIHW *mock_spi_hw_singleton;
@@ -180,6 +180,18 @@ class spi_rw_data_t
             set_fragments<read_from_slave_spi_transfer_size>(write_data.data(), read_data.data(), N);
     }
 
+    /*!
+     * One big read transfer with constant value written to slave.
+     */
+    template <size_t N>
+    void set_single(enum write_nops nops, const std::array<uint8_t, N> &read_data)
+    {
+        std::array<uint8_t, N> write_data;
+
+        fill_write_data(write_data, nops);
+        set(write_data.data(), read_data.data(), N, 0, 0);
+    }
+
     /*!
      * Full expected transfer specification.
      */
@@ -239,46 +251,72 @@ class spi_rw_data_t
 
 static spi_rw_data_t *spi_rw_data;
 
-template <int SPI_FD>
-static int mock_spi_tx_template(int fd,
-                                const struct spi_ioc_transfer spi_transfer[],
-                                size_t number_of_fragments)
+static void check_spi_tx_fragment(const struct spi_ioc_transfer &spi_transfer)
 {
-    cppcut_assert_equal(SPI_FD, fd);
-    cppcut_assert_equal(size_t(1), number_of_fragments);
     cppcut_assert_operator(spi_rw_data->fragment_, <, spi_rw_data->partial_.size());
 
     const spi_rw_data_partial_t &partial(spi_rw_data->partial_[spi_rw_data->fragment_++]);
 
     if(partial.read_data_.size() > 0)
-        cppcut_assert_not_equal(__u64(0), spi_transfer[0].rx_buf);
+        cppcut_assert_not_equal(__u64(0), spi_transfer.rx_buf);
     else
-        cppcut_assert_equal(__u64(0), spi_transfer[0].rx_buf);
+        cppcut_assert_equal(__u64(0), spi_transfer.rx_buf);
 
     if(partial.expected_write_data_.size() > 0)
-        cppcut_assert_not_equal(__u64(0), spi_transfer[0].tx_buf);
+        cppcut_assert_not_equal(__u64(0), spi_transfer.tx_buf);
     else
-        cppcut_assert_equal(__u64(0), spi_transfer[0].tx_buf);
+        cppcut_assert_equal(__u64(0), spi_transfer.tx_buf);
 
-    cppcut_assert_equal(partial.transfer_size_, size_t(spi_transfer[0].len));
+    cppcut_assert_equal(partial.transfer_size_, size_t(spi_transfer.len));
     cppcut_assert_equal(partial.transfer_size_, partial.expected_write_data_.size());
 
     if(partial.read_data_.size() > 0)
     {
         cppcut_assert_equal(partial.transfer_size_, partial.read_data_.size());
         std::copy_n(partial.read_data_.begin(), partial.read_data_.size(),
-                    reinterpret_cast<uint8_t *>(spi_transfer[0].rx_buf));
+                    reinterpret_cast<uint8_t *>(spi_transfer.rx_buf));
     }
 
     if(partial.expected_write_data_.size() > 0)
         cut_assert_equal_memory(partial.expected_write_data_.data(),
                                 partial.expected_write_data_.size(),
-                                reinterpret_cast<uint8_t *>(spi_transfer[0].tx_buf),
-                                spi_transfer[0].len);
+                                reinterpret_cast<uint8_t *>(spi_transfer.tx_buf),
+                                spi_transfer.len);
 
     errno = partial.errno_value_;
+}
+
+template <int SPI_FD>
+static int mock_spi_tx_template(int fd,
+                                const struct spi_ioc_transfer spi_transfer[],
+                                size_t number_of_fragments)
+{
+    cppcut_assert_equal(SPI_FD, fd);
+    cppcut_assert_equal(size_t(1), number_of_fragments);
+
+    check_spi_tx_fragment(spi_transfer[0]);
+
+    return spi_rw_data->partial_[spi_rw_data->fragment_ - 1].return_value_;
+}
+
+/*!
+ * Like #mock_spi_tx_template(), but for any number of fragments.
+ *
+ * Each fragment consumes the next partial transfer from #spi_rw_data. The
+ * return value is taken from the last fragment.
+ */
+template <int SPI_FD>
+static int mock_spi_multi_tx_template(int fd,
+                                      const struct spi_ioc_transfer spi_transfer[],
+                                      size_t number_of_fragments)
+{
+    cppcut_assert_equal(SPI_FD, fd);
+    cppcut_assert_operator(size_t(0), <, number_of_fragments);
+
+    for(size_t i = 0; i < number_of_fragments; ++i)
+        check_spi_tx_fragment(spi_transfer[i]);
 
-    return partial.return_value_;
+    return spi_rw_data->partial_[spi_rw_data->fragment_ - 1].return_value_;
 }
 
 #endif /* !SPI_HW_DATA_HH */
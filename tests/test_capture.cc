@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include <cppcutter.h>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+
+#include "capture.h"
+
+#include "mock_messages.hh"
+#include "mock_os.hh"
+
+/*!
+ * \addtogroup capture_tests Unit tests
+ * \ingroup capture
+ *
+ * Binary traffic capture unit tests.
+ */
+/*!@{*/
+
+namespace capture_tests
+{
+
+static MockMessages *mock_messages;
+static MockOs *mock_os;
+
+static const char capture_file_name[] = "test_capture.bin";
+
+void cut_setup()
+{
+    mock_messages = new MockMessages;
+    cppcut_assert_not_null(mock_messages);
+    mock_messages->init();
+    mock_messages_singleton = mock_messages;
+
+    mock_os = new MockOs;
+    cppcut_assert_not_null(mock_os);
+    mock_os->init();
+    mock_os_singleton = mock_os;
+}
+
+void cut_teardown()
+{
+    unlink(capture_file_name);
+
+    mock_messages->check();
+    mock_os->check();
+
+    mock_messages_singleton = nullptr;
+    mock_os_singleton = nullptr;
+
+    delete mock_messages;
+    delete mock_os;
+
+    mock_messages = nullptr;
+    mock_os = nullptr;
+}
+
+static std::vector<uint8_t> read_capture_file()
+{
+    std::ifstream f(capture_file_name, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(f),
+                                std::istreambuf_iterator<char>());
+}
+
+static void record(enum CaptureRecordType type, int result,
+                   const std::vector<uint8_t> &data, time_t sec, long nsec)
+{
+    const struct timespec t = { .tv_sec = sec, .tv_nsec = nsec, };
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    capture_record(type, result, data.data(), data.size());
+}
+
+/*!\test
+ * Nothing is recorded, and the clock is not read, while capturing is
+ * disabled.
+ */
+void test_disabled_capture_records_nothing()
+{
+    static const uint8_t data[] = { 0x01, 0x02, 0x03 };
+
+    cut_assert_false(capture_is_enabled());
+    capture_record(CAPTURE_RECORD_SPI_TX, 3, data, sizeof(data));
+    capture_close();
+}
+
+/*!\test
+ * Records are written to the file with their metadata, padded to the record
+ * alignment, and the file is truncated to the size used when closing it.
+ */
+void test_records_are_written_to_file()
+{
+    cppcut_assert_equal(0, capture_open(capture_file_name, 4096));
+    cut_assert_true(capture_is_enabled());
+
+    const std::vector<uint8_t> tx = { 'c', 0x0a, 0x80, 0x01, 0x05, 0x00 };
+    const std::vector<uint8_t> rx = { 0xff, 0xff, 0x00 };
+
+    capture_set_serial(0x8001);
+    record(CAPTURE_RECORD_SPI_TX, 2, tx, 5, 100);
+    record(CAPTURE_RECORD_SPI_RX, 2, rx, 5, 2500);
+
+    mock_messages->expect_msg_info_formatted("Captured 64 bytes to \"test_capture.bin\"");
+    capture_close();
+    cut_assert_false(capture_is_enabled());
+
+    const auto file(read_capture_file());
+    cppcut_assert_equal(sizeof(struct capture_file_header) + 64, file.size());
+
+    const auto *header = reinterpret_cast<const struct capture_file_header *>(file.data());
+    cppcut_assert_equal(CAPTURE_FILE_MAGIC, header->magic);
+    cppcut_assert_equal(uint16_t(CAPTURE_FILE_VERSION), header->version);
+    cppcut_assert_equal(uint16_t(sizeof(struct capture_file_header)), header->header_size);
+    cppcut_assert_equal(uint16_t(sizeof(struct capture_record)), header->record_header_size);
+    cppcut_assert_equal(uint32_t(0), header->dropped);
+    cppcut_assert_equal(uint64_t(64), header->used);
+
+    const uint8_t *p = file.data() + sizeof(*header);
+    const auto *rec = reinterpret_cast<const struct capture_record *>(p);
+
+    cppcut_assert_equal(uint64_t(5000000100), rec->timestamp_ns);
+    cppcut_assert_equal(int32_t(2), rec->result);
+    cppcut_assert_equal(uint16_t(0x8001), rec->serial);
+    cppcut_assert_equal(uint16_t(tx.size()), rec->length);
+    cppcut_assert_equal(uint8_t(CAPTURE_RECORD_SPI_TX), rec->type);
+    cut_assert_equal_memory(tx.data(), tx.size(), rec + 1, rec->length);
+
+    p += 32;
+    rec = reinterpret_cast<const struct capture_record *>(p);
+
+    cppcut_assert_equal(uint64_t(5000002500), rec->timestamp_ns);
+    cppcut_assert_equal(uint16_t(0x8001), rec->serial);
+    cppcut_assert_equal(uint16_t(rx.size()), rec->length);
+    cppcut_assert_equal(uint8_t(CAPTURE_RECORD_SPI_RX), rec->type);
+    cut_assert_equal_memory(rx.data(), rx.size(), rec + 1, rec->length);
+}
+
+/*!\test
+ * Records which do not fit anymore are counted, and a warning is emitted
+ * only once.
+ */
+void test_full_capture_file_drops_records()
+{
+    const size_t size = sizeof(struct capture_file_header) + 2 * 32;
+    cppcut_assert_equal(0, capture_open(capture_file_name, size));
+
+    const std::vector<uint8_t> data(8, 0x55);
+
+    record(CAPTURE_RECORD_SPI_TX, 8, data, 1, 0);
+    record(CAPTURE_RECORD_SPI_TX, 8, data, 1, 1000);
+
+    mock_messages->expect_msg_error_formatted(0, LOG_WARNING,
+                                              "Capture file \"test_capture.bin\" full");
+    capture_record(CAPTURE_RECORD_SPI_TX, 8, data.data(), data.size());
+    capture_record(CAPTURE_RECORD_SPI_RX, 8, data.data(), data.size());
+
+    /* a smaller record would still fit, but nothing is left at all */
+    capture_record(CAPTURE_RECORD_COLLISION, 0, data.data(), 0);
+
+    mock_messages->expect_msg_info_formatted(
+        "Captured 64 bytes to \"test_capture.bin\", 3 records did not fit");
+    capture_close();
+
+    const auto file(read_capture_file());
+    cppcut_assert_equal(size, file.size());
+
+    const auto *header = reinterpret_cast<const struct capture_file_header *>(file.data());
+    cppcut_assert_equal(uint32_t(3), header->dropped);
+    cppcut_assert_equal(uint64_t(64), header->used);
+}
+
+/*!\test
+ * Capture files too small for a single record are rejected.
+ */
+void test_tiny_capture_file_is_rejected()
+{
+    mock_messages->expect_msg_error_formatted(EINVAL, LOG_ERR,
+                                              "Capture file size 47 too small");
+    cppcut_assert_equal(-1, capture_open(capture_file_name, 47));
+    cut_assert_false(capture_is_enabled());
+}
+
+}
+
+/*!@}*/
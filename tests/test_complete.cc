@@ -21,6 +21,7 @@
 
 #include <cppcutter.h>
 #include <array>
+#include <tuple>
 
 #include "dcpspi_process.h"
 #include "dcpdefs.h"
@@ -32,9 +33,11 @@
 #include "mock_gpio.hh"
 #include "mock_os.hh"
 #include "spi_hw_data.hh"
+#include "os_writev.h"
 
 ssize_t (*os_read)(int fd, void *dest, size_t count);
 ssize_t (*os_write)(int fd, const void *buf, size_t count);
+ssize_t (*os_writev)(int fd, const struct iovec *iov, int iovcnt);
 int (*os_poll)(struct pollfd *fds, nfds_t nfds, int timeout);
 
 /* Dummy implementation */
@@ -51,16 +54,31 @@ namespace complete_tests
 
 static constexpr unsigned long delay_between_slave_probes_ms = 5;
 
+/* POLLIN if the GPIO delivers edge events, POLLPRI | POLLERR for sysfs */
+static short expected_gpio_poll_events;
+
+/* the debounce timer is polled as third fd while debouncing is enabled */
+static int expected_debounce_fd;
+
+/* DCPD input is read in one go if read-ahead is enabled */
+static bool expect_read_ahead;
+
 class PollResult
 {
   private:
     int retval_;
     int errno_;
+    int expected_timeout_;
     bool pending_;
-    std::array<short, 2> revents;
+    std::array<short, 6> revents;
+    int expected_dcpd_output_fd_;
+    int expected_stop_fd_;
 
     static constexpr const size_t GPIO_INDEX = 0;
     static constexpr const size_t DCPD_INDEX = 1;
+    static constexpr const size_t DEBOUNCE_INDEX = 2;
+    static constexpr const size_t DCPD_OUTPUT_INDEX = 4;
+    static constexpr const size_t STOP_INDEX = 5;
 
   public:
     PollResult(const PollResult &) = delete;
@@ -73,8 +91,11 @@ class PollResult
     {
         retval_ = -1;
         errno_ = EFAULT;
+        expected_timeout_ = 0;
         pending_ = false;
         revents.fill(0);
+        expected_dcpd_output_fd_ = -1;
+        expected_stop_fd_ = -1;
     }
 
     void check()
@@ -103,19 +124,68 @@ class PollResult
         return *this;
     }
 
+    PollResult &set_debounce_events(short events)
+    {
+        revents[DEBOUNCE_INDEX] = events;
+        pending_ = true;
+        return *this;
+    }
+
+    /* the output fd is polled as fifth fd while DCPD is not taking data */
+    PollResult &set_dcpd_output_events(int fd, short events)
+    {
+        expected_dcpd_output_fd_ = fd;
+        revents[DCPD_OUTPUT_INDEX] = events;
+        pending_ = true;
+        return *this;
+    }
+
+    /* the stop fd is polled as sixth fd if set */
+    PollResult &set_stop_events(int fd, short events)
+    {
+        expected_stop_fd_ = fd;
+        revents[STOP_INDEX] = events;
+        pending_ = true;
+        return *this;
+    }
+
     PollResult &set_errno(int error_number)
     {
         errno_ = error_number;
         return *this;
     }
 
+    /* for waiting without DCPD, quick checks are done with 0 */
+    PollResult &expect_timeout(int timeout)
+    {
+        expected_timeout_ = timeout;
+        return *this;
+    }
+
     int finish(struct pollfd *fds, nfds_t nfds, int timeout,
                int expected_gpio_fd, int expected_dcpd_fd)
     {
         cppcut_assert_not_null(fds);
-        cppcut_assert_equal(nfds_t(revents.size()), nfds);
+
+        if(expected_stop_fd_ >= 0)
+        {
+            cppcut_assert_equal(nfds_t(STOP_INDEX + 1), nfds);
+            cppcut_assert_equal(expected_stop_fd_, fds[STOP_INDEX].fd);
+            cppcut_assert_equal(short(POLLIN), fds[STOP_INDEX].events);
+            fds[STOP_INDEX].revents = revents[STOP_INDEX];
+        }
+        else if(expected_dcpd_output_fd_ >= 0)
+        {
+            cppcut_assert_equal(nfds_t(DCPD_OUTPUT_INDEX + 1), nfds);
+            cppcut_assert_equal(expected_dcpd_output_fd_, fds[DCPD_OUTPUT_INDEX].fd);
+            cppcut_assert_equal(short(POLLOUT), fds[DCPD_OUTPUT_INDEX].events);
+            fds[DCPD_OUTPUT_INDEX].revents = revents[DCPD_OUTPUT_INDEX];
+        }
+        else
+            cppcut_assert_equal(nfds_t(expected_debounce_fd >= 0 ? 3 : 2), nfds);
+
         cppcut_assert_equal(expected_gpio_fd,         fds[GPIO_INDEX].fd);
-        cppcut_assert_equal(short(POLLPRI | POLLERR), fds[GPIO_INDEX].events);
+        cppcut_assert_equal(expected_gpio_poll_events, fds[GPIO_INDEX].events);
         cppcut_assert_equal(short(POLLIN),            fds[DCPD_INDEX].events);
 
         if(fds[DCPD_INDEX].fd != -1)
@@ -125,10 +195,19 @@ class PollResult
         }
         else
         {
-            cppcut_assert_equal(0, timeout);
+            cppcut_assert_equal(expected_timeout_, timeout);
             cppcut_assert_equal(short(0), revents[DCPD_INDEX]);
         }
 
+        if(expected_debounce_fd >= 0)
+        {
+            cppcut_assert_equal(expected_debounce_fd, fds[DEBOUNCE_INDEX].fd);
+            cppcut_assert_equal(short(POLLIN),        fds[DEBOUNCE_INDEX].events);
+            fds[DEBOUNCE_INDEX].revents = revents[DEBOUNCE_INDEX];
+        }
+        else
+            cppcut_assert_equal(short(0), revents[DEBOUNCE_INDEX]);
+
         if(retval_ == 0)
             cppcut_assert_operator(0, <=, timeout);
 
@@ -239,6 +318,7 @@ static const int expected_fifo_in_fd = 40;
 static const int expected_fifo_out_fd = 50;
 static const int expected_gpio_fd = 60;
 static const int expected_spi_fd = 70;
+static const int debounce_timer_fd = 80;
 
 static const struct timespec dummy_time = { .tv_sec = 0, .tv_nsec = 0, };
 
@@ -253,12 +333,18 @@ static ProcessData *process_data;
 
 static std::vector<uint8_t> os_write_buffer;
 static std::vector<uint8_t> os_read_buffer;
+static unsigned int os_read_calls;
+static unsigned int os_writev_calls;
+static size_t os_writev_max_bytes;
+static unsigned int os_writev_eagain_count;
 
 static constexpr char process_transaction_message[] =
     "Process transaction state %d, serial 0x%04x, lock state %d, pending size %u, flush pos %zu";
 
 static ssize_t read_mock(int fd, void *dest, size_t count)
 {
+    ++os_read_calls;
+
     cppcut_assert_equal(expected_fifo_in_fd, fd);
     cppcut_assert_not_null(dest);
     cppcut_assert_operator(size_t(0), <, count);
@@ -288,6 +374,34 @@ static ssize_t write_mock(int fd, const void *buf, size_t count)
     return count;
 }
 
+static ssize_t writev_mock(int fd, const struct iovec *iov, int iovcnt)
+{
+    ++os_writev_calls;
+
+    cppcut_assert_equal(expected_fifo_out_fd, fd);
+    cppcut_assert_not_null(iov);
+    cppcut_assert_operator(0, <, iovcnt);
+
+    if(os_writev_eagain_count > 0)
+    {
+        --os_writev_eagain_count;
+        errno = EAGAIN;
+        return -1;
+    }
+
+    size_t count = 0;
+
+    for(int i = 0; i < iovcnt && count < os_writev_max_bytes; ++i)
+    {
+        cppcut_assert_operator(size_t(0), <, iov[i].iov_len);
+
+        const size_t n = std::min(iov[i].iov_len, os_writev_max_bytes - count);
+        count += write_mock(fd, iov[i].iov_base, n);
+    }
+
+    return count;
+}
+
 static int poll_mock(struct pollfd *fds, nfds_t nfds, int timeout)
 {
     return poll_results.finish_next(fds, nfds, timeout,
@@ -300,6 +414,7 @@ void cut_setup()
 {
     os_read = read_mock;
     os_write = write_mock;
+    os_writev = writev_mock;
     os_poll = poll_mock;
 
     mock_messages = new MockMessages;
@@ -336,6 +451,14 @@ void cut_setup()
                                    spi_backing_buffer);
     cppcut_assert_not_null(process_data);
 
+    expected_gpio_poll_events = POLLPRI | POLLERR;
+    expected_debounce_fd = -1;
+    expect_read_ahead = false;
+    os_read_calls = 0;
+    os_writev_calls = 0;
+    os_writev_max_bytes = SIZE_MAX;
+    os_writev_eagain_count = 0;
+
     spi_rw_data = new spi_rw_data_t;
     cppcut_assert_not_null(spi_rw_data);
 
@@ -415,7 +538,7 @@ static void wrap_data_into_protocol(std::vector<uint8_t> &buffer,
 
 static void expect_wait_for_spi_slave(const struct timespec &t)
 {
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     spi_rw_data->set<wait_for_slave_spi_transfer_size>(spi_rw_data_t::EXPECT_WRITE_NOPS,
                                                        spi_rw_data_t::EXPECT_READ_ZEROS,
                                                        true);
@@ -453,13 +576,21 @@ static void expect_no_more_actions()
 static void run_complete_single_slave_transaction(uint16_t expected_slave_serial,
                                                   bool expecting_extra_process_message,
                                                   bool check_for_true_idle,
-                                                  bool slow_request_release = false)
+                                                  bool slow_request_release = false,
+                                                  bool use_edge_events = false)
 {
+    const short gpio_event = use_edge_events ? POLLIN : POLLPRI;
+
     /* slave activates the request GPIO and sends write command for UPnP
      * friendly name */
-    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
-    mock_gpio->expect_gpio_is_active(true, process_data->gpio);
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
+    poll_results.expect(std::move(PollResult().set_gpio_events(gpio_event).set_return_value(1)));
+
+    if(use_edge_events)
+        mock_gpio->expect_gpio_read_edge_events({{true, 1000}, {true, 1500}},
+                                                process_data->gpio);
+    else
+        mock_gpio->expect_gpio_is_active(true, process_data->gpio);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
     static const std::array<uint8_t, 8> write_command
     {
         UINT8_MAX, DCP_COMMAND_MULTI_WRITE_REGISTER, 0x58, 0x03, 0x00,
@@ -474,7 +605,7 @@ static void run_complete_single_slave_transaction(uint16_t expected_slave_serial
     mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
         "Slave transaction: command header from SPI: 0x02 0x58 0x03 0x00");
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
@@ -493,8 +624,13 @@ static void run_complete_single_slave_transaction(uint16_t expected_slave_serial
         poll_results.expect(std::move(PollResult().set_return_value(0)));
     else
     {
-        poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
-        mock_gpio->expect_gpio_is_active(false, process_data->gpio);
+        poll_results.expect(std::move(PollResult().set_gpio_events(gpio_event).set_return_value(1)));
+
+        if(use_edge_events)
+            mock_gpio->expect_gpio_read_edge_events({{false, 2000}},
+                                                    process_data->gpio);
+        else
+            mock_gpio->expect_gpio_is_active(false, process_data->gpio);
     }
 
     char expected_process_message[256];
@@ -549,914 +685,2787 @@ void test_single_slave_transaction()
 }
 
 /*!\test
- * Regular master write followed by a regular slave write, no collisions.
+ * Packets forwarded to DCPD are written completely even if the pipe accepts
+ * only a few bytes per writev(2).
  */
-void test_master_write_followed_by_slave_write()
+void test_single_slave_transaction_with_partial_writes()
 {
-    /* DCPD tells slave that the next external stream URL is empty */
-    static const std::array<uint8_t, 4> next_appstream_empty
+    os_writev_max_bytes = 5;
+
+    run_complete_single_slave_transaction(DCPSYNC_SLAVE_SERIAL_MIN, true, true);
+
+    /* 13 bytes in chunks of 5 bytes */
+    cppcut_assert_equal(3U, os_writev_calls);
+}
+
+/*!\test
+ * A full pipe to DCPD does not block, the packet is written once the pipe
+ * has become writable again.
+ */
+void test_single_slave_transaction_with_full_pipe_to_dcpd()
+{
+    static const std::array<uint8_t, 8> write_command
     {
-        DCP_COMMAND_MULTI_WRITE_REGISTER, 0xef, 0x00, 0x00,
+        UINT8_MAX, DCP_COMMAND_MULTI_WRITE_REGISTER, 0x58, 0x03, 0x00,
+        0x61, 0x62, 0x63
     };
-    std::vector<uint8_t> wrapped_appstream;
-    wrap_data_into_protocol(wrapped_appstream, 'c', UINT8_MAX, 0xeba9,
-                            next_appstream_empty.begin(), next_appstream_empty.size());
-    std::copy_n(wrapped_appstream.begin(), wrapped_appstream.size(),
-                std::back_inserter(os_read_buffer));
 
-    poll_results.expect(std::move(PollResult().set_return_value(0)));
-    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
-        "Master transaction: command header from DCPD: 0x02 0xef 0x00 0x00");
-    expect_wait_for_spi_slave(dummy_time);
-    spi_rw_data->set(next_appstream_empty);
+    /* slave activates the request GPIO and sends write command */
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(true, process_data->gpio);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, write_command);
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
+    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Slave transaction: command header from SPI: 0x02 0x58 0x03 0x00");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
-    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
-    std::vector<uint8_t> master_command_ack;
-    wrap_data_into_protocol(master_command_ack, 'a', 0, 0xeba9);
-    cut_assert_equal_memory(master_command_ack.data(), master_command_ack.size(),
-                            os_write_buffer.data(), os_write_buffer.size());
-    os_write_buffer.clear();
+    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
     mock_messages->check();
     mock_gpio->check();
+    mock_os->check();
     mock_spi_hw->check();
     poll_results.check();
 
-    /* short writes succeed within a single call of #dcpspi_process(), so we
-     * can process a slave request now */
-    run_complete_single_slave_transaction(DCPSYNC_SLAVE_SERIAL_MIN, true, true);
-}
+    /* slave releases the request line, but the pipe is full */
+    os_writev_eagain_count = 2;
 
-/*!\test
- * Regular slave write followed by a regular master write, no collisions.
- */
-void test_slave_write_followed_by_master_write()
-{
-    /* slave sends something */
-    run_complete_single_slave_transaction(DCPSYNC_SLAVE_SERIAL_MIN, true, false);
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(false, process_data->gpio);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 8, serial 0x0001, lock state 2, pending size 0, flush pos 0");
 
-    /* done, now DCPD tells slave that the next external stream URL is empty */
-    static const std::array<uint8_t, 4> next_appstream_empty
-    {
-        DCP_COMMAND_MULTI_WRITE_REGISTER, 0xef, 0x00, 0x00,
-    };
-    std::vector<uint8_t> wrapped_appstream;
-    wrap_data_into_protocol(wrapped_appstream, 'c', UINT8_MAX, 0xeba9,
-                            next_appstream_empty.begin(), next_appstream_empty.size());
-    std::copy_n(wrapped_appstream.begin(), wrapped_appstream.size(),
-                std::back_inserter(os_read_buffer));
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
 
-    poll_results.expect(std::move(PollResult().set_return_value(0)));
-    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
+    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
+    cppcut_assert_equal(2U, os_writev_calls);
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+    poll_results.check();
+
+    /* wait for the pipe to become writable, then send the packet */
+    poll_results.expect(std::move(PollResult()
+                                  .set_dcpd_output_events(expected_fifo_out_fd, POLLOUT)
+                                  .expect_timeout(-1)
+                                  .set_return_value(1)));
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
-        "Master transaction: command header from DCPD: 0x02 0xef 0x00 0x00");
-    expect_wait_for_spi_slave(dummy_time);
-    spi_rw_data->set(next_appstream_empty);
-    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+        "Process transaction state 8, serial 0x0001, lock state 2, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "End of transaction 0x0001 in state 8, return to idle state");
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
     cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
-    std::vector<uint8_t> master_command_ack;
-    wrap_data_into_protocol(master_command_ack, 'a', 0, 0xeba9);
-    cut_assert_equal_memory(master_command_ack.data(), master_command_ack.size(),
+    cppcut_assert_equal(3U, os_writev_calls);
+
+    std::vector<uint8_t> wrapped_write_command;
+    wrap_data_into_protocol(wrapped_write_command, 'c', 0, DCPSYNC_SLAVE_SERIAL_MIN,
+                            write_command.begin() + 1, write_command.size() - 1);
+    cut_assert_equal_memory(wrapped_write_command.data(), wrapped_write_command.size(),
                             os_write_buffer.data(), os_write_buffer.size());
     os_write_buffer.clear();
     mock_messages->check();
     mock_gpio->check();
-    mock_spi_hw->check();
     poll_results.check();
 
-    /* done */
     expect_no_more_actions();
 }
 
 /*!\test
- * Two messages sent in fast succession, ending up together in the pipe buffer.
+ * Processing ends when the stop fd becomes readable, so that threads serving
+ * additional slaves can be stopped between transactions.
  */
-void test_two_fast_master_transactions()
+void test_stop_fd_ends_processing()
 {
-    /* DCPD sends something through its pipe */
-    static const std::array<uint8_t, 6> network_status
-    {
-        DCP_COMMAND_MULTI_READ_REGISTER, 0x32, 0x02, 0x00,
-        0x02, 0x01
-    };
-    static const std::array<uint8_t, 6> device_status
-    {
-        DCP_COMMAND_MULTI_READ_REGISTER, 0x11, 0x02, 0x00,
-        0x24, 0x42
-    };
-    std::vector<uint8_t> wrapped_network_status;
-    wrap_data_into_protocol(wrapped_network_status, 'c', UINT8_MAX, 0xc830,
-                            network_status.begin(), network_status.size());
-    std::vector<uint8_t> wrapped_device_status;
-    wrap_data_into_protocol(wrapped_device_status, 'c', UINT8_MAX, 0xc831,
-                            device_status.begin(), device_status.size());
-    std::copy_n(wrapped_network_status.begin(), wrapped_network_status.size(),
-                std::back_inserter(os_read_buffer));
-    std::copy_n(wrapped_device_status.begin(), wrapped_device_status.size(),
-                std::back_inserter(os_read_buffer));
+    static const int stop_fd = 90;
 
-    cppcut_assert_equal(wrapped_network_status.size() + wrapped_device_status.size(),
-                        os_read_buffer.size());
+    dcpspi_set_stop_fd(stop_fd);
 
-    poll_results.expect(std::move(PollResult().set_return_value(0)));
-    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
-        "Master transaction: command header from DCPD: 0x03 0x32 0x02 0x00");
+    /* nothing happens, the stop fd is polled along with all others */
+    poll_results.expect(std::move(PollResult().set_stop_events(stop_fd, 0).set_return_value(0)));
+    poll_results.expect(std::move(PollResult().set_stop_events(stop_fd, 0).set_errno(EINTR).set_return_value(-1)));
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
-    cppcut_assert_equal(TR_MASTER_COMMAND_RECEIVING_DATA_FROM_DCPD, process_data->transaction.state);
-    cppcut_assert_equal(size_t(2) + wrapped_device_status.size(), os_read_buffer.size());
-    cppcut_assert_equal(size_t(DCPSYNC_HEADER_SIZE + DCP_HEADER_SIZE),
-                        process_data->transaction.dcp_buffer.pos);
-    cut_assert_true(os_write_buffer.empty());
+    poll_results.check();
+
+    /* stop requested, no more waiting for DCPD */
+    poll_results.expect(std::move(PollResult().set_stop_events(stop_fd, POLLIN).set_return_value(1)));
+
+    cut_assert_false(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                    expected_spi_fd, &process_data->transaction,
+                                    &process_data->rldata));
+
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
     mock_messages->check();
-    mock_gpio->check();
+    poll_results.check();
 
-    /* process data from DCPD remaining in pipe buffer */
-    poll_results.expect(std::move(PollResult().set_return_value(0)));
-    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 2, serial 0xc830, lock state 0, pending size 2, flush pos 0");
+    dcpspi_set_stop_fd(-1);
+
+    expect_no_more_actions();
+}
+
+/*!\test
+ * Two packets sent back-to-back by the slave in a single transfer are
+ * processed as two transactions, but the second one only after the slave has
+ * requested it through the request line.
+ */
+void test_back_to_back_slave_packets_become_two_transactions()
+{
+    static const std::array<uint8_t, 14> two_commands
+    {
+        UINT8_MAX, DCP_COMMAND_MULTI_WRITE_REGISTER, 0x58, 0x03, 0x00,
+        0x61, 0x62, 0x63,
+        0x00, DCP_COMMAND_MULTI_WRITE_REGISTER, 0x79, 0x01, 0x00,
+        0x41,
+    };
+
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(true, process_data->gpio);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, two_commands);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
+    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Slave transaction: command header from SPI: 0x02 0x58 0x03 0x00");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
-    cppcut_assert_equal(TR_MASTER_COMMAND_FORWARDING_TO_SLAVE, process_data->transaction.state);
-    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
-    cut_assert_equal_memory(wrapped_network_status.data(), wrapped_network_status.size(),
-                            process_data->transaction.dcp_buffer.buffer,
-                            process_data->transaction.dcp_buffer.pos);
-    cppcut_assert_equal(uint16_t(0xc830), process_data->transaction.serial);
-    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
-    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
-    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
-    cppcut_assert_equal(wrapped_network_status.size(), os_read_buffer.size());
+    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
     cut_assert_true(os_write_buffer.empty());
     mock_messages->check();
     mock_gpio->check();
+    mock_os->check();
+    mock_spi_hw->check();
     poll_results.check();
 
-    /* send command to SPI slave, send ACK to DCPD */
-    poll_results.expect(std::move(PollResult().set_return_value(0)));
-    expect_wait_for_spi_slave(dummy_time);
-    spi_rw_data->set(network_status);
-    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    /* first packet goes to DCPD, the slave releases the request line; the
+     * second packet remains in the SPI input buffer, but no transaction is
+     * started until the slave asks for it */
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(false, process_data->gpio);
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 3, serial 0xc830, lock state 0, pending size 0, flush pos 0");
+        "Process transaction state 8, serial 0x0001, lock state 2, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "End of transaction 0x0001 in state 8, return to idle state");
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
     cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
-    std::vector<uint8_t> master_command_ack;
-    wrap_data_into_protocol(master_command_ack, 'a', 0, 0xc830);
-    cut_assert_equal_memory(master_command_ack.data(), master_command_ack.size(),
+    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
+
+    std::vector<uint8_t> wrapped_first_command;
+    wrap_data_into_protocol(wrapped_first_command, 'c', 0, DCPSYNC_SLAVE_SERIAL_MIN,
+                            two_commands.data() + 1, 7);
+    cut_assert_equal_memory(wrapped_first_command.data(), wrapped_first_command.size(),
                             os_write_buffer.data(), os_write_buffer.size());
     os_write_buffer.clear();
     mock_messages->check();
     mock_gpio->check();
+    mock_os->check();
     mock_spi_hw->check();
     poll_results.check();
 
-    /* done, second command is still in pipe buffer, so there will be a poll(2)
-     * event for it */
-    cppcut_assert_equal(wrapped_device_status.size(), os_read_buffer.size());
+    expect_no_more_actions();
 
-    poll_results.expect(std::move(PollResult().set_return_value(0)));
-    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
+    /* slave requests the next transaction, second packet is read from the
+     * SPI input buffer, no SPI transfer required */
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(true, process_data->gpio);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
-        "Master transaction: command header from DCPD: 0x03 0x11 0x02 0x00");
+        "Keeping 5 bytes in SPI receive buffer for next packet");
+    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Slave transaction: command header from SPI: 0x02 0x79 0x01 0x00");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
-    cppcut_assert_equal(TR_MASTER_COMMAND_RECEIVING_DATA_FROM_DCPD, process_data->transaction.state);
-    cppcut_assert_equal(size_t(2), os_read_buffer.size());
-    cppcut_assert_equal(size_t(DCPSYNC_HEADER_SIZE + DCP_HEADER_SIZE),
-                        process_data->transaction.dcp_buffer.pos);
+    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
+    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN + 1), process_data->transaction.serial);
     cut_assert_true(os_write_buffer.empty());
     mock_messages->check();
     mock_gpio->check();
+    mock_os->check();
+    mock_spi_hw->check();
+    poll_results.check();
 
-    /* process data from DCPD remaining in pipe buffer */
-    poll_results.expect(std::move(PollResult().set_return_value(0)));
-    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
+    /* second packet goes to DCPD */
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(false, process_data->gpio);
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 2, serial 0xc831, lock state 0, pending size 2, flush pos 0");
+        "Process transaction state 8, serial 0x0002, lock state 2, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "End of transaction 0x0002 in state 8, return to idle state");
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
-    cppcut_assert_equal(TR_MASTER_COMMAND_FORWARDING_TO_SLAVE, process_data->transaction.state);
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
     cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
-    cut_assert_equal_memory(wrapped_device_status.data(), wrapped_device_status.size(),
-                            process_data->transaction.dcp_buffer.buffer,
-                            process_data->transaction.dcp_buffer.pos);
-    cppcut_assert_equal(uint16_t(0xc831), process_data->transaction.serial);
-    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
-    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
-    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
-    cppcut_assert_equal(size_t(0), os_read_buffer.size());
-    cut_assert_true(os_write_buffer.empty());
+
+    std::vector<uint8_t> wrapped_second_command;
+    wrap_data_into_protocol(wrapped_second_command, 'c', 0, DCPSYNC_SLAVE_SERIAL_MIN + 1,
+                            two_commands.data() + 9, 5);
+    cut_assert_equal_memory(wrapped_second_command.data(), wrapped_second_command.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
     mock_messages->check();
     mock_gpio->check();
     poll_results.check();
 
-    /* send command to SPI slave, send ACK to DCPD */
-    poll_results.expect(std::move(PollResult().set_return_value(0)));
-    expect_wait_for_spi_slave(dummy_time);
-    spi_rw_data->set(device_status);
-    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 3, serial 0xc831, lock state 0, pending size 0, flush pos 0");
+    /* done */
+    expect_no_more_actions();
+}
+
+/*!\test
+ * Slave transaction driven by the GPIO edge event queue; redundant edges are
+ * ignored.
+ */
+void test_single_slave_transaction_with_edge_events()
+{
+    MockGPIO::set_has_edge_events(process_data->gpio, true);
+    expected_gpio_poll_events = POLLIN;
+
+    run_complete_single_slave_transaction(DCPSYNC_SLAVE_SERIAL_MIN, true, true,
+                                          false, true);
+}
+
+/*!
+ * Let the request line bounce once, no transaction must be started while the
+ * debounce timer is running.
+ */
+static void expect_request_line_bounce()
+{
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_debounce(GPIO_DEBOUNCE_BOUNCING, false, process_data->gpio);
+    poll_results.expect(std::move(PollResult().set_errno(EINTR).set_return_value(-1)));
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
     cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
-    master_command_ack.clear();
-    wrap_data_into_protocol(master_command_ack, 'a', 0, 0xc831);
-    cut_assert_equal_memory(master_command_ack.data(), master_command_ack.size(),
-                            os_write_buffer.data(), os_write_buffer.size());
-    os_write_buffer.clear();
+    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
+    cut_assert_true(os_write_buffer.empty());
     mock_messages->check();
     mock_gpio->check();
+    mock_os->check();
     mock_spi_hw->check();
     poll_results.check();
-
-    /* done */
-    expect_no_more_actions();
 }
 
-/*!
- * Set up some data to be used in #create_collision_state() and related tests.
+/*!\test
+ * Request line bounces, then settles in asserted state when the debounce
+ * timer expires; the slave transaction is started only then.
  */
-static std::tuple<const std::array<uint8_t, 6> &, const std::array<uint8_t, 6>, std::vector<uint8_t>>
-prepare_for_collision(uint16_t master_serial, uint8_t ttl)
+void test_slave_transaction_after_request_line_has_been_debounced()
 {
-    static const std::array<uint8_t, 6> network_status
-    {
-        DCP_COMMAND_MULTI_READ_REGISTER, 0x32, 0x02, 0x00,
-        0x02, 0x01
-    };
-    std::vector<uint8_t> wrapped_network_status;
-    wrap_data_into_protocol(wrapped_network_status, 'c', ttl, master_serial,
-                            network_status.begin(), network_status.size());
-    std::copy_n(wrapped_network_status.begin(), wrapped_network_status.size(),
-                std::back_inserter(os_read_buffer));
+    MockGPIO::set_debounce_fd(process_data->gpio, debounce_timer_fd);
+    expected_debounce_fd = debounce_timer_fd;
 
-    static const std::array<uint8_t, 8> interrupting_slave_command
+    expect_request_line_bounce();
+    expect_request_line_bounce();
+
+    /* debounce timer expires, line is stable in asserted state */
+    poll_results.expect(std::move(PollResult().set_debounce_events(POLLIN).set_return_value(1)));
+    mock_gpio->expect_gpio_debounce(GPIO_DEBOUNCE_SETTLED, true, process_data->gpio);
+    mock_gpio->expect_gpio_is_active(true, process_data->gpio);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    static const std::array<uint8_t, 8> write_command
     {
         UINT8_MAX, DCP_COMMAND_MULTI_WRITE_REGISTER, 0x58, 0x03, 0x00,
         0x61, 0x62, 0x63
     };
-    std::array<uint8_t, 2> interrupting_slave_command_prefix;
-    std::array<uint8_t, 6> interrupting_slave_command_suffix;
-
-    std::copy_n(interrupting_slave_command.begin(),
-                interrupting_slave_command_prefix.size(),
-                interrupting_slave_command_prefix.begin());
-    std::copy_n(interrupting_slave_command.begin() + interrupting_slave_command_prefix.size(),
-                interrupting_slave_command_suffix.size(),
-                interrupting_slave_command_suffix.begin());
-
-    std::vector<uint8_t> wrapped_interrupting_slave_command;
-    wrap_data_into_protocol(wrapped_interrupting_slave_command, 'c', 0, DCPSYNC_SLAVE_SERIAL_MIN,
-                            interrupting_slave_command.begin() + 1,
-                            interrupting_slave_command.size() - 1);
-
-    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, interrupting_slave_command_prefix, true);
-
-    return std::make_tuple(network_status, interrupting_slave_command_suffix,
-                           wrapped_interrupting_slave_command);
-}
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, write_command);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
+    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Slave transaction: command header from SPI: 0x02 0x58 0x03 0x00");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
 
-static const char *gpio_trace_to_ascii_art(const uint8_t trace,
-                                           unsigned int number_of_bits)
-{
-    static char buffer[8];
-    char *bufptr = buffer;
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
 
-    cppcut_assert_operator(sizeof(buffer), >, size_t(number_of_bits));
-    cppcut_assert_operator(0U, <, number_of_bits);
+    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+    mock_os->check();
+    mock_spi_hw->check();
+    poll_results.check();
 
-    for(uint8_t mask = 1U << (number_of_bits - 1); mask != 0; mask >>= 1)
-        *bufptr++ = ((trace & mask) == 0) ? '_' : '~';
+    /* slave releases the request line, but it bounces again; the packet is
+     * sent to DCPD anyway */
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_debounce(GPIO_DEBOUNCE_BOUNCING, false, process_data->gpio);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 8, serial 0x0001, lock state 1, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "About to end transaction 0x0001 in state 8, "
+        "waiting for slave to release request line");
 
-    *bufptr = '\0';
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
 
-    return buffer;
-}
+    cppcut_assert_equal(TR_SLAVE_COMMAND_WAIT_FOR_REQUEST_DEASSERT,
+                        process_data->transaction.state);
+    std::vector<uint8_t> wrapped_write_command;
+    wrap_data_into_protocol(wrapped_write_command, 'c', 0, DCPSYNC_SLAVE_SERIAL_MIN,
+                            write_command.begin() + 1, write_command.size() - 1);
+    cut_assert_equal_memory(wrapped_write_command.data(), wrapped_write_command.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
+    mock_messages->check();
+    mock_gpio->check();
+    poll_results.check();
 
-static void expect_detection_of_interrupt_by_slave(uint16_t expected_master_serial)
-{
-    char expected_message_buffer[256];
+    /* debounce timer expires, line is stable in deasserted state */
+    mock_messages->expect_msg_info_formatted("Waiting for slave to deassert the request pin");
+    poll_results.expect(std::move(PollResult().set_debounce_events(POLLIN).set_return_value(1)));
+    mock_gpio->expect_gpio_debounce(GPIO_DEBOUNCE_SETTLED, true, process_data->gpio);
+    mock_gpio->expect_gpio_is_active(false, process_data->gpio);
+    mock_messages->expect_msg_info_formatted("Slave has deasserted the request pin");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 9, serial 0x0001, lock state 2, pending size 0, flush pos 13");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "End of transaction 0x0001 in state 9, return to idle state");
 
-    snprintf(expected_message_buffer, sizeof(expected_message_buffer),
-             "Transaction 0x%04x interrupted by slave request", expected_master_serial);
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG, expected_message_buffer);
-}
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
 
-static void expect_detection_of_pending_slave_request(uint16_t expected_master_serial)
-{
-    char expected_message_buffer[256];
+    mock_messages->check();
+    mock_gpio->check();
+    poll_results.check();
 
-    snprintf(expected_message_buffer, sizeof(expected_message_buffer),
-             "Pending slave request while processing transaction 0x%04x",
-             expected_master_serial);
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG, expected_message_buffer);
+    expect_no_more_actions();
 }
 
-enum class RequestPinBehavior
-{
-    UNCHANGED,
-    ON,
-    OFF,
-    ON_OFF,
-    OFF_ON,
-};
-
-/*!
- * Enter a state of SPI collision by GPIO request.
- *
- * In case of any collision, the interrupting slave transaction shall take
- * priority over the master transaction. The master transaction is rejected so
- * that the slave transaction can be processed. After the slave transaction has
- * finished, the master transaction should be restarted by DCPD.
- *
- * \pre
- *     A command whose transmission shall be \e interrupted by the SPI slave
- *     must be copied into the #os_read_buffer before calling this function.
- *
- * The length of the interrupted command must be passed via parameter (because
- * the buffer could contain more data than only the interrupted command).
- *
- * \pre
- *     The first \e two bytes of data sent by the SPI slave that are
- *     \e interrupting the master transaction must be placed into the
- *     #spi_rw_data object before calling this function (use
- *     #spi_rw_data_t::set() with \p is_slave_ready_probe set to true).
- *
- * At least one of the two interrupting bytes must be a non-NOP byte, otherwise
- * there will be no collision.
+/*!\test
+ * Request line bounces, but settles in its previous, deasserted state; no
+ * transaction is started.
  */
-static void create_collision_state(const size_t expected_bytes_in_read_buffer,
-                                   const size_t size_of_interrupted_message,
-                                   const uint16_t expected_master_serial,
-                                   const RequestPinBehavior rpb_gpio_only_when_receiving_from_dcpd,
-                                   const RequestPinBehavior rpb_combined_when_receiving_from_dcpd,
-                                   const RequestPinBehavior rpb_when_sending_to_slave,
-                                   const uint8_t expected_nack_ttl,
-                                   const bool is_nack_expected = true)
+void test_request_line_bounce_settling_in_previous_state_is_ignored()
 {
-    cppcut_assert_operator(size_t(DCP_HEADER_SIZE), <=, size_of_interrupted_message);
-    cppcut_assert_equal(size_t(0), process_data->transaction.dcp_buffer.pos);
+    MockGPIO::set_debounce_fd(process_data->gpio, debounce_timer_fd);
+    expected_debounce_fd = debounce_timer_fd;
 
-    char expected_message_buffer[1024];
+    expect_request_line_bounce();
 
-    /* DCPD sends something through its pipe */
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
-    poll_results.expect(std::move(PollResult().set_return_value(0)));
-    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
-    snprintf(expected_message_buffer, sizeof(expected_message_buffer),
-             "Master transaction: command header from DCPD: "
-             "0x%02x 0x%02x 0x%02x 0x%02x",
-             os_read_buffer[DCPSYNC_HEADER_SIZE + 0],
-             os_read_buffer[DCPSYNC_HEADER_SIZE + 1],
-             os_read_buffer[DCPSYNC_HEADER_SIZE + 2],
-             os_read_buffer[DCPSYNC_HEADER_SIZE + 3]);
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
-                                              expected_message_buffer);
+    /* debounce timer expires, line is back in deasserted state */
+    poll_results.expect(std::move(PollResult().set_debounce_events(POLLIN).set_return_value(1)));
+    mock_gpio->expect_gpio_debounce(GPIO_DEBOUNCE_SETTLED, true, process_data->gpio);
+    mock_gpio->expect_gpio_is_active(false, process_data->gpio);
+    poll_results.expect(std::move(PollResult().set_errno(EINTR).set_return_value(-1)));
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
-    cppcut_assert_equal(TR_MASTER_COMMAND_RECEIVING_DATA_FROM_DCPD, process_data->transaction.state);
-    cppcut_assert_equal(expected_bytes_in_read_buffer - DCPSYNC_HEADER_SIZE - DCP_HEADER_SIZE,
-                        os_read_buffer.size());
-    cppcut_assert_equal(size_t(DCPSYNC_HEADER_SIZE + DCP_HEADER_SIZE),
-                        process_data->transaction.dcp_buffer.pos);
-    mock_messages->check();
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
     mock_gpio->check();
+    poll_results.check();
 
-    /* SPI slave interrupts with a write command, DCPD's data still resides in
-     * the pipe buffer and is processed before the collision is detected so
-     * that the full transaction is there before going any further */
-    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
+    expect_no_more_actions();
+}
 
-    bool is_gpio_active = false;
-    uint8_t gpio_trace = 0;
-    uint8_t gpio_toggle_count = 0;
-    bool pending_slave_request_detected = false;
+/*!\test
+ * With cut-through forwarding, a slave payload is forwarded to DCPD in chunks
+ * while it is read from the slave.
+ */
+void test_slave_payload_is_forwarded_in_chunks()
+{
+    cppcut_assert_equal(size_t(0), dcpspi_cut_through_enable(4));
 
-    switch(rpb_gpio_only_when_receiving_from_dcpd)
+    static const std::array<uint8_t, 8> first_transfer
     {
-      case RequestPinBehavior::UNCHANGED:
-        poll_results.expect(std::move(PollResult().set_return_value(0)));
-        gpio_trace = (gpio_trace << 1) | 0;
-        gpio_trace = (gpio_trace << 1) | 0;
-        break;
+        UINT8_MAX, DCP_COMMAND_MULTI_WRITE_REGISTER, 0x58, 0x0a, 0x00,
+        0x61, 0x62, 0x63,
+    };
+    static const std::array<uint8_t, 8> second_transfer
+    {
+        0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, UINT8_MAX,
+    };
 
-      case RequestPinBehavior::ON:
-        poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI)
-                                                  .set_return_value(1)));
-        is_gpio_active = true;
-        mock_gpio->expect_gpio_is_active(is_gpio_active, process_data->gpio);
-        gpio_trace = (gpio_trace << 1) | 1;
-        gpio_trace = (gpio_trace << 1) | 1;
-        ++gpio_toggle_count;
-        break;
+    /* slave activates the request GPIO and sends write command, the headers
+     * and the first chunk go out right away */
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(true, process_data->gpio);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, first_transfer);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
+    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Slave transaction: command header from SPI: 0x02 0x58 0x0a 0x00");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Slave transaction: forwarding 10 bytes of payload in chunks");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, second_transfer);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
 
-      case RequestPinBehavior::ON_OFF:
-        poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI)
-                                                  .set_return_value(1)));
-        mock_gpio->expect_gpio_is_active(is_gpio_active, process_data->gpio);
-        gpio_trace = (gpio_trace << 1) | 1;
-        gpio_trace = (gpio_trace << 1) | 0;
-        gpio_toggle_count += 2;
-        break;
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
 
-      case RequestPinBehavior::OFF:
-      case RequestPinBehavior::OFF_ON:
-        /* these behaviors violate our assumption that the GPIO was inactive */
-        cut_fail("Unsupported pin behavior");
-        break;
-    }
+    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
+    cppcut_assert_equal(uint16_t(6), process_data->transaction.pending_size_of_transaction);
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+    mock_os->check();
+    mock_spi_hw->check();
+    poll_results.check();
 
-    switch(rpb_combined_when_receiving_from_dcpd)
+    std::vector<uint8_t> expected_output;
+    static const std::array<uint8_t, 14> payload
     {
-      case RequestPinBehavior::UNCHANGED:
-        poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN)
-                                                  .set_return_value(1)));
-        gpio_trace = (gpio_trace << 1) | is_gpio_active;
-        gpio_trace = (gpio_trace << 1) | is_gpio_active;
-        break;
+        DCP_COMMAND_MULTI_WRITE_REGISTER, 0x58, 0x0a, 0x00,
+        0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    };
+    wrap_data_into_protocol(expected_output, 'c', 0, DCPSYNC_SLAVE_SERIAL_MIN,
+                            payload.data(), payload.size());
 
-      case RequestPinBehavior::ON:
-        cut_assert_false(is_gpio_active);
-        poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN)
-                                                  .set_gpio_events(POLLPRI)
-                                                  .set_return_value(2)));
-        is_gpio_active = true;
-        mock_gpio->expect_gpio_is_active(is_gpio_active, process_data->gpio);
-        gpio_trace = (gpio_trace << 1) | 1;
-        gpio_trace = (gpio_trace << 1) | 1;
-        ++gpio_toggle_count;
-        break;
+    /* first chunk with headers, then the remaining chunks taken from the SPI
+     * input buffer */
+    size_t expected_written = DCPSYNC_HEADER_SIZE + DCP_HEADER_SIZE + 4;
 
-      case RequestPinBehavior::OFF_ON:
-        cut_assert_true(is_gpio_active);
-        poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN)
-                                                  .set_gpio_events(POLLPRI)
-                                                  .set_return_value(2)));
-        mock_gpio->expect_gpio_is_active(is_gpio_active, process_data->gpio);
-        gpio_trace = (gpio_trace << 1) | 0;
-        gpio_trace = (gpio_trace << 1) | 1;
-        gpio_toggle_count += 2;
-        break;
+    for(const size_t chunk_size : { 4, 2, })
+    {
+        poll_results.expect(std::move(PollResult().set_return_value(0)));
+        mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
 
-      case RequestPinBehavior::OFF:
-        cut_assert_true(is_gpio_active);
-        poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN)
-                                                  .set_gpio_events(POLLPRI)
-                                                  .set_return_value(2)));
-        is_gpio_active = false;
-        mock_gpio->expect_gpio_is_active(is_gpio_active, process_data->gpio);
-        gpio_trace = (gpio_trace << 1) | 0;
-        gpio_trace = (gpio_trace << 1) | 0;
-        ++gpio_toggle_count;
-        break;
+        cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                       expected_spi_fd, &process_data->transaction,
+                                       &process_data->rldata));
 
-      case RequestPinBehavior::ON_OFF:
-        cut_assert_false(is_gpio_active);
-        poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN)
-                                                  .set_gpio_events(POLLPRI)
-                                                  .set_return_value(2)));
-        mock_gpio->expect_gpio_is_active(is_gpio_active, process_data->gpio);
-        gpio_trace = (gpio_trace << 1) | 1;
-        gpio_trace = (gpio_trace << 1) | 0;
-        gpio_toggle_count += 2;
-        break;
-    }
+        cppcut_assert_equal(TR_SLAVE_COMMAND_RECEIVING_DATA_FROM_SLAVE, process_data->transaction.state);
+        cut_assert_equal_memory(expected_output.data(), expected_written,
+                                os_write_buffer.data(), os_write_buffer.size());
+        mock_messages->check();
+        poll_results.check();
 
-    if(gpio_trace != 0)
-    {
-        /* early collision */
-        expect_detection_of_interrupt_by_slave(expected_master_serial);
-    }
+        poll_results.expect(std::move(PollResult().set_return_value(0)));
+        mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
+        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
 
-    if(!pending_slave_request_detected && gpio_toggle_count >= 3)
-    {
-        /* early pending second slave request */
-        expect_detection_of_pending_slave_request(expected_master_serial);
-        pending_slave_request_detected = true;
+        cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                       expected_spi_fd, &process_data->transaction,
+                                       &process_data->rldata));
+
+        cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
+        cppcut_assert_equal(chunk_size, process_data->transaction.dcp_buffer.pos);
+        mock_messages->check();
+        mock_os->check();
+        poll_results.check();
+
+        expected_written += chunk_size;
     }
 
+    /* last chunk, slave releases request line */
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(false, process_data->gpio);
     mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "End of transaction 0x0001 in state 8, return to idle state");
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
-    mock_messages->check();
-    const enum transaction_request_state previous_request_state =
-        process_data->transaction.request_state;
-
-    cppcut_assert_equal(TR_MASTER_COMMAND_FORWARDING_TO_SLAVE, process_data->transaction.state);
-    cppcut_assert_equal(expected_bytes_in_read_buffer - DCPSYNC_HEADER_SIZE - size_of_interrupted_message,
-                        os_read_buffer.size());
-    cppcut_assert_equal(size_of_interrupted_message + DCPSYNC_HEADER_SIZE,
-                        process_data->transaction.dcp_buffer.pos);
-    cppcut_assert_equal(expected_master_serial, process_data->transaction.serial);
-    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
-    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
-    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
-    cut_assert_true(os_write_buffer.empty());
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+    cut_assert_equal_memory(expected_output.data(), expected_output.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
     mock_messages->check();
     mock_gpio->check();
+    poll_results.check();
 
-    /* try sending command to SPI slave, but collision is detected and NACK is
-     * immediately sent to dcpd; the master transaction is discarded and
-     * replaced by a slave transaction */
-    switch(rpb_when_sending_to_slave)
+    expect_no_more_actions();
+}
+
+/*!\test
+ * Slave payloads larger than the DCP buffer are rejected unless cut-through
+ * forwarding is enabled and the maximum payload size has been raised.
+ */
+void test_large_slave_payload_requires_cut_through()
+{
+    cppcut_assert_equal(size_t(DCP_PAYLOAD_MAXSIZE), dcpspi_set_max_payload_size(1024));
+
+    static const std::array<uint8_t, 8> header_transfer
     {
-      case RequestPinBehavior::UNCHANGED:
-        poll_results.expect(std::move(PollResult().set_return_value(0)));
-        gpio_trace = (gpio_trace << 1) | is_gpio_active;
-        gpio_trace = (gpio_trace << 1) | is_gpio_active;
-        break;
+        UINT8_MAX, DCP_COMMAND_MULTI_WRITE_REGISTER, 0x58, 0x2c, 0x01,
+        0x61, 0x62, 0x63,
+    };
 
-      case RequestPinBehavior::ON:
-        cut_assert_false(is_gpio_active);
-        poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
-        mock_gpio->expect_gpio_is_active(true, process_data->gpio);
-        gpio_trace = (gpio_trace << 1) | 1;
-        gpio_trace = (gpio_trace << 1) | 1;
-        ++gpio_toggle_count;
-        break;
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(true, process_data->gpio);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, header_transfer);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
+    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Slave transaction: command header from SPI: 0x02 0x58 0x2c 0x01");
+    mock_messages->expect_msg_error_formatted(EINVAL, LOG_ERR,
+        "Slave transaction: transaction size 300 exceeds maximum size of 262");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "About to end transaction 0x0000 in state 6, waiting for slave to release request line");
 
-      case RequestPinBehavior::OFF_ON:
-        cut_assert_true(is_gpio_active);
-        poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
-        mock_gpio->expect_gpio_is_active(true, process_data->gpio);
-        gpio_trace = (gpio_trace << 1) | 0;
-        gpio_trace = (gpio_trace << 1) | 1;
-        gpio_toggle_count += 2;
-        break;
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
 
-      case RequestPinBehavior::OFF:
-        cut_assert_true(is_gpio_active);
-        poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
-        mock_gpio->expect_gpio_is_active(false, process_data->gpio);
-        gpio_trace = (gpio_trace << 1) | 0;
-        gpio_trace = (gpio_trace << 1) | 0;
-        ++gpio_toggle_count;
-        break;
+    cppcut_assert_equal(TR_SLAVE_COMMAND_WAIT_FOR_REQUEST_DEASSERT, process_data->transaction.state);
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+    mock_os->check();
+    mock_spi_hw->check();
+    poll_results.check();
+}
 
-      case RequestPinBehavior::ON_OFF:
-        cut_assert_false(is_gpio_active);
-        poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
-        mock_gpio->expect_gpio_is_active(false, process_data->gpio);
-        gpio_trace = (gpio_trace << 1) | 1;
-        gpio_trace = (gpio_trace << 1) | 0;
-        gpio_toggle_count += 2;
-        break;
-    }
+/*!\test
+ * With read-ahead enabled, all packets queued in the pipe are read by a single
+ * read(2), and no further poll(2) events are required to process them.
+ */
+void test_two_fast_master_transactions_with_read_ahead()
+{
+    dcpspi_read_ahead_enable(true);
 
-    if((gpio_trace & (0x0f << 2)) == 0 && (gpio_trace & (0x03 << 0)) != 0)
+    static const std::array<uint8_t, 6> network_status
     {
-        /* didn't detect this before polling, so the message is emitted a bit
-         * later */
-        expect_detection_of_interrupt_by_slave(expected_master_serial);
-    }
-
-    if(!pending_slave_request_detected && gpio_toggle_count >= 3)
+        DCP_COMMAND_MULTI_READ_REGISTER, 0x32, 0x02, 0x00,
+        0x02, 0x01
+    };
+    static const std::array<uint8_t, 6> device_status
     {
-        /* later pending second slave request */
-        expect_detection_of_pending_slave_request(expected_master_serial);
-        pending_slave_request_detected = true;
-    }
+        DCP_COMMAND_MULTI_READ_REGISTER, 0x11, 0x02, 0x00,
+        0x24, 0x42
+    };
+    std::vector<uint8_t> wrapped_network_status;
+    wrap_data_into_protocol(wrapped_network_status, 'c', UINT8_MAX, 0xc830,
+                            network_status.begin(), network_status.size());
+    std::vector<uint8_t> wrapped_device_status;
+    wrap_data_into_protocol(wrapped_device_status, 'c', UINT8_MAX, 0xc831,
+                            device_status.begin(), device_status.size());
+    std::copy_n(wrapped_network_status.begin(), wrapped_network_status.size(),
+                std::back_inserter(os_read_buffer));
+    std::copy_n(wrapped_device_status.begin(), wrapped_device_status.size(),
+                std::back_inserter(os_read_buffer));
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
+    /* DCPD has written two packets, we are woken up once */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Master transaction: command header from DCPD: 0x03 0x32 0x02 0x00");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_MASTER_COMMAND_RECEIVING_DATA_FROM_DCPD, process_data->transaction.state);
+    cut_assert_true(os_read_buffer.empty());
+    cppcut_assert_equal(1U, os_read_calls);
+    mock_messages->check();
+    poll_results.check();
+
+    for(const auto &packet :
+        { std::make_tuple(0xc830, &network_status, &wrapped_network_status),
+          std::make_tuple(0xc831, &device_status, &wrapped_device_status), })
+    {
+        const uint16_t serial = std::get<0>(packet);
+        char expected_message[128];
+
+        if(serial != 0xc830)
+        {
+            /* header of next packet, taken from read-ahead buffer */
+            poll_results.expect(std::move(PollResult().set_return_value(0)));
+            mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+                "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
+            mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+                "Master transaction: command header from DCPD: 0x03 0x11 0x02 0x00");
+
+            cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                           expected_spi_fd, &process_data->transaction,
+                                           &process_data->rldata));
+
+            cppcut_assert_equal(TR_MASTER_COMMAND_RECEIVING_DATA_FROM_DCPD,
+                                process_data->transaction.state);
+            mock_messages->check();
+            poll_results.check();
+        }
+
+        /* payload, taken from read-ahead buffer */
+        poll_results.expect(std::move(PollResult().set_return_value(0)));
+        snprintf(expected_message, sizeof(expected_message),
+                 "Process transaction state 2, serial 0x%04x, lock state 0, pending size 2, flush pos 0",
+                 serial);
+        mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG, expected_message);
+
+        cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                       expected_spi_fd, &process_data->transaction,
+                                       &process_data->rldata));
+
+        cppcut_assert_equal(TR_MASTER_COMMAND_FORWARDING_TO_SLAVE, process_data->transaction.state);
+        cut_assert_equal_memory(std::get<2>(packet)->data(), std::get<2>(packet)->size(),
+                                process_data->transaction.dcp_buffer.buffer,
+                                process_data->transaction.dcp_buffer.pos);
+        mock_messages->check();
+        poll_results.check();
+
+        /* send command to SPI slave, send ACK to DCPD */
+        poll_results.expect(std::move(PollResult().set_return_value(0)));
+        expect_wait_for_spi_slave(dummy_time);
+        spi_rw_data->set(*std::get<1>(packet));
+        mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+        snprintf(expected_message, sizeof(expected_message),
+                 "Process transaction state 3, serial 0x%04x, lock state 0, pending size 0, flush pos 0",
+                 serial);
+        mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG, expected_message);
+
+        cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                       expected_spi_fd, &process_data->transaction,
+                                       &process_data->rldata));
+
+        cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+        std::vector<uint8_t> master_command_ack;
+        wrap_data_into_protocol(master_command_ack, 'a', 0, serial);
+        cut_assert_equal_memory(master_command_ack.data(), master_command_ack.size(),
+                                os_write_buffer.data(), os_write_buffer.size());
+        os_write_buffer.clear();
+        mock_messages->check();
+        mock_spi_hw->check();
+        poll_results.check();
+    }
+
+    cppcut_assert_equal(1U, os_read_calls);
+    cppcut_assert_equal(2U, os_writev_calls);
+
+    /* done */
+    expect_no_more_actions();
+}
+
+/*!\test
+ * Hangup on the named pipe terminates the program.
+ */
+void test_dcpd_hangup_on_named_pipe_terminates()
+{
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLHUP).set_return_value(1)));
+    mock_messages->expect_msg_error_formatted(0, LOG_ERR,
+        "DCP daemon died, terminating");
+
+    char expected_message[128];
+    snprintf(expected_message, sizeof(expected_message),
+             "Unexpected poll() events on fifo_fd %d: %04x",
+             expected_fifo_in_fd, POLLHUP);
+    mock_messages->expect_msg_error_formatted(0, LOG_WARNING, expected_message);
+
+    cut_assert_false(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                    expected_spi_fd, &process_data->transaction,
+                                    &process_data->rldata));
+}
+
+/*!\test
+ * Hangup on a socket with message boundaries is reported to the caller, which
+ * may then wait for DCPD to reconnect.
+ */
+void test_dcpd_hangup_on_message_socket_is_not_fatal()
+{
+    dcpspi_read_ahead_enable(true);
+    dcpspi_set_message_mode(true);
+
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN | POLLHUP).set_return_value(1)));
+    mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
+        "DCP daemon disconnected");
+
+    cut_assert_false(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                    expected_spi_fd, &process_data->transaction,
+                                    &process_data->rldata));
+    cppcut_assert_equal(0U, os_read_calls);
+
+    dcpspi_dcpd_disconnected(&process_data->transaction);
+
+    expect_no_more_actions();
+}
+
+/*!\test
+ * A packet cut short by DCPD going away is dropped.
+ */
+void test_incomplete_packet_is_dropped_on_dcpd_disconnect()
+{
+    dcpspi_read_ahead_enable(true);
+    dcpspi_set_message_mode(true);
+
+    static const std::array<uint8_t, 6> network_status
+    {
+        DCP_COMMAND_MULTI_READ_REGISTER, 0x32, 0x02, 0x00,
+        0x02, 0x01
+    };
+    std::vector<uint8_t> wrapped_network_status;
+    wrap_data_into_protocol(wrapped_network_status, 'c', UINT8_MAX, 0xc830,
+                            network_status.begin(), network_status.size());
+
+    /* payload is missing */
+    std::copy_n(wrapped_network_status.begin(), wrapped_network_status.size() - 2,
+                std::back_inserter(os_read_buffer));
+
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Master transaction: command header from DCPD: 0x03 0x32 0x02 0x00");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_MASTER_COMMAND_RECEIVING_DATA_FROM_DCPD, process_data->transaction.state);
+    mock_messages->check();
+    poll_results.check();
+
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLHUP).set_return_value(1)));
+    mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
+        "DCP daemon disconnected");
+
+    cut_assert_false(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                    expected_spi_fd, &process_data->transaction,
+                                    &process_data->rldata));
+
+    mock_messages->expect_msg_info("Dropping incomplete packet from DCPD");
+    dcpspi_dcpd_disconnected(&process_data->transaction);
+
+    expect_no_more_actions();
+}
+
+/*!\test
+ * Regular master write followed by a regular slave write, no collisions.
+ */
+void test_master_write_followed_by_slave_write()
+{
+    /* DCPD tells slave that the next external stream URL is empty */
+    static const std::array<uint8_t, 4> next_appstream_empty
+    {
+        DCP_COMMAND_MULTI_WRITE_REGISTER, 0xef, 0x00, 0x00,
+    };
+    std::vector<uint8_t> wrapped_appstream;
+    wrap_data_into_protocol(wrapped_appstream, 'c', UINT8_MAX, 0xeba9,
+                            next_appstream_empty.begin(), next_appstream_empty.size());
+    std::copy_n(wrapped_appstream.begin(), wrapped_appstream.size(),
+                std::back_inserter(os_read_buffer));
+
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Master transaction: command header from DCPD: 0x02 0xef 0x00 0x00");
+    expect_wait_for_spi_slave(dummy_time);
+    spi_rw_data->set(next_appstream_empty);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+    std::vector<uint8_t> master_command_ack;
+    wrap_data_into_protocol(master_command_ack, 'a', 0, 0xeba9);
+    cut_assert_equal_memory(master_command_ack.data(), master_command_ack.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
+    mock_messages->check();
+    mock_gpio->check();
+    mock_spi_hw->check();
+    poll_results.check();
+
+    /* short writes succeed within a single call of #dcpspi_process(), so we
+     * can process a slave request now */
+    run_complete_single_slave_transaction(DCPSYNC_SLAVE_SERIAL_MIN, true, true);
+}
+
+/*!\test
+ * Regular slave write followed by a regular master write, no collisions.
+ */
+void test_slave_write_followed_by_master_write()
+{
+    /* slave sends something */
+    run_complete_single_slave_transaction(DCPSYNC_SLAVE_SERIAL_MIN, true, false);
+
+    /* done, now DCPD tells slave that the next external stream URL is empty */
+    static const std::array<uint8_t, 4> next_appstream_empty
+    {
+        DCP_COMMAND_MULTI_WRITE_REGISTER, 0xef, 0x00, 0x00,
+    };
+    std::vector<uint8_t> wrapped_appstream;
+    wrap_data_into_protocol(wrapped_appstream, 'c', UINT8_MAX, 0xeba9,
+                            next_appstream_empty.begin(), next_appstream_empty.size());
+    std::copy_n(wrapped_appstream.begin(), wrapped_appstream.size(),
+                std::back_inserter(os_read_buffer));
+
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Master transaction: command header from DCPD: 0x02 0xef 0x00 0x00");
+    expect_wait_for_spi_slave(dummy_time);
+    spi_rw_data->set(next_appstream_empty);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+    std::vector<uint8_t> master_command_ack;
+    wrap_data_into_protocol(master_command_ack, 'a', 0, 0xeba9);
+    cut_assert_equal_memory(master_command_ack.data(), master_command_ack.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
+    mock_messages->check();
+    mock_gpio->check();
+    mock_spi_hw->check();
+    poll_results.check();
+
+    /* done */
+    expect_no_more_actions();
+}
+
+/*!\test
+ * Two messages sent in fast succession, ending up together in the pipe buffer.
+ */
+void test_two_fast_master_transactions()
+{
+    /* DCPD sends something through its pipe */
+    static const std::array<uint8_t, 6> network_status
+    {
+        DCP_COMMAND_MULTI_READ_REGISTER, 0x32, 0x02, 0x00,
+        0x02, 0x01
+    };
+    static const std::array<uint8_t, 6> device_status
+    {
+        DCP_COMMAND_MULTI_READ_REGISTER, 0x11, 0x02, 0x00,
+        0x24, 0x42
+    };
+    std::vector<uint8_t> wrapped_network_status;
+    wrap_data_into_protocol(wrapped_network_status, 'c', UINT8_MAX, 0xc830,
+                            network_status.begin(), network_status.size());
+    std::vector<uint8_t> wrapped_device_status;
+    wrap_data_into_protocol(wrapped_device_status, 'c', UINT8_MAX, 0xc831,
+                            device_status.begin(), device_status.size());
+    std::copy_n(wrapped_network_status.begin(), wrapped_network_status.size(),
+                std::back_inserter(os_read_buffer));
+    std::copy_n(wrapped_device_status.begin(), wrapped_device_status.size(),
+                std::back_inserter(os_read_buffer));
+
+    cppcut_assert_equal(wrapped_network_status.size() + wrapped_device_status.size(),
+                        os_read_buffer.size());
+
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Master transaction: command header from DCPD: 0x03 0x32 0x02 0x00");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_MASTER_COMMAND_RECEIVING_DATA_FROM_DCPD, process_data->transaction.state);
+    cppcut_assert_equal(size_t(2) + wrapped_device_status.size(), os_read_buffer.size());
+    cppcut_assert_equal(size_t(DCPSYNC_HEADER_SIZE + DCP_HEADER_SIZE),
+                        process_data->transaction.dcp_buffer.pos);
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+
+    /* process data from DCPD remaining in pipe buffer */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 2, serial 0xc830, lock state 0, pending size 2, flush pos 0");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_MASTER_COMMAND_FORWARDING_TO_SLAVE, process_data->transaction.state);
+    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
+    cut_assert_equal_memory(wrapped_network_status.data(), wrapped_network_status.size(),
+                            process_data->transaction.dcp_buffer.buffer,
+                            process_data->transaction.dcp_buffer.pos);
+    cppcut_assert_equal(uint16_t(0xc830), process_data->transaction.serial);
+    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
+    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
+    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
+    cppcut_assert_equal(wrapped_network_status.size(), os_read_buffer.size());
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+    poll_results.check();
+
+    /* send command to SPI slave, send ACK to DCPD */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    expect_wait_for_spi_slave(dummy_time);
+    spi_rw_data->set(network_status);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 3, serial 0xc830, lock state 0, pending size 0, flush pos 0");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+    std::vector<uint8_t> master_command_ack;
+    wrap_data_into_protocol(master_command_ack, 'a', 0, 0xc830);
+    cut_assert_equal_memory(master_command_ack.data(), master_command_ack.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
+    mock_messages->check();
+    mock_gpio->check();
+    mock_spi_hw->check();
+    poll_results.check();
+
+    /* done, second command is still in pipe buffer, so there will be a poll(2)
+     * event for it */
+    cppcut_assert_equal(wrapped_device_status.size(), os_read_buffer.size());
+
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Master transaction: command header from DCPD: 0x03 0x11 0x02 0x00");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_MASTER_COMMAND_RECEIVING_DATA_FROM_DCPD, process_data->transaction.state);
+    cppcut_assert_equal(size_t(2), os_read_buffer.size());
+    cppcut_assert_equal(size_t(DCPSYNC_HEADER_SIZE + DCP_HEADER_SIZE),
+                        process_data->transaction.dcp_buffer.pos);
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+
+    /* process data from DCPD remaining in pipe buffer */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 2, serial 0xc831, lock state 0, pending size 2, flush pos 0");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_MASTER_COMMAND_FORWARDING_TO_SLAVE, process_data->transaction.state);
+    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
+    cut_assert_equal_memory(wrapped_device_status.data(), wrapped_device_status.size(),
+                            process_data->transaction.dcp_buffer.buffer,
+                            process_data->transaction.dcp_buffer.pos);
+    cppcut_assert_equal(uint16_t(0xc831), process_data->transaction.serial);
+    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
+    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
+    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
+    cppcut_assert_equal(size_t(0), os_read_buffer.size());
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+    poll_results.check();
+
+    /* send command to SPI slave, send ACK to DCPD */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    expect_wait_for_spi_slave(dummy_time);
+    spi_rw_data->set(device_status);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 3, serial 0xc831, lock state 0, pending size 0, flush pos 0");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+    master_command_ack.clear();
+    wrap_data_into_protocol(master_command_ack, 'a', 0, 0xc831);
+    cut_assert_equal_memory(master_command_ack.data(), master_command_ack.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
+    mock_messages->check();
+    mock_gpio->check();
+    mock_spi_hw->check();
+    poll_results.check();
+
+    /* done */
+    expect_no_more_actions();
+}
+
+/*!
+ * Set up some data to be used in #create_collision_state() and related tests.
+ */
+static std::tuple<const std::array<uint8_t, 6> &, const std::array<uint8_t, 6>, std::vector<uint8_t>>
+prepare_for_collision(uint16_t master_serial, uint8_t ttl)
+{
+    static const std::array<uint8_t, 6> network_status
+    {
+        DCP_COMMAND_MULTI_READ_REGISTER, 0x32, 0x02, 0x00,
+        0x02, 0x01
+    };
+    std::vector<uint8_t> wrapped_network_status;
+    wrap_data_into_protocol(wrapped_network_status, 'c', ttl, master_serial,
+                            network_status.begin(), network_status.size());
+    std::copy_n(wrapped_network_status.begin(), wrapped_network_status.size(),
+                std::back_inserter(os_read_buffer));
+
+    static const std::array<uint8_t, 8> interrupting_slave_command
+    {
+        UINT8_MAX, DCP_COMMAND_MULTI_WRITE_REGISTER, 0x58, 0x03, 0x00,
+        0x61, 0x62, 0x63
+    };
+    std::array<uint8_t, 2> interrupting_slave_command_prefix;
+    std::array<uint8_t, 6> interrupting_slave_command_suffix;
+
+    std::copy_n(interrupting_slave_command.begin(),
+                interrupting_slave_command_prefix.size(),
+                interrupting_slave_command_prefix.begin());
+    std::copy_n(interrupting_slave_command.begin() + interrupting_slave_command_prefix.size(),
+                interrupting_slave_command_suffix.size(),
+                interrupting_slave_command_suffix.begin());
+
+    std::vector<uint8_t> wrapped_interrupting_slave_command;
+    wrap_data_into_protocol(wrapped_interrupting_slave_command, 'c', 0, DCPSYNC_SLAVE_SERIAL_MIN,
+                            interrupting_slave_command.begin() + 1,
+                            interrupting_slave_command.size() - 1);
+
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, interrupting_slave_command_prefix, true);
+
+    return std::make_tuple(network_status, interrupting_slave_command_suffix,
+                           wrapped_interrupting_slave_command);
+}
+
+static const char *gpio_trace_to_ascii_art(const uint8_t trace,
+                                           unsigned int number_of_bits)
+{
+    static char buffer[8];
+    char *bufptr = buffer;
+
+    cppcut_assert_operator(sizeof(buffer), >, size_t(number_of_bits));
+    cppcut_assert_operator(0U, <, number_of_bits);
+
+    for(uint8_t mask = 1U << (number_of_bits - 1); mask != 0; mask >>= 1)
+        *bufptr++ = ((trace & mask) == 0) ? '_' : '~';
+
+    *bufptr = '\0';
+
+    return buffer;
+}
+
+static void expect_detection_of_interrupt_by_slave(uint16_t expected_master_serial)
+{
+    char expected_message_buffer[256];
+
+    snprintf(expected_message_buffer, sizeof(expected_message_buffer),
+             "Transaction 0x%04x interrupted by slave request", expected_master_serial);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG, expected_message_buffer);
+}
+
+static void expect_detection_of_pending_slave_request(uint16_t expected_master_serial)
+{
+    char expected_message_buffer[256];
+
+    snprintf(expected_message_buffer, sizeof(expected_message_buffer),
+             "Pending slave request while processing transaction 0x%04x",
+             expected_master_serial);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG, expected_message_buffer);
+}
+
+enum class RequestPinBehavior
+{
+    UNCHANGED,
+    ON,
+    OFF,
+    ON_OFF,
+    OFF_ON,
+};
+
+/*!
+ * Enter a state of SPI collision by GPIO request.
+ *
+ * In case of any collision, the interrupting slave transaction shall take
+ * priority over the master transaction. The master transaction is rejected so
+ * that the slave transaction can be processed. After the slave transaction has
+ * finished, the master transaction should be restarted by DCPD.
+ *
+ * \pre
+ *     A command whose transmission shall be \e interrupted by the SPI slave
+ *     must be copied into the #os_read_buffer before calling this function.
+ *
+ * The length of the interrupted command must be passed via parameter (because
+ * the buffer could contain more data than only the interrupted command).
+ *
+ * \pre
+ *     The first \e two bytes of data sent by the SPI slave that are
+ *     \e interrupting the master transaction must be placed into the
+ *     #spi_rw_data object before calling this function (use
+ *     #spi_rw_data_t::set() with \p is_slave_ready_probe set to true).
+ *
+ * At least one of the two interrupting bytes must be a non-NOP byte, otherwise
+ * there will be no collision.
+ */
+static void create_collision_state(const size_t expected_bytes_in_read_buffer,
+                                   const size_t size_of_interrupted_message,
+                                   const uint16_t expected_master_serial,
+                                   const RequestPinBehavior rpb_gpio_only_when_receiving_from_dcpd,
+                                   const RequestPinBehavior rpb_combined_when_receiving_from_dcpd,
+                                   const RequestPinBehavior rpb_when_sending_to_slave,
+                                   const uint8_t expected_nack_ttl,
+                                   const bool is_nack_expected = true)
+{
+    cppcut_assert_operator(size_t(DCP_HEADER_SIZE), <=, size_of_interrupted_message);
+    cppcut_assert_equal(size_t(0), process_data->transaction.dcp_buffer.pos);
+
+    char expected_message_buffer[1024];
+
+    /* DCPD sends something through its pipe */
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
+    snprintf(expected_message_buffer, sizeof(expected_message_buffer),
+             "Master transaction: command header from DCPD: "
+             "0x%02x 0x%02x 0x%02x 0x%02x",
+             os_read_buffer[DCPSYNC_HEADER_SIZE + 0],
+             os_read_buffer[DCPSYNC_HEADER_SIZE + 1],
+             os_read_buffer[DCPSYNC_HEADER_SIZE + 2],
+             os_read_buffer[DCPSYNC_HEADER_SIZE + 3]);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+                                              expected_message_buffer);
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_MASTER_COMMAND_RECEIVING_DATA_FROM_DCPD, process_data->transaction.state);
+    cppcut_assert_equal(expect_read_ahead
+                        ? size_t(0)
+                        : expected_bytes_in_read_buffer - DCPSYNC_HEADER_SIZE - DCP_HEADER_SIZE,
+                        os_read_buffer.size());
+    cppcut_assert_equal(size_t(DCPSYNC_HEADER_SIZE + DCP_HEADER_SIZE),
+                        process_data->transaction.dcp_buffer.pos);
+    mock_messages->check();
+    mock_gpio->check();
+
+    /* SPI slave interrupts with a write command, DCPD's data still resides in
+     * the pipe buffer and is processed before the collision is detected so
+     * that the full transaction is there before going any further */
+    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
+
+    bool is_gpio_active = false;
+    uint8_t gpio_trace = 0;
+    uint8_t gpio_toggle_count = 0;
+    bool pending_slave_request_detected = false;
+
+    switch(rpb_gpio_only_when_receiving_from_dcpd)
+    {
+      case RequestPinBehavior::UNCHANGED:
+        poll_results.expect(std::move(PollResult().set_return_value(0)));
+        gpio_trace = (gpio_trace << 1) | 0;
+        gpio_trace = (gpio_trace << 1) | 0;
+        break;
+
+      case RequestPinBehavior::ON:
+        poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI)
+                                                  .set_return_value(1)));
+        is_gpio_active = true;
+        mock_gpio->expect_gpio_is_active(is_gpio_active, process_data->gpio);
+        gpio_trace = (gpio_trace << 1) | 1;
+        gpio_trace = (gpio_trace << 1) | 1;
+        ++gpio_toggle_count;
+        break;
+
+      case RequestPinBehavior::ON_OFF:
+        poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI)
+                                                  .set_return_value(1)));
+        mock_gpio->expect_gpio_is_active(is_gpio_active, process_data->gpio);
+        gpio_trace = (gpio_trace << 1) | 1;
+        gpio_trace = (gpio_trace << 1) | 0;
+        gpio_toggle_count += 2;
+        break;
+
+      case RequestPinBehavior::OFF:
+      case RequestPinBehavior::OFF_ON:
+        /* these behaviors violate our assumption that the GPIO was inactive */
+        cut_fail("Unsupported pin behavior");
+        break;
+    }
+
+    /* the payload is taken from the read-ahead buffer without waiting for
+     * DCPD, so there is no chance for the request pin to change meanwhile */
+    if(expect_read_ahead &&
+       rpb_combined_when_receiving_from_dcpd != RequestPinBehavior::UNCHANGED)
+        cut_fail("Unsupported pin behavior with read-ahead");
+
+    switch(rpb_combined_when_receiving_from_dcpd)
+    {
+      case RequestPinBehavior::UNCHANGED:
+        if(!expect_read_ahead)
+            poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN)
+                                                      .set_return_value(1)));
+        gpio_trace = (gpio_trace << 1) | is_gpio_active;
+        gpio_trace = (gpio_trace << 1) | is_gpio_active;
+        break;
+
+      case RequestPinBehavior::ON:
+        cut_assert_false(is_gpio_active);
+        poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN)
+                                                  .set_gpio_events(POLLPRI)
+                                                  .set_return_value(2)));
+        is_gpio_active = true;
+        mock_gpio->expect_gpio_is_active(is_gpio_active, process_data->gpio);
+        gpio_trace = (gpio_trace << 1) | 1;
+        gpio_trace = (gpio_trace << 1) | 1;
+        ++gpio_toggle_count;
+        break;
+
+      case RequestPinBehavior::OFF_ON:
+        cut_assert_true(is_gpio_active);
+        poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN)
+                                                  .set_gpio_events(POLLPRI)
+                                                  .set_return_value(2)));
+        mock_gpio->expect_gpio_is_active(is_gpio_active, process_data->gpio);
+        gpio_trace = (gpio_trace << 1) | 0;
+        gpio_trace = (gpio_trace << 1) | 1;
+        gpio_toggle_count += 2;
+        break;
+
+      case RequestPinBehavior::OFF:
+        cut_assert_true(is_gpio_active);
+        poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN)
+                                                  .set_gpio_events(POLLPRI)
+                                                  .set_return_value(2)));
+        is_gpio_active = false;
+        mock_gpio->expect_gpio_is_active(is_gpio_active, process_data->gpio);
+        gpio_trace = (gpio_trace << 1) | 0;
+        gpio_trace = (gpio_trace << 1) | 0;
+        ++gpio_toggle_count;
+        break;
+
+      case RequestPinBehavior::ON_OFF:
+        cut_assert_false(is_gpio_active);
+        poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN)
+                                                  .set_gpio_events(POLLPRI)
+                                                  .set_return_value(2)));
+        mock_gpio->expect_gpio_is_active(is_gpio_active, process_data->gpio);
+        gpio_trace = (gpio_trace << 1) | 1;
+        gpio_trace = (gpio_trace << 1) | 0;
+        gpio_toggle_count += 2;
+        break;
+    }
+
+    if(gpio_trace != 0)
+    {
+        /* early collision */
+        expect_detection_of_interrupt_by_slave(expected_master_serial);
+    }
+
+    if(!pending_slave_request_detected && gpio_toggle_count >= 3)
+    {
+        /* early pending second slave request */
+        expect_detection_of_pending_slave_request(expected_master_serial);
+        pending_slave_request_detected = true;
+    }
+
+    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    mock_messages->check();
+    const enum transaction_request_state previous_request_state =
+        process_data->transaction.request_state;
+
+    cppcut_assert_equal(TR_MASTER_COMMAND_FORWARDING_TO_SLAVE, process_data->transaction.state);
+    cppcut_assert_equal(expect_read_ahead
+                        ? size_t(0)
+                        : expected_bytes_in_read_buffer - DCPSYNC_HEADER_SIZE - size_of_interrupted_message,
+                        os_read_buffer.size());
+    cppcut_assert_equal(size_of_interrupted_message + DCPSYNC_HEADER_SIZE,
+                        process_data->transaction.dcp_buffer.pos);
+    cppcut_assert_equal(expected_master_serial, process_data->transaction.serial);
+    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
+    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
+    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+
+    /* try sending command to SPI slave, but collision is detected and NACK is
+     * immediately sent to dcpd; the master transaction is discarded and
+     * replaced by a slave transaction */
+    switch(rpb_when_sending_to_slave)
+    {
+      case RequestPinBehavior::UNCHANGED:
+        poll_results.expect(std::move(PollResult().set_return_value(0)));
+        gpio_trace = (gpio_trace << 1) | is_gpio_active;
+        gpio_trace = (gpio_trace << 1) | is_gpio_active;
+        break;
+
+      case RequestPinBehavior::ON:
+        cut_assert_false(is_gpio_active);
+        poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+        mock_gpio->expect_gpio_is_active(true, process_data->gpio);
+        gpio_trace = (gpio_trace << 1) | 1;
+        gpio_trace = (gpio_trace << 1) | 1;
+        ++gpio_toggle_count;
+        break;
+
+      case RequestPinBehavior::OFF_ON:
+        cut_assert_true(is_gpio_active);
+        poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+        mock_gpio->expect_gpio_is_active(true, process_data->gpio);
+        gpio_trace = (gpio_trace << 1) | 0;
+        gpio_trace = (gpio_trace << 1) | 1;
+        gpio_toggle_count += 2;
+        break;
+
+      case RequestPinBehavior::OFF:
+        cut_assert_true(is_gpio_active);
+        poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+        mock_gpio->expect_gpio_is_active(false, process_data->gpio);
+        gpio_trace = (gpio_trace << 1) | 0;
+        gpio_trace = (gpio_trace << 1) | 0;
+        ++gpio_toggle_count;
+        break;
+
+      case RequestPinBehavior::ON_OFF:
+        cut_assert_false(is_gpio_active);
+        poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+        mock_gpio->expect_gpio_is_active(false, process_data->gpio);
+        gpio_trace = (gpio_trace << 1) | 1;
+        gpio_trace = (gpio_trace << 1) | 0;
+        gpio_toggle_count += 2;
+        break;
+    }
+
+    if((gpio_trace & (0x0f << 2)) == 0 && (gpio_trace & (0x03 << 0)) != 0)
+    {
+        /* didn't detect this before polling, so the message is emitted a bit
+         * later */
+        expect_detection_of_interrupt_by_slave(expected_master_serial);
+    }
+
+    if(!pending_slave_request_detected && gpio_toggle_count >= 3)
+    {
+        /* later pending second slave request */
+        expect_detection_of_pending_slave_request(expected_master_serial);
+        pending_slave_request_detected = true;
+    }
+
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
+    mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
+                                              "Collision detected (got funny poll bytes)");
+
+    if(!is_nack_expected)
+    {
+        snprintf(expected_message_buffer, sizeof(expected_message_buffer),
+                 "Silently dropping 0x%04x", expected_master_serial);
+        mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG, expected_message_buffer);
+    }
+
+    cppcut_assert_equal(TR_MASTER_COMMAND_FORWARDING_TO_SLAVE, process_data->transaction.state);
+    cppcut_assert_equal(expected_master_serial, process_data->transaction.serial);
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    mock_messages->check();
+    cppcut_assert_equal(TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE, process_data->transaction.state);
+
+    switch(gpio_trace)
+    {
+      case 0x00: /* ______ */
+        /* slave is very late to raise the request pin: no activation at all */
+        cppcut_assert_equal(REQSTATE_IDLE,         previous_request_state);
+        cppcut_assert_equal(REQSTATE_IDLE,         process_data->transaction.request_state);
+        break;
+
+      case 0x03: /* ____~~ */
+        /* late assertion: single activation, pending */
+        cppcut_assert_equal(REQSTATE_IDLE,         previous_request_state);
+        cppcut_assert_equal(REQSTATE_LOCKED,       process_data->transaction.request_state);
+        break;
+
+      case 0x3f: /* ~~~~~~ */
+      case 0x0f: /* __~~~~ */
+        /* early long assertion: single activation, pending */
+        cppcut_assert_equal(REQSTATE_LOCKED,       previous_request_state);
+        cppcut_assert_equal(REQSTATE_LOCKED,       process_data->transaction.request_state);
+        break;
+
+      case 0x02: /* ____~_ */
+        /* late short peak: single complete activation */
+        cppcut_assert_equal(REQSTATE_IDLE,         previous_request_state);
+        cppcut_assert_equal(REQSTATE_RELEASED,     process_data->transaction.request_state);
+        break;
+
+      case 0x20: /* ~_____ */
+      case 0x08: /* __~___ */
+      case 0x30: /* ~~____ */
+        /* early short peak: single complete activation */
+        cppcut_assert_equal(REQSTATE_RELEASED,     previous_request_state);
+        cppcut_assert_equal(REQSTATE_RELEASED,     process_data->transaction.request_state);
+        break;
+
+      case 0x3c: /* ~~~~__ */
+      case 0x0c: /* __~~__ */
+        /* early long peak: single complete activation */
+        cppcut_assert_equal(REQSTATE_LOCKED,       previous_request_state);
+        cppcut_assert_equal(REQSTATE_RELEASED,     process_data->transaction.request_state);
+        break;
+
+      case 0x23: /* ~___~~ */
+      case 0x33: /* ~~__~~ */
+      case 0x0b: /* __~_~~ */
+        /* rather early short peak, second assertion follows: one complete activation,
+         * second pending */
+        cppcut_assert_equal(REQSTATE_RELEASED,     previous_request_state);
+        cppcut_assert_equal(REQSTATE_NEXT_PENDING, process_data->transaction.request_state);
+        break;
+
+      case 0x31: /* ~~___~ */
+      case 0x3d: /* ~~~~_~ */
+      case 0x0d: /* __~~_~ */
+        /* rather early long peak, second assertion follows: one complete activation,
+         * second pending */
+        cppcut_assert_equal(REQSTATE_LOCKED,       previous_request_state);
+        cppcut_assert_equal(REQSTATE_NEXT_PENDING, process_data->transaction.request_state);
+        break;
+
+      case 0x2f: /* ~_~~~~ */
+      case 0x37: /* ~~_~~~ */
+        /* early short peak, second assertion follows quickly: one complete activation,
+         * second pending */
+        cppcut_assert_equal(REQSTATE_NEXT_PENDING, previous_request_state);
+        cppcut_assert_equal(REQSTATE_NEXT_PENDING, process_data->transaction.request_state);
+        break;
+
+      case 0x22: /* ~___~_ */
+      case 0x28: /* ~_~___ */
+        /* early short peak, second short peak follows: two complete activations */
+        cppcut_assert_equal(REQSTATE_RELEASED,     previous_request_state);
+        cppcut_assert_equal(REQSTATE_MISSED,       process_data->transaction.request_state);
+        break;
+
+      default:
+        {
+            char buffer[128];
+            snprintf(buffer, sizeof(buffer), "Invalid GPIO trace %s (0x%02x)",
+                     gpio_trace_to_ascii_art(gpio_trace, 6), gpio_trace);
+            cut_fail("%s", buffer);
+        }
+
+        break;
+    }
+
+    cppcut_assert_equal(size_of_interrupted_message + DCPSYNC_HEADER_SIZE,
+                        process_data->transaction.dcp_buffer.pos);
+    cppcut_assert_equal(uint16_t(0), process_data->transaction.serial);
+    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
+    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
+    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
+
+    if(is_nack_expected)
+    {
+        std::vector<uint8_t> master_command_nack;
+        wrap_data_into_protocol(master_command_nack, 'n',
+                                expected_nack_ttl, expected_master_serial);
+        cut_assert_equal_memory(master_command_nack.data(), master_command_nack.size(),
+                                os_write_buffer.data(), os_write_buffer.size());
+        os_write_buffer.clear();
+    }
+    else
+        cut_assert_true(os_write_buffer.empty());
+
+    mock_messages->check();
+    mock_gpio->check();
+    mock_spi_hw->check();
+    poll_results.check();
+}
+
+/*!\test
+ * Collision: Slave sends data bytes when being polled for ready state, GPIO
+ * request present, but not done before data is fetched from slave.
+ *
+ * Several variations with respect to timing are possible and are sometimes
+ * handled slightly differently, but the outcome should always be the same.
+ *
+ * See also ticket #161.
+ */
+static void
+collision_with_open_transaction_request(const RequestPinBehavior rpb_gpio_only_when_receiving_from_dcpd,
+                                        const RequestPinBehavior rpb_combined_when_receiving_from_dcpd,
+                                        const RequestPinBehavior rpb_when_sending_to_slave)
+{
+    const auto &prepared_data(prepare_for_collision(0xb934, UINT8_MAX));
+    const auto &network_status(std::get<0>(prepared_data));
+    const auto &interrupting_slave_command_suffix(std::get<1>(prepared_data));
+    const auto &wrapped_interrupting_slave_command(std::get<2>(prepared_data));
+
+    create_collision_state(network_status.size() + DCPSYNC_HEADER_SIZE,
+                           network_status.size(), 0xb934,
+                           rpb_gpio_only_when_receiving_from_dcpd,
+                           rpb_combined_when_receiving_from_dcpd,
+                           rpb_when_sending_to_slave, 9);
+
+    /* switch over to slave transaction: slave sends write command for UPnP
+     * friendly name, request pin still active */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, interrupting_slave_command_suffix);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 6, serial 0x0000, lock state 1, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Slave transaction: command header from SPI: 0x02 0x58 0x03 0x00");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
+    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN), process_data->transaction.serial);
+    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
+                            wrapped_interrupting_slave_command.size(),
+                            process_data->transaction.dcp_buffer.buffer,
+                            process_data->transaction.dcp_buffer.pos);
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+    mock_spi_hw->check();
+
+    /* slave transaction: send write command to DCPD */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 8, serial 0x0001, lock state 1, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "About to end transaction 0x0001 in state 8, waiting for slave to release request line");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_SLAVE_COMMAND_WAIT_FOR_REQUEST_DEASSERT, process_data->transaction.state);
+    cppcut_assert_equal(REQSTATE_LOCKED, process_data->transaction.request_state);
+    cppcut_assert_equal(wrapped_interrupting_slave_command.size(),
+                        process_data->transaction.dcp_buffer.pos);
+    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
+    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN), process_data->transaction.serial);
+    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
+    cppcut_assert_equal(size_t(wrapped_interrupting_slave_command.size()),
+                        process_data->transaction.flush_to_dcpd_buffer_pos);
+    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
+                            wrapped_interrupting_slave_command.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
+                            wrapped_interrupting_slave_command.size(),
+                            process_data->transaction.dcp_buffer.buffer,
+                            process_data->transaction.dcp_buffer.pos);
+    os_write_buffer.clear();
+    mock_messages->check();
+    mock_gpio->check();
+    poll_results.check();
+
+    /* nice, now the SPI slave releases its request line, a bit slow today */
+    cppcut_assert_equal(size_t(13), wrapped_interrupting_slave_command.size());
+    mock_messages->expect_msg_info_formatted("Waiting for slave to deassert the request pin");
+    mock_messages->expect_msg_info_formatted("Slave has deasserted the request pin");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 9, serial 0x0001, lock state 2, pending size 0, flush pos 13");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "End of transaction 0x0001 in state 9, return to idle state");
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(false, process_data->gpio);
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    mock_messages->check();
+    mock_gpio->check();
+    poll_results.check();
+
+    /* done */
+    expect_no_more_actions();
+}
+
+/*!
+ * Collision: Slave sends data bytes when being polled for ready state, GPIO
+ * request present and done before data is fetched from slave.
+ *
+ * Several variations with respect to timing are possible and are sometimes
+ * handled slightly differently, but the outcome should always be the same.
+ */
+static void
+collision_with_full_transaction_request(const RequestPinBehavior rpb_gpio_only_when_receiving_from_dcpd,
+                                        const RequestPinBehavior rpb_combined_when_receiving_from_dcpd,
+                                        const RequestPinBehavior rpb_when_sending_to_slave)
+{
+    const auto &prepared_data(prepare_for_collision(0xa678, UINT8_MAX));
+    const auto &network_status(std::get<0>(prepared_data));
+    const auto &interrupting_slave_command_suffix(std::get<1>(prepared_data));
+    const auto &wrapped_interrupting_slave_command(std::get<2>(prepared_data));
+
+    create_collision_state(network_status.size() + DCPSYNC_HEADER_SIZE,
+                           network_status.size(), 0xa678,
+                           rpb_gpio_only_when_receiving_from_dcpd,
+                           rpb_combined_when_receiving_from_dcpd,
+                           rpb_when_sending_to_slave, 9);
+
+    /* switch over to slave transaction: slave sends write command for UPnP
+     * friendly name, request pin not active anymore */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, interrupting_slave_command_suffix);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 6, serial 0x0000, lock state 2, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Slave transaction: command header from SPI: 0x02 0x58 0x03 0x00");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
+    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN), process_data->transaction.serial);
+    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
+                            wrapped_interrupting_slave_command.size(),
+                            process_data->transaction.dcp_buffer.buffer,
+                            process_data->transaction.dcp_buffer.pos);
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+    mock_spi_hw->check();
+
+    /* slave transaction: send write command to DCPD, and we are done */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 8, serial 0x0001, lock state 2, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "End of transaction 0x0001 in state 8, return to idle state");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
+    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
+    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_INVALID), process_data->transaction.serial);
+    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
+    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
+    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
+                            wrapped_interrupting_slave_command.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    cppcut_assert_equal(size_t(0), process_data->transaction.dcp_buffer.pos);
+    os_write_buffer.clear();
+    mock_messages->check();
+    mock_gpio->check();
+    poll_results.check();
+
+    /* done */
+    expect_no_more_actions();
+}
+
+/*!
+ * Collision: Slave sends data, request is closed and followed by next, open
+ * request.
+ *
+ * Happens if the slave decides to interrupt us with a burst of transactions
+ * and behaves civilized.
+ *
+ * Several variations with respect to timing are possible and are sometimes
+ * handled slightly differently, but the outcome should always be the same.
+ */
+static void collision_with_full_request_followed_by_open_request(
+        const RequestPinBehavior rpb_gpio_only_when_receiving_from_dcpd,
+        const RequestPinBehavior rpb_combined_when_receiving_from_dcpd,
+        const RequestPinBehavior rpb_when_sending_to_slave)
+{
+    const auto &prepared_data(prepare_for_collision(0xdf86, UINT8_MAX));
+    const auto &network_status(std::get<0>(prepared_data));
+    const auto &interrupting_slave_command_suffix(std::get<1>(prepared_data));
+    const auto &wrapped_interrupting_slave_command(std::get<2>(prepared_data));
+
+    create_collision_state(network_status.size() + DCPSYNC_HEADER_SIZE,
+                           network_status.size(), 0xdf86,
+                           rpb_gpio_only_when_receiving_from_dcpd,
+                           rpb_combined_when_receiving_from_dcpd,
+                           rpb_when_sending_to_slave, 9);
+
+    /* switch over to slave transaction: slave sends write command for UPnP
+     * friendly name, request pin still active */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, interrupting_slave_command_suffix);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 6, serial 0x0000, lock state 3, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Slave transaction: command header from SPI: 0x02 0x58 0x03 0x00");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
+    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN), process_data->transaction.serial);
+    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
+                            wrapped_interrupting_slave_command.size(),
+                            process_data->transaction.dcp_buffer.buffer,
+                            process_data->transaction.dcp_buffer.pos);
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+    mock_spi_hw->check();
+
+    /* slave transaction: send write command to DCPD */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 8, serial 0x0001, lock state 3, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "End of transaction 0x0001 in state 8, slave request pending");
+    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DIAG,
+                                    "Processing pending slave transaction");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 0, serial 0x0000, lock state 1, pending size 0, flush pos 0");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE, process_data->transaction.state);
+    cppcut_assert_equal(REQSTATE_LOCKED, process_data->transaction.request_state);
+    cppcut_assert_equal(size_t(0), process_data->transaction.dcp_buffer.pos);
+    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
+    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_INVALID), process_data->transaction.serial);
+    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
+    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
+    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
+                            wrapped_interrupting_slave_command.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
+    mock_messages->check();
+    mock_gpio->check();
+    poll_results.check();
+
+    /* pending slave transaction: slave sends write command for DRC command */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    static const std::array<uint8_t, 5> drcp_store_favorites
+    {
+        DCP_COMMAND_MULTI_WRITE_REGISTER, 0x48, 0x01, 0x00, 0x2c
+    };
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, drcp_store_favorites);
+    expect_wait_for_spi_slave(dummy_time);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 6, serial 0x0000, lock state 1, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Slave transaction: command header from SPI: 0x02 0x48 0x01 0x00");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(REQSTATE_LOCKED, process_data->transaction.request_state);
+    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN + 1), process_data->transaction.serial);
+    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+    poll_results.check();
+
+    /* pending slave transaction: slave deasserts request pin, we forward the
+     * command to DCPD */
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(false, process_data->gpio);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 8, serial 0x0002, lock state 2, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "End of transaction 0x0002 in state 8, return to idle state");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
+    std::vector<uint8_t> wrapped_drcp_store_favorites;
+    wrap_data_into_protocol(wrapped_drcp_store_favorites, 'c', 0,
+                            DCPSYNC_SLAVE_SERIAL_MIN + 1,
+                            drcp_store_favorites.begin(), drcp_store_favorites.size());
+    cut_assert_equal_memory(wrapped_drcp_store_favorites.data(),
+                            wrapped_drcp_store_favorites.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
+    mock_messages->check();
+    mock_gpio->check();
+    mock_spi_hw->check();
+    poll_results.check();
+
+    /* done */
+    expect_no_more_actions();
+}
+
+/*!\test
+ * Collision: Slave sends data bytes, request is very early and stays asserted.
+ */
+void test_collision_with_slow_early_request()
+{
+    collision_with_open_transaction_request(RequestPinBehavior::ON,
+                                            RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::UNCHANGED);
+}
+
+/*!\test
+ * Collision: Slave sends data bytes, request is early and stays asserted.
+ */
+void test_collision_with_slow_later_request()
+{
+    collision_with_open_transaction_request(RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::ON,
+                                            RequestPinBehavior::UNCHANGED);
+}
+
+/*!\test
+ * Collision: Slave sends data bytes, request is late and stays asserted.
+ */
+void test_collision_with_slow_late_request()
+{
+    collision_with_open_transaction_request(RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::ON);
+}
+
+/*!\test
+ * Collision: Slave sends data bytes, request is early and long.
+ */
+void test_collision_with_fast_early_request_release()
+{
+    collision_with_full_transaction_request(RequestPinBehavior::ON,
+                                            RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::OFF);
+}
+
+/*!\test
+ * Collision: Slave sends data bytes, request is early and not so long.
+ */
+void test_collision_with_faster_early_request_release()
+{
+    collision_with_full_transaction_request(RequestPinBehavior::ON,
+                                            RequestPinBehavior::OFF,
+                                            RequestPinBehavior::UNCHANGED);
+}
+
+/*!\test
+ * Collision: Slave sends data bytes, request is later and long.
+ */
+void test_collision_with_fast_later_request_release()
+{
+    collision_with_full_transaction_request(RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::ON,
+                                            RequestPinBehavior::OFF);
+}
+
+/*!\test
+ * Collision: Slave sends data bytes, request is early and short.
+ */
+void test_collision_with_very_fast_early_request_release()
+{
+    collision_with_full_transaction_request(RequestPinBehavior::ON_OFF,
+                                            RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::UNCHANGED);
+}
+
+/*!\test
+ * Collision: Slave sends data bytes, request is later and short.
+ */
+void test_collision_with_very_fast_later_request_release()
+{
+    collision_with_full_transaction_request(RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::ON_OFF,
+                                            RequestPinBehavior::UNCHANGED);
+}
+
+/*!\test
+ * Collision: Slave sends data bytes, request is late and short.
+ */
+void test_collision_with_very_fast_late_request_release()
+{
+    collision_with_full_transaction_request(RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::ON_OFF);
+}
+
+/*!\test
+ * Collision: Slave sends data, full request is followed by open request.
+ */
+void test_collision_with_follow_up_request_simple()
+{
+    collision_with_full_request_followed_by_open_request(RequestPinBehavior::ON,
+                                                         RequestPinBehavior::OFF,
+                                                         RequestPinBehavior::ON);
+}
+
+/*!\test
+ * Collision: Slave sends data, requests transaction, quickly requests next.
+ */
+void test_collision_with_follow_up_request_new_request_early_just_in_time()
+{
+    collision_with_full_request_followed_by_open_request(RequestPinBehavior::ON,
+                                                         RequestPinBehavior::OFF_ON,
+                                                         RequestPinBehavior::UNCHANGED);
+}
+
+/*!\test
+ * Collision: Slave sends data, requests transaction, quickly requests next.
+ */
+void test_collision_with_follow_up_request_new_request_late_just_in_time()
+{
+    collision_with_full_request_followed_by_open_request(RequestPinBehavior::ON,
+                                                         RequestPinBehavior::UNCHANGED,
+                                                         RequestPinBehavior::OFF_ON);
+}
+
+/*!\test
+ * Collision: Slave sends data, requests transaction, quickly requests next.
+ */
+void test_collision_with_follow_up_request_new_request_early()
+{
+    collision_with_full_request_followed_by_open_request(RequestPinBehavior::ON_OFF,
+                                                         RequestPinBehavior::ON,
+                                                         RequestPinBehavior::UNCHANGED);
+}
+
+/*!\test
+ * Collision: Slave sends data, requests transaction, quickly requests next.
+ */
+void test_collision_with_follow_up_request_new_request_late()
+{
+    collision_with_full_request_followed_by_open_request(RequestPinBehavior::ON_OFF,
+                                                         RequestPinBehavior::UNCHANGED,
+                                                         RequestPinBehavior::ON);
+}
+
+/*!\test
+ * Collision: Slave sends data, requests transaction, quickly requests next.
+ */
+void test_collision_with_follow_up_request_first_request_late()
+{
+    collision_with_full_request_followed_by_open_request(RequestPinBehavior::UNCHANGED,
+                                                         RequestPinBehavior::ON_OFF,
+                                                         RequestPinBehavior::ON);
+}
+
+/*!\test
+ * Collision: Slave sends data, requests transaction, quickly requests next.
+ */
+void test_collision_with_follow_up_request_first_request_late_new_request_just_in_time()
+{
+    collision_with_full_request_followed_by_open_request(RequestPinBehavior::UNCHANGED,
+                                                         RequestPinBehavior::ON,
+                                                         RequestPinBehavior::OFF_ON);
+}
+
+/*!
+ * Collision: Slave requests transaction, then requests the next one and sends
+ * the full second request together with the first one.
+ *
+ * This situation occurs in case the load on the Streaming Board is high and
+ * the slave is sending two subsequent requests quickly one after the other
+ * while a master transaction is about to start. In this case, dcpspi may not
+ * even see the first request and runs into an SPI collision. Two bytes are
+ * read by dcpspi, signaling to the slave that its GPIO request has been seen
+ * (even though it hasn't yet). The DCP header isn't fully there yet, so the
+ * next read from SPI slave is for a full chunk of 32 bytes. In the meantime,
+ * the slave has already prepared the next request and asserted the request pin
+ * again. It sends the rest of the first request and then sends the second
+ * request right after it.
+ *
+ * In theory (and rarely in practice), this effect can stack, meaning that
+ * multiple small requests may reside in the SPI input buffer for very unlucky
+ * timings and successive collisions. The communication temporarily falls out
+ * of sync as transaction requests are lost while processing some transaction
+ * because the Streaming Board fails to keep up with the speed of the SPI
+ * slave.
+ *
+ * The solution that dcpspi implements is that it peeks into the SPI input
+ * buffer after being done handling any requests performed after a collision if
+ * the request GPIO has been toggled in the meantime in such a way that lost
+ * transaction requests are indicated. If there is any pending request data, it
+ * will be processed. The input buffer must begin with one or two zeros (the
+ * ready signal) for this to work, otherwise it must be completely discarded
+ * (we cannot actively search for DCP messages in arbitrary buffers because the
+ * protocol lacks sync marks, and the binary nature of the protocol makes
+ * guessing risky).
+ */
+void test_collision_with_lost_and_found_slave_request()
+{
+    const auto &prepared_data(prepare_for_collision(0x920b, UINT8_MAX));
+    const auto &network_status(std::get<0>(prepared_data));
+    const auto &interrupting_slave_command_suffix(std::get<1>(prepared_data));
+    const auto &wrapped_interrupting_slave_command(std::get<2>(prepared_data));
+
+    create_collision_state(network_status.size() + DCPSYNC_HEADER_SIZE,
+                           network_status.size(), 0x920b,
+                           RequestPinBehavior::ON,
+                           RequestPinBehavior::OFF,
+                           RequestPinBehavior::UNCHANGED, 9);
+
+    /* next command tacked to the end of the first one, sent by slave because
+     * of unlucky timing; there could be a UINT8_MAX because first poll byte is
+     * usually that, and the 0x00 (sometimes 2 of them instead of UINT8_MAX) is
+     * the ready signal because the slave thought it's being polled */
+    static const std::array<uint8_t, 17> follow_up_slave_command
+    {
+        UINT8_MAX, 0x00, DCP_COMMAND_MULTI_WRITE_REGISTER, 0x79, 0x0b, 0x00,
+        0x51, 0xc3, 0x01, 0xa9, 0xe4, 0x2e, 0x03, 0x3a, 0x02, 0x01, 0xfb,
+    };
+    cppcut_assert_equal(size_t(6), interrupting_slave_command_suffix.size());
+    std::array<uint8_t, 6 + follow_up_slave_command.size()> two_commands;
+
+    std::copy_n(interrupting_slave_command_suffix.data(),
+                interrupting_slave_command_suffix.size(),
+                two_commands.begin());
+    std::copy_n(follow_up_slave_command.data(),
+                follow_up_slave_command.size(),
+                two_commands.begin() + interrupting_slave_command_suffix.size());
+
+    /* switch over to slave transaction: slave sends write command for UPnP
+     * friendly name */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, two_commands);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 6, serial 0x0000, lock state 2, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Slave transaction: command header from SPI: 0x02 0x58 0x03 0x00");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
+    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN), process_data->transaction.serial);
+    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
+                            wrapped_interrupting_slave_command.size(),
+                            process_data->transaction.dcp_buffer.buffer,
+                            process_data->transaction.dcp_buffer.pos);
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+    mock_spi_hw->check();
+
+    /* slave transaction: slave has prepared the next request and sends it
+     * while we are sending the first command to DCPD */
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(false, process_data->gpio);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Pending slave request while processing transaction 0x0001");
+    mock_messages->expect_msg_error_formatted(0, LOG_WARNING,
+        "Lost slave request while processing transaction 0x0001");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 8, serial 0x0001, lock state 4, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "End of transaction 0x0001 in state 8, looking for missed transactions");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 0, serial 0x0000, lock state 4, pending size 0, flush pos 0");
+    mock_messages->expect_msg_info_formatted("Possibly found lost packet(s) in SPI input buffer");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 6, serial 0x0000, lock state 2, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Slave transaction: command header from SPI: 0x02 0x79 0x0b 0x00");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    std::vector<uint8_t> wrapped_second_slave_command;
+    wrap_data_into_protocol(wrapped_second_slave_command, 'c', 0, DCPSYNC_SLAVE_SERIAL_MIN + 1,
+                            follow_up_slave_command.begin() + 2,
+                            follow_up_slave_command.size() - 2);
+    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
+    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN + 1), process_data->transaction.serial);
+    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
+                            wrapped_interrupting_slave_command.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
+    cut_assert_equal_memory(wrapped_second_slave_command.data(),
+                            wrapped_second_slave_command.size(),
+                            process_data->transaction.dcp_buffer.buffer,
+                            process_data->transaction.dcp_buffer.pos);
+    mock_messages->check();
+    mock_gpio->check();
+    mock_spi_hw->check();
+
+    /* second slave transaction: send to DCPD */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 8, serial 0x0002, lock state 2, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "End of transaction 0x0002 in state 8, return to idle state");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
+    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
+    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_INVALID), process_data->transaction.serial);
+    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
+    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
+    cut_assert_equal_memory(wrapped_second_slave_command.data(),
+                            wrapped_second_slave_command.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    cppcut_assert_equal(size_t(0), process_data->transaction.dcp_buffer.pos);
+    os_write_buffer.clear();
+    mock_messages->check();
+    mock_gpio->check();
+    poll_results.check();
+
+    /* done */
+    expect_no_more_actions();
+}
+
+/*!\test
+ * Lost slave request whose DCP header is split across SPI transfers.
+ *
+ * Like #test_collision_with_lost_and_found_slave_request(), but only the
+ * ready signal and the first two bytes of the DCP header made it into the SPI
+ * input buffer. The rest of the header must be read from SPI.
+ */
+void test_collision_with_lost_slave_request_with_header_split_across_transfers()
+{
+    const auto &prepared_data(prepare_for_collision(0x920b, UINT8_MAX));
+    const auto &network_status(std::get<0>(prepared_data));
+    const auto &interrupting_slave_command_suffix(std::get<1>(prepared_data));
+    const auto &wrapped_interrupting_slave_command(std::get<2>(prepared_data));
+
+    create_collision_state(network_status.size() + DCPSYNC_HEADER_SIZE,
+                           network_status.size(), 0x920b,
+                           RequestPinBehavior::ON,
+                           RequestPinBehavior::OFF,
+                           RequestPinBehavior::UNCHANGED, 9);
+
+    static const std::array<uint8_t, 15> follow_up_slave_command
+    {
+        DCP_COMMAND_MULTI_WRITE_REGISTER, 0x79, 0x0b, 0x00,
+        0x51, 0xc3, 0x01, 0xa9, 0xe4, 0x2e, 0x03, 0x3a, 0x02, 0x01, 0xfb,
+    };
+
+    /* ready signal and first half of the next DCP header at the end of the
+     * transfer, the rest follows in the next one */
+    cppcut_assert_equal(size_t(6), interrupting_slave_command_suffix.size());
+    std::array<uint8_t, 6 + 4> first_transfer;
+
+    std::copy_n(interrupting_slave_command_suffix.data(),
+                interrupting_slave_command_suffix.size(),
+                first_transfer.begin());
+    first_transfer[6] = UINT8_MAX;
+    first_transfer[7] = 0x00;
+    first_transfer[8] = follow_up_slave_command[0];
+    first_transfer[9] = follow_up_slave_command[1];
+
+    std::array<uint8_t, follow_up_slave_command.size() - 2> second_transfer;
+
+    std::copy_n(follow_up_slave_command.begin() + 2, second_transfer.size(),
+                second_transfer.begin());
+
+    /* switch over to slave transaction: slave sends write command for UPnP
+     * friendly name */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, first_transfer);
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
-    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DEBUG, process_transaction_message);
-    mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
-                                              "Collision detected (got funny poll bytes)");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 6, serial 0x0000, lock state 2, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Slave transaction: command header from SPI: 0x02 0x58 0x03 0x00");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
+    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
+                            wrapped_interrupting_slave_command.size(),
+                            process_data->transaction.dcp_buffer.buffer,
+                            process_data->transaction.dcp_buffer.pos);
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+    mock_spi_hw->check();
+
+    /* lost request is detected, the rest of its header is read from SPI */
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(false, process_data->gpio);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Pending slave request while processing transaction 0x0001");
+    mock_messages->expect_msg_error_formatted(0, LOG_WARNING,
+        "Lost slave request while processing transaction 0x0001");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 8, serial 0x0001, lock state 4, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "End of transaction 0x0001 in state 8, looking for missed transactions");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 0, serial 0x0000, lock state 4, pending size 0, flush pos 0");
+    mock_messages->expect_msg_info_formatted("Possibly found lost packet(s) in SPI input buffer");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 6, serial 0x0000, lock state 2, pending size 0, flush pos 0");
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, second_transfer);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Slave transaction: command header from SPI: 0x02 0x79 0x0b 0x00");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    std::vector<uint8_t> wrapped_second_slave_command;
+    wrap_data_into_protocol(wrapped_second_slave_command, 'c', 0, DCPSYNC_SLAVE_SERIAL_MIN + 1,
+                            follow_up_slave_command.data(),
+                            follow_up_slave_command.size());
+    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
+    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN + 1), process_data->transaction.serial);
+    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
+                            wrapped_interrupting_slave_command.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
+    cut_assert_equal_memory(wrapped_second_slave_command.data(),
+                            wrapped_second_slave_command.size(),
+                            process_data->transaction.dcp_buffer.buffer,
+                            process_data->transaction.dcp_buffer.pos);
+    mock_messages->check();
+    mock_gpio->check();
+    mock_spi_hw->check();
+
+    /* second slave transaction: send to DCPD */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 8, serial 0x0002, lock state 2, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "End of transaction 0x0002 in state 8, return to idle state");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
+    cut_assert_equal_memory(wrapped_second_slave_command.data(),
+                            wrapped_second_slave_command.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
+    mock_messages->check();
+    mock_gpio->check();
+    poll_results.check();
+
+    /* done */
+    expect_no_more_actions();
+}
+
+/*!\test
+ * Collision occurs, but DCPD doesn't want to know (anymore).
+ */
+void test_collision_with_command_ttl_of_0()
+{
+    const auto &prepared_data(prepare_for_collision(0x81f7, 0));
+    const auto &network_status(std::get<0>(prepared_data));
+
+    create_collision_state(network_status.size() + DCPSYNC_HEADER_SIZE,
+                           network_status.size(), 0x81f7,
+                           RequestPinBehavior::ON,
+                           RequestPinBehavior::UNCHANGED,
+                           RequestPinBehavior::OFF,
+                           23, false);
+
+    /* no NACK was sent, slave transaction should be processed next (we do not
+     * do this here, though, to keep the test small */
+}
+
+/*!\test
+ * Collision occurs, DCPD should not retry anymore.
+ */
+void test_collision_with_command_ttl_of_1()
+{
+    const auto &prepared_data(prepare_for_collision(0xf094, 1));
+    const auto &network_status(std::get<0>(prepared_data));
+
+    create_collision_state(network_status.size() + DCPSYNC_HEADER_SIZE,
+                           network_status.size(), 0xf094,
+                           RequestPinBehavior::ON,
+                           RequestPinBehavior::UNCHANGED,
+                           RequestPinBehavior::OFF,
+                           0);
+
+    /* final NACK was sent, slave transaction should be processed next (we do
+     * not do this here, though, to keep the test small */
+}
+
+/*!\test
+ * Collision occurs, master has sent a burst of packets without waiting for
+ * ACKs.
+ *
+ * This can happen because DCPD may want to push multiple packets into the pipe
+ * buffer in the hope of higher throughput as long as no collision occurs.
+ * In case of a collision with a slave transaction, however, the most recent
+ * master transaction is going to be rejected and DCPD must send it again.
+ *
+ * Note that this will lead to reordering of packets, leading to messed up data
+ * in case of long data fragmented over multiple packets (such as DRC data)>.
+ * Consequently, DCPD must make sure to synchronize on ACKs to avoid this where
+ * necessary.
+ *
+ * This test is a bit like #test_two_fast_master_transactions(), but with a
+ * collision strayed in.
+ */
+void test_collision_with_multiple_master_transactions_in_pipe_buffer()
+{
+    const auto &prepared_data(prepare_for_collision(0xc0e5, UINT8_MAX));
+    const auto &network_status(std::get<0>(prepared_data));
+    const auto &interrupting_slave_command_suffix(std::get<1>(prepared_data));
+    const auto &wrapped_interrupting_slave_command(std::get<2>(prepared_data));
+
+    static const std::array<uint8_t, 6> device_status
+    {
+        DCP_COMMAND_MULTI_READ_REGISTER, 0x11, 0x02, 0x00,
+        0x24, 0x42
+    };
+    std::vector<uint8_t> wrapped_device_status;
+    wrap_data_into_protocol(wrapped_device_status, 'c', UINT8_MAX, 0xc0e6,
+                            device_status.begin(), device_status.size());
+    std::copy_n(wrapped_device_status.begin(), wrapped_device_status.size(),
+                std::back_inserter(os_read_buffer));
+
+    create_collision_state(network_status.size() + DCPSYNC_HEADER_SIZE + wrapped_device_status.size(),
+                           network_status.size(), 0xc0e5,
+                           RequestPinBehavior::ON,
+                           RequestPinBehavior::UNCHANGED,
+                           RequestPinBehavior::OFF,
+                           9);
+
+    /* switch over to slave transaction: slave sends write command for UPnP
+     * friendly name, request pin not active anymore */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, interrupting_slave_command_suffix);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 6, serial 0x0000, lock state 2, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Slave transaction: command header from SPI: 0x02 0x58 0x03 0x00");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
+    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN), process_data->transaction.serial);
+    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
+                            wrapped_interrupting_slave_command.size(),
+                            process_data->transaction.dcp_buffer.buffer,
+                            process_data->transaction.dcp_buffer.pos);
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+    mock_spi_hw->check();
+
+    /* slave transaction: send write command to DCPD, and we are done */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 8, serial 0x0001, lock state 2, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "End of transaction 0x0001 in state 8, return to idle state");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
+    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
+    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_INVALID), process_data->transaction.serial);
+    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
+    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
+    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
+                            wrapped_interrupting_slave_command.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    cppcut_assert_equal(size_t(0), process_data->transaction.dcp_buffer.pos);
+    os_write_buffer.clear();
+    mock_messages->check();
+    mock_gpio->check();
+    poll_results.check();
+
+    /* slave transaction done, but there is another master transaction sitting
+     * in the pipe buffer */
+    cppcut_assert_equal(wrapped_device_status.size(), os_read_buffer.size());
+
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Master transaction: command header from DCPD: 0x03 0x11 0x02 0x00");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_MASTER_COMMAND_RECEIVING_DATA_FROM_DCPD, process_data->transaction.state);
+    cppcut_assert_equal(size_t(2), os_read_buffer.size());
+    cppcut_assert_equal(size_t(DCPSYNC_HEADER_SIZE + DCP_HEADER_SIZE),
+                        process_data->transaction.dcp_buffer.pos);
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+
+    /* process data from DCPD remaining in pipe buffer */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 2, serial 0xc0e6, lock state 0, pending size 2, flush pos 0");
 
-    if(!is_nack_expected)
-    {
-        snprintf(expected_message_buffer, sizeof(expected_message_buffer),
-                 "Silently dropping 0x%04x", expected_master_serial);
-        mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG, expected_message_buffer);
-    }
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
 
     cppcut_assert_equal(TR_MASTER_COMMAND_FORWARDING_TO_SLAVE, process_data->transaction.state);
-    cppcut_assert_equal(expected_master_serial, process_data->transaction.serial);
+    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
+    cut_assert_equal_memory(wrapped_device_status.data(), wrapped_device_status.size(),
+                            process_data->transaction.dcp_buffer.buffer,
+                            process_data->transaction.dcp_buffer.pos);
+    cppcut_assert_equal(uint16_t(0xc0e6), process_data->transaction.serial);
+    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
+    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
+    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
+    cppcut_assert_equal(size_t(0), os_read_buffer.size());
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+    poll_results.check();
+
+    /* send command to SPI slave, send ACK to DCPD */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    expect_wait_for_spi_slave(dummy_time);
+    spi_rw_data->set(device_status);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 3, serial 0xc0e6, lock state 0, pending size 0, flush pos 0");
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+    std::vector<uint8_t> master_command_ack;
+    wrap_data_into_protocol(master_command_ack, 'a', 0, 0xc0e6);
+    cut_assert_equal_memory(master_command_ack.data(), master_command_ack.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
     mock_messages->check();
-    cppcut_assert_equal(TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE, process_data->transaction.state);
+    mock_gpio->check();
+    mock_spi_hw->check();
+    poll_results.check();
 
-    switch(gpio_trace)
-    {
-      case 0x00: /* ______ */
-        /* slave is very late to raise the request pin: no activation at all */
-        cppcut_assert_equal(REQSTATE_IDLE,         previous_request_state);
-        cppcut_assert_equal(REQSTATE_IDLE,         process_data->transaction.request_state);
-        break;
+    /* done */
+    expect_no_more_actions();
+}
 
-      case 0x03: /* ____~~ */
-        /* late assertion: single activation, pending */
-        cppcut_assert_equal(REQSTATE_IDLE,         previous_request_state);
-        cppcut_assert_equal(REQSTATE_LOCKED,       process_data->transaction.request_state);
-        break;
+static std::vector<std::vector<uint8_t>> expected_burst_packets;
 
-      case 0x3f: /* ~~~~~~ */
-      case 0x0f: /* __~~~~ */
-        /* early long assertion: single activation, pending */
-        cppcut_assert_equal(REQSTATE_LOCKED,       previous_request_state);
-        cppcut_assert_equal(REQSTATE_LOCKED,       process_data->transaction.request_state);
-        break;
+static int check_burst_transfer(int fd, const struct spi_ioc_transfer spi_transfer[],
+                                size_t number_of_fragments)
+{
+    cppcut_assert_equal(expected_spi_fd, fd);
+    cppcut_assert_equal(expected_burst_packets.size(), number_of_fragments);
 
-      case 0x02: /* ____~_ */
-        /* late short peak: single complete activation */
-        cppcut_assert_equal(REQSTATE_IDLE,         previous_request_state);
-        cppcut_assert_equal(REQSTATE_RELEASED,     process_data->transaction.request_state);
-        break;
+    int total = 0;
 
-      case 0x20: /* ~_____ */
-      case 0x08: /* __~___ */
-      case 0x30: /* ~~____ */
-        /* early short peak: single complete activation */
-        cppcut_assert_equal(REQSTATE_RELEASED,     previous_request_state);
-        cppcut_assert_equal(REQSTATE_RELEASED,     process_data->transaction.request_state);
-        break;
+    for(size_t i = 0; i < number_of_fragments; ++i)
+    {
+        const auto &packet(expected_burst_packets[i]);
 
-      case 0x3c: /* ~~~~__ */
-      case 0x0c: /* __~~__ */
-        /* early long peak: single complete activation */
-        cppcut_assert_equal(REQSTATE_LOCKED,       previous_request_state);
-        cppcut_assert_equal(REQSTATE_RELEASED,     process_data->transaction.request_state);
-        break;
+        cut_assert_equal_memory(packet.data(), packet.size(),
+                                reinterpret_cast<const void *>(spi_transfer[i].tx_buf),
+                                spi_transfer[i].len);
+        total += spi_transfer[i].len;
+    }
 
-      case 0x23: /* ~___~~ */
-      case 0x33: /* ~~__~~ */
-      case 0x0b: /* __~_~~ */
-        /* rather early short peak, second assertion follows: one complete activation,
-         * second pending */
-        cppcut_assert_equal(REQSTATE_RELEASED,     previous_request_state);
-        cppcut_assert_equal(REQSTATE_NEXT_PENDING, process_data->transaction.request_state);
-        break;
+    return total;
+}
 
-      case 0x31: /* ~~___~ */
-      case 0x3d: /* ~~~~_~ */
-      case 0x0d: /* __~~_~ */
-        /* rather early long peak, second assertion follows: one complete activation,
-         * second pending */
-        cppcut_assert_equal(REQSTATE_LOCKED,       previous_request_state);
-        cppcut_assert_equal(REQSTATE_NEXT_PENDING, process_data->transaction.request_state);
-        break;
+/*!\test
+ * In burst mode, two master transactions queued by DCPD are sent to the slave
+ * after a single handshake, and each is ACKed.
+ */
+void test_two_fast_master_transactions_in_one_burst()
+{
+    dcpspi_read_ahead_enable(true);
+    cppcut_assert_equal(size_t(0), dcpspi_burst_enable(64));
 
-      case 0x2f: /* ~_~~~~ */
-      case 0x37: /* ~~_~~~ */
-        /* early short peak, second assertion follows quickly: one complete activation,
-         * second pending */
-        cppcut_assert_equal(REQSTATE_NEXT_PENDING, previous_request_state);
-        cppcut_assert_equal(REQSTATE_NEXT_PENDING, process_data->transaction.request_state);
-        break;
+    static const std::array<uint8_t, 6> network_status
+    {
+        DCP_COMMAND_MULTI_READ_REGISTER, 0x32, 0x02, 0x00,
+        0x02, 0x01
+    };
+    static const std::array<uint8_t, 6> device_status
+    {
+        DCP_COMMAND_MULTI_READ_REGISTER, 0x11, 0x02, 0x00,
+        0x24, 0x42
+    };
+    std::vector<uint8_t> wrapped_network_status;
+    wrap_data_into_protocol(wrapped_network_status, 'c', UINT8_MAX, 0xc830,
+                            network_status.begin(), network_status.size());
+    std::vector<uint8_t> wrapped_device_status;
+    wrap_data_into_protocol(wrapped_device_status, 'c', UINT8_MAX, 0xc831,
+                            device_status.begin(), device_status.size());
+    std::copy_n(wrapped_network_status.begin(), wrapped_network_status.size(),
+                std::back_inserter(os_read_buffer));
+    std::copy_n(wrapped_device_status.begin(), wrapped_device_status.size(),
+                std::back_inserter(os_read_buffer));
 
-      case 0x22: /* ~___~_ */
-      case 0x28: /* ~_~___ */
-        /* early short peak, second short peak follows: two complete activations */
-        cppcut_assert_equal(REQSTATE_RELEASED,     previous_request_state);
-        cppcut_assert_equal(REQSTATE_MISSED,       process_data->transaction.request_state);
-        break;
+    /* DCPD has written two packets, we are woken up once */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Master transaction: command header from DCPD: 0x03 0x32 0x02 0x00");
 
-      default:
-        {
-            char buffer[128];
-            snprintf(buffer, sizeof(buffer), "Invalid GPIO trace %s (0x%02x)",
-                     gpio_trace_to_ascii_art(gpio_trace, 6), gpio_trace);
-            cut_fail("%s", buffer);
-        }
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
 
-        break;
-    }
+    cppcut_assert_equal(TR_MASTER_COMMAND_RECEIVING_DATA_FROM_DCPD, process_data->transaction.state);
+    cut_assert_true(os_read_buffer.empty());
+    mock_messages->check();
+    poll_results.check();
 
-    cppcut_assert_equal(size_of_interrupted_message + DCPSYNC_HEADER_SIZE,
-                        process_data->transaction.dcp_buffer.pos);
-    cppcut_assert_equal(uint16_t(0), process_data->transaction.serial);
-    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
-    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
-    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
+    /* payload of first packet, taken from read-ahead buffer */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 2, serial 0xc830, lock state 0, pending size 2, flush pos 0");
 
-    if(is_nack_expected)
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_MASTER_COMMAND_FORWARDING_TO_SLAVE, process_data->transaction.state);
+    mock_messages->check();
+    poll_results.check();
+
+    /* both packets are sent after one handshake, one fragment per packet */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    expect_wait_for_spi_slave(dummy_time);
+    expected_burst_packets =
     {
-        std::vector<uint8_t> master_command_nack;
-        wrap_data_into_protocol(master_command_nack, 'n',
-                                expected_nack_ttl, expected_master_serial);
-        cut_assert_equal_memory(master_command_nack.data(), master_command_nack.size(),
-                                os_write_buffer.data(), os_write_buffer.size());
-        os_write_buffer.clear();
-    }
-    else
-        cut_assert_true(os_write_buffer.empty());
+        std::vector<uint8_t>(network_status.begin(), network_status.end()),
+        std::vector<uint8_t>(device_status.begin(), device_status.end()),
+    };
+    mock_spi_hw->expect_spi_hw_do_transfer_fragments(expected_spi_fd,
+        {
+            { network_status.size(), 0, true,  true, false, },
+            { device_status.size(),  0, false, true, false, },
+        },
+        check_burst_transfer);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 3, serial 0xc830, lock state 0, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Master transaction: sending 2 packets, 12 bytes in one burst");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
 
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+    std::vector<uint8_t> master_command_acks;
+    wrap_data_into_protocol(master_command_acks, 'a', 0, 0xc830);
+    wrap_data_into_protocol(master_command_acks, 'a', 0, 0xc831);
+    cut_assert_equal_memory(master_command_acks.data(), master_command_acks.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
     mock_messages->check();
-    mock_gpio->check();
     mock_spi_hw->check();
     poll_results.check();
+
+    cppcut_assert_equal(1U, os_read_calls);
+
+    /* done, second packet is not processed again */
+    expect_no_more_actions();
 }
 
 /*!\test
- * Collision: Slave sends data bytes when being polled for ready state, GPIO
- * request present, but not done before data is fetched from slave.
- *
- * Several variations with respect to timing are possible and are sometimes
- * handled slightly differently, but the outcome should always be the same.
- *
- * See also ticket #161.
+ * A collision detected during the handshake for a burst rejects the first
+ * packet only; the other packet remains queued with its TTL untouched and is
+ * sent after the slave transaction.
  */
-static void
-collision_with_open_transaction_request(const RequestPinBehavior rpb_gpio_only_when_receiving_from_dcpd,
-                                        const RequestPinBehavior rpb_combined_when_receiving_from_dcpd,
-                                        const RequestPinBehavior rpb_when_sending_to_slave)
+void test_collision_before_burst_rejects_first_packet_only()
 {
-    const auto &prepared_data(prepare_for_collision(0xb934, UINT8_MAX));
-    const auto &network_status(std::get<0>(prepared_data));
+    dcpspi_read_ahead_enable(true);
+    dcpspi_burst_enable(64);
+
+    const auto &prepared_data(prepare_for_collision(0xc0e5, UINT8_MAX));
     const auto &interrupting_slave_command_suffix(std::get<1>(prepared_data));
     const auto &wrapped_interrupting_slave_command(std::get<2>(prepared_data));
 
-    create_collision_state(network_status.size() + DCPSYNC_HEADER_SIZE,
-                           network_status.size(), 0xb934,
-                           rpb_gpio_only_when_receiving_from_dcpd,
-                           rpb_combined_when_receiving_from_dcpd,
-                           rpb_when_sending_to_slave, 9);
+    static const std::array<uint8_t, 6> device_status
+    {
+        DCP_COMMAND_MULTI_READ_REGISTER, 0x11, 0x02, 0x00,
+        0x24, 0x42
+    };
+    std::vector<uint8_t> wrapped_device_status;
+    wrap_data_into_protocol(wrapped_device_status, 'c', 3, 0xc0e6,
+                            device_status.begin(), device_status.size());
+    std::copy_n(wrapped_device_status.begin(), wrapped_device_status.size(),
+                std::back_inserter(os_read_buffer));
 
-    /* switch over to slave transaction: slave sends write command for UPnP
-     * friendly name, request pin still active */
+    /* DCPD sends two packets through its pipe */
     poll_results.expect(std::move(PollResult().set_return_value(0)));
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
-    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, interrupting_slave_command_suffix);
-    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 6, serial 0x0000, lock state 1, pending size 0, flush pos 0");
+        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
-        "Slave transaction: command header from SPI: 0x02 0x58 0x03 0x00");
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
+        "Master transaction: command header from DCPD: 0x03 0x32 0x02 0x00");
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
-    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
-    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN), process_data->transaction.serial);
-    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
-                            wrapped_interrupting_slave_command.size(),
-                            process_data->transaction.dcp_buffer.buffer,
-                            process_data->transaction.dcp_buffer.pos);
-    cut_assert_true(os_write_buffer.empty());
+    cppcut_assert_equal(TR_MASTER_COMMAND_RECEIVING_DATA_FROM_DCPD, process_data->transaction.state);
+    cut_assert_true(os_read_buffer.empty());
     mock_messages->check();
-    mock_gpio->check();
-    mock_spi_hw->check();
+    poll_results.check();
 
-    /* slave transaction: send write command to DCPD */
-    poll_results.expect(std::move(PollResult().set_return_value(0)));
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 8, serial 0x0001, lock state 1, pending size 0, flush pos 0");
+    /* slave asserts request line while we are taking the payload */
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(true, process_data->gpio);
+    expect_detection_of_interrupt_by_slave(0xc0e5);
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "About to end transaction 0x0001 in state 8, waiting for slave to release request line");
+        "Process transaction state 2, serial 0xc0e5, lock state 1, pending size 2, flush pos 0");
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
-    cppcut_assert_equal(TR_SLAVE_COMMAND_WAIT_FOR_REQUEST_DEASSERT, process_data->transaction.state);
+    cppcut_assert_equal(TR_MASTER_COMMAND_FORWARDING_TO_SLAVE, process_data->transaction.state);
     cppcut_assert_equal(REQSTATE_LOCKED, process_data->transaction.request_state);
-    cppcut_assert_equal(wrapped_interrupting_slave_command.size(),
-                        process_data->transaction.dcp_buffer.pos);
-    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
-    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN), process_data->transaction.serial);
-    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
-    cppcut_assert_equal(size_t(wrapped_interrupting_slave_command.size()),
-                        process_data->transaction.flush_to_dcpd_buffer_pos);
-    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
-                            wrapped_interrupting_slave_command.size(),
-                            os_write_buffer.data(), os_write_buffer.size());
-    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
-                            wrapped_interrupting_slave_command.size(),
-                            process_data->transaction.dcp_buffer.buffer,
-                            process_data->transaction.dcp_buffer.pos);
-    os_write_buffer.clear();
     mock_messages->check();
     mock_gpio->check();
     poll_results.check();
 
-    /* nice, now the SPI slave releases its request line, a bit slow today */
-    cppcut_assert_equal(size_t(13), wrapped_interrupting_slave_command.size());
-    mock_messages->expect_msg_info_formatted("Waiting for slave to deassert the request pin");
-    mock_messages->expect_msg_info_formatted("Slave has deasserted the request pin");
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 9, serial 0x0001, lock state 2, pending size 0, flush pos 13");
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "End of transaction 0x0001 in state 9, return to idle state");
+    /* the handshake for the burst runs into the collision, request line is
+     * released meanwhile; only the first packet is rejected */
     poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
     mock_gpio->expect_gpio_is_active(false, process_data->gpio);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 3, serial 0xc0e5, lock state 2, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Master transaction: sending 2 packets, 12 bytes in one burst");
+    mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
+                                              "Collision detected (got funny poll bytes)");
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
+    cppcut_assert_equal(TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE, process_data->transaction.state);
+    cppcut_assert_equal(REQSTATE_RELEASED, process_data->transaction.request_state);
+    std::vector<uint8_t> master_command_nack;
+    wrap_data_into_protocol(master_command_nack, 'n', 9, 0xc0e5);
+    cut_assert_equal_memory(master_command_nack.data(), master_command_nack.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
     mock_messages->check();
     mock_gpio->check();
+    mock_spi_hw->check();
     poll_results.check();
 
-    /* done */
-    expect_no_more_actions();
-}
-
-/*!
- * Collision: Slave sends data bytes when being polled for ready state, GPIO
- * request present and done before data is fetched from slave.
- *
- * Several variations with respect to timing are possible and are sometimes
- * handled slightly differently, but the outcome should always be the same.
- */
-static void
-collision_with_full_transaction_request(const RequestPinBehavior rpb_gpio_only_when_receiving_from_dcpd,
-                                        const RequestPinBehavior rpb_combined_when_receiving_from_dcpd,
-                                        const RequestPinBehavior rpb_when_sending_to_slave)
-{
-    const auto &prepared_data(prepare_for_collision(0xa678, UINT8_MAX));
-    const auto &network_status(std::get<0>(prepared_data));
-    const auto &interrupting_slave_command_suffix(std::get<1>(prepared_data));
-    const auto &wrapped_interrupting_slave_command(std::get<2>(prepared_data));
-
-    create_collision_state(network_status.size() + DCPSYNC_HEADER_SIZE,
-                           network_status.size(), 0xa678,
-                           rpb_gpio_only_when_receiving_from_dcpd,
-                           rpb_combined_when_receiving_from_dcpd,
-                           rpb_when_sending_to_slave, 9);
-
-    /* switch over to slave transaction: slave sends write command for UPnP
-     * friendly name, request pin not active anymore */
+    /* slave transaction */
     poll_results.expect(std::move(PollResult().set_return_value(0)));
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
     spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, interrupting_slave_command_suffix);
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
         "Process transaction state 6, serial 0x0000, lock state 2, pending size 0, flush pos 0");
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
         "Slave transaction: command header from SPI: 0x02 0x58 0x03 0x00");
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
     cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
-    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN), process_data->transaction.serial);
-    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
-                            wrapped_interrupting_slave_command.size(),
-                            process_data->transaction.dcp_buffer.buffer,
-                            process_data->transaction.dcp_buffer.pos);
-    cut_assert_true(os_write_buffer.empty());
     mock_messages->check();
-    mock_gpio->check();
     mock_spi_hw->check();
 
-    /* slave transaction: send write command to DCPD, and we are done */
     poll_results.expect(std::move(PollResult().set_return_value(0)));
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
         "Process transaction state 8, serial 0x0001, lock state 2, pending size 0, flush pos 0");
@@ -1468,696 +3477,592 @@ collision_with_full_transaction_request(const RequestPinBehavior rpb_gpio_only_w
                                    &process_data->rldata));
 
     cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
-    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
-    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
-    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_INVALID), process_data->transaction.serial);
-    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
-    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
     cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
                             wrapped_interrupting_slave_command.size(),
                             os_write_buffer.data(), os_write_buffer.size());
-    cppcut_assert_equal(size_t(0), process_data->transaction.dcp_buffer.pos);
     os_write_buffer.clear();
     mock_messages->check();
-    mock_gpio->check();
     poll_results.check();
 
-    /* done */
-    expect_no_more_actions();
-}
+    /* second packet is still there, taken from read-ahead buffer */
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Master transaction: command header from DCPD: 0x03 0x11 0x02 0x00");
 
-/*!
- * Collision: Slave sends data, request is closed and followed by next, open
- * request.
- *
- * Happens if the slave decides to interrupt us with a burst of transactions
- * and behaves civilized.
- *
- * Several variations with respect to timing are possible and are sometimes
- * handled slightly differently, but the outcome should always be the same.
- */
-static void collision_with_full_request_followed_by_open_request(
-        const RequestPinBehavior rpb_gpio_only_when_receiving_from_dcpd,
-        const RequestPinBehavior rpb_combined_when_receiving_from_dcpd,
-        const RequestPinBehavior rpb_when_sending_to_slave)
-{
-    const auto &prepared_data(prepare_for_collision(0xdf86, UINT8_MAX));
-    const auto &network_status(std::get<0>(prepared_data));
-    const auto &interrupting_slave_command_suffix(std::get<1>(prepared_data));
-    const auto &wrapped_interrupting_slave_command(std::get<2>(prepared_data));
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
 
-    create_collision_state(network_status.size() + DCPSYNC_HEADER_SIZE,
-                           network_status.size(), 0xdf86,
-                           rpb_gpio_only_when_receiving_from_dcpd,
-                           rpb_combined_when_receiving_from_dcpd,
-                           rpb_when_sending_to_slave, 9);
+    cppcut_assert_equal(TR_MASTER_COMMAND_RECEIVING_DATA_FROM_DCPD, process_data->transaction.state);
+    cppcut_assert_equal(uint8_t(3), process_data->transaction.ttl);
+    mock_messages->check();
+    poll_results.check();
 
-    /* switch over to slave transaction: slave sends write command for UPnP
-     * friendly name, request pin still active */
     poll_results.expect(std::move(PollResult().set_return_value(0)));
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
-    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, interrupting_slave_command_suffix);
-    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 6, serial 0x0000, lock state 3, pending size 0, flush pos 0");
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
-        "Slave transaction: command header from SPI: 0x02 0x58 0x03 0x00");
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
+        "Process transaction state 2, serial 0xc0e6, lock state 0, pending size 2, flush pos 0");
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
-    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
-    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN), process_data->transaction.serial);
-    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
-                            wrapped_interrupting_slave_command.size(),
-                            process_data->transaction.dcp_buffer.buffer,
-                            process_data->transaction.dcp_buffer.pos);
-    cut_assert_true(os_write_buffer.empty());
+    cppcut_assert_equal(TR_MASTER_COMMAND_FORWARDING_TO_SLAVE, process_data->transaction.state);
     mock_messages->check();
-    mock_gpio->check();
-    mock_spi_hw->check();
+    poll_results.check();
 
-    /* slave transaction: send write command to DCPD */
     poll_results.expect(std::move(PollResult().set_return_value(0)));
+    expect_wait_for_spi_slave(dummy_time);
+    spi_rw_data->set(device_status);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 8, serial 0x0001, lock state 3, pending size 0, flush pos 0");
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "End of transaction 0x0001 in state 8, slave request pending");
-    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DIAG,
-                                    "Processing pending slave transaction");
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 0, serial 0x0000, lock state 1, pending size 0, flush pos 0");
+        "Process transaction state 3, serial 0xc0e6, lock state 0, pending size 0, flush pos 0");
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
-    cppcut_assert_equal(TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE, process_data->transaction.state);
-    cppcut_assert_equal(REQSTATE_LOCKED, process_data->transaction.request_state);
-    cppcut_assert_equal(size_t(0), process_data->transaction.dcp_buffer.pos);
-    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
-    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_INVALID), process_data->transaction.serial);
-    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
-    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
-    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
-                            wrapped_interrupting_slave_command.size(),
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+    std::vector<uint8_t> master_command_ack;
+    wrap_data_into_protocol(master_command_ack, 'a', 0, 0xc0e6);
+    cut_assert_equal_memory(master_command_ack.data(), master_command_ack.size(),
                             os_write_buffer.data(), os_write_buffer.size());
     os_write_buffer.clear();
     mock_messages->check();
-    mock_gpio->check();
+    mock_spi_hw->check();
     poll_results.check();
 
-    /* pending slave transaction: slave sends write command for DRC command */
+    cppcut_assert_equal(1U, os_read_calls);
+
+    expect_no_more_actions();
+}
+
+static const uint8_t *expected_first_fragment_buffer;
+
+static int check_escaped_transfer(int fd, const struct spi_ioc_transfer spi_transfer[],
+                                  size_t number_of_fragments)
+{
+    const int ret = check_burst_transfer(fd, spi_transfer, number_of_fragments);
+
+    cppcut_assert_equal(static_cast<const void *>(expected_first_fragment_buffer),
+                        reinterpret_cast<const void *>(spi_transfer[0].tx_buf));
+
+    return ret;
+}
+
+/*!
+ * Send a master packet with special characters in its payload to the slave.
+ */
+static void run_master_transaction_with_escapes(const std::vector<uint8_t> &command,
+                                                std::vector<std::vector<uint8_t>> &&expected_fragments,
+                                                const uint8_t *expected_first_fragment)
+{
+    dcpspi_read_ahead_enable(true);
+
+    std::vector<uint8_t> wrapped_command;
+    wrap_data_into_protocol(wrapped_command, 'c', UINT8_MAX, 0x5a2e,
+                            command.data(), command.size());
+    std::copy_n(wrapped_command.begin(), wrapped_command.size(),
+                std::back_inserter(os_read_buffer));
+
     poll_results.expect(std::move(PollResult().set_return_value(0)));
-    static const std::array<uint8_t, 5> drcp_store_favorites
-    {
-        DCP_COMMAND_MULTI_WRITE_REGISTER, 0x48, 0x01, 0x00, 0x2c
-    };
-    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, drcp_store_favorites);
-    expect_wait_for_spi_slave(dummy_time);
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 6, serial 0x0000, lock state 1, pending size 0, flush pos 0");
+        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
-        "Slave transaction: command header from SPI: 0x02 0x48 0x01 0x00");
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
+        "Master transaction: command header from DCPD: 0x02 0x58 0x09 0x00");
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
-    cppcut_assert_equal(REQSTATE_LOCKED, process_data->transaction.request_state);
-    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN + 1), process_data->transaction.serial);
-    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
-    cut_assert_true(os_write_buffer.empty());
+    cppcut_assert_equal(TR_MASTER_COMMAND_RECEIVING_DATA_FROM_DCPD, process_data->transaction.state);
     mock_messages->check();
-    mock_gpio->check();
     poll_results.check();
 
-    /* pending slave transaction: slave deasserts request pin, we forward the
-     * command to DCPD */
-    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
-    mock_gpio->expect_gpio_is_active(false, process_data->gpio);
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 8, serial 0x0002, lock state 2, pending size 0, flush pos 0");
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "End of transaction 0x0002 in state 8, return to idle state");
+        "Process transaction state 2, serial 0x5a2e, lock state 0, pending size 9, flush pos 0");
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
-    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
-    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
-    std::vector<uint8_t> wrapped_drcp_store_favorites;
-    wrap_data_into_protocol(wrapped_drcp_store_favorites, 'c', 0,
-                            DCPSYNC_SLAVE_SERIAL_MIN + 1,
-                            drcp_store_favorites.begin(), drcp_store_favorites.size());
-    cut_assert_equal_memory(wrapped_drcp_store_favorites.data(),
-                            wrapped_drcp_store_favorites.size(),
-                            os_write_buffer.data(), os_write_buffer.size());
-    os_write_buffer.clear();
+    cppcut_assert_equal(TR_MASTER_COMMAND_FORWARDING_TO_SLAVE, process_data->transaction.state);
     mock_messages->check();
-    mock_gpio->check();
-    mock_spi_hw->check();
     poll_results.check();
 
-    /* done */
-    expect_no_more_actions();
-}
+    /* chip select is held across all fragments */
+    std::vector<MockSPIHW::Fragment> layout;
 
-/*!\test
- * Collision: Slave sends data bytes, request is very early and stays asserted.
- */
-void test_collision_with_slow_early_request()
-{
-    collision_with_open_transaction_request(RequestPinBehavior::ON,
-                                            RequestPinBehavior::UNCHANGED,
-                                            RequestPinBehavior::UNCHANGED);
-}
+    for(const auto &fragment : expected_fragments)
+        layout.push_back({ fragment.size(), 0, false, true, false, });
 
-/*!\test
- * Collision: Slave sends data bytes, request is early and stays asserted.
- */
-void test_collision_with_slow_later_request()
-{
-    collision_with_open_transaction_request(RequestPinBehavior::UNCHANGED,
-                                            RequestPinBehavior::ON,
-                                            RequestPinBehavior::UNCHANGED);
-}
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    expect_wait_for_spi_slave(dummy_time);
+    expected_burst_packets = std::move(expected_fragments);
+    expected_first_fragment_buffer = expected_first_fragment;
+    mock_spi_hw->expect_spi_hw_do_transfer_fragments(expected_spi_fd,
+                                                     std::move(layout),
+                                                     check_escaped_transfer);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 3, serial 0x5a2e, lock state 0, pending size 0, flush pos 0");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+    std::vector<uint8_t> master_command_ack;
+    wrap_data_into_protocol(master_command_ack, 'a', 0, 0x5a2e);
+    cut_assert_equal_memory(master_command_ack.data(), master_command_ack.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
+    mock_messages->check();
+    mock_spi_hw->check();
+    poll_results.check();
 
-/*!\test
- * Collision: Slave sends data bytes, request is late and stays asserted.
- */
-void test_collision_with_slow_late_request()
-{
-    collision_with_open_transaction_request(RequestPinBehavior::UNCHANGED,
-                                            RequestPinBehavior::UNCHANGED,
-                                            RequestPinBehavior::ON);
+    expect_no_more_actions();
 }
 
 /*!\test
- * Collision: Slave sends data bytes, request is early and long.
+ * Master packets are sent straight from the DCP buffer, with escape sequences
+ * in fragments of their own.
  */
-void test_collision_with_fast_early_request_release()
+void test_master_packet_with_escapes_is_sent_without_copying()
 {
-    collision_with_full_transaction_request(RequestPinBehavior::ON,
-                                            RequestPinBehavior::UNCHANGED,
-                                            RequestPinBehavior::OFF);
-}
+    static const std::vector<uint8_t> command
+    {
+        DCP_COMMAND_MULTI_WRITE_REGISTER, 0x58, 0x09, 0x00,
+        0x61, 0x62, DCP_ESCAPE_CHARACTER, 0x63, 0x64, UINT8_MAX, UINT8_MAX,
+        0x65, 0x66,
+    };
 
-/*!\test
- * Collision: Slave sends data bytes, request is early and not so long.
- */
-void test_collision_with_faster_early_request_release()
-{
-    collision_with_full_transaction_request(RequestPinBehavior::ON,
-                                            RequestPinBehavior::OFF,
-                                            RequestPinBehavior::UNCHANGED);
+    run_master_transaction_with_escapes(command,
+        {
+            { DCP_COMMAND_MULTI_WRITE_REGISTER, 0x58, 0x09, 0x00, 0x61, 0x62, },
+            { DCP_ESCAPE_CHARACTER, DCP_ESCAPE_CHARACTER, },
+            { 0x63, 0x64, },
+            { DCP_ESCAPE_CHARACTER, 0x01, },
+            { DCP_ESCAPE_CHARACTER, 0x01, },
+            { 0x65, 0x66, },
+        },
+        process_data->transaction.dcp_buffer.buffer + DCPSYNC_HEADER_SIZE);
 }
 
 /*!\test
- * Collision: Slave sends data bytes, request is later and long.
+ * Master packets with too many special characters for sending them in
+ * fragments are escaped into the SPI buffer and sent in one go.
  */
-void test_collision_with_fast_later_request_release()
+void test_master_packet_with_many_escapes_is_copied()
 {
-    collision_with_full_transaction_request(RequestPinBehavior::UNCHANGED,
-                                            RequestPinBehavior::ON,
-                                            RequestPinBehavior::OFF);
-}
+    static const std::vector<uint8_t> command
+    {
+        DCP_COMMAND_MULTI_WRITE_REGISTER, 0x58, 0x09, 0x00,
+        0x61, UINT8_MAX, 0x62, UINT8_MAX, 0x63, UINT8_MAX, 0x64, UINT8_MAX,
+        0x65,
+    };
 
-/*!\test
- * Collision: Slave sends data bytes, request is early and short.
- */
-void test_collision_with_very_fast_early_request_release()
-{
-    collision_with_full_transaction_request(RequestPinBehavior::ON_OFF,
-                                            RequestPinBehavior::UNCHANGED,
-                                            RequestPinBehavior::UNCHANGED);
+    run_master_transaction_with_escapes(command,
+        {
+            {
+                DCP_COMMAND_MULTI_WRITE_REGISTER, 0x58, 0x09, 0x00,
+                0x61, DCP_ESCAPE_CHARACTER, 0x01, 0x62, DCP_ESCAPE_CHARACTER, 0x01,
+                0x63, DCP_ESCAPE_CHARACTER, 0x01, 0x64, DCP_ESCAPE_CHARACTER, 0x01,
+                0x65,
+            },
+        },
+        process_data->transaction.spi_buffer.buffer);
 }
 
-/*!\test
- * Collision: Slave sends data bytes, request is later and short.
+/*!
+ * Let DCPD send a master command and have the slave not ready for it.
+ *
+ * With non-blocking SPI, the transaction ends up waiting for the slave.
  */
-void test_collision_with_very_fast_later_request_release()
+static void start_master_transaction_with_slave_not_ready(uint8_t ttl)
 {
-    collision_with_full_transaction_request(RequestPinBehavior::UNCHANGED,
-                                            RequestPinBehavior::ON_OFF,
-                                            RequestPinBehavior::UNCHANGED);
-}
+    static const std::array<uint8_t, 4> next_appstream_empty
+    {
+        DCP_COMMAND_MULTI_WRITE_REGISTER, 0xef, 0x00, 0x00,
+    };
+    std::vector<uint8_t> wrapped_appstream;
+    wrap_data_into_protocol(wrapped_appstream, 'c', ttl, 0xeba9,
+                            next_appstream_empty.begin(), next_appstream_empty.size());
+    std::copy_n(wrapped_appstream.begin(), wrapped_appstream.size(),
+                std::back_inserter(os_read_buffer));
 
-/*!\test
- * Collision: Slave sends data bytes, request is late and short.
- */
-void test_collision_with_very_fast_late_request_release()
-{
-    collision_with_full_transaction_request(RequestPinBehavior::UNCHANGED,
-                                            RequestPinBehavior::UNCHANGED,
-                                            RequestPinBehavior::ON_OFF);
-}
+    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Master transaction: command header from DCPD: 0x02 0xef 0x00 0x00");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    spi_rw_data->set<wait_for_slave_spi_transfer_size>(spi_rw_data_t::EXPECT_WRITE_NOPS,
+                                                       spi_rw_data_t::EXPECT_READ_NOPS,
+                                                       true);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
 
-/*!\test
- * Collision: Slave sends data, full request is followed by open request.
- */
-void test_collision_with_follow_up_request_simple()
-{
-    collision_with_full_request_followed_by_open_request(RequestPinBehavior::ON,
-                                                         RequestPinBehavior::OFF,
-                                                         RequestPinBehavior::ON);
-}
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
 
-/*!\test
- * Collision: Slave sends data, requests transaction, quickly requests next.
- */
-void test_collision_with_follow_up_request_new_request_early_just_in_time()
-{
-    collision_with_full_request_followed_by_open_request(RequestPinBehavior::ON,
-                                                         RequestPinBehavior::OFF_ON,
-                                                         RequestPinBehavior::UNCHANGED);
+    /* nothing has been sent, and we are back in the main loop */
+    cppcut_assert_equal(TR_MASTER_COMMAND_WAITING_FOR_SLAVE, process_data->transaction.state);
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_os->check();
+    mock_spi_hw->check();
+    poll_results.check();
 }
 
 /*!\test
- * Collision: Slave sends data, requests transaction, quickly requests next.
+ * With non-blocking SPI, the main loop waits for the slave to get ready for
+ * a master command, not the SPI code.
  */
-void test_collision_with_follow_up_request_new_request_late_just_in_time()
+void test_master_transaction_waits_for_slave_in_main_loop()
 {
-    collision_with_full_request_followed_by_open_request(RequestPinBehavior::ON,
-                                                         RequestPinBehavior::UNCHANGED,
-                                                         RequestPinBehavior::OFF_ON);
-}
+    dcpspi_nonblocking_spi_enable(true);
 
-/*!\test
- * Collision: Slave sends data, requests transaction, quickly requests next.
- */
-void test_collision_with_follow_up_request_new_request_early()
-{
-    collision_with_full_request_followed_by_open_request(RequestPinBehavior::ON_OFF,
-                                                         RequestPinBehavior::ON,
-                                                         RequestPinBehavior::UNCHANGED);
-}
+    start_master_transaction_with_slave_not_ready(UINT8_MAX);
 
-/*!\test
- * Collision: Slave sends data, requests transaction, quickly requests next.
- */
-void test_collision_with_follow_up_request_new_request_late()
-{
-    collision_with_full_request_followed_by_open_request(RequestPinBehavior::ON_OFF,
-                                                         RequestPinBehavior::UNCHANGED,
-                                                         RequestPinBehavior::ON);
-}
+    /* the delay between two probes is spent in poll(2), without DCPD */
+    poll_results.expect(std::move(PollResult().expect_timeout(delay_between_slave_probes_ms)
+                                              .set_return_value(0)));
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 10, serial 0xeba9, lock state 0, pending size 0, flush pos 0");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    spi_rw_data->set<wait_for_slave_spi_transfer_size>(spi_rw_data_t::EXPECT_WRITE_NOPS,
+                                                       spi_rw_data_t::EXPECT_READ_ZEROS,
+                                                       true);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    static const std::array<uint8_t, 4> next_appstream_empty
+    {
+        DCP_COMMAND_MULTI_WRITE_REGISTER, 0xef, 0x00, 0x00,
+    };
+    spi_rw_data->set(next_appstream_empty);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
 
-/*!\test
- * Collision: Slave sends data, requests transaction, quickly requests next.
- */
-void test_collision_with_follow_up_request_first_request_late()
-{
-    collision_with_full_request_followed_by_open_request(RequestPinBehavior::UNCHANGED,
-                                                         RequestPinBehavior::ON_OFF,
-                                                         RequestPinBehavior::ON);
-}
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
 
-/*!\test
- * Collision: Slave sends data, requests transaction, quickly requests next.
- */
-void test_collision_with_follow_up_request_first_request_late_new_request_just_in_time()
-{
-    collision_with_full_request_followed_by_open_request(RequestPinBehavior::UNCHANGED,
-                                                         RequestPinBehavior::ON,
-                                                         RequestPinBehavior::OFF_ON);
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+    std::vector<uint8_t> master_command_ack;
+    wrap_data_into_protocol(master_command_ack, 'a', 0, 0xeba9);
+    cut_assert_equal_memory(master_command_ack.data(), master_command_ack.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
+    mock_messages->check();
+    mock_os->check();
+    mock_spi_hw->check();
+    poll_results.check();
+
+    expect_no_more_actions();
 }
 
-/*!
- * Collision: Slave requests transaction, then requests the next one and sends
- * the full second request together with the first one.
- *
- * This situation occurs in case the load on the Streaming Board is high and
- * the slave is sending two subsequent requests quickly one after the other
- * while a master transaction is about to start. In this case, dcpspi may not
- * even see the first request and runs into an SPI collision. Two bytes are
- * read by dcpspi, signaling to the slave that its GPIO request has been seen
- * (even though it hasn't yet). The DCP header isn't fully there yet, so the
- * next read from SPI slave is for a full chunk of 32 bytes. In the meantime,
- * the slave has already prepared the next request and asserted the request pin
- * again. It sends the rest of the first request and then sends the second
- * request right after it.
- *
- * In theory (and rarely in practice), this effect can stack, meaning that
- * multiple small requests may reside in the SPI input buffer for very unlucky
- * timings and successive collisions. The communication temporarily falls out
- * of sync as transaction requests are lost while processing some transaction
- * because the Streaming Board fails to keep up with the speed of the SPI
- * slave.
- *
- * The solution that dcpspi implements is that it peeks into the SPI input
- * buffer after being done handling any requests performed after a collision if
- * the request GPIO has been toggled in the meantime in such a way that lost
- * transaction requests are indicated. If there is any pending request data, it
- * will be processed. The input buffer must begin with one or two zeros (the
- * ready signal) for this to work, otherwise it must be completely discarded
- * (we cannot actively search for DCP messages in arbitrary buffers because the
- * protocol lacks sync marks, and the binary nature of the protocol makes
- * guessing risky).
+/*!\test
+ * With non-blocking SPI, a slave request while waiting for the slave to get
+ * ready is seen right away, and the collision is handled as usual.
  */
-void test_collision_with_lost_and_found_slave_request()
+void test_slave_request_while_master_transaction_waits_for_slave()
 {
-    const auto &prepared_data(prepare_for_collision(0x920b, UINT8_MAX));
-    const auto &network_status(std::get<0>(prepared_data));
-    const auto &interrupting_slave_command_suffix(std::get<1>(prepared_data));
-    const auto &wrapped_interrupting_slave_command(std::get<2>(prepared_data));
+    dcpspi_nonblocking_spi_enable(true);
 
-    create_collision_state(network_status.size() + DCPSYNC_HEADER_SIZE,
-                           network_status.size(), 0x920b,
-                           RequestPinBehavior::ON,
-                           RequestPinBehavior::OFF,
-                           RequestPinBehavior::UNCHANGED, 9);
+    start_master_transaction_with_slave_not_ready(3);
 
-    /* next command tacked to the end of the first one, sent by slave because
-     * of unlucky timing; there could be a UINT8_MAX because first poll byte is
-     * usually that, and the 0x00 (sometimes 2 of them instead of UINT8_MAX) is
-     * the ready signal because the slave thought it's being polled */
-    static const std::array<uint8_t, 17> follow_up_slave_command
+    poll_results.expect(std::move(PollResult().expect_timeout(delay_between_slave_probes_ms)
+                                              .set_gpio_events(POLLPRI)
+                                              .set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(true, process_data->gpio);
+    expect_detection_of_interrupt_by_slave(0xeba9);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 10, serial 0xeba9, lock state 1, pending size 0, flush pos 0");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    static const std::array<uint8_t, wait_for_slave_spi_transfer_size> collision_bytes
     {
-        UINT8_MAX, 0x00, DCP_COMMAND_MULTI_WRITE_REGISTER, 0x79, 0x0b, 0x00,
-        0x51, 0xc3, 0x01, 0xa9, 0xe4, 0x2e, 0x03, 0x3a, 0x02, 0x01, 0xfb,
+        UINT8_MAX, DCP_COMMAND_MULTI_WRITE_REGISTER,
     };
-    cppcut_assert_equal(size_t(6), interrupting_slave_command_suffix.size());
-    std::array<uint8_t, 6 + follow_up_slave_command.size()> two_commands;
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, collision_bytes, true);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
+        "Collision detected (got funny poll bytes)");
 
-    std::copy_n(interrupting_slave_command_suffix.data(),
-                interrupting_slave_command_suffix.size(),
-                two_commands.begin());
-    std::copy_n(follow_up_slave_command.data(),
-                follow_up_slave_command.size(),
-                two_commands.begin() + interrupting_slave_command_suffix.size());
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
 
-    /* switch over to slave transaction: slave sends write command for UPnP
-     * friendly name */
-    poll_results.expect(std::move(PollResult().set_return_value(0)));
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
-    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, two_commands);
-    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    /* master transaction rejected, slave transaction takes over */
+    cppcut_assert_equal(TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE, process_data->transaction.state);
+    cppcut_assert_equal(REQSTATE_LOCKED, process_data->transaction.request_state);
+    std::vector<uint8_t> master_command_nack;
+    wrap_data_into_protocol(master_command_nack, 'n', 2, 0xeba9);
+    cut_assert_equal_memory(master_command_nack.data(), master_command_nack.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
+    mock_messages->check();
+    mock_gpio->check();
+    mock_os->check();
+    mock_spi_hw->check();
+    poll_results.check();
+}
+
+/*!\test
+ * With non-blocking SPI, the main loop waits for the slave to send data after
+ * it has requested a transaction, but sent only NOPs at first.
+ */
+void test_slave_transaction_waits_for_slave_data_in_main_loop()
+{
+    dcpspi_nonblocking_spi_enable(true);
+
+    /* slave activates the request GPIO, but is not quite there yet */
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(true, process_data->gpio);
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 6, serial 0x0000, lock state 2, pending size 0, flush pos 0");
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
-        "Slave transaction: command header from SPI: 0x02 0x58 0x03 0x00");
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
+        "Process transaction state 0, serial 0x0000, lock state 1, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 6, serial 0x0000, lock state 1, pending size 0, flush pos 0");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    spi_rw_data->set<read_from_slave_spi_transfer_size>(spi_rw_data_t::EXPECT_WRITE_NOPS,
+                                                        spi_rw_data_t::EXPECT_READ_NOPS,
+                                                        false);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
-    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
-    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN), process_data->transaction.serial);
-    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
-                            wrapped_interrupting_slave_command.size(),
-                            process_data->transaction.dcp_buffer.buffer,
-                            process_data->transaction.dcp_buffer.pos);
-    cut_assert_true(os_write_buffer.empty());
+    cppcut_assert_equal(TR_SLAVE_COMMAND_WAITING_FOR_SLAVE_DATA, process_data->transaction.state);
     mock_messages->check();
     mock_gpio->check();
+    mock_os->check();
     mock_spi_hw->check();
+    poll_results.check();
 
-    /* slave transaction: slave has prepared the next request and sends it
-     * while we are sending the first command to DCPD */
-    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
-    mock_gpio->expect_gpio_is_active(false, process_data->gpio);
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
-        "Pending slave request while processing transaction 0x0001");
-    mock_messages->expect_msg_error_formatted(0, LOG_WARNING,
-        "Lost slave request while processing transaction 0x0001");
+    /* slave sends write command for UPnP friendly name after the delay */
+    poll_results.expect(std::move(PollResult().expect_timeout(delay_between_slave_probes_ms)
+                                              .set_return_value(0)));
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 8, serial 0x0001, lock state 4, pending size 0, flush pos 0");
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "End of transaction 0x0001 in state 8, looking for missed transactions");
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 0, serial 0x0000, lock state 4, pending size 0, flush pos 0");
-    mock_messages->expect_msg_info_formatted("Possibly found lost packet(s) in SPI input buffer");
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 6, serial 0x0000, lock state 2, pending size 0, flush pos 0");
+        "Process transaction state 11, serial 0x0000, lock state 1, pending size 0, flush pos 0");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    static const std::array<uint8_t, 8> write_command
+    {
+        UINT8_MAX, DCP_COMMAND_MULTI_WRITE_REGISTER, 0x58, 0x03, 0x00,
+        0x61, 0x62, 0x63
+    };
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, write_command);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
-        "Slave transaction: command header from SPI: 0x02 0x79 0x0b 0x00");
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
+        "Slave transaction: command header from SPI: 0x02 0x58 0x03 0x00");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
-    std::vector<uint8_t> wrapped_second_slave_command;
-    wrap_data_into_protocol(wrapped_second_slave_command, 'c', 0, DCPSYNC_SLAVE_SERIAL_MIN + 1,
-                            follow_up_slave_command.begin() + 2,
-                            follow_up_slave_command.size() - 2);
     cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
-    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN + 1), process_data->transaction.serial);
-    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
-                            wrapped_interrupting_slave_command.size(),
-                            os_write_buffer.data(), os_write_buffer.size());
-    os_write_buffer.clear();
-    cut_assert_equal_memory(wrapped_second_slave_command.data(),
-                            wrapped_second_slave_command.size(),
-                            process_data->transaction.dcp_buffer.buffer,
-                            process_data->transaction.dcp_buffer.pos);
+    cut_assert_true(os_write_buffer.empty());
     mock_messages->check();
-    mock_gpio->check();
+    mock_os->check();
     mock_spi_hw->check();
+    poll_results.check();
 
-    /* second slave transaction: send to DCPD */
-    poll_results.expect(std::move(PollResult().set_return_value(0)));
+    /* send write command to DCPD */
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(false, process_data->gpio);
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 8, serial 0x0002, lock state 2, pending size 0, flush pos 0");
+        "Process transaction state 8, serial 0x0001, lock state 2, pending size 0, flush pos 0");
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "End of transaction 0x0002 in state 8, return to idle state");
+        "End of transaction 0x0001 in state 8, return to idle state");
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
                                    &process_data->rldata));
 
-    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
-    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
-    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
-    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_INVALID), process_data->transaction.serial);
-    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
-    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
-    cut_assert_equal_memory(wrapped_second_slave_command.data(),
-                            wrapped_second_slave_command.size(),
+    std::vector<uint8_t> wrapped_write_command;
+    wrap_data_into_protocol(wrapped_write_command, 'c', 0, DCPSYNC_SLAVE_SERIAL_MIN,
+                            write_command.begin() + 1, write_command.size() - 1);
+    cut_assert_equal_memory(wrapped_write_command.data(), wrapped_write_command.size(),
                             os_write_buffer.data(), os_write_buffer.size());
-    cppcut_assert_equal(size_t(0), process_data->transaction.dcp_buffer.pos);
     os_write_buffer.clear();
     mock_messages->check();
     mock_gpio->check();
     poll_results.check();
 
-    /* done */
     expect_no_more_actions();
 }
 
 /*!\test
- * Collision occurs, but DCPD doesn't want to know (anymore).
+ * Slave transaction with non-blocking SPI, slave answers right away.
  */
-void test_collision_with_command_ttl_of_0()
+void test_single_slave_transaction_with_nonblocking_spi()
 {
-    const auto &prepared_data(prepare_for_collision(0x81f7, 0));
-    const auto &network_status(std::get<0>(prepared_data));
-
-    create_collision_state(network_status.size() + DCPSYNC_HEADER_SIZE,
-                           network_status.size(), 0x81f7,
-                           RequestPinBehavior::ON,
-                           RequestPinBehavior::UNCHANGED,
-                           RequestPinBehavior::OFF,
-                           23, false);
+    dcpspi_nonblocking_spi_enable(true);
 
-    /* no NACK was sent, slave transaction should be processed next (we do not
-     * do this here, though, to keep the test small */
+    run_complete_single_slave_transaction(DCPSYNC_SLAVE_SERIAL_MIN, true, true);
 }
 
 /*!\test
- * Collision occurs, DCPD should not retry anymore.
+ * Slave transaction with non-blocking SPI driven by GPIO edge events.
  */
-void test_collision_with_command_ttl_of_1()
+void test_single_slave_transaction_with_edge_events_and_nonblocking_spi()
 {
-    const auto &prepared_data(prepare_for_collision(0xf094, 1));
-    const auto &network_status(std::get<0>(prepared_data));
+    dcpspi_nonblocking_spi_enable(true);
+    MockGPIO::set_has_edge_events(process_data->gpio, true);
+    expected_gpio_poll_events = POLLIN;
 
-    create_collision_state(network_status.size() + DCPSYNC_HEADER_SIZE,
-                           network_status.size(), 0xf094,
-                           RequestPinBehavior::ON,
-                           RequestPinBehavior::UNCHANGED,
-                           RequestPinBehavior::OFF,
-                           0);
+    run_complete_single_slave_transaction(DCPSYNC_SLAVE_SERIAL_MIN, true, true,
+                                          false, true);
+}
 
-    /* final NACK was sent, slave transaction should be processed next (we do
-     * not do this here, though, to keep the test small */
+/*!\test
+ * Collision with non-blocking SPI, request stays asserted.
+ */
+void test_collision_with_slow_early_request_and_nonblocking_spi()
+{
+    dcpspi_nonblocking_spi_enable(true);
+
+    collision_with_open_transaction_request(RequestPinBehavior::ON,
+                                            RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::UNCHANGED);
 }
 
 /*!\test
- * Collision occurs, master has sent a burst of packets without waiting for
- * ACKs.
- *
- * This can happen because DCPD may want to push multiple packets into the pipe
- * buffer in the hope of higher throughput as long as no collision occurs.
- * In case of a collision with a slave transaction, however, the most recent
- * master transaction is going to be rejected and DCPD must send it again.
- *
- * Note that this will lead to reordering of packets, leading to messed up data
- * in case of long data fragmented over multiple packets (such as DRC data)>.
- * Consequently, DCPD must make sure to synchronize on ACKs to avoid this where
- * necessary.
- *
- * This test is a bit like #test_two_fast_master_transactions(), but with a
- * collision strayed in.
+ * Collision with non-blocking SPI, request is released while the master
+ * packet is sent to the slave.
  */
-void test_collision_with_multiple_master_transactions_in_pipe_buffer()
+void test_collision_with_fast_later_request_release_and_nonblocking_spi()
 {
-    const auto &prepared_data(prepare_for_collision(0xc0e5, UINT8_MAX));
-    const auto &network_status(std::get<0>(prepared_data));
-    const auto &interrupting_slave_command_suffix(std::get<1>(prepared_data));
-    const auto &wrapped_interrupting_slave_command(std::get<2>(prepared_data));
+    dcpspi_nonblocking_spi_enable(true);
 
-    static const std::array<uint8_t, 6> device_status
-    {
-        DCP_COMMAND_MULTI_READ_REGISTER, 0x11, 0x02, 0x00,
-        0x24, 0x42
-    };
-    std::vector<uint8_t> wrapped_device_status;
-    wrap_data_into_protocol(wrapped_device_status, 'c', UINT8_MAX, 0xc0e6,
-                            device_status.begin(), device_status.size());
-    std::copy_n(wrapped_device_status.begin(), wrapped_device_status.size(),
-                std::back_inserter(os_read_buffer));
+    collision_with_full_transaction_request(RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::ON,
+                                            RequestPinBehavior::OFF);
+}
 
-    create_collision_state(network_status.size() + DCPSYNC_HEADER_SIZE + wrapped_device_status.size(),
-                           network_status.size(), 0xc0e5,
-                           RequestPinBehavior::ON,
-                           RequestPinBehavior::UNCHANGED,
-                           RequestPinBehavior::OFF,
-                           9);
+/*!\test
+ * Collision with non-blocking SPI, request is asserted and released before
+ * the master packet is sent to the slave.
+ */
+void test_collision_with_very_fast_late_request_release_and_nonblocking_spi()
+{
+    dcpspi_nonblocking_spi_enable(true);
 
-    /* switch over to slave transaction: slave sends write command for UPnP
-     * friendly name, request pin not active anymore */
-    poll_results.expect(std::move(PollResult().set_return_value(0)));
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
-    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, interrupting_slave_command_suffix);
-    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 6, serial 0x0000, lock state 2, pending size 0, flush pos 0");
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
-        "Slave transaction: command header from SPI: 0x02 0x58 0x03 0x00");
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
+    collision_with_full_transaction_request(RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::ON_OFF);
+}
 
-    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
-                                   expected_spi_fd, &process_data->transaction,
-                                   &process_data->rldata));
+/*!\test
+ * Collision with non-blocking SPI, followed by the next slave request.
+ */
+void test_collision_with_follow_up_request_and_nonblocking_spi()
+{
+    dcpspi_nonblocking_spi_enable(true);
 
-    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
-    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_MIN), process_data->transaction.serial);
-    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
-                            wrapped_interrupting_slave_command.size(),
-                            process_data->transaction.dcp_buffer.buffer,
-                            process_data->transaction.dcp_buffer.pos);
-    cut_assert_true(os_write_buffer.empty());
-    mock_messages->check();
-    mock_gpio->check();
-    mock_spi_hw->check();
+    collision_with_full_request_followed_by_open_request(RequestPinBehavior::ON,
+                                                         RequestPinBehavior::OFF,
+                                                         RequestPinBehavior::ON);
+}
 
-    /* slave transaction: send write command to DCPD, and we are done */
-    poll_results.expect(std::move(PollResult().set_return_value(0)));
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 8, serial 0x0001, lock state 2, pending size 0, flush pos 0");
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "End of transaction 0x0001 in state 8, return to idle state");
+/*!\test
+ * Collision with non-blocking SPI, next slave request comes in just in time.
+ */
+void test_collision_with_follow_up_request_just_in_time_and_nonblocking_spi()
+{
+    dcpspi_nonblocking_spi_enable(true);
 
-    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
-                                   expected_spi_fd, &process_data->transaction,
-                                   &process_data->rldata));
+    collision_with_full_request_followed_by_open_request(RequestPinBehavior::ON,
+                                                         RequestPinBehavior::UNCHANGED,
+                                                         RequestPinBehavior::OFF_ON);
+}
 
-    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
-    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
-    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
-    cppcut_assert_equal(uint16_t(DCPSYNC_SLAVE_SERIAL_INVALID), process_data->transaction.serial);
-    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
-    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
-    cut_assert_equal_memory(wrapped_interrupting_slave_command.data(),
-                            wrapped_interrupting_slave_command.size(),
-                            os_write_buffer.data(), os_write_buffer.size());
-    cppcut_assert_equal(size_t(0), process_data->transaction.dcp_buffer.pos);
-    os_write_buffer.clear();
-    mock_messages->check();
-    mock_gpio->check();
-    poll_results.check();
+/*!
+ * Enable read-ahead of DCPD input as done by the daemon.
+ */
+static void enable_read_ahead()
+{
+    cut_assert_false(dcpspi_read_ahead_enable(true));
+    expect_read_ahead = true;
+}
 
-    /* slave transaction done, but there is another master transaction sitting
-     * in the pipe buffer */
-    cppcut_assert_equal(wrapped_device_status.size(), os_read_buffer.size());
+/*!\test
+ * Collision with read-ahead, request stays asserted.
+ */
+void test_collision_with_slow_early_request_and_read_ahead()
+{
+    enable_read_ahead();
 
-    poll_results.expect(std::move(PollResult().set_return_value(0)));
-    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 0, serial 0x0000, lock state 0, pending size 0, flush pos 0");
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
-        "Master transaction: command header from DCPD: 0x03 0x11 0x02 0x00");
+    collision_with_open_transaction_request(RequestPinBehavior::ON,
+                                            RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::UNCHANGED);
+}
 
-    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
-                                   expected_spi_fd, &process_data->transaction,
-                                   &process_data->rldata));
+/*!\test
+ * Collision with read-ahead, request is asserted while the master packet is
+ * sent to the slave.
+ */
+void test_collision_with_slow_late_request_and_read_ahead()
+{
+    enable_read_ahead();
+
+    collision_with_open_transaction_request(RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::ON);
+}
 
-    cppcut_assert_equal(TR_MASTER_COMMAND_RECEIVING_DATA_FROM_DCPD, process_data->transaction.state);
-    cppcut_assert_equal(size_t(2), os_read_buffer.size());
-    cppcut_assert_equal(size_t(DCPSYNC_HEADER_SIZE + DCP_HEADER_SIZE),
-                        process_data->transaction.dcp_buffer.pos);
-    cut_assert_true(os_write_buffer.empty());
-    mock_messages->check();
-    mock_gpio->check();
+/*!\test
+ * Collision with read-ahead, request is released while the master packet is
+ * sent to the slave.
+ */
+void test_collision_with_fast_early_request_release_and_read_ahead()
+{
+    enable_read_ahead();
 
-    /* process data from DCPD remaining in pipe buffer */
-    poll_results.expect(std::move(PollResult().set_return_value(0)));
-    poll_results.expect(std::move(PollResult().set_dcpd_events(POLLIN).set_return_value(1)));
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 2, serial 0xc0e6, lock state 0, pending size 2, flush pos 0");
+    collision_with_full_transaction_request(RequestPinBehavior::ON,
+                                            RequestPinBehavior::UNCHANGED,
+                                            RequestPinBehavior::OFF);
+}
 
-    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
-                                   expected_spi_fd, &process_data->transaction,
-                                   &process_data->rldata));
+/*!\test
+ * Collision with read-ahead, followed by the next slave request.
+ */
+void test_collision_with_follow_up_request_and_read_ahead()
+{
+    enable_read_ahead();
 
-    cppcut_assert_equal(TR_MASTER_COMMAND_FORWARDING_TO_SLAVE, process_data->transaction.state);
-    cppcut_assert_equal(REQSTATE_IDLE, process_data->transaction.request_state);
-    cut_assert_equal_memory(wrapped_device_status.data(), wrapped_device_status.size(),
-                            process_data->transaction.dcp_buffer.buffer,
-                            process_data->transaction.dcp_buffer.pos);
-    cppcut_assert_equal(uint16_t(0xc0e6), process_data->transaction.serial);
-    cppcut_assert_equal(size_t(0), process_data->transaction.spi_buffer.pos);
-    cppcut_assert_equal(uint16_t(0), process_data->transaction.pending_size_of_transaction);
-    cppcut_assert_equal(size_t(0), process_data->transaction.flush_to_dcpd_buffer_pos);
-    cppcut_assert_equal(size_t(0), os_read_buffer.size());
-    cut_assert_true(os_write_buffer.empty());
-    mock_messages->check();
-    mock_gpio->check();
-    poll_results.check();
+    collision_with_full_request_followed_by_open_request(RequestPinBehavior::ON_OFF,
+                                                         RequestPinBehavior::UNCHANGED,
+                                                         RequestPinBehavior::ON);
+}
 
-    /* send command to SPI slave, send ACK to DCPD */
-    poll_results.expect(std::move(PollResult().set_return_value(0)));
-    expect_wait_for_spi_slave(dummy_time);
-    spi_rw_data->set(device_status);
-    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
-    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
-        "Process transaction state 3, serial 0xc0e6, lock state 0, pending size 0, flush pos 0");
+/*!\test
+ * Collision in the daemon's default configuration: read-ahead and
+ * non-blocking SPI.
+ */
+void test_collision_with_follow_up_request_just_in_time_and_read_ahead()
+{
+    enable_read_ahead();
+    dcpspi_nonblocking_spi_enable(true);
 
-    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
-                                   expected_spi_fd, &process_data->transaction,
-                                   &process_data->rldata));
+    collision_with_full_request_followed_by_open_request(RequestPinBehavior::ON,
+                                                         RequestPinBehavior::UNCHANGED,
+                                                         RequestPinBehavior::OFF_ON);
+}
 
-    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
-    std::vector<uint8_t> master_command_ack;
-    wrap_data_into_protocol(master_command_ack, 'a', 0, 0xc0e6);
-    cut_assert_equal_memory(master_command_ack.data(), master_command_ack.size(),
-                            os_write_buffer.data(), os_write_buffer.size());
-    os_write_buffer.clear();
-    mock_messages->check();
-    mock_gpio->check();
-    mock_spi_hw->check();
-    poll_results.check();
+/*!\test
+ * Slave transaction in the daemon's default configuration.
+ */
+void test_single_slave_transaction_with_read_ahead()
+{
+    enable_read_ahead();
+    dcpspi_nonblocking_spi_enable(true);
 
-    /* done */
-    expect_no_more_actions();
+    run_complete_single_slave_transaction(DCPSYNC_SLAVE_SERIAL_MIN, true, true);
 }
 
 /*!\test
@@ -2169,7 +4074,7 @@ void test_junk_is_forwarded_to_dcpd()
     /* slave activates the request GPIO and sends junk */
     poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
     mock_gpio->expect_gpio_is_active(true, process_data->gpio);
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
 
     static const std::array<uint8_t, 10> junk_bytes
     {
@@ -2233,13 +4138,57 @@ void test_junk_is_forwarded_to_dcpd()
 }
 
 /*!\test
- * In case the slave tries to send two successive messages, but is sloppy with
- * the request signal, then we may lose a message (depending on implementation
- * on slave side) and end up recovering via timeout.
- *
- * Processing continues after our internal timeout has expired.
+ * Queued GPIO edges are replayed one by one: deassertion of the request line
+ * ends the slave transaction, then the next assertion is taken as new slave
+ * request.
  */
-void test_lost_transaction_and_timeout_if_slave_deasserts_request_line_too_soon()
+void test_queued_request_line_edges_are_replayed_in_order()
+{
+    MockGPIO::set_has_edge_events(process_data->gpio, true);
+    expected_gpio_poll_events = POLLIN;
+
+    run_complete_single_slave_transaction(DCPSYNC_SLAVE_SERIAL_MIN, true, false,
+                                          true, true);
+
+    cppcut_assert_equal(TR_SLAVE_COMMAND_WAIT_FOR_REQUEST_DEASSERT, process_data->transaction.state);
+    cppcut_assert_equal(REQSTATE_LOCKED, process_data->transaction.request_state);
+
+    /* slave has released the request line and asserted it again before we
+     * got around to looking at it, but the kernel has seen both edges */
+    mock_messages->expect_msg_info_formatted("Waiting for slave to deassert the request pin");
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLIN).set_return_value(1)));
+    mock_gpio->expect_gpio_read_edge_events({{false, 3000}, {true, 3100}},
+                                            process_data->gpio);
+    mock_messages->expect_msg_info_formatted("Slave has deasserted the request pin");
+    expect_detection_of_pending_slave_request(DCPSYNC_SLAVE_SERIAL_MIN);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 9, serial 0x0001, lock state 3, pending size 0, flush pos 13");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "End of transaction 0x0001 in state 9, slave request pending");
+    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DIAG,
+                                    "Processing pending slave transaction");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 0, serial 0x0000, lock state 1, pending size 0, flush pos 0");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    mock_messages->check();
+    mock_gpio->check();
+    mock_os->check();
+    poll_results.check();
+
+    cppcut_assert_equal(TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE, process_data->transaction.state);
+    cppcut_assert_equal(REQSTATE_LOCKED, process_data->transaction.request_state);
+    cppcut_assert_equal(true, process_data->rldata.previous_gpio_state);
+}
+
+/*!
+ * Let the slave toggle the request line too quickly at the end of a slave
+ * transaction, so that a new slave transaction is started.
+ */
+static void start_slave_transaction_after_too_short_deassertion()
 {
     run_complete_single_slave_transaction(DCPSYNC_SLAVE_SERIAL_MIN, true, false, true);
 
@@ -2277,6 +4226,18 @@ void test_lost_transaction_and_timeout_if_slave_deasserts_request_line_too_soon(
      * to process it */
     cppcut_assert_equal(TR_SLAVE_COMMAND_RECEIVING_HEADER_FROM_SLAVE, process_data->transaction.state);
     cppcut_assert_equal(REQSTATE_LOCKED, process_data->transaction.request_state);
+}
+
+/*!\test
+ * In case the slave tries to send two successive messages, but is sloppy with
+ * the request signal, then we may lose a message (depending on implementation
+ * on slave side) and end up recovering via timeout.
+ *
+ * Processing continues after our internal timeout has expired.
+ */
+void test_lost_transaction_and_timeout_if_slave_deasserts_request_line_too_soon()
+{
+    start_slave_transaction_after_too_short_deassertion();
 
     /* the slave has already released the GPIO pin in the meantime (which must
      * be considered a bug in the implementation on slave side) and doesn't
@@ -2288,14 +4249,14 @@ void test_lost_transaction_and_timeout_if_slave_deasserts_request_line_too_soon(
         "We will try to process this pending transaction anyway.");
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
         "Process transaction state 6, serial 0x0000, lock state 2, pending size 0, flush pos 0");
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
     spi_rw_data->set<read_from_slave_spi_transfer_size>(spi_rw_data_t::EXPECT_WRITE_NOPS,
                                                         spi_rw_data_t::EXPECT_READ_NOPS,
                                                         false);
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
     mock_os->expect_os_nanosleep(0, delay_between_slave_probes_ms);
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
 
     /* expire multiple timeouts */
     struct timespec expired_time = dummy_time;
@@ -2307,9 +4268,9 @@ void test_lost_transaction_and_timeout_if_slave_deasserts_request_line_too_soon(
                                             false);
         mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
         ++expired_time.tv_sec;
-        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, expired_time);
+        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, expired_time);
         mock_os->expect_os_nanosleep(0, delay_between_slave_probes_ms);
-        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, expired_time);
+        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, expired_time);
     }
     spi_rw_data->set<read_from_slave_spi_transfer_size>(
                                             spi_rw_data_t::EXPECT_WRITE_NOPS,
@@ -2317,7 +4278,7 @@ void test_lost_transaction_and_timeout_if_slave_deasserts_request_line_too_soon(
                                             false);
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
     ++expired_time.tv_sec;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, expired_time);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, expired_time);
 
     mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
         "SPI read timeout, returning 0 of 4 bytes");
@@ -2334,6 +4295,80 @@ void test_lost_transaction_and_timeout_if_slave_deasserts_request_line_too_soon(
     expect_no_more_actions();
 }
 
+/*!\test
+ * Same as
+ * #test_lost_transaction_and_timeout_if_slave_deasserts_request_line_too_soon(),
+ * but with non-blocking SPI; the slave is waited for in the main loop.
+ */
+void test_lost_transaction_and_timeout_with_nonblocking_spi()
+{
+    dcpspi_nonblocking_spi_enable(true);
+
+    start_slave_transaction_after_too_short_deassertion();
+
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(false, process_data->gpio);
+    mock_messages->expect_msg_error_formatted(0, LOG_CRIT,
+        "APPLIANCE BUG: Transaction was requested by slave, but request pin is deasserted now. "
+        "We will try to process this pending transaction anyway.");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 6, serial 0x0000, lock state 2, pending size 0, flush pos 0");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    spi_rw_data->set<read_from_slave_spi_transfer_size>(spi_rw_data_t::EXPECT_WRITE_NOPS,
+                                                        spi_rw_data_t::EXPECT_READ_NOPS,
+                                                        false);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_SLAVE_COMMAND_WAITING_FOR_SLAVE_DATA, process_data->transaction.state);
+    mock_messages->check();
+    mock_gpio->check();
+    mock_os->check();
+    mock_spi_hw->check();
+    poll_results.check();
+
+    /* expire multiple timeouts, each delay is spent in poll(2) */
+    struct timespec expired_time = dummy_time;
+    for(int i = 0; i < 5; ++i)
+    {
+        poll_results.expect(std::move(PollResult().expect_timeout(delay_between_slave_probes_ms)
+                                                  .set_return_value(0)));
+        mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+            "Process transaction state 11, serial 0x0000, lock state 2, pending size 0, flush pos 0");
+        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, expired_time);
+        spi_rw_data->set<read_from_slave_spi_transfer_size>(
+                                            spi_rw_data_t::EXPECT_WRITE_NOPS,
+                                            spi_rw_data_t::EXPECT_READ_NOPS,
+                                            false);
+        mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+        ++expired_time.tv_sec;
+        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, expired_time);
+
+        if(i == 4)
+        {
+            mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
+                "SPI read timeout, returning 0 of 4 bytes");
+            mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+                "End of transaction 0x0000 in state 6, return to idle state");
+        }
+
+        cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                       expected_spi_fd, &process_data->transaction,
+                                       &process_data->rldata));
+
+        mock_messages->check();
+        mock_os->check();
+        mock_spi_hw->check();
+        poll_results.check();
+    }
+
+    expect_no_more_actions();
+}
+
 /*!\test
  * In case the slave tries to send two successive messages, but is sloppy with
  * the request signal, then we may still receive a message (depending on
@@ -2384,7 +4419,7 @@ void test_new_transaction_even_if_slave_deasserts_request_line_too_soon()
         "We will try to process this pending transaction anyway.");
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
         "Process transaction state 6, serial 0x0000, lock state 2, pending size 0, flush pos 0");
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
     static const std::array<uint8_t, 8> write_command
     {
         UINT8_MAX, DCP_COMMAND_MULTI_WRITE_REGISTER, 0x58, 0x03, 0x00,
@@ -2394,7 +4429,7 @@ void test_new_transaction_even_if_slave_deasserts_request_line_too_soon()
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
     mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
         "Slave transaction: command header from SPI: 0x02 0x58 0x03 0x00");
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, dummy_time);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
 
     cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
                                    expected_spi_fd, &process_data->transaction,
@@ -2443,4 +4478,113 @@ void test_new_transaction_even_if_slave_deasserts_request_line_too_soon()
     expect_no_more_actions();
 }
 
+/*!\test
+ * On the slave fast path, a slave request seen while another slave
+ * transaction is running is processed right after it, without going through
+ * the main loop again.
+ */
+void test_pending_slave_request_is_processed_right_away_on_fast_path()
+{
+    cut_assert_false(dcpspi_slave_fast_path_enable(true));
+
+    run_complete_single_slave_transaction(DCPSYNC_SLAVE_SERIAL_MIN, true, false, true);
+
+    cppcut_assert_equal(TR_SLAVE_COMMAND_WAIT_FOR_REQUEST_DEASSERT, process_data->transaction.state);
+    cppcut_assert_equal(REQSTATE_LOCKED, process_data->transaction.request_state);
+
+    /* slave toggles the request line quickly and sends its next packet, which
+     * is read in the same pass */
+    mock_messages->expect_msg_info_formatted("Waiting for slave to deassert the request pin");
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(true, process_data->gpio);
+    mock_messages->expect_msg_info_formatted("Slave has deasserted the request pin (and has asserted it again)");
+    expect_detection_of_pending_slave_request(DCPSYNC_SLAVE_SERIAL_MIN);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 9, serial 0x0001, lock state 3, pending size 0, flush pos 13");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "End of transaction 0x0001 in state 9, slave request pending");
+    mock_messages->expect_msg_vinfo(MESSAGE_LEVEL_DIAG,
+                                    "Processing pending slave transaction");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 6, serial 0x0000, lock state 1, pending size 0, flush pos 0");
+    static const std::array<uint8_t, 6> write_command
+    {
+        UINT8_MAX, DCP_COMMAND_MULTI_WRITE_REGISTER, 0x79, 0x01, 0x00, 0x41,
+    };
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, write_command);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Slave transaction: command header from SPI: 0x02 0x79 0x01 0x00");
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, dummy_time);
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    static const uint16_t expected_slave_serial = DCPSYNC_SLAVE_SERIAL_MIN + 1;
+    cppcut_assert_equal(TR_SLAVE_COMMAND_FORWARDING_TO_DCPD, process_data->transaction.state);
+    cppcut_assert_equal(REQSTATE_LOCKED, process_data->transaction.request_state);
+    cppcut_assert_equal(expected_slave_serial, process_data->transaction.serial);
+    cut_assert_true(os_write_buffer.empty());
+    mock_messages->check();
+    mock_gpio->check();
+    mock_os->check();
+    mock_spi_hw->check();
+    poll_results.check();
+
+    /* send write command to DCPD */
+    poll_results.expect(std::move(PollResult().set_gpio_events(POLLPRI).set_return_value(1)));
+    mock_gpio->expect_gpio_is_active(false, process_data->gpio);
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "Process transaction state 8, serial 0x0002, lock state 2, pending size 0, flush pos 0");
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DEBUG,
+        "End of transaction 0x0002 in state 8, return to idle state");
+
+    cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                   expected_spi_fd, &process_data->transaction,
+                                   &process_data->rldata));
+
+    cppcut_assert_equal(TR_IDLE, process_data->transaction.state);
+    std::vector<uint8_t> wrapped_write_command;
+    wrap_data_into_protocol(wrapped_write_command, 'c', 0, expected_slave_serial,
+                            write_command.begin() + 1, write_command.size() - 1);
+    cut_assert_equal_memory(wrapped_write_command.data(), wrapped_write_command.size(),
+                            os_write_buffer.data(), os_write_buffer.size());
+    os_write_buffer.clear();
+    mock_messages->check();
+    mock_gpio->check();
+    poll_results.check();
+
+    expect_no_more_actions();
+}
+
+/*!\test
+ * Each slave has its own settings and statistics.
+ */
+void test_slave_contexts_are_independent()
+{
+    cut_assert_false(dcpspi_statistics_enable(true));
+    const struct program_statistics *first_stats = dcpspi_statistics_get();
+
+    struct dcpspi_context *second = dcpspi_context_init(1);
+    cppcut_assert_not_null(second);
+
+    struct dcpspi_context *first = dcpspi_context_switch(second);
+    cut_assert_true(dcpspi_statistics_get() != first_stats);
+    cut_assert_false(dcpspi_statistics_get()->is_enabled);
+    cut_assert_false(dcpspi_read_ahead_enable(true));
+
+    cppcut_assert_equal(second, dcpspi_context_switch(first));
+    cppcut_assert_equal(first_stats, dcpspi_statistics_get());
+    cut_assert_true(dcpspi_statistics_get()->is_enabled);
+    cut_assert_false(dcpspi_read_ahead_enable(false));
+
+    dcpspi_context_switch(second);
+    cut_assert_true(dcpspi_read_ahead_enable(false));
+
+    cppcut_assert_equal(second, dcpspi_context_switch(nullptr));
+    cut_assert_true(dcpspi_statistics_enable(false));
+}
+
 }
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include <cppcutter.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <vector>
+
+#include "dcpd_bridge.h"
+#include "ipc_ring.h"
+
+#include "mock_messages.hh"
+
+/*!
+ * \addtogroup dcpd_bridge_tests Unit tests
+ * \ingroup dcpd_bridge
+ *
+ * DCPD thread unit tests, using real pipes in place of the named pipes.
+ */
+/*!@{*/
+
+namespace dcpd_bridge_tests
+{
+
+static MockMessages *mock_messages;
+static struct ipc_channel *channel;
+
+/* DCPD writes to \c to_spi[1] and reads from \c from_spi[0] */
+static int to_spi[2];
+static int from_spi[2];
+
+void cut_setup()
+{
+    mock_messages = new MockMessages;
+    cppcut_assert_not_null(mock_messages);
+    mock_messages->init();
+    mock_messages_singleton = mock_messages;
+
+    cppcut_assert_equal(0, pipe2(to_spi, O_CLOEXEC));
+    cppcut_assert_equal(0, pipe2(from_spi, O_CLOEXEC));
+    cppcut_assert_equal(0, fcntl(to_spi[0], F_SETFL, O_NONBLOCK));
+
+    channel = ipc_channel_create_local();
+    cppcut_assert_not_null(channel);
+
+    cppcut_assert_equal(0, dcpd_bridge_start(to_spi[0], from_spi[1],
+                                             channel, nullptr));
+}
+
+void cut_teardown()
+{
+    dcpd_bridge_stop();
+    ipc_channel_close(channel);
+    channel = nullptr;
+
+    for(int fd : { to_spi[0], to_spi[1], from_spi[0], from_spi[1] })
+        if(fd >= 0)
+            close(fd);
+
+    mock_messages->check();
+    mock_messages_singleton = nullptr;
+    delete mock_messages;
+    mock_messages = nullptr;
+}
+
+static void wait_for(int fd, short events)
+{
+    struct pollfd pfd = { .fd = fd, .events = events };
+    cppcut_assert_equal(1, poll(&pfd, 1, 5000));
+}
+
+/*!\test
+ * Data written by DCPD show up in the channel.
+ */
+void test_data_from_dcpd_are_forwarded_to_channel()
+{
+    static const uint8_t data[] = { 0x01, 0x05, 0x02, 0x00, 0xaa, 0xbb };
+    cppcut_assert_equal(ssize_t(sizeof(data)),
+                        write(to_spi[1], data, sizeof(data)));
+
+    uint8_t buffer[16];
+    size_t received = 0;
+
+    while(received < sizeof(data))
+    {
+        wait_for(ipc_channel_get_poll_fd(channel), POLLIN);
+
+        const ssize_t len = ipc_channel_read(channel, buffer + received,
+                                             sizeof(buffer) - received);
+        if(len > 0)
+            received += len;
+    }
+
+    cut_assert_equal_memory(data, sizeof(data), buffer, received);
+}
+
+/*!\test
+ * More data than fit into the ring are forwarded as the channel user makes
+ * room.
+ */
+void test_data_from_dcpd_wait_for_space_in_full_ring()
+{
+    std::vector<uint8_t> data(2 * IPC_RING_SIZE + 100);
+
+    for(size_t i = 0; i < data.size(); ++i)
+        data[i] = i & UINT8_MAX;
+
+    cppcut_assert_equal(ssize_t(data.size()),
+                        write(to_spi[1], data.data(), data.size()));
+
+    std::vector<uint8_t> buffer(data.size());
+    size_t received = 0;
+
+    while(received < data.size())
+    {
+        wait_for(ipc_channel_get_poll_fd(channel), POLLIN);
+
+        const ssize_t len = ipc_channel_read(channel, buffer.data() + received,
+                                             buffer.size() - received);
+        if(len > 0)
+            received += len;
+    }
+
+    cut_assert_equal_memory(data.data(), data.size(), buffer.data(), received);
+}
+
+/*!\test
+ * Data written to the channel are sent to DCPD.
+ */
+void test_data_from_channel_are_forwarded_to_dcpd()
+{
+    static uint8_t data[] = { 0x02, 0x05, 0x01, 0x00, 0x42 };
+    const struct iovec iov = { .iov_base = data, .iov_len = sizeof(data) };
+    cppcut_assert_equal(ssize_t(sizeof(data)),
+                        ipc_channel_writev(channel, &iov, 1));
+
+    uint8_t buffer[16];
+    size_t received = 0;
+
+    while(received < sizeof(data))
+    {
+        wait_for(from_spi[0], POLLIN);
+
+        const ssize_t len = read(from_spi[0], buffer + received,
+                                 sizeof(buffer) - received);
+        cut_assert_true(len > 0);
+        received += len;
+    }
+
+    cut_assert_equal_memory(data, sizeof(data), buffer, received);
+}
+
+/*!\test
+ * DCPD closing its end of the pipe is reported as hangup on the channel.
+ */
+void test_dcpd_hangup_is_reported_to_channel()
+{
+    close(to_spi[1]);
+    to_spi[1] = -1;
+
+    struct pollfd pfd = { .fd = ipc_channel_get_peer_fd(channel), .events = 0 };
+    cppcut_assert_equal(1, poll(&pfd, 1, 5000));
+    cut_assert_true(pfd.revents & POLLHUP);
+}
+
+}
+
+/*!@}*/
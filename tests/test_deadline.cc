@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include <cppcutter.h>
+
+#include "deadline.h"
+
+#include "mock_messages.hh"
+#include "mock_os.hh"
+
+/*!
+ * \addtogroup deadline_tests Unit tests
+ * \ingroup deadline
+ *
+ * Deadline unit tests, mostly in virtual time.
+ */
+/*!@{*/
+
+namespace deadline_tests
+{
+
+static MockMessages *mock_messages;
+static MockOs *mock_os;
+
+void cut_setup()
+{
+    mock_messages = new MockMessages;
+    cppcut_assert_not_null(mock_messages);
+    mock_messages->init();
+    mock_messages_singleton = mock_messages;
+
+    mock_os = new MockOs;
+    cppcut_assert_not_null(mock_os);
+    mock_os->init();
+    mock_os_singleton = mock_os;
+}
+
+void cut_teardown()
+{
+    mock_messages->check();
+    mock_os->check();
+
+    mock_messages_singleton = nullptr;
+    mock_os_singleton = nullptr;
+
+    delete mock_messages;
+    delete mock_os;
+
+    mock_messages = nullptr;
+    mock_os = nullptr;
+}
+
+static void start(struct deadline &dl, unsigned int period_ms,
+                  unsigned int periods, const struct timespec &t)
+{
+    mock_os->expect_os_clock_gettime(0, 0, DEADLINE_CLOCK, t);
+
+    struct timespec now;
+    deadline_start(&dl, period_ms, periods, &now);
+
+    cppcut_assert_equal(t.tv_sec, now.tv_sec);
+    cppcut_assert_equal(t.tv_nsec, now.tv_nsec);
+}
+
+static bool check(struct deadline &dl, const struct timespec &t)
+{
+    mock_os->expect_os_clock_gettime(0, 0, DEADLINE_CLOCK, t);
+
+    struct timespec now;
+    const bool expired = deadline_check(&dl, &now);
+
+    cppcut_assert_equal(t.tv_sec, now.tv_sec);
+    cppcut_assert_equal(t.tv_nsec, now.tv_nsec);
+
+    return expired;
+}
+
+static void rearm(struct deadline &dl, const struct timespec &t)
+{
+    cut_assert_true(dl.needs_rearm);
+    mock_os->expect_os_clock_gettime(0, 0, DEADLINE_CLOCK, t);
+    deadline_rearm(&dl);
+    cut_assert_false(dl.needs_rearm);
+}
+
+/*!\test
+ * The first check consumes a period regardless of time, then each period
+ * starts when the deadline is re-armed.
+ */
+void test_deadline_expires_after_all_periods()
+{
+    struct deadline dl;
+    struct timespec t = { .tv_sec = 100, .tv_nsec = 0, };
+
+    start(dl, 1000, 2, t);
+
+    /* first check, no time has passed */
+    cut_assert_false(check(dl, t));
+    t.tv_nsec = 5000000;
+    rearm(dl, t);
+    cppcut_assert_equal(time_t(101), dl.expires.tv_sec);
+    cppcut_assert_equal(5000000L, dl.expires.tv_nsec);
+
+    /* not re-armed as long as the period lasts */
+    t.tv_sec = 101;
+    t.tv_nsec = 4999999;
+    cut_assert_false(check(dl, t));
+    deadline_rearm(&dl);
+
+    /* first real period expires */
+    t.tv_nsec = 5000000;
+    cut_assert_false(check(dl, t));
+    rearm(dl, t);
+
+    /* second real period expires */
+    t.tv_sec = 102;
+    cut_assert_true(check(dl, t));
+}
+
+/*!\test
+ * A long time of starvation between two checks consumes only one period.
+ */
+void test_starvation_consumes_single_period()
+{
+    struct deadline dl;
+    struct timespec t = { .tv_sec = 100, .tv_nsec = 0, };
+
+    start(dl, 1000, 3, t);
+
+    t.tv_sec += 60;
+    cut_assert_false(check(dl, t));
+    rearm(dl, t);
+
+    t.tv_sec += 60;
+    cut_assert_false(check(dl, t));
+    rearm(dl, t);
+
+    t.tv_sec += 60;
+    cut_assert_false(check(dl, t));
+    rearm(dl, t);
+
+    t.tv_sec += 60;
+    cut_assert_true(check(dl, t));
+}
+
+/*!\test
+ * The clock is not read while the deadline is waiting to be re-armed.
+ */
+void test_no_clock_read_while_rearm_is_pending()
+{
+    struct deadline dl;
+    struct timespec t = { .tv_sec = 100, .tv_nsec = 0, };
+
+    start(dl, 1000, 1, t);
+    cut_assert_false(check(dl, t));
+
+    struct timespec now = { .tv_sec = 42, .tv_nsec = 23, };
+    cut_assert_false(deadline_check(&dl, &now));
+    cppcut_assert_equal(time_t(42), now.tv_sec);
+    cppcut_assert_equal(23L, now.tv_nsec);
+
+    rearm(dl, t);
+
+    t.tv_sec += 1;
+    cut_assert_true(check(dl, t));
+}
+
+/*!\test
+ * Progress grants all periods again, starting with the next re-arm.
+ */
+void test_restart_grants_all_periods_again()
+{
+    struct deadline dl;
+    struct timespec t = { .tv_sec = 100, .tv_nsec = 0, };
+
+    start(dl, 1000, 2, t);
+    cut_assert_false(check(dl, t));
+    rearm(dl, t);
+
+    t.tv_sec += 1;
+    cut_assert_false(check(dl, t));
+    rearm(dl, t);
+
+    /* almost timed out, but slave answered */
+    deadline_restart(&dl);
+    cut_assert_false(deadline_check(&dl, &t));
+
+    t.tv_sec += 1;
+    rearm(dl, t);
+
+    t.tv_sec += 1;
+    cut_assert_false(check(dl, t));
+    rearm(dl, t);
+
+    t.tv_sec += 1;
+    cut_assert_true(check(dl, t));
+}
+
+/*!\test
+ * Expiration times carry nanoseconds over into seconds.
+ */
+void test_expiration_time_wraps_nanoseconds()
+{
+    struct deadline dl;
+    struct timespec t = { .tv_sec = 100, .tv_nsec = 800 * 1000 * 1000, };
+
+    start(dl, 1500, 1, t);
+    cut_assert_false(check(dl, t));
+    rearm(dl, t);
+
+    cppcut_assert_equal(time_t(102), dl.expires.tv_sec);
+    cppcut_assert_equal(300L * 1000L * 1000L, dl.expires.tv_nsec);
+
+    t.tv_sec = 102;
+    t.tv_nsec = 299999999;
+    cut_assert_false(check(dl, t));
+
+    t.tv_nsec = 300000000;
+    cut_assert_true(check(dl, t));
+}
+
+}
+
+/*!@}*/
@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include <cppcutter.h>
+#include <array>
+#include <memory>
+#include <poll.h>
+
+#include "ipc_ring.h"
+
+#include "mock_messages.hh"
+
+/*!
+ * \addtogroup ipc_ring_tests Unit tests
+ * \ingroup ipc_ring
+ *
+ * Shared memory ring buffer unit tests.
+ */
+/*!@{*/
+
+namespace ipc_ring_tests
+{
+
+static MockMessages *mock_messages;
+static std::unique_ptr<struct ipc_ring> ring;
+
+void cut_setup()
+{
+    mock_messages = new MockMessages;
+    cppcut_assert_not_null(mock_messages);
+    mock_messages->init();
+    mock_messages_singleton = mock_messages;
+
+    ring.reset(new struct ipc_ring);
+    memset(ring.get(), 0, sizeof(*ring));
+}
+
+void cut_teardown()
+{
+    ring.reset();
+
+    mock_messages->check();
+    mock_messages_singleton = nullptr;
+    delete mock_messages;
+    mock_messages = nullptr;
+}
+
+static size_t put(const uint8_t *data, size_t size)
+{
+    const struct iovec iov =
+    {
+        .iov_base = const_cast<uint8_t *>(data),
+        .iov_len = size,
+    };
+
+    return ipc_ring_put(ring.get(), &iov, 1);
+}
+
+/*!\test
+ * Data put into the ring can be taken out again.
+ */
+void test_put_and_get()
+{
+    static const uint8_t data[] = { 0x01, 0x02, 0x03, 0x04, 0x05 };
+
+    cppcut_assert_equal(size_t(0), ipc_ring_used(ring.get()));
+    cppcut_assert_equal(sizeof(data), put(data, sizeof(data)));
+    cppcut_assert_equal(sizeof(data), ipc_ring_used(ring.get()));
+
+    std::array<uint8_t, 16> buffer;
+    buffer.fill(0xaa);
+
+    cppcut_assert_equal(size_t(3), ipc_ring_get(ring.get(), buffer.data(), 3));
+    cut_assert_equal_memory(data, 3, buffer.data(), 3);
+    cppcut_assert_equal(size_t(2), ipc_ring_used(ring.get()));
+
+    cppcut_assert_equal(size_t(2),
+                        ipc_ring_get(ring.get(), buffer.data() + 3, 10));
+    cut_assert_equal_memory(data, sizeof(data), buffer.data(), sizeof(data));
+    cppcut_assert_equal(uint8_t(0xaa), buffer[sizeof(data)]);
+    cppcut_assert_equal(size_t(0), ipc_ring_used(ring.get()));
+}
+
+/*!\test
+ * Reading from an empty ring returns nothing and leaves the buffer alone.
+ */
+void test_get_from_empty_ring()
+{
+    uint8_t buffer[4] = { 0x55, 0x55, 0x55, 0x55 };
+
+    cppcut_assert_equal(size_t(0), ipc_ring_get(ring.get(), buffer, sizeof(buffer)));
+    cppcut_assert_equal(uint8_t(0x55), buffer[0]);
+}
+
+/*!\test
+ * Multiple I/O vectors are gathered into the ring in order.
+ */
+void test_put_gathers_io_vector()
+{
+    static const uint8_t header[] = { 'c', 0x01, 0x00, 0x05, 0x00, 0x03 };
+    static const uint8_t payload[] = { 0x10, 0x20, 0x30 };
+
+    const struct iovec iov[] =
+    {
+        { .iov_base = const_cast<uint8_t *>(header), .iov_len = sizeof(header), },
+        { .iov_base = nullptr, .iov_len = 0, },
+        { .iov_base = const_cast<uint8_t *>(payload), .iov_len = sizeof(payload), },
+    };
+
+    cppcut_assert_equal(sizeof(header) + sizeof(payload),
+                        ipc_ring_put(ring.get(), iov, 3));
+
+    static const uint8_t expected[] =
+    {
+        'c', 0x01, 0x00, 0x05, 0x00, 0x03, 0x10, 0x20, 0x30,
+    };
+    uint8_t buffer[sizeof(expected)];
+
+    cppcut_assert_equal(sizeof(expected),
+                        ipc_ring_get(ring.get(), buffer, sizeof(buffer)));
+    cut_assert_equal_memory(expected, sizeof(expected), buffer, sizeof(buffer));
+}
+
+/*!\test
+ * Data wrapping around the end of the ring are copied correctly.
+ */
+void test_put_and_get_across_end_of_ring()
+{
+    std::vector<uint8_t> filler(IPC_RING_SIZE - 4);
+    cppcut_assert_equal(filler.size(), put(filler.data(), filler.size()));
+    cppcut_assert_equal(filler.size(),
+                        ipc_ring_get(ring.get(), filler.data(), filler.size()));
+
+    static const uint8_t data[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07 };
+    cppcut_assert_equal(sizeof(data), put(data, sizeof(data)));
+    cppcut_assert_equal(sizeof(data), ipc_ring_used(ring.get()));
+    cppcut_assert_equal(uint8_t(0x05), ring->data[0]);
+
+    uint8_t buffer[sizeof(data)];
+    cppcut_assert_equal(sizeof(data),
+                        ipc_ring_get(ring.get(), buffer, sizeof(buffer)));
+    cut_assert_equal_memory(data, sizeof(data), buffer, sizeof(buffer));
+}
+
+/*!\test
+ * A full ring accepts only as much as fits.
+ */
+void test_put_into_full_ring_is_partial()
+{
+    std::vector<uint8_t> data(IPC_RING_SIZE - 2, 0x7f);
+    cppcut_assert_equal(data.size(), put(data.data(), data.size()));
+
+    static const uint8_t more[] = { 0x01, 0x02, 0x03, 0x04 };
+    cppcut_assert_equal(size_t(2), put(more, sizeof(more)));
+    cppcut_assert_equal(size_t(IPC_RING_SIZE), ipc_ring_used(ring.get()));
+    cppcut_assert_equal(size_t(0), put(more, sizeof(more)));
+
+    cppcut_assert_equal(data.size(),
+                        ipc_ring_get(ring.get(), data.data(), data.size()));
+
+    uint8_t buffer[2];
+    cppcut_assert_equal(size_t(2),
+                        ipc_ring_get(ring.get(), buffer, sizeof(buffer)));
+    cut_assert_equal_memory(more, 2, buffer, sizeof(buffer));
+}
+
+/*!\test
+ * Free-running indices keep working when they overflow.
+ */
+void test_indices_wrap_around_at_32_bits()
+{
+    ring->head = UINT32_MAX - 1;
+    ring->tail = UINT32_MAX - 1;
+
+    static const uint8_t data[] = { 0xde, 0xad, 0xbe, 0xef };
+    cppcut_assert_equal(sizeof(data), put(data, sizeof(data)));
+    cppcut_assert_equal(uint32_t(2), ring->tail);
+    cppcut_assert_equal(sizeof(data), ipc_ring_used(ring.get()));
+
+    uint8_t buffer[sizeof(data)];
+    cppcut_assert_equal(sizeof(data),
+                        ipc_ring_get(ring.get(), buffer, sizeof(buffer)));
+    cut_assert_equal_memory(data, sizeof(data), buffer, sizeof(buffer));
+    cppcut_assert_equal(size_t(0), ipc_ring_used(ring.get()));
+}
+
+/*!\test
+ * Data written by the peer of a local channel are read by the channel user.
+ */
+void test_local_channel_peer_to_user()
+{
+    struct ipc_channel *ch = ipc_channel_create_local();
+    cppcut_assert_not_null(ch);
+
+    static uint8_t data[] = { 0x01, 0x02, 0x03, 0x04, 0x05 };
+    const struct iovec iov = { .iov_base = data, .iov_len = sizeof(data) };
+    cppcut_assert_equal(ssize_t(sizeof(data)),
+                        ipc_channel_peer_writev(ch, &iov, 1));
+
+    struct pollfd pfd = { .fd = ipc_channel_get_poll_fd(ch), .events = POLLIN };
+    cppcut_assert_equal(1, poll(&pfd, 1, 0));
+
+    uint8_t buffer[16];
+    cppcut_assert_equal(ssize_t(sizeof(data)),
+                        ipc_channel_read(ch, buffer, sizeof(buffer)));
+    cut_assert_equal_memory(data, sizeof(data), buffer, sizeof(data));
+
+    cppcut_assert_equal(ssize_t(-1),
+                        ipc_channel_read(ch, buffer, sizeof(buffer)));
+    cppcut_assert_equal(EAGAIN, errno);
+
+    ipc_channel_close(ch);
+}
+
+/*!\test
+ * Data written by the user of a local channel are read by the peer.
+ */
+void test_local_channel_user_to_peer()
+{
+    struct ipc_channel *ch = ipc_channel_create_local();
+    cppcut_assert_not_null(ch);
+
+    static uint8_t header[] = { 0x02, 0x05, 0x02, 0x00 };
+    static uint8_t payload[] = { 0xaa, 0xbb };
+    const struct iovec iov[] =
+    {
+        { .iov_base = header, .iov_len = sizeof(header) },
+        { .iov_base = payload, .iov_len = sizeof(payload) },
+    };
+    cppcut_assert_equal(ssize_t(sizeof(header) + sizeof(payload)),
+                        ipc_channel_writev(ch, iov, 2));
+
+    struct pollfd pfd = { .fd = ipc_channel_get_peer_poll_fd(ch), .events = POLLIN };
+    cppcut_assert_equal(1, poll(&pfd, 1, 0));
+
+    static const uint8_t expected[] = { 0x02, 0x05, 0x02, 0x00, 0xaa, 0xbb };
+    uint8_t buffer[16];
+    cppcut_assert_equal(ssize_t(sizeof(expected)),
+                        ipc_channel_peer_read(ch, buffer, sizeof(buffer)));
+    cut_assert_equal_memory(expected, sizeof(expected), buffer, sizeof(expected));
+
+    ipc_channel_close(ch);
+}
+
+/*!\test
+ * The user of a local channel is woken up when the peer has made room in a
+ * full ring.
+ */
+void test_local_channel_user_is_woken_up_when_ring_has_space()
+{
+    struct ipc_channel *ch = ipc_channel_create_local();
+    cppcut_assert_not_null(ch);
+
+    std::vector<uint8_t> data(IPC_RING_SIZE, 0x55);
+    const struct iovec iov = { .iov_base = data.data(), .iov_len = data.size() };
+    cppcut_assert_equal(ssize_t(IPC_RING_SIZE), ipc_channel_writev(ch, &iov, 1));
+
+    struct pollfd pfd = { .fd = ipc_channel_get_space_poll_fd(ch), .events = POLLIN };
+    cppcut_assert_equal(0, poll(&pfd, 1, 0));
+
+    cppcut_assert_equal(ssize_t(-1), ipc_channel_writev(ch, &iov, 1));
+    cppcut_assert_equal(EAGAIN, errno);
+    cppcut_assert_equal(0, poll(&pfd, 1, 0));
+
+    uint8_t buffer[16];
+    cppcut_assert_equal(ssize_t(sizeof(buffer)),
+                        ipc_channel_peer_read(ch, buffer, sizeof(buffer)));
+    cppcut_assert_equal(1, poll(&pfd, 1, 0));
+
+    cppcut_assert_equal(ssize_t(sizeof(buffer)), ipc_channel_writev(ch, &iov, 1));
+
+    ipc_channel_close(ch);
+}
+
+/*!\test
+ * The peer hanging up is reported through the peer file descriptor.
+ */
+void test_local_channel_peer_hangup_is_reported()
+{
+    struct ipc_channel *ch = ipc_channel_create_local();
+    cppcut_assert_not_null(ch);
+
+    struct pollfd pfd = { .fd = ipc_channel_get_peer_fd(ch), .events = 0 };
+    cppcut_assert_equal(0, poll(&pfd, 1, 0));
+
+    ipc_channel_peer_hang_up(ch);
+
+    cppcut_assert_equal(1, poll(&pfd, 1, 0));
+    cut_assert_true(pfd.revents & POLLHUP);
+
+    ipc_channel_close(ch);
+}
+
+}
+
+/*!@}*/
@@ -0,0 +1,596 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+
+#include <cppcutter.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "dcpspi_process.h"
+#include "dcpdefs.h"
+#include "spi.h"
+#include "spi_hw.h"
+#include "gpio.h"
+#include "hexdump.h"
+#include "os_writev.h"
+
+#include "mock_messages.hh"
+#include "virtual_clock.hh"
+#include "fake_dcp_peers.hh"
+
+ssize_t (*os_read)(int fd, void *dest, size_t count);
+ssize_t (*os_write)(int fd, const void *buf, size_t count);
+ssize_t (*os_writev)(int fd, const struct iovec *iov, int iovcnt);
+int (*os_poll)(struct pollfd *fds, nfds_t nfds, int timeout);
+
+/* Dummy implementation */
+void hexdump_to_log(enum MessageVerboseLevel level,
+                    const uint8_t *const buffer, size_t buffer_length,
+                    const char *what)
+{
+    cppcut_assert_not_null(buffer);
+    cppcut_assert_not_null(what);
+}
+
+/*!
+ * \addtogroup latency_tests Latency regression tests
+ *
+ * Latency budgets of complete transactions, measured in virtual time.
+ *
+ * In contrast to the complete transfer tests, these tests do not expect any
+ * particular sequence of calls. A simulated DCPD and SPI slave react to
+ * whatever #dcpspi_process() does, and a #VirtualClock keeps track of how long
+ * it takes. Budgets are a bit larger than what the code needs today, but much
+ * smaller than any sleep or timeout in the code, so that a new wait in one of
+ * these paths lets the tests fail.
+ */
+/*!@{*/
+
+namespace latency_tests
+{
+
+static const int expected_fifo_in_fd = 40;
+static const int expected_fifo_out_fd = 50;
+static const int expected_gpio_fd = 60;
+static const int expected_spi_fd = 70;
+
+/* slave read probes are this large, see #spi_send_buffer() */
+static constexpr size_t slave_ready_probe_size = 2;
+
+/* default SPI clock, see spi.c */
+static constexpr uint32_t default_spi_speed_hz = 900U * 1000U;
+
+/* give up if nothing has happened after this many iterations */
+static constexpr unsigned int max_iterations = 100;
+
+struct DCPDPacket
+{
+    uint8_t command_;
+    uint8_t ttl_;
+    uint16_t serial_;
+    std::vector<uint8_t> data_;
+    uint64_t received_us_;
+};
+
+/*!
+ * Simulated DCPD on the other end of the pipes.
+ *
+ * Packets written by #dcpspi_process() are timestamped when they are
+ * complete. NACKed master packets are sent again right away with the TTL
+ * taken from the NACK, just like DCPD does.
+ */
+class FakeDCPD
+{
+  private:
+    fake_dcp_peers::DCPDPipe pipe_;
+    std::map<uint16_t, std::vector<uint8_t>> master_packets_;
+
+  public:
+    std::vector<DCPDPacket> received_;
+
+    FakeDCPD(const FakeDCPD &) = delete;
+    FakeDCPD &operator=(const FakeDCPD &) = delete;
+
+    explicit FakeDCPD() {}
+
+    void send(uint16_t serial, uint8_t ttl, const std::vector<uint8_t> &packet)
+    {
+        master_packets_[serial] = packet;
+        pipe_.send('c', ttl, serial, packet);
+    }
+
+    bool has_input() const { return pipe_.has_input(); }
+
+    ssize_t read(void *dest, size_t count) { return pipe_.read(dest, count); }
+
+    void write(const void *src, size_t count)
+    {
+        pipe_.write(src, count);
+        pipe_.process_output(
+            [this] (uint8_t command, uint8_t ttl, uint16_t serial,
+                    const uint8_t *data, size_t size)
+            {
+                if(command == 'n' && ttl > 0)
+                    send(serial, ttl, master_packets_[serial]);
+
+                received_.emplace_back(DCPDPacket
+                {
+                    command, ttl, serial, std::vector<uint8_t>(data, data + size),
+                    virtual_clock_singleton->now_us(),
+                });
+            });
+    }
+
+    const DCPDPacket *find(uint8_t command, uint16_t serial = 0) const
+    {
+        for(const auto &p : received_)
+            if(p.command_ == command && (command == 'c' || p.serial_ == serial))
+                return &p;
+
+        return nullptr;
+    }
+};
+
+/*!
+ * Simulated SPI slave and its request line.
+ *
+ * The slave asserts the request line when it has something to send, streams
+ * the escaped packet (preceded by a NOP) to the master, and deasserts the
+ * request line as soon as the packet has been read completely. The GPIO
+ * behaves like a sysfs GPIO: an edge is reported by \c poll(2) until the
+ * value has been read.
+ */
+class FakeSlave
+{
+  private:
+    fake_dcp_peers::SlaveStream stream_;
+    std::vector<uint8_t> colliding_packet_;
+
+  public:
+    bool is_request_active_;
+    bool is_request_reported_;
+    uint64_t request_asserted_us_;
+    unsigned int collisions_;
+
+    FakeSlave(const FakeSlave &) = delete;
+    FakeSlave &operator=(const FakeSlave &) = delete;
+
+    explicit FakeSlave():
+        is_request_active_(false),
+        is_request_reported_(false),
+        request_asserted_us_(0),
+        collisions_(0)
+    {}
+
+    void request(const std::vector<uint8_t> &packet)
+    {
+        stream_.start(packet);
+        is_request_active_ = true;
+        request_asserted_us_ = virtual_clock_singleton->now_us();
+    }
+
+    /*!
+     * Start sending \p packet when the master probes us next time.
+     */
+    void collide_on_next_probe(const std::vector<uint8_t> &packet)
+    {
+        colliding_packet_ = packet;
+    }
+
+    bool has_gpio_event() const
+    {
+        return is_request_active_ != is_request_reported_;
+    }
+
+    void transfer(const struct spi_ioc_transfer &xfer)
+    {
+        auto *const rx = reinterpret_cast<uint8_t *>(xfer.rx_buf);
+
+        if(rx == nullptr)
+            return;
+
+        if(xfer.len == slave_ready_probe_size && !stream_.is_sending())
+        {
+            if(colliding_packet_.empty())
+            {
+                std::fill_n(rx, xfer.len, 0);
+                return;
+            }
+
+            ++collisions_;
+            request(colliding_packet_);
+            colliding_packet_.clear();
+        }
+
+        stream_.transfer(rx, xfer.len);
+
+        if(!stream_.is_sending())
+            is_request_active_ = false;
+    }
+};
+
+}
+
+struct gpio_handle
+{
+    int fd;
+};
+
+static latency_tests::FakeDCPD *fake_dcpd;
+static latency_tests::FakeSlave *fake_slave;
+
+short gpio_get_poll_events(const struct gpio_handle *gpio)
+{
+    return POLLPRI | POLLERR;
+}
+
+bool gpio_has_edge_events(const struct gpio_handle *gpio)
+{
+    return false;
+}
+
+ssize_t gpio_read_edge_events(struct gpio_handle *gpio,
+                              struct gpio_edge_event *events, size_t max_events)
+{
+    errno = EINVAL;
+    return -1;
+}
+
+bool gpio_is_active(const struct gpio_handle *gpio)
+{
+    cppcut_assert_equal(latency_tests::expected_gpio_fd, gpio->fd);
+    fake_slave->is_request_reported_ = fake_slave->is_request_active_;
+    return fake_slave->is_request_active_;
+}
+
+int gpio_get_debounce_fd(const struct gpio_handle *gpio)
+{
+    return -1;
+}
+
+enum GpioDebounceResult gpio_debounce(struct gpio_handle *gpio,
+                                      bool is_timer_event,
+                                      struct stats_wait *stats)
+{
+    return GPIO_DEBOUNCE_SETTLED;
+}
+
+int spi_hw_open_device(const char *devname)
+{
+    return latency_tests::expected_spi_fd;
+}
+
+void spi_hw_close_device(int fd) {}
+
+int spi_hw_do_transfer(int fd, const struct spi_ioc_transfer spi_transfer[],
+                       size_t number_of_fragments)
+{
+    cppcut_assert_equal(latency_tests::expected_spi_fd, fd);
+
+    for(size_t i = 0; i < number_of_fragments; ++i)
+        fake_slave->transfer(spi_transfer[i]);
+
+    virtual_clock_singleton->spi_transfer(spi_transfer, number_of_fragments);
+
+    return 0;
+}
+
+namespace latency_tests
+{
+
+static MockMessages *mock_messages;
+static VirtualClock *virtual_clock;
+
+static struct gpio_handle gpio = { expected_gpio_fd };
+static struct dcp_transaction *transaction;
+static struct slave_request_and_lock_data *rldata;
+
+static uint8_t dcp_buffer[DCPSYNC_HEADER_SIZE + DCP_HEADER_SIZE + DCP_PAYLOAD_MAXSIZE];
+static uint8_t spi_buffer[(DCP_HEADER_SIZE + DCP_PAYLOAD_MAXSIZE) * 2];
+
+static ssize_t read_fake(int fd, void *dest, size_t count)
+{
+    cppcut_assert_equal(expected_fifo_in_fd, fd);
+    return fake_dcpd->read(dest, count);
+}
+
+static ssize_t write_fake(int fd, const void *buf, size_t count)
+{
+    cppcut_assert_equal(expected_fifo_out_fd, fd);
+    fake_dcpd->write(buf, count);
+    return count;
+}
+
+static ssize_t writev_fake(int fd, const struct iovec *iov, int iovcnt)
+{
+    size_t count = 0;
+
+    for(int i = 0; i < iovcnt; ++i)
+        count += write_fake(fd, iov[i].iov_base, iov[i].iov_len);
+
+    return count;
+}
+
+static int poll_fake(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    int ready = 0;
+
+    for(nfds_t i = 0; i < nfds; ++i)
+    {
+        fds[i].revents = 0;
+
+        if(fds[i].fd == expected_gpio_fd && fake_slave->has_gpio_event())
+            fds[i].revents = POLLPRI;
+        else if(fds[i].fd == expected_fifo_in_fd && fake_dcpd->has_input())
+            fds[i].revents = POLLIN;
+        else if(fds[i].fd == expected_fifo_out_fd)
+            fds[i].revents = fds[i].events & POLLOUT;
+
+        if(fds[i].revents != 0)
+            ++ready;
+    }
+
+    if(ready > 0)
+        return ready;
+
+    /* nothing will ever happen if we wait forever, pretend a signal */
+    if(timeout < 0)
+    {
+        errno = EINTR;
+        return -1;
+    }
+
+    virtual_clock->poll_timed_out(timeout);
+
+    return 0;
+}
+
+static std::vector<uint8_t> make_dcp_packet(uint8_t reg, size_t payload_size)
+{
+    std::vector<uint8_t> packet;
+
+    fake_dcp_peers::make_dcp_packet(packet, reg, payload_size,
+                                    [] (size_t i) { return 0x30 + i % 64; });
+
+    return packet;
+}
+
+/*!
+ * Run the main loop until \p is_done returns true.
+ */
+template <typename F>
+static void process_until(F &&is_done)
+{
+    for(unsigned int i = 0; i < max_iterations; ++i)
+    {
+        cut_assert_true(dcpspi_process(expected_fifo_in_fd, expected_fifo_out_fd,
+                                       expected_spi_fd, transaction, rldata));
+
+        if(is_done())
+            return;
+    }
+
+    cut_fail("Not done after %u iterations", max_iterations);
+}
+
+static void assert_within_budget(uint64_t started_us, uint64_t finished_us,
+                                 uint64_t budget_us)
+{
+    cppcut_assert_operator(started_us, <=, finished_us);
+    cppcut_assert_operator(finished_us - started_us, <=, budget_us);
+}
+
+void cut_setup()
+{
+    os_read = read_fake;
+    os_write = write_fake;
+    os_writev = writev_fake;
+    os_poll = poll_fake;
+
+    mock_messages = new MockMessages;
+    cppcut_assert_not_null(mock_messages);
+    mock_messages->init();
+    mock_messages_singleton = mock_messages;
+    mock_messages->ignore_messages_with_level_or_above(MESSAGE_LEVEL_DIAG);
+
+    virtual_clock = new VirtualClock;
+    cppcut_assert_not_null(virtual_clock);
+    virtual_clock_singleton = virtual_clock;
+
+    fake_dcpd = new FakeDCPD;
+    cppcut_assert_not_null(fake_dcpd);
+
+    fake_slave = new FakeSlave;
+    cppcut_assert_not_null(fake_slave);
+
+    transaction = new dcp_transaction;
+    cppcut_assert_not_null(transaction);
+    memset(transaction, 0, sizeof(*transaction));
+    transaction->dcp_buffer.buffer = dcp_buffer;
+    transaction->dcp_buffer.size = sizeof(dcp_buffer);
+    transaction->spi_buffer.buffer = spi_buffer;
+    transaction->spi_buffer.size = sizeof(spi_buffer);
+
+    rldata = new slave_request_and_lock_data{true, &gpio, expected_gpio_fd, false};
+    cppcut_assert_not_null(rldata);
+
+    /* same settings as the daemon uses by default, see configure_slave() */
+    dcpspi_init();
+    dcpspi_read_ahead_enable(true);
+    dcpspi_nonblocking_spi_enable(true);
+    spi_reset();
+    spi_set_speed_hz(default_spi_speed_hz);
+    reset_transaction_struct(transaction, true);
+}
+
+void cut_teardown()
+{
+    mock_messages->check();
+
+    mock_messages_singleton = nullptr;
+    virtual_clock_singleton = nullptr;
+
+    delete mock_messages;
+    delete virtual_clock;
+    delete fake_dcpd;
+    delete fake_slave;
+    delete transaction;
+    delete rldata;
+
+    mock_messages = nullptr;
+    virtual_clock = nullptr;
+    fake_dcpd = nullptr;
+    fake_slave = nullptr;
+    transaction = nullptr;
+    rldata = nullptr;
+}
+
+/*!\test
+ * A slave packet reaches DCPD without any waiting apart from the SPI bus.
+ *
+ * Request line edge to DCPD delivery of a packet with 16 bytes of payload.
+ * The packet alone (20 bytes plus a NOP) takes about 190 us on the bus at
+ * 900 kHz.
+ */
+void test_slave_packet_is_delivered_to_dcpd_within_budget()
+{
+    static constexpr uint64_t budget_us = 500;
+
+    const auto packet = make_dcp_packet(0x58, 16);
+
+    fake_slave->request(packet);
+    process_until([] { return fake_dcpd->find('c') != nullptr; });
+
+    const DCPDPacket *const delivered = fake_dcpd->find('c');
+    cut_assert_equal_memory(packet.data(), packet.size(),
+                            delivered->data_.data(), delivered->data_.size());
+
+    assert_within_budget(fake_slave->request_asserted_us_,
+                         delivered->received_us_, budget_us);
+    cppcut_assert_equal(0U, virtual_clock->sleeps_);
+    cppcut_assert_equal(uint64_t(0), virtual_clock->poll_timeouts_ns_);
+}
+
+/*!
+ * Send a master packet and expect its ACK within budget.
+ *
+ * FIFO readable to ACK for a packet with 16 bytes of payload: one probe and
+ * the packet itself are 22 bytes, about 200 us on the bus at 900 kHz.
+ */
+static void send_master_packet_and_measure_ack()
+{
+    static constexpr uint64_t budget_us = 500;
+    static constexpr uint16_t serial = DCPSYNC_MASTER_SERIAL_MIN;
+
+    const uint64_t started_us = virtual_clock->now_us();
+
+    fake_dcpd->send(serial, 3, make_dcp_packet(0x47, 16));
+    process_until([] { return fake_dcpd->find('a', serial) != nullptr; });
+
+    assert_within_budget(started_us, fake_dcpd->find('a', serial)->received_us_,
+                         budget_us);
+    cut_assert_true(fake_dcpd->find('n', serial) == nullptr);
+    cppcut_assert_equal(0U, virtual_clock->sleeps_);
+    cppcut_assert_equal(uint64_t(0), virtual_clock->poll_timeouts_ns_);
+}
+
+/*!\test
+ * A master packet is acknowledged after a single slave ready probe.
+ */
+void test_master_packet_is_acknowledged_within_budget()
+{
+    send_master_packet_and_measure_ack();
+}
+
+/*!\test
+ * Same as #test_master_packet_is_acknowledged_within_budget(), but with
+ * blocking SPI transfers as selected by \c --blocking-spi.
+ */
+void test_master_packet_is_acknowledged_within_budget_with_blocking_spi()
+{
+    cut_assert_true(dcpspi_nonblocking_spi_enable(false));
+    send_master_packet_and_measure_ack();
+}
+
+/*!\test
+ * A master packet rejected because of a collision is retried right away.
+ *
+ * From the colliding probe, the slave packet has to be read and forwarded to
+ * DCPD, the master packet NACKed, and then sent again and ACKed. Both packets
+ * have 16 bytes of payload.
+ */
+void test_master_packet_is_retried_within_budget_after_collision()
+{
+    static constexpr uint64_t budget_us = 1000;
+    static constexpr uint16_t serial = DCPSYNC_MASTER_SERIAL_MIN;
+
+    const auto slave_packet = make_dcp_packet(0x58, 16);
+
+    mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
+                                              "Collision detected (got funny poll bytes)");
+
+    fake_slave->collide_on_next_probe(slave_packet);
+    fake_dcpd->send(serial, 3, make_dcp_packet(0x47, 16));
+    process_until([] { return fake_dcpd->find('a', serial) != nullptr; });
+
+    cppcut_assert_equal(1U, fake_slave->collisions_);
+
+    const DCPDPacket *const nack = fake_dcpd->find('n', serial);
+    cppcut_assert_not_null(nack);
+    cppcut_assert_not_null(fake_dcpd->find('c'));
+    cppcut_assert_operator(nack->received_us_, <=,
+                           fake_dcpd->find('a', serial)->received_us_);
+
+    assert_within_budget(fake_slave->request_asserted_us_,
+                         fake_dcpd->find('a', serial)->received_us_, budget_us);
+    cppcut_assert_equal(0U, virtual_clock->sleeps_);
+}
+
+/*!\test
+ * Latencies are dominated by the time spent on the SPI bus.
+ *
+ * Twice the clock gives roughly half the latency of a maximum size slave
+ * packet, which takes more than 5 ms on the bus at 900 kHz.
+ */
+void test_slave_packet_latency_scales_with_spi_clock()
+{
+    static constexpr size_t bus_bytes = 1 + DCP_HEADER_SIZE + DCP_PAYLOAD_MAXSIZE;
+    const auto packet = make_dcp_packet(0x58, DCP_PAYLOAD_MAXSIZE);
+
+    spi_set_speed_hz(2 * default_spi_speed_hz);
+
+    fake_slave->request(packet);
+    process_until([] { return fake_dcpd->find('c') != nullptr; });
+
+    const uint64_t wire_us =
+        VirtualClock::spi_duration_ns(bus_bytes, 2 * default_spi_speed_hz) / 1000U;
+
+    cppcut_assert_operator(wire_us, <=, virtual_clock->spi_ns_ / 1000U);
+    assert_within_budget(fake_slave->request_asserted_us_,
+                         fake_dcpd->find('c')->received_us_,
+                         wire_us + 200);
+    cppcut_assert_equal(0U, virtual_clock->sleeps_);
+}
+
+}
+
+/*!@}*/
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include <cppcutter.h>
+
+#include "rt_profile.h"
+
+#include "mock_messages.hh"
+
+/*!
+ * \addtogroup rt_profile_tests Unit tests
+ * \ingroup rt_profile
+ *
+ * Real-time profile unit tests.
+ */
+/*!@{*/
+
+namespace rt_profile_tests
+{
+
+static MockMessages *mock_messages;
+
+void cut_setup()
+{
+    mock_messages = new MockMessages;
+    cppcut_assert_not_null(mock_messages);
+    mock_messages->init();
+    mock_messages_singleton = mock_messages;
+}
+
+void cut_teardown()
+{
+    mock_messages->check();
+    mock_messages_singleton = nullptr;
+    delete mock_messages;
+    mock_messages = nullptr;
+}
+
+/*!\test
+ * A default profile leaves everything alone.
+ */
+void test_default_profile_changes_nothing()
+{
+    struct rt_profile profile;
+    rt_profile_init(&profile);
+
+    cppcut_assert_equal(SCHED_OTHER, profile.sched_policy);
+    cppcut_assert_equal(0, CPU_COUNT(&profile.cpus));
+    cut_assert_false(profile.lock_memory);
+
+    cppcut_assert_equal(0, rt_profile_apply(&profile));
+}
+
+/*!\test
+ * Scheduling policies are given by short names.
+ */
+void test_policy_from_string()
+{
+    int policy = -1;
+
+    cut_assert_true(rt_profile_policy_from_string("fifo", &policy));
+    cppcut_assert_equal(SCHED_FIFO, policy);
+    cut_assert_true(rt_profile_policy_from_string("rr", &policy));
+    cppcut_assert_equal(SCHED_RR, policy);
+    cut_assert_true(rt_profile_policy_from_string("other", &policy));
+    cppcut_assert_equal(SCHED_OTHER, policy);
+
+    cut_assert_false(rt_profile_policy_from_string("FIFO", &policy));
+    cppcut_assert_equal(SCHED_OTHER, policy);
+}
+
+/*!\test
+ * CPU lists may contain single CPUs and ranges.
+ */
+void test_cpu_list_from_string()
+{
+    cpu_set_t cpus;
+
+    cut_assert_true(rt_profile_cpus_from_string("1", &cpus));
+    cppcut_assert_equal(1, CPU_COUNT(&cpus));
+    cut_assert_true(CPU_ISSET(1, &cpus));
+
+    cut_assert_true(rt_profile_cpus_from_string("0,2-4,7", &cpus));
+    cppcut_assert_equal(5, CPU_COUNT(&cpus));
+    cut_assert_true(CPU_ISSET(0, &cpus));
+    cut_assert_false(CPU_ISSET(1, &cpus));
+    cut_assert_true(CPU_ISSET(2, &cpus));
+    cut_assert_true(CPU_ISSET(3, &cpus));
+    cut_assert_true(CPU_ISSET(4, &cpus));
+    cut_assert_false(CPU_ISSET(5, &cpus));
+    cut_assert_true(CPU_ISSET(7, &cpus));
+}
+
+/*!\test
+ * Malformed CPU lists are rejected.
+ */
+void test_invalid_cpu_lists_are_rejected()
+{
+    static const char *const lists[] =
+    {
+        "", ",", "1,", ",1", "a", "1a", "-1", "1-", "3-2", "1--2", "1 2",
+        "100000",
+    };
+
+    for(const auto &list : lists)
+    {
+        cpu_set_t cpus;
+        cut_assert_false(rt_profile_cpus_from_string(list, &cpus),
+                         cut_message("List \"%s\"", list));
+    }
+}
+
+/*!\test
+ * Prefaulting leaves the buffer content alone.
+ */
+void test_prefault_keeps_buffer_content()
+{
+    static uint8_t buffer[3 * 4096 + 5];
+
+    for(size_t i = 0; i < sizeof(buffer); ++i)
+        buffer[i] = i & 0xff;
+
+    rt_profile_prefault(buffer, sizeof(buffer));
+    rt_profile_prefault(buffer, 0);
+
+    for(size_t i = 0; i < sizeof(buffer); ++i)
+        cppcut_assert_equal(uint8_t(i & 0xff), buffer[i]);
+}
+
+}
+
+/*!@}*/
@@ -21,6 +21,8 @@
 
 #include <cppcutter.h>
 #include <array>
+#include <vector>
+#include <random>
 
 #include "spi.h"
 #include "dcpdefs.h"
@@ -39,6 +41,8 @@
  */
 /*!@{*/
 
+int (*os_poll)(struct pollfd *fds, nfds_t nfds, int timeout);
+
 /* Dummy implementation */
 void hexdump_to_log(enum MessageVerboseLevel level,
                     const uint8_t *const buffer, size_t buffer_length,
@@ -81,6 +85,10 @@ void cut_setup()
     cppcut_assert_not_null(spi_rw_data);
 
     spi_reset();
+    spi_set_slave_ready_strategy(SPI_SLAVE_READY_FIXED_DELAY, 20, 0, -1,
+                                 POLLPRI | POLLERR);
+
+    os_poll = nullptr;
 }
 
 void cut_teardown()
@@ -137,21 +145,21 @@ static void advance_to_last_read_timeout_iteration(struct timespec &t,
 {
     /* first iteration always runs into a timeout if SPI remains silent,
      * regardless of current time; this is part of the strategy */
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_spi_hw->expect_spi_hw_do_transfer_callback(return_nops);
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_os->expect_os_nanosleep(0, delay_between_slave_probes_ms);
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     /* more iterations */
     for(int i = 0; i < 4; ++i)
     {
         mock_spi_hw->expect_spi_hw_do_transfer_callback(return_nops);
         t.tv_sec += add_seconds_first;
-        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
         mock_os->expect_os_nanosleep(0, delay_between_slave_probes_ms);
         t.tv_sec += add_seconds_second;
-        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     }
 }
 
@@ -162,21 +170,21 @@ static void advance_to_last_send_timeout_iteration(struct timespec &t,
     /* first iteration always runs into a timeout if SPI slave doesn't respond
      * immediately on first try, regardless of current time; this is part of
      * the strategy */
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_spi_hw->expect_spi_hw_do_transfer_callback(return_nops);
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_os->expect_os_nanosleep(0, delay_between_slave_probes_ms);
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     /* more iterations */
     for(int i = 0; i < 2; ++i)
     {
         mock_spi_hw->expect_spi_hw_do_transfer_callback(return_nops);
         t.tv_sec += add_seconds_first;
-        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
         mock_os->expect_os_nanosleep(0, delay_between_slave_probes_ms);
         t.tv_sec += add_seconds_second;
-        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     }
 }
 
@@ -188,7 +196,7 @@ static void ensure_empty_read_buffer()
     /* last iteration: timeout */
     mock_spi_hw->expect_spi_hw_do_transfer_callback(return_nops);
     ++t.tv_sec;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     mock_messages->expect_msg_error(0, LOG_NOTICE,
                                     "SPI read timeout, returning %zu of %zu bytes");
@@ -225,7 +233,7 @@ void test_read_from_spi()
     expect_spi_transfers(expected_content.size());
 
     static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     std::array<uint8_t, 100> buffer;
     buffer.fill(0xab);
@@ -241,6 +249,157 @@ void test_read_from_spi()
     ensure_empty_read_buffer();
 }
 
+/*!\test
+ * Payloads of known size are read in a single transfer with some headroom.
+ */
+void test_read_payload_from_spi_in_one_transfer()
+{
+    std::array<uint8_t, 100 + 16> slave_data;
+    slave_data.fill(UINT8_MAX);
+
+    /* slave sends a few NOPs before its data */
+    for(size_t i = 0; i < 100; ++i)
+        slave_data[i + 3] = i + DCP_ESCAPE_CHARACTER + 1;
+
+    spi_rw_data->set_single(spi_rw_data_t::EXPECT_WRITE_NOPS, slave_data);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+
+    static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    std::array<uint8_t, 100> buffer;
+    buffer.fill(0xab);
+
+    cppcut_assert_equal(ssize_t(buffer.size()),
+                        spi_read_payload(expected_spi_fd,
+                                         buffer.data(), buffer.size(),
+                                         nullptr));
+
+    cut_assert_equal_memory(slave_data.data() + 3, buffer.size(),
+                            buffer.data(), buffer.size());
+
+    ensure_empty_read_buffer();
+}
+
+/*!\test
+ * Bytes following the payload are kept in the internal buffer, and bytes
+ * missing due to escape sequences are read in small chunks.
+ */
+void test_read_payload_with_escapes_and_trailing_bytes()
+{
+    std::array<uint8_t, 50 + 16> slave_data;
+    slave_data.fill(UINT8_MAX);
+
+    /* every other byte in the payload is escaped, so the headroom is too
+     * small for reading it all in one go */
+    std::array<uint8_t, 50> expected_content;
+    size_t pos = 0;
+    size_t bytes_in_first_transfer = 0;
+
+    for(size_t i = 0; i < expected_content.size(); ++i)
+    {
+        expected_content[i] = (i % 2 == 0) ? UINT8_MAX : (i | 0x80);
+
+        const size_t needed = (expected_content[i] == UINT8_MAX) ? 2 : 1;
+
+        if(pos + needed > slave_data.size())
+            continue;
+
+        if(needed == 2)
+        {
+            slave_data[pos++] = DCP_ESCAPE_CHARACTER;
+            slave_data[pos++] = 0x01;
+        }
+        else
+            slave_data[pos++] = expected_content[i];
+
+        ++bytes_in_first_transfer;
+    }
+
+    cppcut_assert_equal(size_t(44), bytes_in_first_transfer);
+
+    spi_rw_data->set_single(spi_rw_data_t::EXPECT_WRITE_NOPS, slave_data);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+
+    /* remaining bytes, and then some bytes not belonging to the payload */
+    std::array<uint8_t, 32> second_chunk;
+    second_chunk.fill(UINT8_MAX);
+    pos = 0;
+
+    for(size_t i = bytes_in_first_transfer; i < expected_content.size(); ++i)
+    {
+        if(expected_content[i] == UINT8_MAX)
+        {
+            second_chunk[pos++] = DCP_ESCAPE_CHARACTER;
+            second_chunk[pos++] = 0x01;
+        }
+        else
+            second_chunk[pos++] = expected_content[i];
+    }
+
+    second_chunk[pos++] = 0x5a;
+    second_chunk[pos++] = 0xa5;
+
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, second_chunk);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+
+    static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    std::array<uint8_t, 50> buffer;
+    buffer.fill(0xab);
+
+    cppcut_assert_equal(ssize_t(buffer.size()),
+                        spi_read_payload(expected_spi_fd,
+                                         buffer.data(), buffer.size(),
+                                         nullptr));
+
+    cut_assert_equal_memory(expected_content.data(), expected_content.size(),
+                            buffer.data(), buffer.size());
+
+    /* trailing bytes are still there */
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    std::array<uint8_t, 2> trailing;
+
+    cppcut_assert_equal(ssize_t(trailing.size()),
+                        spi_read_buffer(expected_spi_fd,
+                                        trailing.data(), trailing.size(),
+                                        nullptr));
+    cppcut_assert_equal(0x5a, int(trailing[0]));
+    cppcut_assert_equal(0xa5, int(trailing[1]));
+
+    ensure_empty_read_buffer();
+}
+
+/*!\test
+ * Short payloads are read in small chunks.
+ */
+void test_read_short_payload_from_spi()
+{
+    std::array<uint8_t, 10> expected_content;
+    for(size_t i = 0; i < expected_content.size(); ++i)
+        expected_content[i] = i + DCP_ESCAPE_CHARACTER + 1;
+
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, expected_content);
+    expect_spi_transfers(expected_content.size());
+
+    static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    std::array<uint8_t, 10> buffer;
+
+    cppcut_assert_equal(ssize_t(buffer.size()),
+                        spi_read_payload(expected_spi_fd,
+                                         buffer.data(), buffer.size(),
+                                         nullptr));
+
+    cut_assert_equal_memory(expected_content.data(), expected_content.size(),
+                            buffer.data(), buffer.size());
+
+    ensure_empty_read_buffer();
+}
+
 /*!\test
  * Read some data from SPI slave with escape characters inside.
  */
@@ -270,7 +429,7 @@ void test_read_escaped_data_from_spi()
     expect_spi_transfers(escaped_data.size());
 
     static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     std::array<uint8_t, 11> buffer;
     buffer.fill(0x55);
@@ -309,7 +468,7 @@ void test_read_escaped_data_from_spi_with_last_character_in_first_chunk_is_escap
     cppcut_assert_equal(size_t(2), expect_spi_transfers(data.size()));
 
     static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     /* should receive 63 bytes */
     std::array<uint8_t, 2 * read_from_slave_spi_transfer_size - 1> buffer;
@@ -356,13 +515,13 @@ void test_write_to_spi()
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
 
     static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     cppcut_assert_equal(SPI_SEND_RESULT_OK,
                         spi_send_buffer(expected_spi_fd,
                                         expected_content.data(),
                                         expected_content.size(),
-                                        nullptr));
+                                        nullptr, nullptr));
 }
 
 /*!\test
@@ -384,11 +543,11 @@ void test_write_escaped_data_to_spi()
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
 
     static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     cppcut_assert_equal(SPI_SEND_RESULT_OK,
                         spi_send_buffer(expected_spi_fd, raw_data.data(),
-                                        raw_data.size(), nullptr));
+                                        raw_data.size(), nullptr, nullptr));
 }
 
 /*!\test
@@ -421,6 +580,166 @@ void test_escape_data_for_dcp_over_spi()
                             buffer, expected_result.size());
 }
 
+/*!\test
+ * Size of escaped data can be computed in advance.
+ */
+void test_escaped_length_of_data_for_dcp_over_spi()
+{
+    static const std::array<uint8_t, 6> raw_data =
+    {
+        0x00, 0x01, 0x02, DCP_ESCAPE_CHARACTER, UINT8_MAX - 1U, UINT8_MAX,
+    };
+
+    cppcut_assert_equal(size_t(8),
+                        spi_escaped_length(raw_data.data(), raw_data.size()));
+    cppcut_assert_equal(size_t(0), spi_escaped_length(raw_data.data(), 0));
+
+    std::array<uint8_t, 100> plain;
+    plain.fill(0x42);
+    cppcut_assert_equal(plain.size(),
+                        spi_escaped_length(plain.data(), plain.size()));
+
+    plain.fill(UINT8_MAX);
+    cppcut_assert_equal(2 * plain.size(),
+                        spi_escaped_length(plain.data(), plain.size()));
+}
+
+/*!\test
+ * Escaping long buffers with and without special characters in them.
+ */
+void test_escape_long_data_for_dcp_over_spi()
+{
+    std::mt19937 prng(0x1234);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_int_distribution<size_t> length(0, 260);
+    std::uniform_int_distribution<int> density(0, 3);
+
+    for(int iteration = 0; iteration < 500; ++iteration)
+    {
+        std::vector<uint8_t> raw_data(length(prng));
+        const int d = density(prng);
+
+        for(auto &b : raw_data)
+        {
+            b = byte(prng);
+
+            /* mostly plain data in some iterations */
+            if(d > 0 && (b == UINT8_MAX || b == DCP_ESCAPE_CHARACTER) &&
+               byte(prng) < 255 - 80 * d)
+                b = 0x55;
+        }
+
+        std::vector<uint8_t> expected;
+
+        for(const auto b : raw_data)
+        {
+            if(b == UINT8_MAX)
+            {
+                expected.push_back(DCP_ESCAPE_CHARACTER);
+                expected.push_back(0x01);
+            }
+            else if(b == DCP_ESCAPE_CHARACTER)
+            {
+                expected.push_back(DCP_ESCAPE_CHARACTER);
+                expected.push_back(DCP_ESCAPE_CHARACTER);
+            }
+            else
+                expected.push_back(b);
+        }
+
+        cppcut_assert_equal(expected.size(),
+                            spi_escaped_length(raw_data.data(), raw_data.size()));
+
+        std::vector<uint8_t> buffer(2 * raw_data.size() + 1, 0xaa);
+
+        cppcut_assert_equal(expected.size(),
+                            spi_fill_buffer_from_raw_data(buffer.data(), buffer.size(),
+                                                          raw_data.data(),
+                                                          raw_data.size()));
+        cut_assert_equal_memory(expected.data(), expected.size(),
+                                buffer.data(), expected.size());
+
+        /* truncated output is a prefix of the full output */
+        if(expected.size() > 1)
+        {
+            const size_t limit = expected.size() / 2;
+
+            cppcut_assert_equal(limit,
+                                spi_fill_buffer_from_raw_data(buffer.data(), limit,
+                                                              raw_data.data(),
+                                                              raw_data.size()));
+            cut_assert_equal_memory(expected.data(), limit,
+                                    buffer.data(), limit);
+        }
+    }
+}
+
+/*!\test
+ * Escaping into fragments references plain spans in the source buffer and
+ * yields the same bytes as copying.
+ */
+void test_escape_data_into_fragments()
+{
+    static const std::array<uint8_t, 7> raw_data =
+    {
+        0x00, 0x01, DCP_ESCAPE_CHARACTER, UINT8_MAX, 0x02, 0x03, UINT8_MAX,
+    };
+
+    std::array<struct iovec, SPI_TRANSFER_BATCH_MAX_FRAGMENTS> fragments;
+
+    cppcut_assert_equal(size_t(5),
+                        spi_escape_to_fragments(fragments.data(), fragments.size(),
+                                                raw_data.data(), raw_data.size()));
+
+    cppcut_assert_equal(static_cast<const void *>(&raw_data[0]),
+                        static_cast<const void *>(fragments[0].iov_base));
+    cppcut_assert_equal(size_t(2), fragments[0].iov_len);
+    cppcut_assert_equal(size_t(2), fragments[1].iov_len);
+    cppcut_assert_equal(size_t(2), fragments[2].iov_len);
+    cppcut_assert_equal(static_cast<const void *>(&raw_data[4]),
+                        static_cast<const void *>(fragments[3].iov_base));
+    cppcut_assert_equal(size_t(2), fragments[3].iov_len);
+    cppcut_assert_equal(size_t(2), fragments[4].iov_len);
+
+    std::vector<uint8_t> gathered;
+
+    for(size_t i = 0; i < 5; ++i)
+        std::copy_n(static_cast<const uint8_t *>(fragments[i].iov_base),
+                    fragments[i].iov_len, std::back_inserter(gathered));
+
+    uint8_t buffer[16];
+    const size_t expected_size =
+        spi_fill_buffer_from_raw_data(buffer, sizeof(buffer),
+                                      raw_data.data(), raw_data.size());
+
+    cut_assert_equal_memory(buffer, expected_size,
+                            gathered.data(), gathered.size());
+}
+
+/*!\test
+ * Escaping into fragments fails if there are more special characters than
+ * fragments.
+ */
+void test_escape_data_into_too_few_fragments()
+{
+    static const std::array<uint8_t, 5> raw_data =
+    {
+        0x10, UINT8_MAX, 0x20, UINT8_MAX, 0x30,
+    };
+
+    std::array<struct iovec, 5> fragments;
+
+    cppcut_assert_equal(size_t(5),
+                        spi_escape_to_fragments(fragments.data(), 5,
+                                                raw_data.data(), raw_data.size()));
+    cppcut_assert_equal(size_t(0),
+                        spi_escape_to_fragments(fragments.data(), 4,
+                                                raw_data.data(), raw_data.size()));
+    cppcut_assert_equal(size_t(1),
+                        spi_escape_to_fragments(fragments.data(), 1,
+                                                raw_data.data(), 1));
+}
+
 /*!\test
  * Destination buffer size is respected while escaping data.
  */
@@ -520,7 +839,7 @@ void test_read_timeout_strategy_is_aware_of_extreme_latencies()
     /* the final iteration leads to a definite timeout */
     mock_spi_hw->expect_spi_hw_do_transfer_callback(return_nops);
     t.tv_sec += 3;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
                                               "SPI read timeout, returning 0 of 10 bytes");
@@ -547,7 +866,7 @@ void test_read_timeout_is_precisely_measured()
     /* 999,999,999 nanoseconds later */
     t.tv_nsec = 1000UL * 1000UL * 1000UL - 1UL,
     mock_spi_hw->expect_spi_hw_do_transfer_callback(return_nops);
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_os->expect_os_nanosleep(0, delay_between_slave_probes_ms);
 
     /* one nanoseconds later (we ignore the 5 ms delay in this test to
@@ -555,7 +874,7 @@ void test_read_timeout_is_precisely_measured()
     ++t.tv_sec;
     t.tv_nsec = 0;
     mock_spi_hw->expect_spi_hw_do_transfer_callback(return_nops);
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
 
     mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
@@ -583,13 +902,13 @@ void test_timeout_overflow_in_struct_timespec()
     /* 700 milliseconds later */
     t.tv_nsec = 700UL * 1000UL * 1000UL;
     mock_spi_hw->expect_spi_hw_do_transfer_callback(return_nops);
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_os->expect_os_nanosleep(0, delay_between_slave_probes_ms);
 
     /* total 999 milliseconds later */
     t.tv_nsec = (1000UL - delay_between_slave_probes_ms - 1) * 1000UL * 1000UL;
     mock_spi_hw->expect_spi_hw_do_transfer_callback(return_nops);
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_os->expect_os_nanosleep(0, delay_between_slave_probes_ms);
     t.tv_nsec += delay_between_slave_probes_ms * 1000UL * 1000UL;
     cppcut_assert_equal(999L * 1000 * 1000, t.tv_nsec);
@@ -599,7 +918,7 @@ void test_timeout_overflow_in_struct_timespec()
     ++t.tv_sec;
     t.tv_nsec = 0;
     mock_spi_hw->expect_spi_hw_do_transfer_callback(return_nops);
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
                                               "SPI read timeout, returning 0 of 10 bytes");
@@ -659,7 +978,7 @@ void test_new_spi_slave_transaction_clears_internal_receive_buffer()
         spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, req);
 
         /* read DCP header */
-        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
         mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
 
         std::array<uint8_t, 4> command_header_buffer;
@@ -676,7 +995,7 @@ void test_new_spi_slave_transaction_clears_internal_receive_buffer()
 
         /* read DRCP command code (comes from internal buffer, no SPI transfer is
          * done here) */
-        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
         std::array<uint8_t, 1> drcp_command_buffer;
 
@@ -697,6 +1016,181 @@ void test_new_spi_slave_transaction_clears_internal_receive_buffer()
     ensure_empty_read_buffer();
 }
 
+/*!\test
+ * A packet sent right after the current one in the same transfer is kept in
+ * the internal receive buffer for the next transaction.
+ */
+void test_back_to_back_packet_is_kept_for_next_transaction()
+{
+    static const std::array<uint8_t, read_from_slave_spi_transfer_size> slave_request_data
+    {
+        0x02, 0x48, 0x01, 0x00, 0x28, 0x00, 0x01, 0x44,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    };
+
+    static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
+
+    spi_new_transaction();
+
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, slave_request_data);
+
+    /* first packet */
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+
+    std::array<uint8_t, 5> first_packet;
+
+    cppcut_assert_equal(ssize_t(first_packet.size()),
+                        spi_read_buffer(expected_spi_fd,
+                                        first_packet.data(), first_packet.size(),
+                                        nullptr));
+    cut_assert_equal_memory(slave_request_data.data(), first_packet.size(),
+                            first_packet.data(), first_packet.size());
+
+    /* single zero is skipped, second header comes from internal buffer */
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Keeping 26 bytes in SPI receive buffer for next packet");
+    spi_new_transaction();
+
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    std::array<uint8_t, 4> second_header;
+
+    cppcut_assert_equal(ssize_t(second_header.size()),
+                        spi_read_buffer(expected_spi_fd,
+                                        second_header.data(), second_header.size(),
+                                        nullptr));
+    cut_assert_equal_memory(slave_request_data.data() + 6, second_header.size(),
+                            second_header.data(), second_header.size());
+
+    mock_messages->expect_msg_info_formatted("Discarding 22 bytes from SPI receive buffer");
+    spi_new_transaction();
+
+    ensure_empty_read_buffer();
+}
+
+/*!\test
+ * Junk, incomplete DCP headers, and headers after more than two zero bytes
+ * are not mistaken for packets.
+ */
+void test_junk_and_partial_headers_are_not_kept()
+{
+    static const std::array<uint8_t, read_from_slave_spi_transfer_size> slave_request_data[3] =
+    {
+        {
+            0x02, 0x48, 0x01, 0x00, 0x28, 0x00, 0x00, 0x80,
+            0x44, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        },
+        {
+            0x02, 0x48, 0x01, 0x00, 0x28, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x48, 0x01,
+        },
+        {
+            0x02, 0x48, 0x01, 0x00, 0x28, 0x00, 0x00, 0x00,
+            0x01, 0x44, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        },
+    };
+
+    static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
+
+    spi_new_transaction();
+
+    for(const auto &req : slave_request_data)
+    {
+        spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, req);
+
+        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+        mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+
+        std::array<uint8_t, 5> packet;
+
+        cppcut_assert_equal(ssize_t(packet.size()),
+                            spi_read_buffer(expected_spi_fd,
+                                            packet.data(), packet.size(),
+                                            nullptr));
+
+        cut_assert_false(spi_input_buffer_weed());
+
+        mock_messages->expect_msg_info_formatted("Discarding 27 bytes from SPI receive buffer");
+        spi_new_transaction();
+    }
+
+    ensure_empty_read_buffer();
+}
+
+/*!\test
+ * The beginning of a DCP header at the end of the internal receive buffer is
+ * kept for a chained transaction, and the rest of the packet is read from the
+ * slave.
+ */
+void test_chained_transaction_keeps_partial_header()
+{
+    static const std::array<uint8_t, read_from_slave_spi_transfer_size> slave_request_data[2] =
+    {
+        {
+            0x02, 0x48, 0x18, 0x00, 0x28, 0x28, 0x28, 0x28,
+            0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28,
+            0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28, 0x28,
+            0x28, 0x28, 0x28, 0x28, 0x00, 0x02, 0x48, 0x01,
+        },
+        {
+            0x00, 0x29, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        },
+    };
+
+    static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
+
+    spi_new_transaction();
+
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, slave_request_data[0]);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+
+    std::array<uint8_t, 28> first_packet;
+
+    cppcut_assert_equal(ssize_t(first_packet.size()),
+                        spi_read_buffer(expected_spi_fd,
+                                        first_packet.data(), first_packet.size(),
+                                        nullptr));
+
+    mock_messages->expect_msg_vinfo_formatted(MESSAGE_LEVEL_DIAG,
+        "Keeping 3 bytes in SPI receive buffer for next packet");
+    spi_chain_transaction();
+
+    spi_rw_data->set(spi_rw_data_t::EXPECT_WRITE_NOPS, slave_request_data[1]);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+
+    std::array<uint8_t, 5> second_packet;
+    static const std::array<uint8_t, 5> expected_second_packet
+    {
+        0x02, 0x48, 0x01, 0x00, 0x29,
+    };
+
+    cppcut_assert_equal(ssize_t(second_packet.size()),
+                        spi_read_buffer(expected_spi_fd,
+                                        second_packet.data(), second_packet.size(),
+                                        nullptr));
+    cut_assert_equal_memory(expected_second_packet.data(), expected_second_packet.size(),
+                            second_packet.data(), second_packet.size());
+
+    mock_messages->expect_msg_info_formatted("Discarding 30 bytes from SPI receive buffer");
+    spi_chain_transaction();
+
+    ensure_empty_read_buffer();
+}
+
 /*!\test
  * Timeout during write due to extreme latency (context switch) between time
  * measurements.
@@ -708,7 +1202,7 @@ void test_send_timeout_strategy_is_aware_of_extreme_latencies()
 
     t.tv_sec += 3;
     mock_spi_hw->expect_spi_hw_do_transfer_callback(return_nops);
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
                                               "SPI write timeout, slave didn't get ready within 3000 ms");
@@ -719,7 +1213,7 @@ void test_send_timeout_strategy_is_aware_of_extreme_latencies()
     cppcut_assert_equal(SPI_SEND_RESULT_TIMEOUT,
                         spi_send_buffer(expected_spi_fd,
                                         buffer.data(), buffer.size(),
-                                        nullptr));
+                                        nullptr, nullptr));
 }
 
 /*!\test
@@ -734,7 +1228,7 @@ void test_send_to_slave_waits_for_zero_byte_answer_before_sending()
         .tv_nsec = 0,
     };
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     /* some NOP transfers while waiting for slave, one short transfer per 2 ms
      * (that is, we do NOT take the real amount of delay into account here,
@@ -748,12 +1242,12 @@ void test_send_to_slave_waits_for_zero_byte_answer_before_sending()
         mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
 
         t.tv_nsec += 2UL * 1000UL * 1000UL;
-        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
         mock_os->expect_os_nanosleep(0, delay_between_slave_probes_ms);
         t.tv_nsec += delay_between_slave_probes_ms * 1000UL * 1000UL;
 
         if(i == 0)
-            mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+            mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     }
 
@@ -772,7 +1266,7 @@ void test_send_to_slave_waits_for_zero_byte_answer_before_sending()
     cppcut_assert_equal(SPI_SEND_RESULT_OK,
                         spi_send_buffer(expected_spi_fd,
                                         buffer.data(), buffer.size(),
-                                        nullptr));
+                                        nullptr, nullptr));
 }
 
 /*!\test
@@ -786,12 +1280,12 @@ void test_send_to_slave_may_fail_due_to_timeout()
         .tv_nsec = 0,
     };
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     /* some NOP transfers while waiting for slave */
     for(int i = 0; i < int(3000 / delay_between_slave_probes_ms + 1); ++i)
     {
-        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
         /* the final sleep/get time do not happen because of timeout */
         if(i < int(3000 / delay_between_slave_probes_ms))
@@ -802,7 +1296,7 @@ void test_send_to_slave_may_fail_due_to_timeout()
             {
                 /* iterations are 1s each, so we can conveniently insert
                  * os_clock_gettime() expectations on wrapping seconds */
-                mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+                mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
             }
         }
 
@@ -833,7 +1327,7 @@ void test_send_to_slave_may_fail_due_to_timeout()
     cppcut_assert_equal(SPI_SEND_RESULT_TIMEOUT,
                         spi_send_buffer(expected_spi_fd,
                                         not_sent_data.data(),
-                                        not_sent_data.size(), nullptr));
+                                        not_sent_data.size(), nullptr, nullptr));
 }
 
 /*!\test
@@ -854,7 +1348,7 @@ void test_collision_detection_by_inspecting_poll_bytes()
 
     static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
                                               "Collision detected (got funny poll bytes)");
 
@@ -864,10 +1358,10 @@ void test_collision_detection_by_inspecting_poll_bytes()
     cppcut_assert_equal(SPI_SEND_RESULT_COLLISION,
                         spi_send_buffer(expected_spi_fd,
                                         send_buffer.data(), send_buffer.size(),
-                                        nullptr));
+                                        nullptr, nullptr));
 
     /* the slave's data sent while polling can be received */
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     std::array<uint8_t, 2> receive_buffer;
 
@@ -896,7 +1390,7 @@ void test_collision_in_poll_bytes_does_not_discard_bytes_sent_by_slave()
                                                        true);
     static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
     mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
                                               "Collision detected (got funny poll bytes)");
@@ -907,7 +1401,7 @@ void test_collision_in_poll_bytes_does_not_discard_bytes_sent_by_slave()
     cppcut_assert_equal(SPI_SEND_RESULT_COLLISION,
                         spi_send_buffer(expected_spi_fd,
                                         send_buffer.data(), send_buffer.size(),
-                                        nullptr));
+                                        nullptr, nullptr));
 
     /* slave sends more data to complete its command */
     static const std::array<uint8_t, 5> second_fragment = { 0x66, 0x77, 0x88, 0xaa, 0xfe, };
@@ -923,7 +1417,7 @@ void test_collision_in_poll_bytes_does_not_discard_bytes_sent_by_slave()
 
     std::array<uint8_t, expected_data.size()> receive_buffer;
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
 
     cppcut_assert_equal(ssize_t(receive_buffer.size()),
@@ -951,7 +1445,7 @@ void test_collision_in_poll_bytes_does_not_confuse_escape_sequences()
 
     static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
     mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
                                               "Collision detected (got funny poll bytes)");
@@ -962,7 +1456,7 @@ void test_collision_in_poll_bytes_does_not_confuse_escape_sequences()
     cppcut_assert_equal(SPI_SEND_RESULT_COLLISION,
                         spi_send_buffer(expected_spi_fd,
                                         send_buffer.data(), send_buffer.size(),
-                                        nullptr));
+                                        nullptr, nullptr));
 
     /* slave sends more data to complete its command */
     static const std::array<uint8_t, 3> second_fragment = { 0x33, 0x09, 0x1f, };
@@ -978,7 +1472,7 @@ void test_collision_in_poll_bytes_does_not_confuse_escape_sequences()
 
     std::array<uint8_t, expected_data.size()> receive_buffer;
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
 
     cppcut_assert_equal(ssize_t(receive_buffer.size()),
@@ -1006,7 +1500,7 @@ void test_collision_in_poll_bytes_may_end_with_escape_character()
 
     static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
     mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
                                               "Collision detected (got funny poll bytes)");
@@ -1017,7 +1511,7 @@ void test_collision_in_poll_bytes_may_end_with_escape_character()
     cppcut_assert_equal(SPI_SEND_RESULT_COLLISION,
                         spi_send_buffer(expected_spi_fd,
                                         send_buffer.data(), send_buffer.size(),
-                                        nullptr));
+                                        nullptr, nullptr));
 
     /* slave sends more data to complete its command: the 0x01 is escaped */
     static const std::array<uint8_t, 4> second_fragment = { 0x01, 0x80, 0x71, 0xba, };
@@ -1034,7 +1528,7 @@ void test_collision_in_poll_bytes_may_end_with_escape_character()
 
     std::array<uint8_t, expected_data.size()> receive_buffer;
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
 
     cppcut_assert_equal(ssize_t(receive_buffer.size()),
@@ -1063,7 +1557,7 @@ void test_collision_in_poll_bytes_may_end_with_escape_character_after_nops()
 
     static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
     mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
                                               "Collision detected (got funny poll bytes)");
@@ -1074,7 +1568,7 @@ void test_collision_in_poll_bytes_may_end_with_escape_character_after_nops()
     cppcut_assert_equal(SPI_SEND_RESULT_COLLISION,
                         spi_send_buffer(expected_spi_fd,
                                         send_buffer.data(), send_buffer.size(),
-                                        nullptr));
+                                        nullptr, nullptr));
 
     /* slave sends more data to complete its command */
     static const std::array<uint8_t, 3> second_fragment = { 0x01, 0x02, 0x03, };
@@ -1090,7 +1584,7 @@ void test_collision_in_poll_bytes_may_end_with_escape_character_after_nops()
 
     std::array<uint8_t, expected_data.size()> receive_buffer;
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
 
     cppcut_assert_equal(ssize_t(receive_buffer.size()),
@@ -1118,7 +1612,7 @@ void test_collision_in_poll_bytes_may_begin_with_nop()
 
     static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
     mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
                                               "Collision detected (got funny poll bytes)");
@@ -1129,10 +1623,10 @@ void test_collision_in_poll_bytes_may_begin_with_nop()
     cppcut_assert_equal(SPI_SEND_RESULT_COLLISION,
                         spi_send_buffer(expected_spi_fd,
                                         send_buffer.data(), send_buffer.size(),
-                                        nullptr));
+                                        nullptr, nullptr));
 
     /* the slave's data sent while polling can be received */
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     std::array<uint8_t, 1> receive_buffer;
 
@@ -1160,7 +1654,7 @@ void test_collision_in_poll_bytes_may_end_with_nop()
 
     static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
     mock_messages->expect_msg_error_formatted(0, LOG_NOTICE,
                                               "Collision detected (got funny poll bytes)");
@@ -1171,11 +1665,11 @@ void test_collision_in_poll_bytes_may_end_with_nop()
     cppcut_assert_equal(SPI_SEND_RESULT_COLLISION,
                         spi_send_buffer(expected_spi_fd,
                                         send_buffer.data(), send_buffer.size(),
-                                        nullptr));
+                                        nullptr, nullptr));
     mock_os->check();
 
     /* the slave's data sent while polling can be received */
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     std::array<uint8_t, 1> receive_buffer;
 
@@ -1189,6 +1683,590 @@ void test_collision_in_poll_bytes_may_end_with_nop()
     ensure_empty_read_buffer();
 }
 
+static void expect_slave_probe_with_nops()
+{
+    spi_rw_data->set<wait_for_slave_spi_transfer_size>(spi_rw_data_t::EXPECT_WRITE_NOPS,
+                                                       spi_rw_data_t::EXPECT_READ_NOPS,
+                                                       true);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+}
+
+static void advance_time_us(struct timespec &t, long us)
+{
+    t.tv_nsec += us * 1000L;
+
+    while(t.tv_nsec >= 1000L * 1000L * 1000L)
+    {
+        t.tv_nsec -= 1000L * 1000L * 1000L;
+        ++t.tv_sec;
+    }
+}
+
+static void expect_send_data_after_slave_got_ready(const std::array<uint8_t, 7> &buffer)
+{
+    expect_spi_slave_gets_ready();
+    spi_rw_data->set(buffer);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+}
+
+static const std::array<uint8_t, 7> some_data_to_send =
+{
+    0x90, 0x5a, 0xb7, 0xdb, 0xeb, 0x00, 0x4d,
+};
+
+/*!\test
+ * Exponential backoff doubles the delay between two slave probes, but never
+ * waits longer than the fixed delay.
+ */
+void test_send_to_slave_with_exponential_backoff()
+{
+    spi_set_slave_ready_strategy(SPI_SLAVE_READY_BACKOFF, 1000, 0, -1,
+                                 POLLPRI | POLLERR);
+
+    struct timespec t = { .tv_sec = 10, .tv_nsec = 0, };
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    static const std::array<unsigned long, 5> expected_delays_ms { 1, 2, 4, 5, 5 };
+
+    for(size_t i = 0; i < expected_delays_ms.size(); ++i)
+    {
+        expect_slave_probe_with_nops();
+        advance_time_us(t, 100);
+        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+        mock_os->expect_os_nanosleep(0, expected_delays_ms[i]);
+        advance_time_us(t, expected_delays_ms[i] * 1000L);
+
+        if(i == 0)
+            mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    }
+
+    expect_send_data_after_slave_got_ready(some_data_to_send);
+
+    cppcut_assert_equal(SPI_SEND_RESULT_OK,
+                        spi_send_buffer(expected_spi_fd,
+                                        some_data_to_send.data(),
+                                        some_data_to_send.size(),
+                                        nullptr, nullptr));
+}
+
+/*!\test
+ * Busy polling does not sleep at all within the configured time window, then
+ * backs off exponentially.
+ */
+void test_send_to_slave_with_busy_polling()
+{
+    spi_set_slave_ready_strategy(SPI_SLAVE_READY_BUSY_POLL, 1000, 700, -1,
+                                 POLLPRI | POLLERR);
+
+    struct timespec t = { .tv_sec = 10, .tv_nsec = 0, };
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    /* 200 us per probe, the first three probes are within the window */
+    for(int i = 0; i < 3; ++i)
+    {
+        expect_slave_probe_with_nops();
+        advance_time_us(t, 200);
+        mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+        if(i == 0)
+            mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    }
+
+    expect_slave_probe_with_nops();
+    advance_time_us(t, 200);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    mock_os->expect_os_nanosleep(0, 1);
+    advance_time_us(t, 1000);
+
+    expect_slave_probe_with_nops();
+    advance_time_us(t, 200);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    mock_os->expect_os_nanosleep(0, 2);
+
+    expect_send_data_after_slave_got_ready(some_data_to_send);
+
+    cppcut_assert_equal(SPI_SEND_RESULT_OK,
+                        spi_send_buffer(expected_spi_fd,
+                                        some_data_to_send.data(),
+                                        some_data_to_send.size(),
+                                        nullptr, nullptr));
+}
+
+static void send_and_measure_scheduling_delay(bool is_new_transaction)
+{
+    struct stats_histogram h;
+    stats_histogram_reset(&h);
+    spi_set_sched_delay_histogram(&h);
+
+    if(is_new_transaction)
+        spi_new_transaction();
+
+    spi_set_slave_ready_strategy(SPI_SLAVE_READY_BACKOFF, 1000, 0, -1,
+                                 POLLPRI | POLLERR);
+
+    struct timespec t = { .tv_sec = 20, .tv_nsec = 0, };
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    expect_slave_probe_with_nops();
+    advance_time_us(t, 100);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    mock_os->expect_os_nanosleep(0, 1);
+    advance_time_us(t, 1300);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    expect_slave_probe_with_nops();
+    advance_time_us(t, 100);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    mock_os->expect_os_nanosleep(0, 2);
+    advance_time_us(t, 2000);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    expect_send_data_after_slave_got_ready(some_data_to_send);
+
+    cppcut_assert_equal(SPI_SEND_RESULT_OK,
+                        spi_send_buffer(expected_spi_fd,
+                                        some_data_to_send.data(),
+                                        some_data_to_send.size(),
+                                        nullptr, nullptr));
+
+    cppcut_assert_equal(uint32_t(2), stats_histogram_count(&h));
+    cppcut_assert_equal(uint32_t(1), h.buckets[0]);
+    cppcut_assert_equal(uint32_t(1), h.buckets[stats_histogram_bucket(300)]);
+    cppcut_assert_equal(uint64_t(300), h.max_usec);
+
+    spi_set_sched_delay_histogram(nullptr);
+}
+
+/*!\test
+ * With a histogram given, the time we wake up later than requested is
+ * recorded for each sleep.
+ */
+void test_scheduling_delay_is_measured_around_sleeps()
+{
+    send_and_measure_scheduling_delay(false);
+}
+
+/*!\test
+ * Starting a new transaction does not stop recording scheduling delays.
+ */
+void test_scheduling_delay_is_measured_across_transactions()
+{
+    send_and_measure_scheduling_delay(true);
+}
+
+static std::vector<std::pair<int, int>> expected_gpio_polls;
+static constexpr int expected_gpio_fd = 23;
+
+static int poll_gpio_mock(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    cppcut_assert_equal(nfds_t(1), nfds);
+    cppcut_assert_equal(expected_gpio_fd, fds[0].fd);
+    cppcut_assert_equal(short(POLLPRI | POLLERR), fds[0].events);
+    cut_assert_false(expected_gpio_polls.empty());
+
+    const auto expected = expected_gpio_polls.front();
+    expected_gpio_polls.erase(expected_gpio_polls.begin());
+
+    cppcut_assert_equal(expected.first, timeout);
+
+    fds[0].revents = expected.second;
+
+    return expected.second != 0 ? 1 : 0;
+}
+
+/*!\test
+ * Waiting for the request GPIO replaces sleeping until the first GPIO event
+ * shows up, then exponential backoff takes over.
+ */
+void test_send_to_slave_waits_for_gpio_edge()
+{
+    spi_set_slave_ready_strategy(SPI_SLAVE_READY_GPIO_EDGE, 1000, 0,
+                                 expected_gpio_fd, POLLPRI | POLLERR);
+
+    os_poll = poll_gpio_mock;
+    expected_gpio_polls = { { 1, 0 }, { 2, POLLPRI }, };
+
+    struct timespec t = { .tv_sec = 10, .tv_nsec = 0, };
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    expect_slave_probe_with_nops();
+    advance_time_us(t, 100);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    expect_slave_probe_with_nops();
+    advance_time_us(t, 100);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    /* GPIO event seen, no more polling on the GPIO */
+    expect_slave_probe_with_nops();
+    advance_time_us(t, 100);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    mock_os->expect_os_nanosleep(0, 4);
+
+    expect_send_data_after_slave_got_ready(some_data_to_send);
+
+    cppcut_assert_equal(SPI_SEND_RESULT_OK,
+                        spi_send_buffer(expected_spi_fd,
+                                        some_data_to_send.data(),
+                                        some_data_to_send.size(),
+                                        nullptr, nullptr));
+
+    cut_assert_true(expected_gpio_polls.empty());
+}
+
+/*!\test
+ * Time spent waiting for the slave and the number of probes are recorded.
+ */
+void test_waiting_for_slave_is_measured()
+{
+    struct timespec t = { .tv_sec = 10, .tv_nsec = 0, };
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    expect_slave_probe_with_nops();
+    advance_time_us(t, 100);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    mock_os->expect_os_nanosleep(0, delay_between_slave_probes_ms);
+    advance_time_us(t, delay_between_slave_probes_ms * 1000L);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    expect_spi_slave_gets_ready();
+    advance_time_us(t, 100);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    spi_rw_data->set(some_data_to_send);
+    mock_spi_hw->expect_spi_hw_do_transfer_callback(mock_spi_transfer);
+
+    struct stats_wait wait;
+    stats_wait_reset(&wait);
+
+    cppcut_assert_equal(SPI_SEND_RESULT_OK,
+                        spi_send_buffer(expected_spi_fd,
+                                        some_data_to_send.data(),
+                                        some_data_to_send.size(),
+                                        nullptr, &wait));
+
+    cppcut_assert_equal(uint32_t(1), wait.waits.count);
+    cppcut_assert_equal(uint32_t(2), wait.probes.count);
+    cppcut_assert_equal(uint64_t(5200), wait.total_usec);
+    cppcut_assert_equal(uint64_t(5200), wait.max_usec);
+}
+
+static const auto mock_spi_multi_transfer = mock_spi_multi_tx_template<expected_spi_fd>;
+
+/*!\test
+ * Several fragments are submitted to the SPI driver in a single call, with
+ * per-fragment delays and chip select handling.
+ */
+void test_transfer_batch_submits_all_fragments_at_once()
+{
+    static const std::array<uint8_t, 2> probe_answer { 0x00, UINT8_MAX, };
+    static const std::array<uint8_t, 5> data { 0x10, 0x20, 0x30, 0x40, 0x50, };
+    static const std::array<uint8_t, 3> reply { 0xa1, 0xa2, 0xa3, };
+
+    spi_rw_data->set_single(spi_rw_data_t::EXPECT_WRITE_NOPS, probe_answer);
+    spi_rw_data->set(data);
+    spi_rw_data->set_single(spi_rw_data_t::EXPECT_WRITE_NOPS, reply);
+
+    mock_spi_hw->expect_spi_hw_do_transfer_fragments(expected_spi_fd,
+        {
+            { probe_answer.size(),  0, false, true, true,  },
+            { data.size(),         10, true,  true, false, },
+            { reply.size(),         0, false, true, true,  },
+        },
+        mock_spi_multi_transfer);
+
+    std::array<uint8_t, 2> probe_buffer;
+    std::array<uint8_t, 3> reply_buffer;
+
+    struct spi_transfer_batch batch;
+    spi_transfer_batch_init(&batch);
+
+    cut_assert_true(spi_transfer_batch_add(&batch, nullptr, probe_buffer.data(),
+                                           probe_buffer.size(), 0, false));
+    cut_assert_true(spi_transfer_batch_add(&batch, data.data(), nullptr,
+                                           data.size(), 10, true));
+    cut_assert_true(spi_transfer_batch_add(&batch, nullptr, reply_buffer.data(),
+                                           reply_buffer.size(), 0, false));
+    cppcut_assert_equal(size_t(3), batch.count);
+    cppcut_assert_equal(size_t(10), batch.total_bytes);
+
+    cppcut_assert_equal(0, spi_transfer_batch_submit(expected_spi_fd, &batch,
+                                                     nullptr));
+
+    cppcut_assert_equal(size_t(3), spi_rw_data->fragment_);
+    cppcut_assert_equal(size_t(0), batch.count);
+    cppcut_assert_equal(size_t(0), batch.total_bytes);
+
+    cut_assert_equal_memory(probe_answer.data(), probe_answer.size(),
+                            probe_buffer.data(), probe_buffer.size());
+    cut_assert_equal_memory(reply.data(), reply.size(),
+                            reply_buffer.data(), reply_buffer.size());
+}
+
+/*!\test
+ * The number of fragments per batch is limited.
+ */
+void test_transfer_batch_rejects_too_many_fragments()
+{
+    static const std::array<uint8_t, 1> data { 0x10, };
+
+    struct spi_transfer_batch batch;
+    spi_transfer_batch_init(&batch);
+
+    for(size_t i = 0; i < SPI_TRANSFER_BATCH_MAX_FRAGMENTS; ++i)
+        cut_assert_true(spi_transfer_batch_add(&batch, data.data(), nullptr,
+                                               data.size(), 0, false));
+
+    mock_messages->expect_msg_error_formatted(0, LOG_CRIT,
+                                              "BUG: Too many SPI transfer fragments");
+
+    cut_assert_false(spi_transfer_batch_add(&batch, data.data(), nullptr,
+                                            data.size(), 0, false));
+    cppcut_assert_equal(size_t(SPI_TRANSFER_BATCH_MAX_FRAGMENTS), batch.count);
+}
+
+/*!\test
+ * Packets in a burst are sent after a single handshake, in one SPI message
+ * with chip select toggled between packets.
+ */
+void test_burst_sends_packets_in_one_message()
+{
+    expect_spi_slave_gets_ready();
+
+    static const std::array<uint8_t, 4> first { 0x03, 0x32, 0x02, 0x00, };
+    static const std::array<uint8_t, 6> second { 0x03, 0x11, 0x02, 0x00, 0x24, 0x42, };
+    static const std::array<uint8_t, 5> third { 0x02, 0xef, 0x01, 0x00, 0x61, };
+
+    spi_rw_data->set(first);
+    spi_rw_data->set(second);
+    spi_rw_data->set(third);
+
+    mock_spi_hw->expect_spi_hw_do_transfer_fragments(expected_spi_fd,
+        {
+            { first.size(),  0, true,  true, false, },
+            { second.size(), 0, true,  true, false, },
+            { third.size(),  0, false, true, false, },
+        },
+        mock_spi_multi_transfer);
+
+    static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    const struct iovec fragments[] =
+    {
+        { .iov_base = const_cast<uint8_t *>(first.data()),  .iov_len = first.size(), },
+        { .iov_base = const_cast<uint8_t *>(second.data()), .iov_len = second.size(), },
+        { .iov_base = const_cast<uint8_t *>(third.data()),  .iov_len = third.size(), },
+    };
+    const struct spi_packet packets[] =
+    {
+        { .fragments = &fragments[0], .count = 1, },
+        { .fragments = &fragments[1], .count = 1, },
+        { .fragments = &fragments[2], .count = 1, },
+    };
+
+    cppcut_assert_equal(SPI_SEND_RESULT_OK,
+                        spi_send_burst(expected_spi_fd, packets,
+                                       sizeof(packets) / sizeof(packets[0]),
+                                       nullptr, nullptr));
+
+    /* handshake plus one fragment per packet */
+    cppcut_assert_equal(size_t(4), spi_rw_data->fragment_);
+}
+
+/*!\test
+ * Chip select is held across the fragments of a packet in a burst.
+ */
+void test_burst_holds_chip_select_within_packets()
+{
+    expect_spi_slave_gets_ready();
+
+    static const std::array<uint8_t, 2> head { 0x03, 0x32, };
+    static const std::array<uint8_t, 2> escape { DCP_ESCAPE_CHARACTER, 0x01, };
+    static const std::array<uint8_t, 3> tail { 0x00, 0x00, 0x42, };
+    static const std::array<uint8_t, 4> second { 0x03, 0x11, 0x00, 0x00, };
+
+    spi_rw_data->set(head);
+    spi_rw_data->set(escape);
+    spi_rw_data->set(tail);
+    spi_rw_data->set(second);
+
+    mock_spi_hw->expect_spi_hw_do_transfer_fragments(expected_spi_fd,
+        {
+            { head.size(),   0, false, true, false, },
+            { escape.size(), 0, false, true, false, },
+            { tail.size(),   0, true,  true, false, },
+            { second.size(), 0, false, true, false, },
+        },
+        mock_spi_multi_transfer);
+
+    static const struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+
+    const struct iovec fragments[] =
+    {
+        { .iov_base = const_cast<uint8_t *>(head.data()),   .iov_len = head.size(), },
+        { .iov_base = const_cast<uint8_t *>(escape.data()), .iov_len = escape.size(), },
+        { .iov_base = const_cast<uint8_t *>(tail.data()),   .iov_len = tail.size(), },
+        { .iov_base = const_cast<uint8_t *>(second.data()), .iov_len = second.size(), },
+    };
+    const struct spi_packet packets[] =
+    {
+        { .fragments = &fragments[0], .count = 3, },
+        { .fragments = &fragments[3], .count = 1, },
+    };
+
+    cppcut_assert_equal(SPI_SEND_RESULT_OK,
+                        spi_send_burst(expected_spi_fd, packets,
+                                       sizeof(packets) / sizeof(packets[0]),
+                                       nullptr, nullptr));
+    cppcut_assert_equal(size_t(5), spi_rw_data->fragment_);
+}
+
+/*!\test
+ * Slaves are configured independently of each other.
+ */
+void test_slave_contexts_are_independent()
+{
+    spi_set_slave_ready_strategy(SPI_SLAVE_READY_BACKOFF, 0, 0, -1,
+                                 POLLPRI | POLLERR);
+
+    struct spi_context *second = spi_context_init(1);
+    cppcut_assert_not_null(second);
+
+    struct spi_context *first = spi_context_switch(second);
+    cppcut_assert_equal(SPI_SLAVE_READY_FIXED_DELAY,
+                        spi_get_slave_ready_strategy());
+    spi_set_slave_ready_strategy(SPI_SLAVE_READY_BUSY_POLL, 0, 100, -1,
+                                 POLLPRI | POLLERR);
+
+    cppcut_assert_equal(second, spi_context_switch(first));
+    cppcut_assert_equal(SPI_SLAVE_READY_BACKOFF,
+                        spi_get_slave_ready_strategy());
+
+    spi_context_switch(second);
+    cppcut_assert_equal(SPI_SLAVE_READY_BUSY_POLL,
+                        spi_get_slave_ready_strategy());
+
+    cppcut_assert_equal(second, spi_context_switch(nullptr));
+    cppcut_assert_equal(SPI_SLAVE_READY_BACKOFF,
+                        spi_get_slave_ready_strategy());
+}
+
+/*!\test
+ * There is a fixed number of slaves.
+ */
+void test_too_many_slave_contexts()
+{
+    mock_messages->expect_msg_error_formatted(0, LOG_CRIT,
+                                              "BUG: Invalid SPI slave 4");
+    cppcut_assert_null(spi_context_init(SPI_MAX_SLAVES));
+}
+
+static void check_filter_input_against_reference(const std::vector<uint8_t> &input,
+                                                 bool pending_escape_sequence)
+{
+    std::vector<uint8_t> expected(input);
+    bool expected_pending = pending_escape_sequence;
+    const size_t expected_size =
+        spi_filter_input_reference(expected.data(), expected.size(),
+                                   &expected_pending);
+
+    std::vector<uint8_t> buffer(input);
+    bool pending = pending_escape_sequence;
+    const size_t size = spi_filter_input(buffer.data(), buffer.size(), &pending);
+
+    cppcut_assert_equal(expected_size, size);
+    cppcut_assert_equal(expected_pending, pending);
+    cut_assert_equal_memory(expected.data(), expected_size,
+                            buffer.data(), size);
+}
+
+/*!\test
+ * The optimized input filter yields the same results as the simple reference
+ * implementation for all kinds of input.
+ */
+void test_filter_input_matches_reference_implementation()
+{
+    std::mt19937 prng(0x27ff);
+    std::uniform_int_distribution<int> kind(0, 9);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_int_distribution<size_t> length(0, 300);
+    std::uniform_int_distribution<size_t> run(1, 40);
+
+    for(int iteration = 0; iteration < 2000; ++iteration)
+    {
+        std::vector<uint8_t> input(length(prng));
+
+        /* runs of NOPs and plain data, interspersed with escape sequences */
+        for(size_t pos = 0; pos < input.size(); /* nothing */)
+        {
+            const int k = kind(prng);
+            const size_t n = std::min(run(prng), input.size() - pos);
+
+            for(size_t j = 0; j < n; ++j, ++pos)
+            {
+                switch(k)
+                {
+                  case 0:
+                  case 1:
+                  case 2:
+                    input[pos] = UINT8_MAX;
+                    break;
+
+                  case 3:
+                    input[pos] = (j == 0) ? DCP_ESCAPE_CHARACTER : 0x01;
+                    break;
+
+                  case 4:
+                    input[pos] = byte(prng);
+                    break;
+
+                  default:
+                    input[pos] = byte(prng) & 0x7f;
+
+                    if(input[pos] == DCP_ESCAPE_CHARACTER)
+                        input[pos] = 0x55;
+
+                    break;
+                }
+            }
+        }
+
+        check_filter_input_against_reference(input, false);
+        check_filter_input_against_reference(input, true);
+    }
+}
+
+/*!\test
+ * Corner cases for the optimized input filter.
+ */
+void test_filter_input_corner_cases()
+{
+    check_filter_input_against_reference({}, false);
+    check_filter_input_against_reference({}, true);
+    check_filter_input_against_reference(std::vector<uint8_t>(64, UINT8_MAX), false);
+    check_filter_input_against_reference(std::vector<uint8_t>(64, UINT8_MAX), true);
+    check_filter_input_against_reference(std::vector<uint8_t>(64, DCP_ESCAPE_CHARACTER), false);
+    check_filter_input_against_reference(std::vector<uint8_t>(63, DCP_ESCAPE_CHARACTER), false);
+    check_filter_input_against_reference(std::vector<uint8_t>(64, 0x01), true);
+
+    std::vector<uint8_t> escape_at_end(40, 0x42);
+    escape_at_end.back() = DCP_ESCAPE_CHARACTER;
+    check_filter_input_against_reference(escape_at_end, false);
+
+    std::vector<uint8_t> escape_then_nops(40, UINT8_MAX);
+    escape_then_nops[17] = DCP_ESCAPE_CHARACTER;
+    check_filter_input_against_reference(escape_then_nops, false);
+
+    escape_then_nops[39] = 0x01;
+    check_filter_input_against_reference(escape_then_nops, false);
+}
+
 };
 
 /*!@}*/
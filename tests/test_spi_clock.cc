@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+
+#include <cppcutter.h>
+
+#include "spi_clock.h"
+
+#include "mock_messages.hh"
+
+/*!
+ * \addtogroup spi_clock_tests Unit tests
+ * \ingroup spi_clock
+ *
+ * Adaptive SPI clock unit tests.
+ */
+/*!@{*/
+
+namespace spi_clock_tests
+{
+
+static MockMessages *mock_messages;
+
+void cut_setup()
+{
+    mock_messages = new MockMessages;
+    cppcut_assert_not_null(mock_messages);
+    mock_messages->init();
+    mock_messages_singleton = mock_messages;
+}
+
+void cut_teardown()
+{
+    mock_messages->check();
+    mock_messages_singleton = nullptr;
+    delete mock_messages;
+    mock_messages = nullptr;
+}
+
+static unsigned int report_successes(struct spi_clock *clk,
+                                     enum SpiClockDirection dir,
+                                     unsigned int count)
+{
+    unsigned int changes = 0;
+
+    for(unsigned int i = 0; i < count; ++i)
+        if(spi_clock_report(clk, dir, SPI_CLOCK_EVENT_SUCCESS))
+            ++changes;
+
+    return changes;
+}
+
+/*!\test
+ * A fixed clock ignores all reports.
+ */
+void test_fixed_clock_never_changes()
+{
+    struct spi_clock clk = SPI_CLOCK_FIXED(1000000U);
+
+    cppcut_assert_equal(0U, report_successes(&clk, SPI_CLOCK_READ, 1000));
+    cut_assert_false(spi_clock_report(&clk, SPI_CLOCK_WRITE, SPI_CLOCK_EVENT_TIMEOUT));
+    cut_assert_false(spi_clock_report(&clk, SPI_CLOCK_READ, SPI_CLOCK_EVENT_JUNK));
+
+    cppcut_assert_equal(1000000U, spi_clock_get_hz(&clk, SPI_CLOCK_READ));
+    cppcut_assert_equal(1000000U, spi_clock_get_hz(&clk, SPI_CLOCK_WRITE));
+}
+
+/*!\test
+ * An adaptive clock is raised after a run of successful transfers, but only
+ * in the direction that has been reported.
+ */
+void test_clock_is_raised_after_successes()
+{
+    struct spi_clock clk = SPI_CLOCK_FIXED(0U);
+    spi_clock_configure(&clk, 1600000U, 500000U, 4000000U);
+
+    cppcut_assert_equal(0U, report_successes(&clk, SPI_CLOCK_WRITE,
+                                             SPI_CLOCK_RAISE_AFTER_SUCCESSES - 1));
+    cppcut_assert_equal(1600000U, spi_clock_get_hz(&clk, SPI_CLOCK_WRITE));
+
+    cut_assert_true(spi_clock_report(&clk, SPI_CLOCK_WRITE, SPI_CLOCK_EVENT_SUCCESS));
+    cppcut_assert_equal(1700001U, spi_clock_get_hz(&clk, SPI_CLOCK_WRITE));
+    cppcut_assert_equal(1600000U, spi_clock_get_hz(&clk, SPI_CLOCK_READ));
+}
+
+/*!\test
+ * The clock never leaves the configured bounds.
+ */
+void test_clock_stays_within_bounds()
+{
+    struct spi_clock clk = SPI_CLOCK_FIXED(0U);
+    spi_clock_configure(&clk, 10000000U, 500000U, 2000000U);
+
+    cppcut_assert_equal(2000000U, spi_clock_get_hz(&clk, SPI_CLOCK_READ));
+
+    report_successes(&clk, SPI_CLOCK_READ, 100 * SPI_CLOCK_RAISE_AFTER_SUCCESSES);
+    cppcut_assert_equal(2000000U, spi_clock_get_hz(&clk, SPI_CLOCK_READ));
+
+    for(int i = 0; i < 100; ++i)
+        spi_clock_report(&clk, SPI_CLOCK_READ, SPI_CLOCK_EVENT_TIMEOUT);
+
+    cppcut_assert_equal(500000U, spi_clock_get_hz(&clk, SPI_CLOCK_READ));
+    cut_assert_false(spi_clock_report(&clk, SPI_CLOCK_READ, SPI_CLOCK_EVENT_JUNK));
+    cppcut_assert_equal(500000U, spi_clock_get_hz(&clk, SPI_CLOCK_READ));
+}
+
+/*!\test
+ * A rate that has failed is not tried again right away.
+ */
+void test_failed_rate_becomes_ceiling()
+{
+    struct spi_clock clk = SPI_CLOCK_FIXED(0U);
+    spi_clock_configure(&clk, 1600000U, 500000U, 4000000U);
+
+    cut_assert_true(spi_clock_report(&clk, SPI_CLOCK_READ, SPI_CLOCK_EVENT_JUNK));
+    cppcut_assert_equal(1200000U, spi_clock_get_hz(&clk, SPI_CLOCK_READ));
+
+    /* climbs back up to just below the failed rate, then stays there */
+    report_successes(&clk, SPI_CLOCK_READ, 20 * SPI_CLOCK_RAISE_AFTER_SUCCESSES);
+    cppcut_assert_equal(1500000U, spi_clock_get_hz(&clk, SPI_CLOCK_READ));
+
+    /* eventually, the ceiling is raised again */
+    report_successes(&clk, SPI_CLOCK_READ, SPI_CLOCK_RETRY_AFTER_SUCCESSES);
+    cppcut_assert_operator(1500000U, <, spi_clock_get_hz(&clk, SPI_CLOCK_READ));
+}
+
+/*!\test
+ * Rates and reasons for changes are published in the statistics.
+ */
+void test_changes_are_published()
+{
+    struct spi_clock_stats stats {};
+    struct spi_clock clk = SPI_CLOCK_FIXED(0U);
+    spi_clock_configure(&clk, 1600000U, 500000U, 4000000U);
+
+    spi_clock_set_statistics(&clk, &stats);
+    cut_assert_true(stats.is_adaptive);
+    cppcut_assert_equal(1600000U, stats.directions[SPI_CLOCK_READ].hz);
+    cppcut_assert_equal(1600000U, stats.directions[SPI_CLOCK_WRITE].hz);
+
+    report_successes(&clk, SPI_CLOCK_WRITE, SPI_CLOCK_RAISE_AFTER_SUCCESSES);
+    spi_clock_report(&clk, SPI_CLOCK_WRITE, SPI_CLOCK_EVENT_TIMEOUT);
+    spi_clock_report(&clk, SPI_CLOCK_READ, SPI_CLOCK_EVENT_JUNK);
+
+    cppcut_assert_equal(1U, stats.directions[SPI_CLOCK_WRITE].raised);
+    cppcut_assert_equal(1U, stats.directions[SPI_CLOCK_WRITE].lowered_for_timeout);
+    cppcut_assert_equal(0U, stats.directions[SPI_CLOCK_WRITE].lowered_for_junk);
+    cppcut_assert_equal(spi_clock_get_hz(&clk, SPI_CLOCK_WRITE),
+                        stats.directions[SPI_CLOCK_WRITE].hz);
+
+    cppcut_assert_equal(0U, stats.directions[SPI_CLOCK_READ].raised);
+    cppcut_assert_equal(0U, stats.directions[SPI_CLOCK_READ].lowered_for_timeout);
+    cppcut_assert_equal(1U, stats.directions[SPI_CLOCK_READ].lowered_for_junk);
+    cppcut_assert_equal(1200000U, stats.directions[SPI_CLOCK_READ].hz);
+
+    spi_clock_configure(&clk, 1000000U, 0, 0);
+    cut_assert_false(stats.is_adaptive);
+    cppcut_assert_equal(1000000U, stats.directions[SPI_CLOCK_READ].hz);
+}
+
+}
+
+/*!@}*/
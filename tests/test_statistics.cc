@@ -86,7 +86,7 @@ void test_context_enter_first()
     cppcut_assert_equal(uint64_t(0), ctx.ti_usec);
 
     static const struct timespec t = { .tv_sec = 300, .tv_nsec = 1234567, };
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     cppcut_assert_null(stats_context_switch(&ctx));
 
@@ -103,7 +103,7 @@ void test_context_simple_switch()
     cppcut_assert_equal(uint64_t(0), ctx.ti_usec);
 
     struct timespec t = { .tv_sec = 500, .tv_nsec = 20000, };
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     cppcut_assert_null(stats_context_switch(&ctx));
 
@@ -115,7 +115,7 @@ void test_context_simple_switch()
 
     t.tv_sec = 502;
     t.tv_nsec = 80000;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     cppcut_assert_equal(&ctx, stats_context_switch(&next));
     cppcut_assert_equal(uint64_t(0), next.t_usec);
@@ -133,7 +133,7 @@ void test_enter_same_context_is_filtered()
     cppcut_assert_equal(uint64_t(0), ctx.t_usec);
 
     struct timespec t = { .tv_sec = 82, .tv_nsec = 918374, };
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     cppcut_assert_null(stats_context_switch(&ctx));
 
@@ -150,7 +150,7 @@ void test_enter_same_context_is_filtered()
 
     t.tv_sec = 85;
     t.tv_nsec = 6000000;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     cppcut_assert_equal(&ctx, stats_context_switch(&next));
     cppcut_assert_equal(uint64_t(0), next.t_usec);
@@ -172,69 +172,69 @@ void test_chain_of_context_switches()
 
     struct timespec t = { .tv_sec = 731, .tv_nsec = 4235891, };
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     cppcut_assert_null(stats_context_switch(&ctx));
 
     /* ctx: 995764424 ns -> 995764 us */
     t.tv_sec = 732;
     t.tv_nsec = 315;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     cppcut_assert_equal(&ctx, stats_context_switch(&a));
     cppcut_assert_equal(uint64_t(995764), ctx.t_usec);
 
     /* a: 2059248649 ns -> 2059249 us */
     t.tv_sec = 734;
     t.tv_nsec = 59248964;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     cppcut_assert_equal(&a, stats_context_switch(&b));
     cppcut_assert_equal(uint64_t(2059249), a.t_usec);
 
     /* b: 20152 ns -> 20 us */
     t.tv_sec = 734;
     t.tv_nsec = 59269116;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     cppcut_assert_equal(&b, stats_context_switch(&c));
     cppcut_assert_equal(uint64_t(20), b.t_usec);
 
     /* c: 940743229 ns -> 940743 us */
     t.tv_sec = 735;
     t.tv_nsec = 12345;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     cppcut_assert_equal(&c, stats_context_switch(&ctx));
     cppcut_assert_equal(uint64_t(940743), c.t_usec);
 
     /* ctx: 3000000000 ns -> 3000000 us */
     t.tv_sec = 738;
     t.tv_nsec = 12345;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     cppcut_assert_equal(&ctx, stats_context_switch(&a));
     cppcut_assert_equal(uint64_t(3995764), ctx.t_usec);
 
     /* a: 999999999 ns -> 1000000 us */
     t.tv_sec = 739;
     t.tv_nsec = 12344;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     cppcut_assert_equal(&a, stats_context_switch(&b));
     cppcut_assert_equal(uint64_t(3059249), a.t_usec);
 
     /* b: 5008975245 ns -> 5008975 us */
     t.tv_sec = 744;
     t.tv_nsec = 8987589;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     cppcut_assert_equal(&b, stats_context_switch(&a));
     cppcut_assert_equal(uint64_t(5008995), b.t_usec);
 
     /* a: 991012411 ns -> 991012 us */
     t.tv_sec = 745;
     t.tv_nsec = 0;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     cppcut_assert_equal(&a, stats_context_switch(&c));
     cppcut_assert_equal(uint64_t(4050261), a.t_usec);
 
     /* c: 18234519 ns -> 18235 us */
     t.tv_sec = 745;
     t.tv_nsec = 18234519;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     cppcut_assert_equal(&c, stats_context_switch(&ctx));
     cppcut_assert_equal(uint64_t(958978), c.t_usec);
 
@@ -263,15 +263,15 @@ void test_switch_from_parent_to_child_context_and_back()
 
     struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     cppcut_assert_null(stats_context_switch(&ctx));
 
     t.tv_sec = 7;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     cppcut_assert_equal(&ctx, stats_context_switch(&child));
 
     t.tv_sec = 9;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     cppcut_assert_equal(&child, stats_context_switch_to_parent(&ctx));
 
     cppcut_assert_equal(uint64_t(7000000), ctx.t_usec);
@@ -280,11 +280,11 @@ void test_switch_from_parent_to_child_context_and_back()
     cppcut_assert_equal(uint64_t(2000000), child.ti_usec);
 
     t.tv_sec = 10;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     cppcut_assert_equal(&ctx, stats_context_switch(&child));
 
     t.tv_sec = 13;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     cppcut_assert_equal(&child, stats_context_switch_to_parent(&ctx));
 
     cppcut_assert_equal(uint64_t(8000000), ctx.t_usec);
@@ -332,10 +332,10 @@ static void check_delta_time_computation(const DeltaT &d)
     struct stats_context next;
     stats_context_reset(&next);
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, d.start_time);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, d.start_time);
     cppcut_assert_null(stats_context_switch(&ctx));
     mock_os->check();
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, d.end_time);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, d.end_time);
     cppcut_assert_equal(&ctx, stats_context_switch(&next));
     mock_os->check();
     cppcut_assert_equal(d.expected_delta_us, ctx.t_usec);
@@ -607,7 +607,7 @@ void test_event_counter_basics()
 void test_io_stastistics()
 {
     struct timespec t = { .tv_sec = 4190, .tv_nsec = 14589551, };
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     /* this might be our "idle" context, or any other context; but we must have
      * entered a context before we can gather I/O statistics */
@@ -621,7 +621,7 @@ void test_io_stastistics()
     cppcut_assert_equal(uint64_t(0), io.blocked.t_usec);
     cppcut_assert_equal(size_t(0), io.bytes_transferred);
 
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     struct stats_context *prev_ctx = stats_io_begin(&io);
     cppcut_assert_equal(&ctx, prev_ctx);
@@ -629,7 +629,7 @@ void test_io_stastistics()
     /* do some I/O...*/
     t.tv_sec = 4191;
     t.tv_nsec = 85312377;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     /* let's assume we have transferred 734782 bytes, and have observed 2
      * failures while doing so (whatever "failures" may mean) */
@@ -647,7 +647,7 @@ void test_io_stastistics()
 void test_cumulated_times()
 {
     struct timespec t = { .tv_sec = 0, .tv_nsec = 0, };
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
 
     cppcut_assert_null(stats_context_switch(&ctx));
 
@@ -655,7 +655,7 @@ void test_cumulated_times()
     stats_io_reset(&io);
 
     t.tv_sec = 1;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     struct stats_context *prev_ctx = stats_io_begin(&io);
     cppcut_assert_equal(&ctx, prev_ctx);
     cppcut_assert_equal(uint64_t(1000000), ctx.t_usec);
@@ -664,7 +664,7 @@ void test_cumulated_times()
     cppcut_assert_equal(io.blocked.t_usec, io.blocked.ti_usec);
 
     t.tv_sec = 3;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     stats_io_end(&io, prev_ctx, 0, 15);
     cppcut_assert_equal(uint64_t(1000000), ctx.t_usec);
     cppcut_assert_equal(uint64_t(3000000), ctx.ti_usec);
@@ -672,7 +672,7 @@ void test_cumulated_times()
     cppcut_assert_equal(io.blocked.t_usec, io.blocked.ti_usec);
 
     t.tv_sec = 7;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     prev_ctx = stats_io_begin(&io);
     cppcut_assert_equal(&ctx, prev_ctx);
     cppcut_assert_equal(uint64_t(5000000), ctx.t_usec);
@@ -681,7 +681,7 @@ void test_cumulated_times()
     cppcut_assert_equal(io.blocked.t_usec, io.blocked.ti_usec);
 
     t.tv_sec = 15;
-    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC_RAW, t);
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
     stats_io_end(&io, prev_ctx, 0, 20);
     cppcut_assert_equal(uint64_t(5000000), ctx.t_usec);
     cppcut_assert_equal(uint64_t(15000000), ctx.ti_usec);
@@ -689,6 +689,198 @@ void test_cumulated_times()
     cppcut_assert_equal(io.blocked.t_usec, io.blocked.ti_usec);
 }
 
+/*!
+ * Waiting times are summed up, and the longest wait is remembered.
+ */
+void test_wait_statistics()
+{
+    struct stats_wait w;
+    stats_wait_reset(&w);
+
+    cppcut_assert_equal(uint32_t(0), w.waits.count);
+    cppcut_assert_equal(uint32_t(0), w.probes.count);
+    cppcut_assert_equal(uint64_t(0), w.total_usec);
+    cppcut_assert_equal(uint64_t(0), w.max_usec);
+
+    const struct timespec first_started = { .tv_sec = 20, .tv_nsec = 0, };
+    struct timespec t = { .tv_sec = 20, .tv_nsec = 750000, };
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    stats_wait_end(&w, &first_started, 3);
+
+    const struct timespec second_started = { .tv_sec = 21, .tv_nsec = 0, };
+    t.tv_sec = 21;
+    t.tv_nsec = 250000;
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    stats_wait_end(&w, &second_started, 1);
+
+    cppcut_assert_equal(uint32_t(2), w.waits.count);
+    cppcut_assert_equal(uint32_t(4), w.probes.count);
+    cppcut_assert_equal(uint64_t(1000), w.total_usec);
+    cppcut_assert_equal(uint64_t(750), w.max_usec);
+
+    /* no-op without statistics */
+    stats_wait_end(NULL, &second_started, 5);
+}
+
+/*!\test
+ * Durations are sorted into log2 buckets, with exact powers of two starting a
+ * new bucket.
+ */
+void test_histogram_bucket_boundaries()
+{
+    cppcut_assert_equal(0U, stats_histogram_bucket(0));
+    cppcut_assert_equal(1U, stats_histogram_bucket(1));
+    cppcut_assert_equal(2U, stats_histogram_bucket(2));
+    cppcut_assert_equal(2U, stats_histogram_bucket(3));
+    cppcut_assert_equal(3U, stats_histogram_bucket(4));
+    cppcut_assert_equal(3U, stats_histogram_bucket(7));
+    cppcut_assert_equal(4U, stats_histogram_bucket(8));
+    cppcut_assert_equal(10U, stats_histogram_bucket(1023));
+    cppcut_assert_equal(11U, stats_histogram_bucket(1024));
+    cppcut_assert_equal(22U, stats_histogram_bucket((UINT64_C(1) << 22) - 1));
+}
+
+/*!\test
+ * Very long durations all end up in the last bucket.
+ */
+void test_histogram_last_bucket_saturates()
+{
+    static const unsigned int last = STATS_HISTOGRAM_BUCKETS - 1;
+
+    cppcut_assert_equal(last, stats_histogram_bucket(UINT64_C(1) << 22));
+    cppcut_assert_equal(last, stats_histogram_bucket(UINT64_C(1) << 40));
+    cppcut_assert_equal(last, stats_histogram_bucket(UINT64_MAX));
+
+    struct stats_histogram h;
+    stats_histogram_reset(&h);
+
+    stats_histogram_add(&h, UINT64_MAX);
+    stats_histogram_add(&h, UINT64_C(1) << 22);
+
+    cppcut_assert_equal(uint32_t(2), h.buckets[last]);
+    cppcut_assert_equal(UINT64_MAX, h.max_usec);
+    cppcut_assert_equal(UINT64_MAX, stats_histogram_percentile(&h, 50));
+}
+
+/*!\test
+ * Bucket counters stop at their maximum value instead of wrapping around.
+ */
+void test_histogram_counters_saturate()
+{
+    struct stats_histogram h;
+    stats_histogram_reset(&h);
+
+    h.buckets[3] = UINT32_MAX - 1;
+
+    stats_histogram_add(&h, 5);
+    cppcut_assert_equal(UINT32_MAX, h.buckets[3]);
+
+    stats_histogram_add(&h, 6);
+    cppcut_assert_equal(UINT32_MAX, h.buckets[3]);
+    cppcut_assert_equal(UINT32_MAX, stats_histogram_count(&h));
+    cppcut_assert_equal(uint64_t(11), h.sum_usec);
+    cppcut_assert_equal(uint64_t(6), h.max_usec);
+
+    /* no-op without statistics */
+    stats_histogram_add(NULL, 6);
+}
+
+/*!\test
+ * Percentiles are reported as upper bounds of buckets, but never larger than
+ * the longest duration seen.
+ */
+void test_histogram_percentiles()
+{
+    struct stats_histogram h;
+    stats_histogram_reset(&h);
+
+    cppcut_assert_equal(uint32_t(0), stats_histogram_count(&h));
+    cppcut_assert_equal(uint64_t(0), stats_histogram_percentile(&h, 50));
+
+    /* 90 fast samples, 9 slower ones, a single outlier */
+    for(int i = 0; i < 90; ++i)
+        stats_histogram_add(&h, 10);
+
+    for(int i = 0; i < 9; ++i)
+        stats_histogram_add(&h, 300);
+
+    stats_histogram_add(&h, 5000);
+
+    cppcut_assert_equal(uint32_t(100), stats_histogram_count(&h));
+    cppcut_assert_equal(uint64_t(15), stats_histogram_percentile(&h, 50));
+    cppcut_assert_equal(uint64_t(15), stats_histogram_percentile(&h, 90));
+    cppcut_assert_equal(uint64_t(511), stats_histogram_percentile(&h, 99));
+    cppcut_assert_equal(uint64_t(5000), stats_histogram_percentile(&h, 100));
+    cppcut_assert_equal(uint64_t(5000), h.max_usec);
+
+    /* single sample: bounded by maximum */
+    stats_histogram_reset(&h);
+    stats_histogram_add(&h, 9);
+    cppcut_assert_equal(uint64_t(9), stats_histogram_percentile(&h, 50));
+    cppcut_assert_equal(uint64_t(9), stats_histogram_percentile(&h, 0));
+}
+
+/*!\test
+ * Each stay in a context and each I/O operation is recorded in the
+ * respective histogram.
+ */
+void test_context_and_io_histograms()
+{
+    struct timespec t = { .tv_sec = 10, .tv_nsec = 0, };
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    cppcut_assert_null(stats_context_switch(&ctx));
+
+    struct stats_io io;
+    stats_io_reset(&io);
+
+    t.tv_nsec = 100000;
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    struct stats_context *prev_ctx = stats_io_begin(&io);
+
+    t.tv_nsec = 103000;
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    stats_io_end(&io, prev_ctx, 0, 1);
+
+    t.tv_nsec = 203000;
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    prev_ctx = stats_io_begin(&io);
+
+    t.tv_nsec = 2203000;
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    stats_io_end(&io, prev_ctx, 0, 1);
+
+    /* two I/O operations of 3 us and 2000 us */
+    cppcut_assert_equal(uint32_t(2), stats_histogram_count(&io.blocked.histogram));
+    cppcut_assert_equal(uint32_t(1), io.blocked.histogram.buckets[2]);
+    cppcut_assert_equal(uint32_t(1), io.blocked.histogram.buckets[11]);
+    cppcut_assert_equal(uint64_t(2000), io.blocked.histogram.max_usec);
+
+    /* two stays of 100 us each in the parent context */
+    cppcut_assert_equal(uint32_t(2), stats_histogram_count(&ctx.histogram));
+    cppcut_assert_equal(uint32_t(2), ctx.histogram.buckets[7]);
+    cppcut_assert_equal(uint64_t(100), ctx.histogram.max_usec);
+}
+
+/*!\test
+ * Elapsed time is measured against the monotonic clock.
+ */
+void test_histogram_add_elapsed()
+{
+    struct stats_histogram h;
+    stats_histogram_reset(&h);
+
+    const struct timespec started = { .tv_sec = 5, .tv_nsec = 999000000, };
+    const struct timespec t = { .tv_sec = 6, .tv_nsec = 1000, };
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    stats_histogram_add_elapsed(&h, &started);
+
+    cppcut_assert_equal(uint32_t(1), h.buckets[10]);
+    cppcut_assert_equal(uint64_t(1001), h.max_usec);
+
+    /* no-op without statistics */
+    stats_histogram_add_elapsed(NULL, &started);
+}
+
 }
 
 /*!@}*/
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include <cppcutter.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <glob.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "stats_export.h"
+
+#include "mock_messages.hh"
+
+/*!
+ * \addtogroup stats_export_tests Unit tests
+ * \ingroup stats_export
+ *
+ * Statistics export unit tests.
+ */
+/*!@{*/
+
+namespace stats_export_tests
+{
+
+static MockMessages *mock_messages;
+static struct program_statistics stats;
+
+static const char export_file_name[] = "test_stats_export.json";
+static const char planted_link_name[] = "test_stats_export.json.tmp";
+static const char victim_file_name[] = "test_stats_export_victim";
+
+void cut_setup()
+{
+    mock_messages = new MockMessages;
+    cppcut_assert_not_null(mock_messages);
+    mock_messages->init();
+    mock_messages_singleton = mock_messages;
+
+    memset(&stats, 0, sizeof(stats));
+}
+
+void cut_teardown()
+{
+    unlink(export_file_name);
+    unlink(planted_link_name);
+    unlink(victim_file_name);
+
+    mock_messages->check();
+    mock_messages_singleton = nullptr;
+    delete mock_messages;
+    mock_messages = nullptr;
+}
+
+static std::string render(enum StatsExportFormat format,
+                          uint64_t timestamp_usec)
+{
+    std::vector<char> buffer(64 * 1024);
+    const size_t length = stats_export_render(buffer.data(), buffer.size(),
+                                              &stats, format, timestamp_usec);
+
+    cppcut_assert_operator(buffer.size(), >, length);
+    cppcut_assert_equal(length, strlen(buffer.data()));
+
+    return std::string(buffer.data());
+}
+
+static void assert_contains(const std::string &text, const char *expected)
+{
+    if(text.find(expected) == std::string::npos)
+        cut_fail("Expected \"%s\" in output:\n%s", expected, text.c_str());
+}
+
+/*!\test
+ * Format names given on the command line are recognized.
+ */
+void test_format_from_string()
+{
+    enum StatsExportFormat format = STATS_EXPORT_FORMAT_JSON;
+
+    cut_assert_true(stats_export_format_from_string("prometheus", &format));
+    cppcut_assert_equal(int(STATS_EXPORT_FORMAT_PROMETHEUS), int(format));
+
+    cut_assert_true(stats_export_format_from_string("json", &format));
+    cppcut_assert_equal(int(STATS_EXPORT_FORMAT_JSON), int(format));
+
+    cut_assert_false(stats_export_format_from_string("xml", &format));
+    cut_assert_false(stats_export_format_from_string("", &format));
+    cppcut_assert_equal(int(STATS_EXPORT_FORMAT_JSON), int(format));
+}
+
+/*!\test
+ * JSON output contains timestamp, counters, and histograms.
+ */
+void test_render_json()
+{
+    stats.is_enabled = true;
+    stats.busy_transaction.t_usec = 1500;
+    stats.busy_transaction.ti_usec = 2500;
+    stats.spi_transfers.ops.count = 12;
+    stats.spi_transfers.failures.count = 1;
+    stats.spi_transfers.bytes_transferred = 4096;
+    stats.spi_transfers.blocked.t_usec = 800;
+    stats.slave_ready.waits.count = 3;
+    stats.slave_ready.probes.count = 9;
+    stats.slave_ready.total_usec = 321;
+    stats.slave_ready.max_usec = 200;
+    stats_histogram_add(&stats.master_transactions, 0);
+    stats_histogram_add(&stats.master_transactions, 5);
+    stats_histogram_add(&stats.master_transactions, 7);
+
+    const std::string text = render(STATS_EXPORT_FORMAT_JSON, 987654321);
+
+    cppcut_assert_equal('{', text.front());
+    cppcut_assert_equal(std::string("]}}\n"), text.substr(text.size() - 4));
+
+    assert_contains(text, "{\"timestamp_monotonic_us\":987654321,\"enabled\":true,");
+    assert_contains(text, "\"busy_transaction\":{\"t_us\":1500,\"ti_us\":2500,");
+    assert_contains(text, "\"spi\":{\"ops\":12,\"failures\":1,\"bytes\":4096,\"blocked_us\":800,");
+    assert_contains(text, "\"slave_ready\":{\"waits\":3,\"probes\":9,\"total_us\":321,\"max_us\":200}");
+    assert_contains(text,
+                    "\"master\":{\"count\":3,\"sum_us\":12,\"max_us\":7,"
+                    "\"buckets\":[1,0,0,2,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0]}");
+}
+
+/*!\test
+ * Prometheus histograms have cumulative buckets, sum, and count.
+ */
+void test_render_prometheus_histogram()
+{
+    stats_histogram_add(&stats.slave_transactions, 1);
+    stats_histogram_add(&stats.slave_transactions, 3);
+    stats_histogram_add(&stats.slave_transactions, 100);
+    stats_histogram_add(&stats.slave_transactions, UINT64_C(1) << 30);
+
+    const std::string text = render(STATS_EXPORT_FORMAT_PROMETHEUS, 42);
+
+    assert_contains(text, "# TYPE dcpspi_transaction_microseconds histogram\n");
+    assert_contains(text, "dcpspi_transaction_microseconds_bucket{kind=\"slave\",le=\"0\"} 0\n");
+    assert_contains(text, "dcpspi_transaction_microseconds_bucket{kind=\"slave\",le=\"1\"} 1\n");
+    assert_contains(text, "dcpspi_transaction_microseconds_bucket{kind=\"slave\",le=\"3\"} 2\n");
+    assert_contains(text, "dcpspi_transaction_microseconds_bucket{kind=\"slave\",le=\"127\"} 3\n");
+    assert_contains(text, "dcpspi_transaction_microseconds_bucket{kind=\"slave\",le=\"4194303\"} 3\n");
+    assert_contains(text, "dcpspi_transaction_microseconds_bucket{kind=\"slave\",le=\"+Inf\"} 4\n");
+    assert_contains(text, "dcpspi_transaction_microseconds_sum{kind=\"slave\"} 1073741928\n");
+    assert_contains(text, "dcpspi_transaction_microseconds_count{kind=\"slave\"} 4\n");
+    assert_contains(text, "dcpspi_transaction_microseconds_count{kind=\"master\"} 0\n");
+}
+
+/*!\test
+ * Prometheus counters are labeled, and each metric family is declared once
+ * right before its samples.
+ */
+void test_render_prometheus_counters()
+{
+    stats.dcpd_reads.ops.count = 7;
+    stats.dcpd_writes.bytes_transferred = 123;
+    stats.debounce.probes.count = 2;
+    stats.wait_for_events.t_usec = 99;
+
+    const std::string text = render(STATS_EXPORT_FORMAT_PROMETHEUS, 1000);
+
+    assert_contains(text, "dcpspi_snapshot_timestamp_microseconds 1000\n");
+    assert_contains(text, "dcpspi_statistics_enabled 0\n");
+    assert_contains(text, "dcpspi_context_microseconds_total{context=\"wait_for_events\"} 99\n");
+    assert_contains(text, "dcpspi_io_operations_total{channel=\"dcpd_read\"} 7\n");
+    assert_contains(text, "dcpspi_io_bytes_total{channel=\"dcpd_write\"} 123\n");
+    assert_contains(text, "dcpspi_wait_probes_total{wait=\"debounce\"} 2\n");
+
+    const size_t type_pos = text.find("# TYPE dcpspi_io_operations_total counter\n");
+    cppcut_assert_not_equal(std::string::npos, type_pos);
+    cppcut_assert_equal(std::string::npos,
+                        text.find("# TYPE dcpspi_io_operations_total", type_pos + 1));
+    cppcut_assert_operator(type_pos, <,
+                           text.find("dcpspi_io_operations_total{channel=\"spi\"}"));
+}
+
+/*!\test
+ * Output is truncated to the buffer size, and the length needed is returned.
+ */
+void test_render_into_small_buffer_is_truncated()
+{
+    const size_t full_length =
+        render(STATS_EXPORT_FORMAT_JSON, 5).length();
+
+    char buffer[16];
+    memset(buffer, 'x', sizeof(buffer));
+
+    cppcut_assert_equal(full_length,
+                        stats_export_render(buffer, sizeof(buffer), &stats,
+                                            STATS_EXPORT_FORMAT_JSON, 5));
+    cppcut_assert_equal(sizeof(buffer) - 1, strlen(buffer));
+    cppcut_assert_equal(std::string("{\"timestamp_mon"), std::string(buffer));
+
+    cppcut_assert_equal(full_length,
+                        stats_export_render(nullptr, 0, &stats,
+                                            STATS_EXPORT_FORMAT_JSON, 5));
+}
+
+static std::string read_file(const char *filename)
+{
+    std::ifstream f(filename);
+    std::ostringstream content;
+    content << f.rdbuf();
+    return content.str();
+}
+
+/*!\test
+ * The statistics file is replaced through a temporary file with a unique
+ * name, so a link planted under a predictable name is left alone.
+ */
+void test_write_to_file_does_not_follow_planted_link()
+{
+    std::ofstream(victim_file_name) << "precious";
+    cppcut_assert_equal(0, symlink(victim_file_name, planted_link_name));
+
+    static const char text[] = "{\"answer\":42}\n";
+
+    cppcut_assert_equal(0, stats_export_write(export_file_name,
+                                              text, sizeof(text) - 1));
+
+    cppcut_assert_equal(std::string(text), read_file(export_file_name));
+    cppcut_assert_equal(std::string("precious"), read_file(victim_file_name));
+
+    struct stat st;
+    cppcut_assert_equal(0, stat(export_file_name, &st));
+    cppcut_assert_equal(mode_t(0644), mode_t(st.st_mode & 0777));
+
+    /* no temporary file left behind */
+    glob_t g;
+    cppcut_assert_equal(0, glob("test_stats_export.json.*", 0, nullptr, &g));
+    cppcut_assert_equal(size_t(1), size_t(g.gl_pathc));
+    cppcut_assert_equal(std::string(planted_link_name), std::string(g.gl_pathv[0]));
+    globfree(&g);
+}
+
+}
+
+/*!@}*/
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#include <cppcutter.h>
+#include <vector>
+
+#include "trace.h"
+
+#include "mock_messages.hh"
+#include "mock_os.hh"
+
+/*!
+ * \addtogroup trace_tests Unit tests
+ * \ingroup trace
+ *
+ * Transaction trace ring unit tests.
+ */
+/*!@{*/
+
+namespace trace_tests
+{
+
+static MockMessages *mock_messages;
+static MockOs *mock_os;
+
+void cut_setup()
+{
+    mock_messages = new MockMessages;
+    cppcut_assert_not_null(mock_messages);
+    mock_messages->init();
+    mock_messages_singleton = mock_messages;
+
+    mock_os = new MockOs;
+    cppcut_assert_not_null(mock_os);
+    mock_os->init();
+    mock_os_singleton = mock_os;
+
+    trace_init();
+}
+
+void cut_teardown()
+{
+    trace_enable(false);
+
+    mock_messages->check();
+    mock_os->check();
+
+    mock_messages_singleton = nullptr;
+    mock_os_singleton = nullptr;
+
+    delete mock_messages;
+    delete mock_os;
+
+    mock_messages = nullptr;
+    mock_os = nullptr;
+}
+
+static void record(uint16_t serial, time_t sec, long nsec)
+{
+    const struct timespec t = { .tv_sec = sec, .tv_nsec = nsec, };
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    trace_record(TRACE_EVENT_TRANSACTION, 3, 1, serial, 2, 0);
+}
+
+/*!\test
+ * Nothing is recorded, and the clock is not read, while tracing is disabled.
+ */
+void test_disabled_trace_records_nothing()
+{
+    trace_record(TRACE_EVENT_TRANSACTION, 1, 0, 0x8001, 5, 0);
+
+    struct trace_event ev;
+    cppcut_assert_equal(size_t(0), trace_copy_events(&ev, 1));
+}
+
+/*!\test
+ * An event stores all values passed, and a timestamp in nanoseconds.
+ */
+void test_record_single_event()
+{
+    cut_assert_false(trace_enable(true));
+
+    const struct timespec t = { .tv_sec = 12, .tv_nsec = 345678901, };
+    mock_os->expect_os_clock_gettime(0, 0, CLOCK_MONOTONIC, t);
+    trace_record(TRACE_EVENT_SPI_RESULT, 3, 2, 0x8123, 7, 4);
+
+    struct trace_event ev[2];
+    cppcut_assert_equal(size_t(1), trace_copy_events(ev, 2));
+
+    cppcut_assert_equal(uint64_t(12345678901), ev[0].timestamp_ns);
+    cppcut_assert_equal(uint16_t(0x8123), ev[0].serial);
+    cppcut_assert_equal(uint8_t(TRACE_EVENT_SPI_RESULT), ev[0].type);
+    cppcut_assert_equal(uint8_t(3), ev[0].state);
+    cppcut_assert_equal(uint8_t(2), ev[0].request_state);
+    cppcut_assert_equal(uint8_t(7), ev[0].ttl);
+    cppcut_assert_equal(uint8_t(4), ev[0].arg);
+}
+
+/*!\test
+ * Events are copied oldest first, limited to the most recent ones.
+ */
+void test_copy_most_recent_events()
+{
+    trace_enable(true);
+
+    for(uint16_t i = 1; i <= 5; ++i)
+        record(i, 1, i * 1000);
+
+    struct trace_event ev[3];
+    cppcut_assert_equal(size_t(3), trace_copy_events(ev, 3));
+
+    cppcut_assert_equal(uint16_t(3), ev[0].serial);
+    cppcut_assert_equal(uint16_t(4), ev[1].serial);
+    cppcut_assert_equal(uint16_t(5), ev[2].serial);
+    cppcut_assert_equal(uint64_t(1000005000), ev[2].timestamp_ns);
+}
+
+/*!\test
+ * A full ring overwrites its oldest events.
+ */
+void test_full_ring_overwrites_oldest_events()
+{
+    trace_enable(true);
+
+    for(unsigned int i = 0; i < TRACE_RING_SIZE + 3; ++i)
+        record(i, 0, i);
+
+    std::vector<struct trace_event> ev(TRACE_RING_SIZE + 10);
+    cppcut_assert_equal(size_t(TRACE_RING_SIZE),
+                        trace_copy_events(ev.data(), ev.size()));
+
+    cppcut_assert_equal(uint16_t(3), ev[0].serial);
+    cppcut_assert_equal(uint64_t(3), ev[0].timestamp_ns);
+    cppcut_assert_equal(uint16_t(TRACE_RING_SIZE + 2), ev[TRACE_RING_SIZE - 1].serial);
+}
+
+/*!\test
+ * Events are still recorded if the clock cannot be read.
+ */
+void test_clock_failure_yields_zero_timestamp()
+{
+    trace_enable(true);
+
+    const struct timespec t = { .tv_sec = 1, .tv_nsec = 1, };
+    mock_os->expect_os_clock_gettime(-1, EINVAL, CLOCK_MONOTONIC, t);
+    trace_record(TRACE_EVENT_REQUEST_STATE, 0, 1, 0, 0, 0);
+
+    struct trace_event ev;
+    cppcut_assert_equal(size_t(1), trace_copy_events(&ev, 1));
+    cppcut_assert_equal(uint64_t(0), ev.timestamp_ns);
+    cppcut_assert_equal(uint8_t(TRACE_EVENT_REQUEST_STATE), ev.type);
+}
+
+}
+
+/*!@}*/
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cppcutter.h>
+
+#include "virtual_clock.hh"
+#include "os.h"
+
+VirtualClock *virtual_clock_singleton;
+
+void VirtualClock::init()
+{
+    now_ns_ = 0;
+    sleeps_ = 0;
+    slept_ns_ = 0;
+    poll_timeouts_ns_ = 0;
+    spi_ns_ = 0;
+}
+
+void VirtualClock::get_time(struct timespec &tp) const
+{
+    tp.tv_sec = now_ns_ / (1000U * 1000U * 1000U);
+    tp.tv_nsec = now_ns_ % (1000U * 1000U * 1000U);
+}
+
+void VirtualClock::sleep(const struct timespec &tp)
+{
+    cppcut_assert_operator(0L, <=, long(tp.tv_sec));
+    cppcut_assert_operator(0L, <=, tp.tv_nsec);
+
+    const uint64_t ns = uint64_t(tp.tv_sec) * 1000U * 1000U * 1000U + tp.tv_nsec;
+
+    ++sleeps_;
+    slept_ns_ += ns;
+    now_ns_ += ns;
+}
+
+void VirtualClock::poll_timed_out(int timeout_ms)
+{
+    if(timeout_ms <= 0)
+        return;
+
+    const uint64_t ns = uint64_t(timeout_ms) * 1000U * 1000U;
+
+    poll_timeouts_ns_ += ns;
+    now_ns_ += ns;
+}
+
+void VirtualClock::spi_transfer(const struct spi_ioc_transfer spi_transfer[],
+                                size_t number_of_fragments)
+{
+    uint64_t ns = 0;
+
+    for(size_t i = 0; i < number_of_fragments; ++i)
+    {
+        cppcut_assert_operator(0U, <, spi_transfer[i].speed_hz);
+
+        ns += spi_duration_ns(spi_transfer[i].len, spi_transfer[i].speed_hz);
+        ns += uint64_t(spi_transfer[i].delay_usecs) * 1000U;
+    }
+
+    spi_ns_ += ns;
+    now_ns_ += ns;
+}
+
+int os_clock_gettime(clockid_t clk_id, struct timespec *tp)
+{
+    cppcut_assert_not_null(virtual_clock_singleton);
+    cppcut_assert_not_null(tp);
+
+    virtual_clock_singleton->get_time(*tp);
+
+    return 0;
+}
+
+void os_nanosleep(const struct timespec *tp)
+{
+    cppcut_assert_not_null(virtual_clock_singleton);
+    cppcut_assert_not_null(tp);
+
+    virtual_clock_singleton->sleep(*tp);
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+
+#ifndef VIRTUAL_CLOCK_HH
+#define VIRTUAL_CLOCK_HH
+
+#include <cstdint>
+#include <ctime>
+#include <linux/spi/spidev.h>
+
+/*!
+ * Virtual time for tests which measure how long things take.
+ *
+ * Link this instead of mock_os.cc. It provides \c os_clock_gettime() and
+ * \c os_nanosleep(), and time passes only when the code under test sleeps,
+ * when the test's \c poll(2) replacement times out (#poll_timed_out()), and
+ * while data are shifted over the SPI bus (#spi_transfer()). Latencies
+ * measured against this clock are therefore the same in each run, and they
+ * change only if the code under test waits longer or moves more bytes.
+ */
+class VirtualClock
+{
+  private:
+    uint64_t now_ns_;
+
+  public:
+    unsigned int sleeps_;
+    uint64_t slept_ns_;
+    uint64_t poll_timeouts_ns_;
+    uint64_t spi_ns_;
+
+    VirtualClock(const VirtualClock &) = delete;
+    VirtualClock &operator=(const VirtualClock &) = delete;
+
+    explicit VirtualClock() { init(); }
+
+    void init();
+
+    uint64_t now_ns() const { return now_ns_; }
+    uint64_t now_us() const { return now_ns_ / 1000U; }
+
+    void get_time(struct timespec &tp) const;
+    void sleep(const struct timespec &tp);
+    void poll_timed_out(int timeout_ms);
+
+    /*!
+     * Let time pass for an SPI transfer, including inter-fragment delays.
+     *
+     * The duration of each fragment is derived from its length and its
+     * \c speed_hz field, which must be set.
+     */
+    void spi_transfer(const struct spi_ioc_transfer spi_transfer[],
+                      size_t number_of_fragments);
+
+    /*!
+     * Time it takes to shift \p bytes bytes over the bus at \p speed_hz.
+     */
+    static uint64_t spi_duration_ns(size_t bytes, uint32_t speed_hz)
+    {
+        return (uint64_t(bytes) * 8U * 1000U * 1000U * 1000U + speed_hz - 1) /
+               speed_hz;
+    }
+};
+
+extern VirtualClock *virtual_clock_singleton;
+
+#endif /* !VIRTUAL_CLOCK_HH */
@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+/*!
+ * \file
+ * Decoder for capture files written by dcpspi.
+ *
+ * The records stored with \c --capture-file are printed either as hexdumps
+ * similar to the ones written to the log by \c --dump-traffic, or as a
+ * timeline with one line per record.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cinttypes>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "capture.h"
+
+/*!
+ * \addtogroup dcpspi_capture Capture file decoder
+ *
+ * Offline analysis of SPI traffic captured by dcpspi.
+ */
+/*!@{*/
+
+enum class OutputMode
+{
+    HEXDUMP,
+    TIMELINE,
+};
+
+static const char *record_type_to_string(uint8_t type, bool long_name)
+{
+    switch(type)
+    {
+      case CAPTURE_RECORD_SPI_TX:
+        return long_name ? "Sent" : "TX";
+
+      case CAPTURE_RECORD_SPI_RX:
+        return long_name ? "Received" : "RX";
+
+      case CAPTURE_RECORD_COLLISION:
+        return long_name ? "Colliding poll bytes" : "COLL";
+
+      case CAPTURE_RECORD_DISCARDED:
+        return long_name ? "Discarded buffer" : "DISC";
+    }
+
+    return "???";
+}
+
+static void hexdump(const uint8_t *data, size_t length)
+{
+    for(size_t i = 0; i < length; i += 16)
+    {
+        printf("  %04zx:", i);
+
+        for(size_t j = i; j < i + 16 && j < length; ++j)
+            printf(" %02x", data[j]);
+
+        printf("\n");
+    }
+}
+
+static void print_record(const struct capture_record &rec, const uint8_t *data,
+                         uint64_t first_ns, uint64_t previous_ns,
+                         OutputMode mode)
+{
+    const double time_us = (rec.timestamp_ns - first_ns) / 1000.0;
+
+    switch(mode)
+    {
+      case OutputMode::HEXDUMP:
+        printf("[%12.3f us] serial 0x%04x, result %" PRId32 ": %s, %u bytes\n",
+               time_us, rec.serial, rec.result,
+               record_type_to_string(rec.type, true), rec.length);
+        hexdump(data, rec.length);
+        break;
+
+      case OutputMode::TIMELINE:
+        printf("%12.3f %10.3f 0x%04x %-4s %5u %6" PRId32 " ",
+               time_us, (rec.timestamp_ns - previous_ns) / 1000.0,
+               rec.serial, record_type_to_string(rec.type, false),
+               rec.length, rec.result);
+
+        for(size_t i = 0; i < rec.length && i < 16; ++i)
+            printf(" %02x", data[i]);
+
+        printf("%s\n", rec.length > 16 ? " ..." : "");
+        break;
+    }
+}
+
+static bool check_header(const std::vector<uint8_t> &file, const char *filename,
+                         struct capture_file_header &header)
+{
+    if(file.size() < sizeof(header))
+    {
+        fprintf(stderr, "File \"%s\" too short\n", filename);
+        return false;
+    }
+
+    memcpy(&header, file.data(), sizeof(header));
+
+    if(header.magic != CAPTURE_FILE_MAGIC)
+    {
+        fprintf(stderr, "File \"%s\" is not a dcpspi capture file\n", filename);
+        return false;
+    }
+
+    if(header.version != CAPTURE_FILE_VERSION)
+    {
+        fprintf(stderr, "Unsupported capture file version %u\n", header.version);
+        return false;
+    }
+
+    if(header.header_size < sizeof(header) ||
+       header.record_header_size < sizeof(struct capture_record) ||
+       header.header_size > file.size() ||
+       header.used > file.size() - header.header_size)
+    {
+        fprintf(stderr, "Capture file \"%s\" is corrupt\n", filename);
+        return false;
+    }
+
+    return true;
+}
+
+static bool decode(const std::vector<uint8_t> &file, const char *filename,
+                   OutputMode mode)
+{
+    struct capture_file_header header;
+
+    if(!check_header(file, filename, header))
+        return false;
+
+    if(mode == OutputMode::TIMELINE)
+        printf("%12s %10s %6s %-4s %5s %6s  %s\n",
+               "time/us", "delta/us", "serial", "type", "len", "result", "data");
+
+    const uint8_t *const records = file.data() + header.header_size;
+    size_t pos = 0;
+    size_t count = 0;
+    uint64_t first_ns = 0;
+    uint64_t previous_ns = 0;
+
+    while(pos < header.used)
+    {
+        struct capture_record rec;
+
+        if(header.used - pos < header.record_header_size)
+        {
+            fprintf(stderr, "Truncated record at offset %zu\n", pos);
+            return false;
+        }
+
+        memcpy(&rec, records + pos, sizeof(rec));
+
+        if(header.used - pos - header.record_header_size < rec.length)
+        {
+            fprintf(stderr, "Truncated record data at offset %zu\n", pos);
+            return false;
+        }
+
+        if(count == 0)
+            first_ns = previous_ns = rec.timestamp_ns;
+
+        print_record(rec, records + pos + header.record_header_size,
+                     first_ns, previous_ns, mode);
+
+        previous_ns = rec.timestamp_ns;
+        ++count;
+
+        pos += (header.record_header_size + rec.length +
+                CAPTURE_RECORD_ALIGNMENT - 1) & ~size_t(CAPTURE_RECORD_ALIGNMENT - 1);
+    }
+
+    printf("%zu records", count);
+
+    if(header.dropped > 0)
+        printf(", %" PRIu32 " records did not fit into the file", header.dropped);
+
+    printf("\n");
+
+    return true;
+}
+
+static void usage(const char *program)
+{
+    printf("Usage: %s [options] file\n"
+           "\n"
+           "Options:\n"
+           "  --help         Show this help.\n"
+           "  --hexdump      Show hexdump of each record (default).\n"
+           "  --timeline     Show one line per record with time differences.\n",
+           program);
+}
+
+int main(int argc, char *argv[])
+{
+    OutputMode mode = OutputMode::HEXDUMP;
+    const char *filename = nullptr;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--help") == 0)
+        {
+            usage(argv[0]);
+            return EXIT_SUCCESS;
+        }
+        else if(strcmp(argv[i], "--hexdump") == 0)
+            mode = OutputMode::HEXDUMP;
+        else if(strcmp(argv[i], "--timeline") == 0)
+            mode = OutputMode::TIMELINE;
+        else if(argv[i][0] != '-' && filename == nullptr)
+            filename = argv[i];
+        else
+        {
+            fprintf(stderr, "Unknown option \"%s\". Please try --help.\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(filename == nullptr)
+    {
+        fprintf(stderr, "No capture file given. Please try --help.\n");
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream f(filename, std::ios::binary);
+
+    if(!f)
+    {
+        fprintf(stderr, "Failed opening \"%s\": %s\n", filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    const std::vector<uint8_t> file((std::istreambuf_iterator<char>(f)),
+                                    std::istreambuf_iterator<char>());
+
+    return decode(file, filename, mode) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*!@}*/
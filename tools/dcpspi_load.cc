@@ -0,0 +1,800 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+/*!
+ * \file
+ * Load generator for a running dcpspi, SPI bus, and slave.
+ *
+ * This program takes the place of DCPD on the named pipes. It sends a stream
+ * of master write packets, handles ACKs and NACKs like DCPD does, answers
+ * slave packets, and measures the time from sending a packet until its ACK
+ * has been received. Optionally, it starts dcpspi itself, once for each SPI
+ * clock frequency from a given list.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <climits>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "dcpdefs.h"
+
+/*!
+ * \addtogroup dcpspi_load Load generator
+ *
+ * Throughput and latency measurements on real hardware.
+ */
+/*!@{*/
+
+namespace
+{
+
+/* how long to wait for dcpspi to open its named pipes */
+constexpr unsigned int open_timeout_ms = 5000;
+
+/* how long to wait for answers after the last packet has been sent */
+constexpr unsigned int drain_timeout_ms = 2000;
+
+struct Options
+{
+    const char *fifo_to_dcpspi;
+    const char *fifo_from_dcpspi;
+
+    unsigned long packets;
+    unsigned int duration_s;
+    unsigned int rate_pps;
+    unsigned int window;
+    uint8_t ttl;
+    uint8_t reg;
+    size_t min_payload_size;
+    size_t max_payload_size;
+    unsigned int timeout_ms;
+
+    const char *dcpspi_path;
+    std::vector<const char *> dcpspi_args;
+    std::vector<unsigned long> spi_clocks;
+};
+
+static uint64_t now_us()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return uint64_t(t.tv_sec) * 1000U * 1000U + t.tv_nsec / 1000U;
+}
+
+struct InFlight
+{
+    uint64_t first_sent_us;
+    uint64_t last_sent_us;
+    size_t payload_size;
+};
+
+/*!
+ * Results of one run.
+ */
+struct Results
+{
+    unsigned long sent;
+    unsigned long retries;
+    unsigned long acks;
+    unsigned long nacks;
+    unsigned long drops;
+    unsigned long lost;
+    unsigned long unexpected;
+    unsigned long slave_packets;
+    unsigned long slave_bytes;
+    unsigned long payload_bytes_acked;
+    uint64_t elapsed_us;
+    std::vector<uint32_t> latencies_us;
+
+    explicit Results():
+        sent(0), retries(0), acks(0), nacks(0), drops(0), lost(0),
+        unexpected(0), slave_packets(0), slave_bytes(0),
+        payload_bytes_acked(0), elapsed_us(0)
+    {}
+
+    uint32_t percentile(double p) const
+    {
+        if(latencies_us.empty())
+            return 0;
+
+        size_t idx = size_t(std::ceil(p * latencies_us.size()));
+
+        if(idx > 0)
+            --idx;
+
+        return latencies_us[std::min(idx, latencies_us.size() - 1)];
+    }
+};
+
+/*!
+ * DCPD stand-in on the named pipes of a running dcpspi.
+ */
+class LoadGenerator
+{
+  private:
+    const Options &options_;
+    int out_fd_;
+    int in_fd_;
+
+    std::vector<uint8_t> output_;
+    std::vector<uint8_t> input_;
+
+    std::unordered_map<uint16_t, InFlight> in_flight_;
+    uint16_t next_serial_;
+    unsigned long packets_started_;
+    uint32_t random_state_;
+
+  public:
+    Results results_;
+
+    LoadGenerator(const LoadGenerator &) = delete;
+    LoadGenerator &operator=(const LoadGenerator &) = delete;
+
+    explicit LoadGenerator(const Options &options, int out_fd, int in_fd):
+        options_(options),
+        out_fd_(out_fd),
+        in_fd_(in_fd),
+        next_serial_(DCPSYNC_MASTER_SERIAL_MIN),
+        packets_started_(0),
+        random_state_(0x10ad5eed)
+    {}
+
+    bool run()
+    {
+        const uint64_t started = now_us();
+        const uint64_t end_of_sending = options_.duration_s > 0
+            ? started + uint64_t(options_.duration_s) * 1000U * 1000U
+            : UINT64_MAX;
+        uint64_t drain_deadline = UINT64_MAX;
+
+        while(true)
+        {
+            const uint64_t now = now_us();
+            const bool may_send =
+                now < end_of_sending &&
+                (options_.packets == 0 || packets_started_ < options_.packets);
+
+            if(!may_send && drain_deadline == UINT64_MAX)
+                drain_deadline = now + drain_timeout_ms * 1000U;
+
+            if(!may_send && in_flight_.empty() && output_.empty())
+                break;
+
+            if(now >= drain_deadline)
+                break;
+
+            expire_packets(now);
+
+            uint64_t next_send = UINT64_MAX;
+
+            if(may_send && in_flight_.size() < options_.window)
+            {
+                next_send = options_.rate_pps > 0
+                    ? started + packets_started_ * 1000U * 1000U / options_.rate_pps
+                    : now;
+
+                if(next_send <= now)
+                {
+                    send_new_packet(now);
+                    continue;
+                }
+            }
+
+            if(!wait_and_process(now, std::min(next_send, drain_deadline)))
+                return false;
+        }
+
+        results_.elapsed_us = now_us() - started;
+        results_.lost += in_flight_.size();
+        in_flight_.clear();
+        std::sort(results_.latencies_us.begin(), results_.latencies_us.end());
+
+        return true;
+    }
+
+  private:
+    uint32_t next_random()
+    {
+        random_state_ ^= random_state_ << 13;
+        random_state_ ^= random_state_ >> 17;
+        random_state_ ^= random_state_ << 5;
+        return random_state_;
+    }
+
+    void queue_header(uint8_t command, uint8_t ttl, uint16_t serial,
+                      size_t size)
+    {
+        output_.push_back(command);
+        output_.push_back(ttl);
+        output_.push_back((serial >> 8) & UINT8_MAX);
+        output_.push_back((serial >> 0) & UINT8_MAX);
+        output_.push_back((size >> 8) & UINT8_MAX);
+        output_.push_back((size >> 0) & UINT8_MAX);
+    }
+
+    void queue_packet(uint16_t serial, uint8_t ttl, size_t payload_size)
+    {
+        queue_header('c', ttl, serial, DCP_HEADER_SIZE + payload_size);
+        output_.push_back(DCP_COMMAND_MULTI_WRITE_REGISTER);
+        output_.push_back(options_.reg);
+        output_.push_back((payload_size >> 0) & UINT8_MAX);
+        output_.push_back((payload_size >> 8) & UINT8_MAX);
+
+        /* the serial makes each payload distinct */
+        for(size_t i = 0; i < payload_size; ++i)
+            output_.push_back((serial + i) & UINT8_MAX);
+    }
+
+    void send_new_packet(uint64_t now)
+    {
+        const uint16_t serial = next_serial_;
+
+        next_serial_ = (next_serial_ == DCPSYNC_MASTER_SERIAL_MAX)
+            ? DCPSYNC_MASTER_SERIAL_MIN
+            : next_serial_ + 1;
+
+        const size_t payload_size =
+            options_.min_payload_size +
+            next_random() % (options_.max_payload_size - options_.min_payload_size + 1);
+
+        in_flight_[serial] = InFlight{now, now, payload_size};
+        queue_packet(serial, options_.ttl, payload_size);
+        ++packets_started_;
+        ++results_.sent;
+    }
+
+    void expire_packets(uint64_t now)
+    {
+        const uint64_t timeout_us = uint64_t(options_.timeout_ms) * 1000U;
+
+        for(auto it = in_flight_.begin(); it != in_flight_.end(); /* nothing */)
+        {
+            if(now - it->second.last_sent_us > timeout_us)
+            {
+                ++results_.lost;
+                it = in_flight_.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+
+    bool wait_and_process(uint64_t now, uint64_t wake_up)
+    {
+        struct pollfd fds[2];
+
+        fds[0].fd = in_fd_;
+        fds[0].events = POLLIN;
+        fds[1].fd = output_.empty() ? -1 : out_fd_;
+        fds[1].events = POLLOUT;
+
+        /* wake up regularly to expire packets */
+        int timeout_ms = 100;
+
+        if(wake_up != UINT64_MAX)
+            timeout_ms = std::min(uint64_t(timeout_ms), (wake_up - now + 999U) / 1000U);
+
+        if(poll(fds, 2, timeout_ms) < 0)
+        {
+            if(errno == EINTR)
+                return true;
+
+            perror("poll()");
+            return false;
+        }
+
+        if(fds[1].revents & POLLOUT)
+        {
+            const ssize_t ret = write(out_fd_, output_.data(), output_.size());
+
+            if(ret < 0 && errno != EAGAIN && errno != EINTR)
+            {
+                perror("Writing to dcpspi");
+                return false;
+            }
+
+            if(ret > 0)
+                output_.erase(output_.begin(), output_.begin() + ret);
+        }
+
+        if(fds[1].revents & (POLLERR | POLLHUP))
+        {
+            fprintf(stderr, "dcpspi has closed its input pipe\n");
+            return false;
+        }
+
+        if(fds[0].revents & POLLIN)
+        {
+            uint8_t buffer[4096];
+            const ssize_t ret = read(in_fd_, buffer, sizeof(buffer));
+
+            if(ret < 0 && errno != EAGAIN && errno != EINTR)
+            {
+                perror("Reading from dcpspi");
+                return false;
+            }
+
+            if(ret > 0)
+            {
+                input_.insert(input_.end(), buffer, buffer + ret);
+                process_input(now_us());
+            }
+        }
+        else if(fds[0].revents & POLLHUP)
+        {
+            fprintf(stderr, "dcpspi has closed its output pipe\n");
+            return false;
+        }
+
+        return true;
+    }
+
+    void process_input(uint64_t now)
+    {
+        size_t pos = 0;
+
+        while(input_.size() - pos >= DCPSYNC_HEADER_SIZE)
+        {
+            const uint8_t *const header = input_.data() + pos;
+            const size_t size = (header[4] << 8) | header[5];
+
+            if(input_.size() - pos < DCPSYNC_HEADER_SIZE + size)
+                break;
+
+            process_packet(header[0], header[1],
+                           (header[2] << 8) | header[3], size, now);
+            pos += DCPSYNC_HEADER_SIZE + size;
+        }
+
+        input_.erase(input_.begin(), input_.begin() + pos);
+    }
+
+    void process_packet(uint8_t command, uint8_t ttl, uint16_t serial,
+                        size_t size, uint64_t now)
+    {
+        if(command == 'c')
+        {
+            ++results_.slave_packets;
+            results_.slave_bytes += size;
+
+            if(ttl > 0)
+                queue_header('a', 0, serial, 0);
+
+            return;
+        }
+
+        const auto it = in_flight_.find(serial);
+
+        if((command != 'a' && command != 'n') || it == in_flight_.end())
+        {
+            ++results_.unexpected;
+            return;
+        }
+
+        if(command == 'a')
+        {
+            ++results_.acks;
+            results_.payload_bytes_acked += it->second.payload_size;
+            results_.latencies_us.push_back(now - it->second.first_sent_us);
+        }
+        else if(ttl > 0)
+        {
+            /* like DCPD, try again with the TTL from the NACK */
+            ++results_.nacks;
+            ++results_.retries;
+            it->second.last_sent_us = now;
+            queue_packet(serial, ttl, it->second.payload_size);
+            return;
+        }
+        else
+            ++results_.drops;
+
+        in_flight_.erase(it);
+    }
+};
+
+static int open_with_retry(const char *name, int flags)
+{
+    const uint64_t deadline = now_us() + open_timeout_ms * 1000U;
+
+    while(true)
+    {
+        const int fd = open(name, flags | O_NONBLOCK | O_CLOEXEC);
+
+        if(fd >= 0)
+            return fd;
+
+        /* ENXIO: no reader on the pipe yet; ENOENT: not created yet */
+        if((errno != ENXIO && errno != ENOENT) || now_us() >= deadline)
+        {
+            fprintf(stderr, "Failed opening \"%s\": %s\n", name, strerror(errno));
+            return -1;
+        }
+
+        usleep(10U * 1000U);
+    }
+}
+
+static pid_t start_dcpspi(const Options &options, unsigned long spi_clock)
+{
+    std::vector<std::string> args;
+
+    args.push_back(options.dcpspi_path);
+
+    for(const auto &arg : options.dcpspi_args)
+        args.push_back(arg);
+
+    args.push_back("--fg");
+    args.push_back("--ififo");
+    args.push_back(options.fifo_to_dcpspi);
+    args.push_back("--ofifo");
+    args.push_back(options.fifo_from_dcpspi);
+
+    if(spi_clock > 0)
+    {
+        args.push_back("--spiclk");
+        args.push_back(std::to_string(spi_clock));
+    }
+
+    std::vector<char *> argv;
+
+    for(auto &arg : args)
+        argv.push_back(&arg[0]);
+
+    argv.push_back(nullptr);
+
+    const pid_t pid = fork();
+
+    if(pid < 0)
+        perror("fork()");
+    else if(pid == 0)
+    {
+        execv(argv[0], argv.data());
+        perror("execv()");
+        _exit(EXIT_FAILURE);
+    }
+
+    return pid;
+}
+
+static void stop_dcpspi(pid_t pid)
+{
+    if(pid <= 0)
+        return;
+
+    kill(pid, SIGTERM);
+
+    int status;
+    while(waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+}
+
+static void print_header()
+{
+    printf("%10s %8s %8s %6s %6s %6s %7s %10s %10s %8s %8s %8s %8s %8s\n",
+           "spiclk", "sent", "acked", "nacks", "drops", "lost", "slave",
+           "pkt/s", "bytes/s", "p50/us", "p90/us", "p99/us", "p99.9/us",
+           "max/us");
+}
+
+static void print_results(unsigned long spi_clock, const Results &r)
+{
+    const double seconds = r.elapsed_us > 0 ? r.elapsed_us / 1e6 : 1.0;
+    const std::string clock =
+        spi_clock > 0 ? std::to_string(spi_clock) : std::string("-");
+
+    printf("%10s %8lu %8lu %6lu %6lu %6lu %7lu %10.1f %10.1f %8u %8u %8u %8u %8u\n",
+           clock.c_str(), r.sent, r.acks, r.nacks, r.drops, r.lost,
+           r.slave_packets, r.acks / seconds, r.payload_bytes_acked / seconds,
+           r.percentile(0.5), r.percentile(0.9), r.percentile(0.99),
+           r.percentile(0.999),
+           r.latencies_us.empty() ? 0 : r.latencies_us.back());
+
+    if(r.unexpected > 0)
+        fprintf(stderr, "%lu unexpected packets from dcpspi\n", r.unexpected);
+}
+
+static bool run_once(const Options &options, unsigned long spi_clock)
+{
+    const pid_t pid = options.dcpspi_path != nullptr
+        ? start_dcpspi(options, spi_clock)
+        : 0;
+
+    if(pid < 0)
+        return false;
+
+    bool ok = false;
+    const int out_fd = open_with_retry(options.fifo_to_dcpspi, O_WRONLY);
+    const int in_fd = out_fd >= 0
+        ? open_with_retry(options.fifo_from_dcpspi, O_RDONLY)
+        : -1;
+
+    if(in_fd >= 0)
+    {
+        LoadGenerator gen(options, out_fd, in_fd);
+
+        ok = gen.run();
+        print_results(spi_clock, gen.results_);
+        fflush(stdout);
+    }
+
+    if(in_fd >= 0)
+        close(in_fd);
+
+    if(out_fd >= 0)
+        close(out_fd);
+
+    stop_dcpspi(pid);
+
+    return ok;
+}
+
+static void usage(const char *program)
+{
+    printf("Usage: %s [options] [-- dcpspi options]\n"
+           "\n"
+           "Options:\n"
+           "  --help         Show this help.\n"
+           "  --ififo name   Named pipe dcpspi reads from (default: /tmp/dcp_to_spi).\n"
+           "  --ofifo name   Named pipe dcpspi writes to (default: /tmp/spi_to_dcp).\n"
+           "  --packets n    Number of master packets to send (default: 1000,\n"
+           "                 0 for no limit).\n"
+           "  --duration s   Stop sending after given number of seconds.\n"
+           "  --rate pps     Packets per second (default: 0, as fast as possible).\n"
+           "  --window n     Maximum number of unanswered packets (default: 1).\n"
+           "  --ttl n        TTL of master packets (default: 255).\n"
+           "  --register n   DCP register to write to (default: 50).\n"
+           "  --size n[-m]   Payload size, or range of sizes (default: 2).\n"
+           "  --timeout ms   Consider packets lost without answer (default: 1000).\n"
+           "  --dcpspi path  Start dcpspi, passing options following \"--\".\n"
+           "  --spiclk list  Comma-separated SPI clock frequencies to run\n"
+           "                 dcpspi with, one run per frequency.\n",
+           program);
+}
+
+static bool parse_number(const char *s, unsigned long max, unsigned long &value)
+{
+    char *endptr;
+
+    errno = 0;
+    value = strtoul(s, &endptr, 0);
+
+    return errno == 0 && endptr != s && *endptr == '\0' && value <= max;
+}
+
+static bool parse_spi_clocks(const char *list, std::vector<unsigned long> &clocks)
+{
+    std::string s(list);
+    size_t start = 0;
+
+    while(start <= s.size())
+    {
+        const size_t comma = std::min(s.find(',', start), s.size());
+        unsigned long hz;
+
+        if(!parse_number(s.substr(start, comma - start).c_str(), UINT32_MAX, hz) ||
+           hz == 0)
+            return false;
+
+        clocks.push_back(hz);
+        start = comma + 1;
+    }
+
+    return !clocks.empty();
+}
+
+static int process_command_line(int argc, char *argv[], Options &options)
+{
+    options.fifo_to_dcpspi = "/tmp/dcp_to_spi";
+    options.fifo_from_dcpspi = "/tmp/spi_to_dcp";
+    options.packets = 1000;
+    options.duration_s = 0;
+    options.rate_pps = 0;
+    options.window = 1;
+    options.ttl = UINT8_MAX;
+    options.reg = 50;
+    options.min_payload_size = 2;
+    options.max_payload_size = 2;
+    options.timeout_ms = 1000;
+    options.dcpspi_path = nullptr;
+
+#define CHECK_ARGUMENT() \
+    do \
+    { \
+        if(i + 1 >= argc) \
+        { \
+            fprintf(stderr, "Option %s requires an argument\n", argv[i]); \
+            return -1; \
+        } \
+        ++i; \
+    } \
+    while(0)
+
+#define PARSE_NUMBER(MAX, DEST) \
+    do \
+    { \
+        unsigned long value; \
+        CHECK_ARGUMENT(); \
+        if(!parse_number(argv[i], (MAX), value)) \
+        { \
+            fprintf(stderr, "Invalid value \"%s\" for %s\n", argv[i], argv[i - 1]); \
+            return -1; \
+        } \
+        DEST = value; \
+    } \
+    while(0)
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(strcmp(argv[i], "--help") == 0)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        else if(strcmp(argv[i], "--ififo") == 0)
+        {
+            CHECK_ARGUMENT();
+            options.fifo_to_dcpspi = argv[i];
+        }
+        else if(strcmp(argv[i], "--ofifo") == 0)
+        {
+            CHECK_ARGUMENT();
+            options.fifo_from_dcpspi = argv[i];
+        }
+        else if(strcmp(argv[i], "--packets") == 0)
+            PARSE_NUMBER(ULONG_MAX, options.packets);
+        else if(strcmp(argv[i], "--duration") == 0)
+            PARSE_NUMBER(UINT_MAX, options.duration_s);
+        else if(strcmp(argv[i], "--rate") == 0)
+            PARSE_NUMBER(UINT_MAX, options.rate_pps);
+        else if(strcmp(argv[i], "--window") == 0)
+        {
+            PARSE_NUMBER(DCPSYNC_MASTER_SERIAL_MAX - DCPSYNC_MASTER_SERIAL_MIN,
+                         options.window);
+
+            if(options.window == 0)
+            {
+                fprintf(stderr, "Window size must be positive\n");
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "--ttl") == 0)
+            PARSE_NUMBER(UINT8_MAX, options.ttl);
+        else if(strcmp(argv[i], "--register") == 0)
+            PARSE_NUMBER(UINT8_MAX, options.reg);
+        else if(strcmp(argv[i], "--size") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            unsigned long min_size;
+            unsigned long max_size;
+            const char *dash = strchr(argv[i], '-');
+            const std::string min_str = dash != nullptr
+                ? std::string(argv[i], dash - argv[i])
+                : std::string(argv[i]);
+
+            if(!parse_number(min_str.c_str(), DCP_PAYLOAD_MAXSIZE, min_size) ||
+               !parse_number(dash != nullptr ? dash + 1 : argv[i],
+                             DCP_PAYLOAD_MAXSIZE, max_size) ||
+               max_size < min_size)
+            {
+                fprintf(stderr, "Invalid payload size \"%s\" (maximum is %u)\n",
+                        argv[i], DCP_PAYLOAD_MAXSIZE);
+                return -1;
+            }
+
+            options.min_payload_size = min_size;
+            options.max_payload_size = max_size;
+        }
+        else if(strcmp(argv[i], "--timeout") == 0)
+            PARSE_NUMBER(UINT_MAX, options.timeout_ms);
+        else if(strcmp(argv[i], "--dcpspi") == 0)
+        {
+            CHECK_ARGUMENT();
+            options.dcpspi_path = argv[i];
+        }
+        else if(strcmp(argv[i], "--spiclk") == 0)
+        {
+            CHECK_ARGUMENT();
+
+            if(!parse_spi_clocks(argv[i], options.spi_clocks))
+            {
+                fprintf(stderr, "Invalid list of SPI clocks \"%s\"\n", argv[i]);
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "--") == 0)
+        {
+            for(++i; i < argc; ++i)
+                options.dcpspi_args.push_back(argv[i]);
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option \"%s\", see --help\n", argv[i]);
+            return -1;
+        }
+    }
+
+#undef PARSE_NUMBER
+#undef CHECK_ARGUMENT
+
+    if(options.dcpspi_path == nullptr &&
+       (!options.spi_clocks.empty() || !options.dcpspi_args.empty()))
+    {
+        fprintf(stderr, "SPI clocks and dcpspi options require --dcpspi\n");
+        return -1;
+    }
+
+    if(options.packets == 0 && options.duration_s == 0)
+    {
+        fprintf(stderr, "Need number of packets or duration\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    const int ret = process_command_line(argc, argv, options);
+
+    if(ret != 0)
+        return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if(options.spi_clocks.empty())
+        options.spi_clocks.push_back(0);
+
+    print_header();
+
+    bool ok = true;
+
+    for(const auto hz : options.spi_clocks)
+    {
+        if(!run_once(options, hz))
+            ok = false;
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*!@}*/
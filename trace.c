@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "messages.h"
+#include "os.h"
+
+/*!
+ * Preallocated event ring.
+ *
+ * There is only one writer, the main loop. Dumps are requested by signal, but
+ * carried out from the main loop as well, so no locking is needed.
+ * The index is free-running, \c next - #TRACE_RING_SIZE is the oldest event
+ * still stored once the ring has been filled.
+ */
+static struct
+{
+    bool is_enabled;
+    uint64_t next;
+    struct trace_event events[TRACE_RING_SIZE];
+}
+trace_ring;
+
+void trace_init(void)
+{
+    trace_ring.is_enabled = false;
+    trace_ring.next = 0;
+}
+
+bool trace_enable(bool enable)
+{
+    const bool result = trace_ring.is_enabled;
+    trace_ring.is_enabled = enable;
+    return result;
+}
+
+void trace_record(enum TraceEventType type, uint8_t state,
+                  uint8_t request_state, uint16_t serial, uint8_t ttl,
+                  uint8_t arg)
+{
+    if(!trace_ring.is_enabled)
+        return;
+
+    struct trace_event *const ev =
+        &trace_ring.events[trace_ring.next++ & (TRACE_RING_SIZE - 1)];
+    struct timespec now;
+
+    if(os_clock_gettime(CLOCK_MONOTONIC, &now) == 0)
+        ev->timestamp_ns = (uint64_t)now.tv_sec * 1000000000U + now.tv_nsec;
+    else
+        ev->timestamp_ns = 0;
+
+    ev->serial = serial;
+    ev->type = type;
+    ev->state = state;
+    ev->request_state = request_state;
+    ev->ttl = ttl;
+    ev->arg = arg;
+    ev->reserved = 0;
+}
+
+size_t trace_copy_events(struct trace_event *dest, size_t max)
+{
+    const uint64_t stored = trace_ring.next < TRACE_RING_SIZE
+        ? trace_ring.next
+        : TRACE_RING_SIZE;
+    const size_t count = stored < max ? stored : max;
+
+    for(uint64_t i = trace_ring.next - count; i < trace_ring.next; ++i)
+        *dest++ = trace_ring.events[i & (TRACE_RING_SIZE - 1)];
+
+    return count;
+}
+
+int trace_dump_to_file(const char *filename)
+{
+    static struct trace_event events[TRACE_RING_SIZE];
+    const size_t count = trace_copy_events(events, TRACE_RING_SIZE);
+
+    const struct trace_file_header header =
+    {
+        .magic = TRACE_FILE_MAGIC,
+        .version = TRACE_FILE_VERSION,
+        .event_size = sizeof(struct trace_event),
+        .count = count,
+        .overwritten = trace_ring.next - count,
+    };
+
+    /* never follow a link planted where we are going to write */
+    const int fd = open(filename,
+                        O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC,
+                        0644);
+    FILE *f = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+
+    if(f == NULL)
+    {
+        msg_error(errno, LOG_ERR, "Failed opening trace file \"%s\"", filename);
+
+        if(fd >= 0)
+            close(fd);
+
+        return -1;
+    }
+
+    const bool ok =
+        fwrite(&header, sizeof(header), 1, f) == 1 &&
+        fwrite(events, sizeof(events[0]), count, f) == count;
+
+    if(fclose(f) != 0 || !ok)
+    {
+        msg_error(errno, LOG_ERR, "Failed writing trace file \"%s\"", filename);
+        return -1;
+    }
+
+    msg_info("Dumped %zu trace events to \"%s\"", count, filename);
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of DCPSPI.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*!
+ * Number of events kept in the trace ring, must be a power of 2.
+ */
+#define TRACE_RING_SIZE 4096
+
+#define TRACE_FILE_MAGIC   0x54504344U  /* "DCPT", little endian */
+#define TRACE_FILE_VERSION 1U
+
+enum TraceEventType
+{
+    /*! Transaction about to be processed; \c arg is unused. */
+    TRACE_EVENT_TRANSACTION = 1,
+
+    /*! Request state changed; \c arg is the previous request state. */
+    TRACE_EVENT_REQUEST_STATE,
+
+    /*! SPI transfer finished; \c arg is the result code. */
+    TRACE_EVENT_SPI_RESULT,
+};
+
+/*!
+ * One entry in the trace ring, also the on-disk format.
+ *
+ * Fields \c state and \c request_state are the transaction's
+ * #transaction_state and #transaction_request_state at the time the event
+ * was recorded.
+ */
+struct trace_event
+{
+    uint64_t timestamp_ns;  /*!< \c CLOCK_MONOTONIC */
+    uint16_t serial;
+    uint8_t type;
+    uint8_t state;
+    uint8_t request_state;
+    uint8_t ttl;
+    uint8_t arg;
+    uint8_t reserved;
+};
+
+/*!
+ * Header of a trace dump, followed by \c count events, oldest first.
+ *
+ * All fields are stored in host byte order.
+ */
+struct trace_file_header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t event_size;
+    uint32_t count;
+    uint32_t overwritten;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void trace_init(void);
+
+/*!
+ * Turn recording on or off.
+ *
+ * \returns
+ *     The previous setting.
+ */
+bool trace_enable(bool enable);
+
+/*!
+ * Store an event in the ring, overwriting the oldest one if full.
+ *
+ * This function does nothing while tracing is disabled.
+ */
+void trace_record(enum TraceEventType type, uint8_t state,
+                  uint8_t request_state, uint16_t serial, uint8_t ttl,
+                  uint8_t arg);
+
+/*!
+ * Copy up to \p max most recent events, oldest first.
+ */
+size_t trace_copy_events(struct trace_event *dest, size_t max);
+
+/*!
+ * Write header and all events in the ring to given file.
+ *
+ * \returns
+ *     0 on success, -1 on error.
+ */
+int trace_dump_to_file(const char *filename);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !TRACE_H */